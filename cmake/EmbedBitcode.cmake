@@ -0,0 +1,54 @@
+##
+# Write llvm bitcode files out as byte arrays in a C++ source file, for
+# the runtime. Run in script mode, with comma separated NAMES and
+# INPUTS, and the OUTPUT file to write:
+#
+#   cmake -DNAMES=a,b -DINPUTS=a.bc,b.bc -DOUTPUT=out.cc -P EmbedBitcode.cmake
+##
+
+string(REPLACE "," ";" NAMES "${NAMES}")
+string(REPLACE "," ";" INPUTS "${INPUTS}")
+
+string(REPEAT "0x.., " 16 LINE)
+
+set(ARRAYS "")
+set(ENTRIES "")
+set(DIGESTS "")
+foreach(NAME INPUT IN ZIP_LISTS NAMES INPUTS)
+  file(READ ${INPUT} HEX HEX)
+  file(SHA256 ${INPUT} DIGEST)
+  string(APPEND DIGESTS ${DIGEST})
+  string(REGEX REPLACE "(..)" "0x\\1, " BYTES "${HEX}")
+  # Sixteen bytes to a line.
+  string(REGEX REPLACE "(${LINE})" "\\1\n    " BYTES "${BYTES}")
+  string(APPEND ARRAYS
+         "alignas(4) const unsigned char ${NAME}_bitcode[] = {\n"
+         "    ${BYTES}};\n\n")
+  string(APPEND ENTRIES
+         "    {\"${NAME}\", ${NAME}_bitcode, sizeof(${NAME}_bitcode)},\n")
+endforeach()
+string(SHA256 DIGEST "${DIGESTS}")
+list(LENGTH NAMES COUNT)
+
+file(WRITE ${OUTPUT}
+     "// Generated by EmbedBitcode.cmake. Do not edit.\n"
+     "#include \"jmlang/CodeGen/Runtime.h\"\n"
+     "\n"
+     "namespace jmlang {\n"
+     "namespace internal {\n"
+     "\n"
+     "namespace {\n"
+     "\n"
+     "${ARRAYS}"
+     "}  // namespace\n"
+     "\n"
+     "const RuntimeBitcode runtime_bitcode[] = {\n"
+     "${ENTRIES}"
+     "};\n"
+     "\n"
+     "const int runtime_bitcode_count = ${COUNT};\n"
+     "\n"
+     "const char* const runtime_bitcode_digest = \"${DIGEST}\";\n"
+     "\n"
+     "}  // namespace internal\n"
+     "}  // namespace jmlang\n")
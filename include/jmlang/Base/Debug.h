@@ -20,8 +20,8 @@ namespace internal {
 /// 3 should be used for tracing everything that occurs.
 ///
 struct debug {
-  static int debug_level;
-  static bool initialized;
+  static inline int debug_level = 0;
+  static inline bool initialized = false;
   int verbosity;
 
   debug(int v) : verbosity(v) {
@@ -45,9 +45,6 @@ struct debug {
   }
 };
 
-int debug::debug_level = 0;
-bool debug::initialized = false;
-
 }  // namespace internal
 }  // namespace jmlang
 
@@ -0,0 +1,118 @@
+#ifndef JMLANG_BASE_TARGET_H
+#define JMLANG_BASE_TARGET_H
+
+#include <cstdint>
+#include <string>
+
+#include "jmlang/Base/Type.h"
+
+namespace jmlang {
+
+/// How closely floating-point code follows IEEE semantics. Strict code
+/// rounds every operation as written. Contract also lets a multiply
+/// and an add fuse into one fma, which rounds once. Fast also lets
+/// llvm reassociate, use approximate reciprocals and math functions,
+/// and assume there are no nans, infinities or signed zeros, so
+/// checks like is_nan may be folded away. FloatDefault means whatever
+/// the target asks for.
+enum FloatMode { FloatDefault = 0, FloatStrict, FloatContract, FloatFast };
+
+/// A description of the machine to generate code for: its operating
+/// system, architecture and word size, the instruction set extensions
+/// code may use, and options that change the code generated. Written
+/// as a string like "x86-64-linux-avx2-no_asserts".
+struct Target {
+  enum OS { OSUnknown = 0, Linux, OSX, Windows } os;
+
+  enum Arch { ArchUnknown = 0, X86 } arch;
+
+  /// The word size, 32 or 64.
+  int bits;
+
+  enum Feature {
+    SSE41,       // sse4.1
+    AVX,         // avx, with os support for the ymm registers
+    AVX2,        // avx2
+    FMA,         // fused multiply-add
+    F16C,        // half-precision float conversions
+    AVX512,      // avx512 f, cd, bw, dq and vl, as in x86-64-v4
+    NoAsserts,   // leave out assertions, such as buffer bounds checks
+    FPContract,  // fp_contract: FloatContract unless a Func says otherwise
+    FastMath,    // fast_math: FloatFast unless a Func says otherwise
+    FeatureEnd
+  };
+
+  /// A bit set of Features.
+  uint64_t features;
+
+  Target() : os(OSUnknown), arch(ArchUnknown), bits(0), features(0) {}
+
+  Target(OS o, Arch a, int b, uint64_t f = 0)
+      : os(o), arch(a), bits(b), features(f) {}
+
+  bool has_feature(Feature f) const { return (features >> f) & 1; }
+
+  Target with_feature(Feature f) const {
+    Target t = *this;
+    t.features |= (uint64_t)1 << f;
+    return t;
+  }
+
+  Target without_feature(Feature f) const {
+    Target t = *this;
+    t.features &= ~((uint64_t)1 << f);
+    return t;
+  }
+
+  /// The floating-point mode for functions that don't choose their
+  /// own: strict, unless the target has fp_contract or fast_math.
+  FloatMode float_mode() const {
+    return has_feature(FastMath)     ? FloatFast
+           : has_feature(FPContract) ? FloatContract
+                                     : FloatStrict;
+  }
+
+  /// The number of elements of the given type that fit in a SIMD
+  /// register. Vector widths should be multiples of this.
+  int natural_vector_size(Type t) const;
+
+  template <typename T>
+  int natural_vector_size() const {
+    return natural_vector_size(type_of<T>());
+  }
+
+  bool operator==(const Target& other) const {
+    return os == other.os && arch == other.arch && bits == other.bits &&
+           features == other.features;
+  }
+
+  bool operator!=(const Target& other) const { return !(*this == other); }
+
+  /// The target as a string that parse_target_string accepts.
+  std::string to_string() const;
+};
+
+/// The machine running this process, with all of the features it
+/// supports.
+Target get_host_target();
+
+/// Parse a target string: the architecture, word size and operating
+/// system, followed by features, all separated by dashes, as in
+/// "x86-64-linux-avx2-fma". The first three may be replaced with
+/// "host", as in "host-no_asserts", to mean the host target plus
+/// some features.
+Target parse_target_string(const std::string& s);
+
+/// The target for code compiled ahead of time, from the environment
+/// variable JMLANG_TARGET, or the host if it isn't set.
+Target get_target_from_environment();
+
+/// The target for jit compiled code, from the environment variable
+/// JMLANG_JIT_TARGET, or the host if it isn't set. It must be for
+/// the host's architecture and operating system, and should only use
+/// features the host supports.
+Target get_jit_target_from_environment();
+
+}  // namespace jmlang
+
+#endif  // JMLANG_BASE_TARGET_H
\ No newline at end of file
@@ -0,0 +1,328 @@
+#ifndef JMLANG_CODEGEN_CODEGEN_H
+#define JMLANG_CODEGEN_CODEGEN_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "jmlang/Base/Target.h"
+#include "jmlang/IR/Argument.h"
+#include "jmlang/IR/IR.h"
+#include "jmlang/IR/IRVisitor.h"
+#include "jmlang/IR/Scope.h"
+#include "jmlang/JIT/JITModule.h"
+
+namespace llvm {
+class Value;
+class Module;
+class Function;
+class FunctionType;
+class LLVMContext;
+class Type;
+class StructType;
+class BasicBlock;
+class ConstantFolder;
+class IRBuilderDefaultInserter;
+template <typename, typename>
+class IRBuilder;
+}  // namespace llvm
+
+namespace jmlang {
+namespace internal {
+
+/// A code generator that emits llvm IR from a lowered, flattened
+/// jmlang statement, for the cpu and features of the Target it is
+/// given, which is the host by default. The generated function
+/// returns zero on success, and a negative error code if an
+/// assertion fails or an allocation can't be made. Generated code
+/// calls into the following runtime functions, which must be
+/// resolvable when the module is linked:
+///
+///   void *jmlang_malloc(size_t); // must return 32-byte aligned memory
+///   void jmlang_free(void *);
+///   void jmlang_error(const char *);
+///   int jmlang_do_par_for(int (*)(int, uint8_t *), int min, int extent,
+///                         uint8_t *closure);
+///   void jmlang_trace(...); // see JITModule::TraceFn
+///
+/// Calls to extern math functions like sin_f32 become calls to the
+/// llvm intrinsic or libm function of the same name.
+class CodeGen : public IRVisitor {
+ public:
+  /// Make a code generator for the given target.
+  CodeGen(const Target& t = get_host_target());
+  virtual ~CodeGen();
+
+  /// Take a jmlang statement and compile it to an llvm module held
+  /// internally. Buffer arguments become buffer_t pointers, and
+  /// scalar arguments are passed by value. Also generates a wrapper
+  /// function called name + "_jit_wrapper", which takes an array of
+  /// pointers to the arguments.
+  virtual void compile(Stmt stmt, std::string name,
+                       const std::vector<Argument>& args);
+
+  /// Emit a compiled jmlang statement as llvm bitcode. Call this
+  /// after calling compile.
+  void compile_to_bitcode(const std::string& filename);
+
+  /// Emit a compiled jmlang statement as a native object file, or as
+  /// assembly, to be linked into a program ahead of time. The runtime
+  /// entry points are included with weak linkage (see
+  /// add_runtime_hooks). The default implementations they call are in
+  /// the object made by compile_runtime_to_native. Call this after
+  /// calling compile.
+  void compile_to_native(const std::string& filename, bool assembly = false);
+
+  /// Write an llvm module out as a native object file or assembly
+  /// for the given target.
+  static void compile_module_to_native(llvm::Module* m,
+                                       const std::string& filename,
+                                       bool assembly, const Target& t);
+
+  /// Emit a native object file holding the default runtime functions
+  /// that objects made by compile_to_native call, for the target in
+  /// the environment variable JMLANG_TARGET.
+  static void compile_runtime_to_native(const std::string& filename);
+
+  /// Hand the compiled module over to the caller, who becomes
+  /// responsible for deleting it, and then its context. Call this
+  /// after calling compile.
+  llvm::Module* release_module();
+
+  /// Compile to machine code stored in memory, and return some
+  /// function pointers into that machine code. Hands the module over
+  /// to the JITModule, so can only be called once per call to
+  /// compile. If an object path is given, the machine code is also
+  /// saved there as an object file (see JITModule::load_object).
+  JITModule compile_to_function_pointers(
+      const std::string& object_path = "");
+
+  /// Set the floating-point mode used for the code that computes
+  /// each of the named functions, overriding the target's. Loops and
+  /// pipelines are matched to functions by name. Everything else
+  /// uses the target's mode. Call this before calling compile.
+  void set_float_modes(const std::map<std::string, FloatMode>& modes) {
+    float_modes = modes;
+  }
+
+  /// The name of the function last compiled.
+  const std::string& function_name() const { return function_name_; }
+
+  /// Initialize the llvm state for the host target. Safe to call
+  /// more than once.
+  static void initialize_llvm();
+
+ protected:
+  /// The target to generate code for.
+  Target target;
+
+  /// State needed by llvm for code generation, including the
+  /// current module, function, context, builder, and most recently
+  /// generated llvm value.
+  llvm::Module* module;
+  llvm::Function* function;
+  llvm::LLVMContext* context;
+  llvm::IRBuilder<llvm::ConstantFolder, llvm::IRBuilderDefaultInserter>*
+      builder;
+  llvm::Value* value;
+  std::string function_name_;
+
+  /// Some useful llvm types.
+  llvm::Type *void_t, *i1, *i8, *i16, *i32, *i64, *f16, *f32, *f64;
+  llvm::StructType* buffer_t_type;
+
+  /// The floating-point modes of functions that chose their own, and
+  /// the mode of the code being generated.
+  std::map<std::string, FloatMode> float_modes;
+  FloatMode float_mode;
+
+  /// Make floating-point operations generated from now on follow the
+  /// given mode, or the mode of the named function, which is the
+  /// target's if the function has none of its own.
+  void set_float_mode(FloatMode mode);
+  void set_float_mode(const std::string& func);
+
+  /// The symbol table. Buffers are stored as name.host, name.min.0,
+  /// etc.
+  Scope<llvm::Value*> symbol_table;
+
+  /// Add an entry to the symbol table, hiding previous entries with
+  /// the same name.
+  void sym_push(const std::string& name, llvm::Value* value);
+
+  /// Remove an entry from the symbol table, revealing any previous
+  /// entries with the same name.
+  void sym_pop(const std::string& name);
+
+  /// Fetch an entry from the symbol table. If the symbol is not
+  /// found, it either errors out (if the second arg is true), or
+  /// returns NULL.
+  llvm::Value* sym_get(const std::string& name, bool must_succeed = true);
+
+  /// Emit code that evaluates an expression, and return the llvm
+  /// representation of the result of the expression.
+  llvm::Value* codegen(Expr);
+
+  /// Emit code that runs a statement.
+  void codegen(Stmt);
+
+  /// Get the llvm type equivalent to the given jmlang type.
+  llvm::Type* llvm_type_of(Type);
+
+  /// The llvm type used to store a jmlang type in memory. The same as
+  /// llvm_type_of, except that booleans take up a byte each.
+  llvm::Type* llvm_storage_type_of(Type);
+
+  /// Make an llvm constant of the given type.
+  llvm::Value* llvm_constant(Type t, int64_t v);
+
+  /// Add the fields of a buffer_t argument to the symbol table.
+  void unpack_buffer(const std::string& name, llvm::Value* buffer);
+
+  /// Given a llvm value representing a pointer to a buffer_t, this
+  /// returns a pointer to one of its fields.
+  llvm::Value* buffer_field_ptr(llvm::Value* buffer, int field, int dim = -1);
+
+  /// Get a pointer to the given element of a buffer, given the type
+  /// of the element.
+  llvm::Value* codegen_buffer_pointer(const std::string& buffer, Type type,
+                                      llvm::Value* index);
+
+  /// The alignment in bytes of a load from or store to the given
+  /// buffer with the given scalar index.
+  int alignment_of(const std::string& buffer, Type type, Expr index);
+
+  /// Make an alloca in the entry block of the current function, so
+  /// that it's only done once however often the current insertion
+  /// point executes.
+  llvm::Value* create_alloca_at_entry(llvm::Type* type, int n,
+                                      const std::string& name = "");
+
+  /// Get or declare a function in the current module.
+  llvm::Function* get_function(const std::string& name, llvm::Type* ret,
+                               const std::vector<llvm::Type*>& args);
+
+  /// Emit code that returns the given error code from the current
+  /// function, after freeing any outstanding heap allocations.
+  void return_with_error_code(llvm::Value* error_code);
+
+  /// Emit code that checks the condition, and fails with the given
+  /// message and error code if it's false.
+  void create_assertion(llvm::Value* condition, const std::string& message,
+                        int error_code = -1);
+
+  /// Concatenate vectors end to end, or take a contiguous slice of
+  /// the lanes of one.
+  llvm::Value* concat_vectors(const std::vector<llvm::Value*>& vecs);
+  llvm::Value* slice_vector(llvm::Value* vec, int start, int size);
+
+  /// Codegen a cast that narrows the result of some widened integer
+  /// arithmetic as a single x86 instruction where there is one: a
+  /// saturating add or subtract (paddusb, psubsw, ...), a rounding
+  /// average (pavgb, pavgw), or the high half of a multiply (pmulhw,
+  /// pmulhuw). Only applies to vectors of 8 or 16-bit results.
+  /// Returns false, and generates nothing, for other casts.
+  bool codegen_x86_pattern(const Cast* op);
+
+  /// Codegen a vector load whose lanes all lie within a small window,
+  /// like a lookup into a table of up to 256 bytes or an upsampling
+  /// x / 2, as a dense load of the window and permutes of it (pshufb,
+  /// vpermd, vpermw) instead of a gather. Returns NULL, and generates
+  /// nothing, if the index isn't known to stay in such a window or
+  /// the target has no suitable permute.
+  llvm::Value* codegen_window_load(const Load* op);
+
+  /// Codegen integer a / b, or a % b, rounding as div_imp and mod_imp
+  /// do, without a divide instruction, when b is a positive constant
+  /// or a Param. Both become a multiply-high and shifts, which unlike
+  /// a divide also vectorize. Returns NULL, and generates nothing,
+  /// for other divisors, and for 64-bit integers.
+  llvm::Value* codegen_fast_div(const Expr& a, const Expr& b, bool mod);
+
+  /// Divide unsigned a by a scalar b from 1 to the largest value of
+  /// its type, with a multiply-high and shifts by numbers computed
+  /// from b. They don't depend on a, so llvm hoists them out of loops
+  /// when b doesn't change.
+  llvm::Value* codegen_udiv_by_invariant(llvm::Value* a, llvm::Value* b,
+                                         Type t);
+
+  /// Call an intrinsic that takes and returns vectors with the given
+  /// number of lanes. Wider or narrower arguments are split up or
+  /// padded, and the results concatenated.
+  llvm::Value* call_intrin(int lanes, const std::string& name,
+                           const std::vector<llvm::Value*>& args);
+
+  /// Codegen a call to an extern function. Math functions map to
+  /// llvm intrinsics where they exist. Vector calls to scalar
+  /// functions are scalarized.
+  llvm::Value* codegen_extern_call(const Call* op);
+
+  /// Codegen a call to one of the intrinsics named in Call.
+  llvm::Value* codegen_intrinsic(const Call* op);
+
+  /// Run the llvm optimization passes over the module.
+  void optimize_module();
+
+  /// Generate code for the given parallel for loop, by outlining its
+  /// body into a function that is called by jmlang_do_par_for.
+  void codegen_parallel_for(const For* op);
+
+  /// An allocation made by an Allocate node. Heap allocations are
+  /// freed on the way out if an error occurs.
+  struct Allocation {
+    llvm::Value* ptr;
+    bool on_heap;
+  };
+  Scope<Allocation> allocations;
+
+  /// Allocations smaller than this many bytes with a constant size go
+  /// on the stack.
+  static const int stack_allocation_limit = 16 * 1024;
+
+  using IRVisitor::visit;
+
+  virtual void visit(const IntImm*);
+  virtual void visit(const FloatImm*);
+  virtual void visit(const StringImm*);
+  virtual void visit(const Cast*);
+  virtual void visit(const Variable*);
+  virtual void visit(const Add*);
+  virtual void visit(const Sub*);
+  virtual void visit(const Mul*);
+  virtual void visit(const Div*);
+  virtual void visit(const Mod*);
+  virtual void visit(const Min*);
+  virtual void visit(const Max*);
+  virtual void visit(const EQ*);
+  virtual void visit(const NE*);
+  virtual void visit(const LT*);
+  virtual void visit(const LE*);
+  virtual void visit(const GT*);
+  virtual void visit(const GE*);
+  virtual void visit(const And*);
+  virtual void visit(const Or*);
+  virtual void visit(const Not*);
+  virtual void visit(const Select*);
+  virtual void visit(const Load*);
+  virtual void visit(const Ramp*);
+  virtual void visit(const Broadcast*);
+  virtual void visit(const Call*);
+  virtual void visit(const Let*);
+  virtual void visit(const LetStmt*);
+  virtual void visit(const AssertStmt*);
+  virtual void visit(const Pipeline*);
+  virtual void visit(const For*);
+  virtual void visit(const Store*);
+  virtual void visit(const Provide*);
+  virtual void visit(const Allocate*);
+  virtual void visit(const Free*);
+  virtual void visit(const Realize*);
+  virtual void visit(const Block*);
+  virtual void visit(const IfThenElse*);
+  virtual void visit(const Evaluate*);
+};
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_CODEGEN_CODEGEN_H
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef JMLANG_CODEGEN_CODEGEN_C_H
+#define JMLANG_CODEGEN_CODEGEN_C_H
+
+#include <string>
+#include <vector>
+
+#include "jmlang/IR/Argument.h"
+#include "jmlang/IR/IR.h"
+
+namespace jmlang {
+namespace internal {
+
+/// Write a lowered statement out as a C99 source file, defining a
+/// function with the given name and arguments with the same
+/// signature as the function compile_to_header declares. The file
+/// only needs a C compiler to build. Vectors become gcc and clang
+/// vector extension types, so their widths must be powers of two,
+/// and parallel loops become calls to jmlang_do_par_for. The file
+/// carries a default runtime, with weak linkage and with the setters
+/// the header declares, which defining JMLANG_NO_RUNTIME leaves out
+/// for programs linked with the jmlang runtime. To match the jit
+/// exactly, compile it without floating-point contraction
+/// (-ffp-contract=off).
+void compile_to_c(const std::string& filename, Stmt s,
+                  const std::string& name, const std::vector<Argument>& args);
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_CODEGEN_CODEGEN_C_H
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef JMLANG_CODEGEN_MULTI_TARGET_H
+#define JMLANG_CODEGEN_MULTI_TARGET_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "jmlang/Base/Target.h"
+#include "jmlang/IR/Argument.h"
+#include "jmlang/IR/IR.h"
+
+namespace jmlang {
+namespace internal {
+
+/// Compile a statement once for each of the given targets, into a
+/// single native object file. The targets must differ only in their
+/// features. The object defines a function with the given name and
+/// arguments that, the first time it is called, uses cpuid to pick
+/// the first target in the list that the cpu supports, and from then
+/// on calls that version directly. If the cpu supports none of them,
+/// the function reports an error and returns -1, so the list should
+/// usually end with a target without instruction set features. Like
+/// CodeGen::compile_to_native, the object calls the default runtime
+/// functions. Functions' floating-point modes are as for
+/// CodeGen::set_float_modes.
+void compile_multitarget_to_native(
+    const std::string& filename, Stmt s, const std::string& name,
+    const std::vector<Argument>& args, const std::vector<Target>& targets,
+    const std::map<std::string, FloatMode>& float_modes =
+        std::map<std::string, FloatMode>());
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_CODEGEN_MULTI_TARGET_H
\ No newline at end of file
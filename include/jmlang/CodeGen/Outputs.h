@@ -0,0 +1,31 @@
+#ifndef JMLANG_CODEGEN_OUTPUTS_H
+#define JMLANG_CODEGEN_OUTPUTS_H
+
+#include <string>
+#include <vector>
+
+#include "jmlang/IR/Argument.h"
+
+namespace jmlang {
+namespace internal {
+
+/// Write a C header declaring a pipeline compiled ahead of time with
+/// the given name and arguments, as it would be called from C or
+/// C++. Buffer arguments become buffer_t pointers, and scalar
+/// arguments are passed by value. Also declares buffer_t, and the
+/// runtime functions for setting custom handlers.
+void compile_to_header(const std::string& filename, const std::string& name,
+                       const std::vector<Argument>& args);
+
+/// The C declaration of buffer_t, guarded so that it can appear in
+/// more than one file included by the same program.
+std::string buffer_t_declaration();
+
+/// Bundle some object files into a static library.
+void create_static_library(const std::string& filename,
+                           const std::vector<std::string>& objects);
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_CODEGEN_OUTPUTS_H
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef JMLANG_CODEGEN_RUNTIME_H
+#define JMLANG_CODEGEN_RUNTIME_H
+
+#include <cstddef>
+
+namespace llvm {
+class Module;
+}
+
+namespace jmlang {
+namespace internal {
+
+/// One file of the runtime (the C++ sources in runtime/), compiled to
+/// llvm bitcode at build time and embedded in the library.
+struct RuntimeBitcode {
+  const char* name;
+  const unsigned char* data;
+  size_t size;
+};
+
+/// The runtime's bitcode, hooks first, and a digest of all of it, so
+/// that caches of compiled code can tell when the runtime changes.
+extern const RuntimeBitcode runtime_bitcode[];
+extern const int runtime_bitcode_count;
+extern const char* const runtime_bitcode_digest;
+
+/// Link the runtime entry points that generated code calls
+/// (jmlang_malloc, jmlang_free, jmlang_error, jmlang_do_par_for,
+/// jmlang_do_task and jmlang_trace) into a module, along with the
+/// jmlang_set_* functions that replace them. Each entry point calls
+/// through a hook variable, which starts out pointing at the default
+/// implementation (jmlang_default_malloc etc.). Null arguments to the
+/// setters restore the defaults.
+///
+/// If shared is false, the hooks are private to the module, which
+/// suits the jit, where each pipeline has its own handlers. If shared
+/// is true, everything is weak, so that pipelines compiled ahead of
+/// time and linked into one program share one set of handlers, and
+/// so that a program can replace an entry point by defining it.
+void add_runtime_hooks(llvm::Module* m, bool shared);
+
+/// Link the default implementations of the runtime functions into a
+/// module, with weak linkage. They depend only on the C library. Used
+/// to make the runtime object that goes with pipelines compiled ahead
+/// of time, and the one copy of the runtime that every pipeline the
+/// jit compiles is linked against, so that they share one thread
+/// pool.
+void add_default_runtime(llvm::Module* m);
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_CODEGEN_RUNTIME_H
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef JMLANG_IR_FIND_CALLS_H
+#define JMLANG_IR_FIND_CALLS_H
+
+#include <map>
+#include <string>
+
+#include "jmlang/IR/Function.h"
+
+namespace jmlang {
+namespace internal {
+
+/// Construct a map from name to Function definition object for all
+/// Jmlang functions called directly in the definition of the Function
+/// f, including in its reduction definition and extern arguments.
+/// Does not include f itself, unless it is recursive.
+std::map<std::string, Function> find_direct_calls(Function f);
+
+/// Construct a map from name to Function definition object for all
+/// Jmlang functions called directly in the definition of the Function
+/// f, or indirectly in those functions' definitions, recursively.
+/// Includes f itself.
+std::map<std::string, Function> find_transitive_calls(Function f);
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_IR_FIND_CALLS_H
\ No newline at end of file
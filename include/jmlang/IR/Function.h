@@ -6,6 +6,7 @@
 
 #include "jmlang/Base/Buffer.h"
 #include "jmlang/Base/IntrusivePtr.h"
+#include "jmlang/Base/Target.h"
 #include "jmlang/IR/Reduction.h"
 #include "jmlang/IR/Schedule.h"
 
@@ -68,8 +69,15 @@ struct FunctionContents {
 
   bool trace_loads, trace_stores, trace_realizations;
 
+  std::vector<Schedule::Bound> estimates;
+
+  FloatMode float_mode;
+
   FunctionContents()
-      : trace_loads(false), trace_stores(false), trace_realizations(false) {}
+      : trace_loads(false),
+        trace_stores(false),
+        trace_realizations(false),
+        float_mode(FloatDefault) {}
 };
 
 /// A reference-counted handle to internal representation of
@@ -194,6 +202,17 @@ class Function {
     return contents.ptr->extern_function_name;
   }
 
+  /// Record the typical min and extent of one of the pure
+  /// arguments, replacing any previous estimate for it. Unlike
+  /// Schedule::bounds, this does not constrain what gets computed,
+  /// and is only used by heuristics such as automatic scheduling.
+  void set_estimate(const std::string& var, Expr min, Expr extent);
+
+  /// Get the estimates recorded for the pure arguments.
+  const std::vector<Schedule::Bound>& estimates() const {
+    return contents.ptr->estimates;
+  }
+
   /// Equality of identity.
   bool same_as(const Function& other) const {
     return contents.same_as(other.contents);
@@ -216,6 +235,11 @@ class Function {
   bool is_tracing_stores() { return contents.ptr->trace_stores; }
   bool is_tracing_realizations() { return contents.ptr->trace_realizations; }
 
+  /// The floating-point mode for the code that computes this
+  /// function, passed down from Func::float_mode.
+  void set_float_mode(FloatMode mode) { contents.ptr->float_mode = mode; }
+  FloatMode float_mode() const { return contents.ptr->float_mode; }
+
   /// What's the smallest amount of this Function that can be
   /// produced? This is a function of the splits being done. Ignores
   /// writes due to scattering done by reductions.
@@ -50,6 +50,9 @@ struct ExprNode : public BaseExprNode {
   static IRNodeType type_info_;
 };
 
+template <typename T>
+IRNodeType ExprNode<T>::type_info_;
+
 template <typename T>
 struct StmtNode : public BaseStmtNode {
   void accept(IRVisitor* v) const { v->visit((const T*)this); }
@@ -57,6 +60,9 @@ struct StmtNode : public BaseStmtNode {
   static IRNodeType type_info_;
 };
 
+template <typename T>
+IRNodeType StmtNode<T>::type_info_;
+
 struct IRHandle : public IntrusivePtr<const IRNode> {
   IRHandle() : IntrusivePtr<const IRNode>() {}
   IRHandle(const IRNode* p) : IntrusivePtr<const IRNode>(p) {}
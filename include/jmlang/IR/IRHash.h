@@ -0,0 +1,30 @@
+#ifndef JMLANG_IR_IR_HASH_H
+#define JMLANG_IR_IR_HASH_H
+
+#include <cstdint>
+
+#include "jmlang/IR/IR.h"
+
+namespace jmlang {
+namespace internal {
+
+/// A hash of the structure of an IR tree, consistent with equal: IR
+/// that compares equal hashes to the same value. Depends only on the
+/// contents of the tree, not on addresses, so it's the same from one
+/// run of a program to the next. Common subexpressions are hashed
+/// once.
+uint64_t structural_hash(Expr e);
+uint64_t structural_hash(Stmt s);
+
+/// Mix a value into a running hash.
+inline uint64_t hash_combine(uint64_t seed, uint64_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+/// A hash of a string that is the same from one run to the next.
+uint64_t hash_string(const std::string& s);
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_IR_IR_HASH_H
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef JMLANG_IR_IR_OPERATOR_H
 #define JMLANG_IR_IR_OPERATOR_H
 
+#include <algorithm>
+
 #include "jmlang/IR/ExprCall.h"
 #include "jmlang/IR/ExprVariable.h"
 #include "jmlang/IR/IR.h"
@@ -112,9 +114,13 @@ Expr const_false(int width = 1);
 /// in an Int(16).
 void match_types(Expr& a, Expr& b);
 
-/// Jmlang's vectorizable transcendentals.
+/// Jmlang's vectorizable transcendentals, for Float(32) scalars or
+/// vectors.
 Expr jmlang_log(Expr a);
 Expr jmlang_exp(Expr a);
+Expr jmlang_pow(Expr a, Expr b);
+Expr jmlang_sin(Expr a);
+Expr jmlang_cos(Expr a);
 
 /// Raise an expression to an integer power by repeatedly multiplying
 /// it by itself.
@@ -376,16 +382,21 @@ inline Expr select(Expr condition, Expr true_value, Expr false_value) {
 }
 
 /// Return the sine of a floating-point expression. If the argument is
-/// not floating-point, it is cast to Float(32). Does not vectorize
-/// well.
+/// not floating-point, it is cast to Float(32). For Float(64)
+/// arguments, this calls the system sin function, and does not
+/// vectorize well. For Float(32) arguments, this is within 1.5 ulp for
+/// |x| <= pi, and within an absolute error of 1e-7 for |x| up to
+/// 8192. The argument is reduced in single precision, so further out
+/// the error grows, to about 0.03 at 1e6, and past 2^24 the result is
+/// meaningless, though it stays within [-1, 1]. It's nan for inf and
+/// nan. Vectorizes cleanly.
 inline Expr sin(Expr x) {
   assert(x.defined() && "sin of undefined");
-  if (x.type() == Float(64)) {
-    return internal::Call::make(Float(64), "sin_f64", vec(x),
+  if (x.type().element_of() == Float(64)) {
+    return internal::Call::make(x.type(), "sin_f64", vec(x),
                                 internal::Call::Extern);
   } else {
-    return internal::Call::make(Float(32), "sin_f32", vec(cast<float>(x)),
-                                internal::Call::Extern);
+    return internal::jmlang_sin(cast(Float(32, x.type().width), x));
   }
 }
 
@@ -404,16 +415,21 @@ inline Expr asin(Expr x) {
 }
 
 /// Return the cosine of a floating-point expression. If the argument
-/// is not floating-point, it is cast to Float(32). Does not vectorize
-/// well.
+/// is not floating-point, it is cast to Float(32). For Float(64)
+/// arguments, this calls the system cos function, and does not
+/// vectorize well. For Float(32) arguments, this is within 1.5 ulp for
+/// |x| <= pi, and within an absolute error of 1e-7 for |x| up to
+/// 8192. The argument is reduced in single precision, so further out
+/// the error grows, to about 0.03 at 1e6, and past 2^24 the result is
+/// meaningless, though it stays within [-1, 1]. It's nan for inf and
+/// nan. Vectorizes cleanly.
 inline Expr cos(Expr x) {
   assert(x.defined() && "cos of undefined");
-  if (x.type() == Float(64)) {
-    return internal::Call::make(Float(64), "cos_f64", vec(x),
+  if (x.type().element_of() == Float(64)) {
+    return internal::Call::make(x.type(), "cos_f64", vec(x),
                                 internal::Call::Extern);
   } else {
-    return internal::Call::make(Float(32), "cos_f32", vec(cast<float>(x)),
-                                internal::Call::Extern);
+    return internal::jmlang_cos(cast(Float(32, x.type().width), x));
   }
 }
 
@@ -585,17 +601,15 @@ inline Expr hypot(Expr x, Expr y) { return sqrt(x * x + y * y); }
 /// Float(64) arguments, this calls the system exp function, and does
 /// not vectorize well. For Float(32) arguments, this function is
 /// vectorizable, does the right thing for extremely small or extremely
-/// large inputs, and is accurate up to the last bit of the
-/// mantissa. Vectorizes cleanly.
+/// large inputs (including denormal results), and is within 1 ulp.
+/// Vectorizes cleanly.
 inline Expr exp(Expr x) {
   assert(x.defined() && "exp of undefined");
-  if (x.type() == Float(64)) {
-    return internal::Call::make(Float(64), "exp_f64", vec(x),
+  if (x.type().element_of() == Float(64)) {
+    return internal::Call::make(x.type(), "exp_f64", vec(x),
                                 internal::Call::Extern);
   } else {
-    // return internal::Call::make(Float(32), "exp_f32", vec(cast<float>(x)),
-    // internal::Call::Extern);
-    return internal::jmlang_exp(cast<float>(x));
+    return internal::jmlang_exp(cast(Float(32, x.type().width), x));
   }
 }
 
@@ -604,26 +618,24 @@ inline Expr exp(Expr x) {
 /// Float(64) arguments, this calls the system log function, and does
 /// not vectorize well. For Float(32) arguments, this function is
 /// vectorizable, does the right thing for inputs <= 0 (returns -inf or
-/// nan), and is accurate up to the last bit of the
-/// mantissa. Vectorizes cleanly.
+/// nan), denormals and inf, and is within 1.5 ulp. Vectorizes cleanly.
 inline Expr log(Expr x) {
   assert(x.defined() && "log of undefined");
-  if (x.type() == Float(64)) {
-    return internal::Call::make(Float(64), "log_f64", vec(x),
+  if (x.type().element_of() == Float(64)) {
+    return internal::Call::make(x.type(), "log_f64", vec(x),
                                 internal::Call::Extern);
   } else {
-    // return internal::Call::make(Float(32), "log_f32", vec(cast<float>(x)),
-    // internal::Call::Extern);
-    return internal::jmlang_log(cast<float>(x));
+    return internal::jmlang_log(cast(Float(32, x.type().width), x));
   }
 }
 
 /// Return one floating point expression raised to the power of
 /// another. The type of the result is given by the type of the first
 /// argument. If the first argument is not a floating-point type, it is
-/// cast to Float(32). For Float(32), cleanly vectorizable, and
-/// accurate up to the last few bits of the mantissa. Gets worse when
-/// approaching overflow. Vectorizes cleanly.
+/// cast to Float(32). For Float(32), the logarithm and its product
+/// with y are carried in Float(64), so the result is within 1 ulp even
+/// for large exponents. Follows C's powf for negative bases, zeros,
+/// infinities and nans. Vectorizes cleanly.
 inline Expr pow(Expr x, Expr y) {
   assert(x.defined() && y.defined() && "pow of undefined");
 
@@ -631,40 +643,52 @@ inline Expr pow(Expr x, Expr y) {
     return raise_to_integer_power(x, *i);
   }
 
-  if (x.type() == Float(64)) {
-    y = cast<double>(y);
-    return internal::Call::make(Float(64), "pow_f64", vec(x, y),
+  if (x.type().element_of() == Float(64)) {
+    y = cast(x.type(), y);
+    return internal::Call::make(x.type(), "pow_f64", vec(x, y),
                                 internal::Call::Extern);
   } else {
-    x = cast<float>(x);
-    y = cast<float>(y);
-    return internal::jmlang_exp(internal::jmlang_log(x) * y);
+    Type t = Float(32, std::max(x.type().width, y.type().width));
+    return internal::jmlang_pow(cast(t, x), cast(t, y));
   }
 }
 
 /// Fast approximate cleanly vectorizable log for Float(32). Returns
-/// nonsense for x <= 0.0f. Accurate up to the last 5 bits of the
-/// mantissa. Vectorizes cleanly.
+/// nonsense for x <= 0.0f. Within an absolute error of 1e-5, which is
+/// about 32 ulp near x = 1. Vectorizes cleanly.
 Expr fast_log(Expr x);
 
 /// Fast approximate cleanly vectorizable exp for Float(32). Returns
-/// nonsense for inputs that would overflow or underflow. Typically
-/// accurate up to the last 5 bits of the mantissa. Gets worse when
-/// approaching overflow. Vectorizes cleanly.
+/// nonsense for inputs that would overflow or underflow. Within 81
+/// ulp, typically much better. Vectorizes cleanly.
 Expr fast_exp(Expr x);
 
+/// Fast approximate cleanly vectorizable sin for Float(32). Within 26
+/// ulp for |x| <= pi, and an absolute error of 1e-5 for |x| up to 100.
+/// Further out, the error grows as it does for sin. Vectorizes
+/// cleanly.
+Expr fast_sin(Expr x);
+
+/// Fast approximate cleanly vectorizable cos for Float(32). Within 26
+/// ulp for |x| <= pi, and an absolute error of 1e-5 for |x| up to 100.
+/// Further out, the error grows as it does for cos. Vectorizes
+/// cleanly.
+Expr fast_cos(Expr x);
+
 /// Fast approximate cleanly vectorizable pow for Float(32). Returns
 /// nonsense for x < 0.0f. Accurate up to the last 5 bits of the
-/// mantissa for typical exponents. Gets worse when approaching
-/// overflow. Vectorizes cleanly.
+/// mantissa for |y| <= 1, and the error grows with |y|, to about 80
+/// ulp at |y| = 4. Gets worse when approaching overflow. Vectorizes
+/// cleanly.
 inline Expr fast_pow(Expr x, Expr y) {
   if (const int* i = as_const_int(y)) {
     return raise_to_integer_power(x, *i);
   }
 
-  x = cast<float>(x);
-  y = cast<float>(y);
-  return select(x == 0.0f, 0.0f, fast_exp(fast_log(x) * y));
+  Type t = Float(32, std::max(x.type().width, y.type().width));
+  x = cast(t, x);
+  y = cast(t, y);
+  return select(x == 0.0f, cast(t, 0.0f), fast_exp(fast_log(x) * y));
 }
 
 /// Return the greatest whole number less than or equal to a
@@ -673,11 +697,12 @@ inline Expr fast_pow(Expr x, Expr y) {
 /// point, despite being a whole number. Vectorizes cleanly.
 inline Expr floor(Expr x) {
   assert(x.defined() && "floor of undefined");
-  if (x.type() == Float(64)) {
-    return internal::Call::make(Float(64), "floor_f64", vec(x),
+  if (x.type().element_of() == Float(64)) {
+    return internal::Call::make(x.type(), "floor_f64", vec(x),
                                 internal::Call::Extern);
   } else {
-    return internal::Call::make(Float(32), "floor_f32", vec(cast<float>(x)),
+    Type t = Float(32, x.type().width);
+    return internal::Call::make(t, "floor_f32", vec(cast(t, x)),
                                 internal::Call::Extern);
   }
 }
@@ -688,11 +713,12 @@ inline Expr floor(Expr x) {
 /// point, despite being a whole number. Vectorizes cleanly.
 inline Expr ceil(Expr x) {
   assert(x.defined() && "ceil of undefined");
-  if (x.type() == Float(64)) {
-    return internal::Call::make(Float(64), "ceil_f64", vec(x),
+  if (x.type().element_of() == Float(64)) {
+    return internal::Call::make(x.type(), "ceil_f64", vec(x),
                                 internal::Call::Extern);
   } else {
-    return internal::Call::make(Float(32), "ceil_f32", vec(cast<float>(x)),
+    Type t = Float(32, x.type().width);
+    return internal::Call::make(t, "ceil_f32", vec(cast(t, x)),
                                 internal::Call::Extern);
   }
 }
@@ -703,11 +729,12 @@ inline Expr ceil(Expr x) {
 /// number. On ties, we round up. Vectorizes cleanly.
 inline Expr round(Expr x) {
   assert(x.defined() && "round of undefined");
-  if (x.type() == Float(64)) {
-    return internal::Call::make(Float(64), "round_f64", vec(x),
+  if (x.type().element_of() == Float(64)) {
+    return internal::Call::make(x.type(), "round_f64", vec(x),
                                 internal::Call::Extern);
   } else {
-    return internal::Call::make(Float(32), "round_f32", vec(cast<float>(x)),
+    Type t = Float(32, x.type().width);
+    return internal::Call::make(t, "round_f32", vec(cast(t, x)),
                                 internal::Call::Extern);
   }
 }
@@ -22,6 +22,9 @@ struct ParameterContents {
   Expr extent_constraint[4];
   Expr stride_constraint[4];
   Expr min_value, max_value;
+  Expr estimate;
+  Expr min_estimate[4];
+  Expr extent_estimate[4];
 
   ParameterContents(Type t, bool b, const std::string& n)
       : type(t), is_buffer(b), name(n), buffer(Buffer()), data(0) {
@@ -167,6 +170,43 @@ class Parameter {
     assert(contents.defined() && !is_buffer());
     return contents.ptr->max_value;
   }
+
+  /// Get or set the typical value of a scalar parameter. Unlike the
+  /// min and max value, this is not a promise about the values the
+  /// parameter can take, and is only used by heuristics such as
+  /// automatic scheduling.
+  // @{
+  void set_estimate(Expr e) {
+    assert(contents.defined() && !is_buffer());
+    contents.ptr->estimate = e;
+  }
+
+  Expr get_estimate() const {
+    assert(contents.defined() && !is_buffer());
+    return contents.ptr->estimate;
+  }
+  // @}
+
+  /// Get or set the typical min and extent of a buffer parameter in
+  /// the given dimension. Only used by heuristics.
+  // @{
+  void set_min_estimate(int dim, Expr e) {
+    assert(contents.defined() && is_buffer() && dim >= 0 && dim < 4);
+    contents.ptr->min_estimate[dim] = e;
+  }
+  void set_extent_estimate(int dim, Expr e) {
+    assert(contents.defined() && is_buffer() && dim >= 0 && dim < 4);
+    contents.ptr->extent_estimate[dim] = e;
+  }
+  Expr min_estimate(int dim) const {
+    assert(contents.defined() && is_buffer() && dim >= 0 && dim < 4);
+    return contents.ptr->min_estimate[dim];
+  }
+  Expr extent_estimate(int dim) const {
+    assert(contents.defined() && is_buffer() && dim >= 0 && dim < 4);
+    return contents.ptr->extent_estimate[dim];
+  }
+  // @}
 };
 
 }  // namespace internal
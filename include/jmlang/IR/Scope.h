@@ -132,7 +132,7 @@ class Scope {
 
     const SmallStack<T>& stack() { return iter->second; }
 
-    const T& value() { return iter->second.top(); }
+    T value() { return iter->second.top(); }
   };
 
   const_iterator cbegin() const { return const_iterator(table.begin()); }
@@ -0,0 +1,57 @@
+#ifndef JMLANG_JIT_INTERPRETER_H
+#define JMLANG_JIT_INTERPRETER_H
+
+#include <vector>
+
+#include "jmlang/IR/Argument.h"
+#include "jmlang/IR/IR.h"
+#include "jmlang/JIT/JITModule.h"
+
+namespace jmlang {
+namespace internal {
+
+/// Runs a lowered statement by walking over it, without compiling it
+/// first. This is much slower per element than compiled code, but
+/// starts immediately, so it wins for pipelines that only run a few
+/// times on small inputs. Parallel loops run serially. Results match
+/// the code CodeGen makes, except that the interpreter may keep more
+/// precision than compiled code for floating-point math functions.
+class Interpreter {
+ public:
+  /// Prepare to run a statement with the given arguments, which are
+  /// as for CodeGen::compile.
+  Interpreter(Stmt s, const std::vector<Argument>& args);
+
+  /// Whether the interpreter can run a statement. It can't call
+  /// extern functions, other than the math functions in
+  /// IROperator.h, and doesn't support 16-bit floats.
+  static bool can_interpret(Stmt s);
+
+  /// Run the statement. The arguments are as for
+  /// JITModule::wrapped_function: an array of pointers to the scalar
+  /// arguments, and of buffer_t pointers for the buffer
+  /// arguments. Returns zero on success, or a negative error
+  /// code. Safe to call from multiple threads at once.
+  int run(const void** args) const;
+
+  /// Set the handlers the statement calls, as for the JITModule
+  /// setters of the same names. Null restores the default.
+  // @{
+  void set_error_handler(JITModule::ErrorHandler handler);
+  void set_custom_allocator(void* (*malloc)(size_t), void (*free)(void*));
+  void set_custom_trace(JITModule::TraceFn trace);
+  // @}
+
+ private:
+  Stmt stmt;
+  std::vector<Argument> args;
+  JITModule::ErrorHandler error_handler;
+  void* (*custom_malloc)(size_t);
+  void (*custom_free)(void*);
+  JITModule::TraceFn trace;
+};
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_JIT_INTERPRETER_H
\ No newline at end of file
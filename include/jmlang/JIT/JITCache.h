@@ -0,0 +1,89 @@
+#ifndef JMLANG_JIT_JIT_CACHE_H
+#define JMLANG_JIT_JIT_CACHE_H
+
+#include <string>
+#include <vector>
+
+#include "jmlang/IR/Argument.h"
+#include "jmlang/IR/IR.h"
+#include "jmlang/JIT/JITModule.h"
+
+namespace jmlang {
+namespace internal {
+
+/// The runtime handlers of a module from the jit cache. Null, or
+/// zero, means the default. See the setters of JITModule.
+struct JITHandlers {
+  JITModule::ErrorHandler error_handler;
+  void* (*custom_malloc)(size_t);
+  void (*custom_free)(void*);
+  JITModule::TraceFn trace;
+  int max_threads, priority;
+  /// -1 leaves it to the environment.
+  int numa_aware;
+
+  JITHandlers()
+      : error_handler(nullptr),
+        custom_malloc(nullptr),
+        custom_free(nullptr),
+        trace(nullptr),
+        max_threads(0),
+        priority(0),
+        numa_aware(-1) {}
+
+  bool operator==(const JITHandlers& other) const {
+    return error_handler == other.error_handler &&
+           custom_malloc == other.custom_malloc &&
+           custom_free == other.custom_free && trace == other.trace &&
+           max_threads == other.max_threads && priority == other.priority &&
+           numa_aware == other.numa_aware;
+  }
+};
+
+/// Compile a lowered statement to machine code, or return the module
+/// already compiled from an equal statement with the same arguments
+/// and handlers for the same target. The target is the one in the
+/// environment variable JMLANG_JIT_TARGET, or the host if it isn't
+/// set. Statements are looked up by structural hash, so pipelines
+/// built separately from the same code share one module. The name
+/// only matters to the first compilation. The handlers are set once,
+/// before the module is shared, and every user of it gets the same
+/// ones, so they mustn't be set again on the module returned. Safe to
+/// call from multiple threads.
+///
+/// If the environment variable JMLANG_JIT_CACHE_DIR names a
+/// directory, compiled object files are also kept there, keyed by
+/// the statement, arguments, target and jmlang version, and later
+/// processes load them instead of compiling again. Nothing is ever
+/// removed from the directory.
+JITModule compile_jit_cached(Stmt s, const std::string& name,
+                             const std::vector<Argument>& args,
+                             const JITHandlers& handlers = JITHandlers());
+
+/// Set the most bytes of machine code the cache holds on to. The
+/// least recently used modules are dropped first. Modules dropped
+/// from the cache stay valid for as long as something else refers
+/// to them. The default is 64 MB.
+void set_jit_cache_limit(size_t bytes);
+
+/// Drop every module from the cache.
+void clear_jit_cache();
+
+/// Counters describing the cache, for tuning the limit.
+struct JITCacheStats {
+  size_t hits, misses, evictions;
+
+  /// The number of misses satisfied from the on-disk cache.
+  size_t disk_hits;
+
+  /// The number of modules in the cache, and the bytes of machine
+  /// code they hold.
+  size_t entries, code_size;
+};
+
+JITCacheStats jit_cache_stats();
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_JIT_JIT_CACHE_H
\ No newline at end of file
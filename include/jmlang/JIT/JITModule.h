@@ -6,13 +6,15 @@
 
 namespace llvm {
 class Module;
+namespace orc {
+class JITDylib;
 }
+}  // namespace llvm
 
 namespace jmlang {
 namespace internal {
 
 class JITModuleHolder;
-class CodeGen;
 
 /// Function pointers into a compiled module. These function
 /// pointers are meaningless once the last copy of a JITModule
@@ -20,9 +22,9 @@ class CodeGen;
 struct JITModule {
   /// A pointer to the raw function. It's true type depends
   /// on the Argument vector passed to CodeGen::compile. Image
-  /// parameters become (buffer_t *), and scalar parameters become
-  /// pointers to the appropriate values. The final argument is a
-  /// pointer to the buffer_t defining the output.
+  /// parameters become (buffer_t *), and scalar parameters are
+  /// passed by value. The final argument is a pointer to the
+  /// buffer_t defining the output.
   void* function;
 
   /// A slightly more type-safe wrapper around the raw
@@ -62,9 +64,19 @@ struct JITModule {
                           int, const int*);
   void (*set_custom_trace)(TraceFn);
 
-  /// Shutdown the thread pool maintained by this JIT module. This
-  /// is also done automatically when the last reference to this
-  /// module is destroyed.
+  /// Limit how many of the thread pool's threads this module's
+  /// parallel loops use at once (0 for no limit), and set their
+  /// priority. Idle threads help the highest priority loop first.
+  void (*set_par_for_options)(int max_threads, int priority);
+
+  /// Whether to split this module's parallel loops between numa
+  /// nodes. See Func::set_numa_aware.
+  void (*set_numa_aware)(int numa_aware);
+
+  /// Stop the workers of the thread pool, which is shared by every
+  /// module in the process. They start again on the next parallel
+  /// loop. Must not be called while any pipeline is running. The
+  /// workers also stop when the last module using them is destroyed.
   void (*shutdown_thread_pool)();
 
   /// Close the tracing file this module may be writing to. Also
@@ -72,6 +84,12 @@ struct JITModule {
   /// destroyed.
   void (*shutdown_trace)();
 
+  /// Free the blocks the default allocator keeps for reuse. It's
+  /// shared by every module, and caches freed blocks per thread, so
+  /// that pipelines run over and over don't go back to malloc for
+  /// their buffers.
+  void (*trim_allocator)();
+
   // The JIT Module Allocator holds onto the memory storing the functions above.
   IntrusivePtr<JITModuleHolder> module;
 
@@ -86,13 +104,37 @@ struct JITModule {
         set_custom_do_par_for(nullptr),
         set_custom_do_task(nullptr),
         set_custom_trace(nullptr),
+        set_par_for_options(nullptr),
+        set_numa_aware(nullptr),
         shutdown_thread_pool(nullptr),
-        shutdown_trace(nullptr) {}
-
-  /// Take an llvm module and compile it. Populates the function
-  /// pointer members above with the result.
-  void compile_module(CodeGen* cg, llvm::Module* mod,
-                      const std::string& function_name);
+        shutdown_trace(nullptr),
+        trim_allocator(nullptr) {}
+
+  /// Take an llvm module and compile it in the process-wide jit,
+  /// adding the runtime hooks that the set_custom_* members point
+  /// to. Takes ownership of the module and its context. Populates the
+  /// function pointer members above with the result. If an object
+  /// path is given, the compiled object file is also saved there, for
+  /// load_object to use later.
+  void compile_module(llvm::Module* mod, const std::string& function_name,
+                      const std::string& object_path = "");
+
+  /// Load an object file saved by compile_module into the jit,
+  /// instead of compiling the module again. The file is mapped into
+  /// memory rather than read where possible. Returns false if the
+  /// file doesn't exist or can't be linked.
+  bool load_object(const std::string& object_path,
+                   const std::string& function_name);
+
+  /// The number of bytes of machine code and data compiled for this
+  /// module. Zero if nothing has been compiled.
+  size_t code_size() const;
+
+ private:
+  /// Populate the function pointers from the code in a jit dylib,
+  /// and take ownership of the dylib.
+  void link(llvm::orc::JITDylib* dylib, const std::string& function_name,
+            size_t code_size);
 };
 
 }  // namespace internal
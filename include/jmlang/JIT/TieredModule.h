@@ -0,0 +1,107 @@
+#ifndef JMLANG_JIT_TIERED_MODULE_H
+#define JMLANG_JIT_TIERED_MODULE_H
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "jmlang/IR/Argument.h"
+#include "jmlang/IR/IR.h"
+#include "jmlang/JIT/Interpreter.h"
+#include "jmlang/JIT/JITCache.h"
+#include "jmlang/JIT/JITModule.h"
+
+namespace jmlang {
+namespace internal {
+
+/// Runs a lowered statement straight away with the Interpreter, while
+/// compiling it with compile_jit_cached on a background thread, and
+/// switches to the compiled code once it's ready. This gets the first
+/// results quickly, and full speed for pipelines that go on to run
+/// many times. Statements the interpreter can't run wait for the
+/// compiled code instead. Destroying a TieredModule waits for its
+/// compilation to finish. The compiled code is shared with other
+/// TieredModules with the same statement and handlers, so its
+/// handlers are part of what it's compiled for, and setting them
+/// compiles it again on the next run, unless the jit cache already
+/// has a module with the new ones.
+class TieredModule {
+ public:
+  TieredModule(Stmt s, const std::string& name,
+               const std::vector<Argument>& args,
+               const JITHandlers& handlers = JITHandlers());
+
+  /// Run the statement, with arguments as for
+  /// JITModule::wrapped_function. Returns zero on success, or a
+  /// negative error code. Safe to call from multiple threads at once,
+  /// as long as no handlers are being set.
+  int run(const void** args);
+
+  /// Whether calls now go to compiled code.
+  bool compiled();
+
+  /// Wait for the compiled code, and return it.
+  JITModule compiled_module();
+
+  /// Set the handlers the statement calls, in both tiers. Null
+  /// restores the default. The interpreter uses them straight away.
+  /// The compiled code is brought up to date on the next run, so
+  /// setting several handlers costs one compilation, or none if they
+  /// are passed to the constructor instead.
+  // @{
+  void set_error_handler(JITModule::ErrorHandler handler);
+  void set_custom_allocator(void* (*malloc)(size_t), void (*free)(void*));
+  void set_custom_trace(JITModule::TraceFn trace);
+  // @}
+
+  /// Limit the threads the compiled code's parallel loops use, and set
+  /// their priority. See JITModule::set_par_for_options. The
+  /// interpreter runs loops serially, so doesn't need it.
+  void set_par_for_options(int max_threads, int priority);
+  void set_numa_aware(bool numa_aware);
+
+ private:
+  Stmt stmt;
+  std::string name;
+  std::vector<Argument> arguments;
+  JITHandlers handlers;
+
+  Interpreter interpreter;
+  bool interpretable;
+
+  /// Guards the handlers and the compilations.
+  std::mutex mutex;
+
+  /// The compilation for the current handlers, and any it replaced
+  /// that haven't finished, kept so that replacing them doesn't wait
+  /// for them.
+  std::shared_future<JITModule> compiling;
+  std::vector<std::shared_future<JITModule> > superseded;
+
+  /// Whether compiling has finished.
+  std::atomic<bool> ready;
+
+  /// Whether the handlers have changed since compiling started.
+  bool dirty;
+
+  /// Compile the statement with the current handlers, in the
+  /// background. Call with the mutex held.
+  void compile();
+
+  /// The compilation for the current handlers, started if they have
+  /// changed since the last one.
+  std::shared_future<JITModule> compilation();
+
+  /// Whether a compilation for the current handlers has finished.
+  bool finished(const std::shared_future<JITModule>& c);
+
+  TieredModule(const TieredModule&);
+  TieredModule& operator=(const TieredModule&);
+};
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_JIT_TIERED_MODULE_H
\ No newline at end of file
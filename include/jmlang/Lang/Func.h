@@ -2,6 +2,7 @@
 #define JMLANG_LANG_FUNC_H
 
 #include "jmlang/Base/IntrusivePtr.h"
+#include "jmlang/Base/Target.h"
 #include "jmlang/Base/Util.h"
 #include "jmlang/IR/Argument.h"
 #include "jmlang/IR/Function.h"
@@ -375,6 +376,17 @@ class Func {
   int (*custom_do_task)(int (*)(int, uint8_t*), int, uint8_t*);
   // @}
 
+  /** The limit on threads used at once by this function's parallel
+   * loops (0 for none), and their priority in the thread pool. */
+  // @{
+  int par_for_max_threads = 0;
+  int par_for_priority = 0;
+  // @}
+
+  /** Whether to split this function's parallel loops between numa
+   * nodes. -1 if unset, in which case JMLANG_NUMA decides. */
+  int numa_aware = -1;
+
   /** The current custom tracing functions. May be NULL. */
   // @{
   void (*custom_trace)(const char*, int32_t, int32_t, int32_t, int32_t, int32_t,
@@ -504,8 +516,12 @@ class Func {
                            const std::string& fn_name = "");
   /** Statically compile this function to C source code. This is
    * useful for providing fallback code paths that will compile on
-   * many platforms. Vectorization will fail, and parallelization
-   * will produce serial code. */
+   * many platforms. The file declares the same function as
+   * compile_to_header. Vectors use gcc and clang vector extensions,
+   * so their widths must be powers of two, and parallel loops call
+   * jmlang_do_par_for, which the file defines as a serial loop
+   * unless the program supplies its own or defines
+   * JMLANG_NO_RUNTIME. */
   void compile_to_c(const std::string& filename, std::vector<Argument>,
                     const std::string& fn_name = "");
 
@@ -514,9 +530,24 @@ class Func {
    * .stmt, which must be supplied in filename. */
   void compile_to_lowered_stmt(const std::string& filename);
 
+  /** Write out a report of the static costs of the lowered code for
+   * this function: arithmetic ops, bytes loaded and stored,
+   * allocation sizes and the redundant recompute factor of each
+   * function in the pipeline, with a roofline estimate of its run
+   * time on a generic machine with the vector width of the target
+   * in JMLANG_TARGET. Trip counts are taken from any estimates set
+   * on this function and on the pipeline's parameters. The function
+   * must already have been lowered by a previous compilation. */
+  void compile_to_cost_report(const std::string& filename);
+
   /** Compile to object file and header pair, with the given
    * arguments. Also names the C function to match the first
-   * argument.
+   * argument. The output buffers are appended to the arguments. The
+   * object file calls into the jmlang runtime, which is in the
+   * library made by compile_to_static_library. The code is for the
+   * target in the environment variable JMLANG_TARGET, or the host if
+   * it isn't set. The function must already have been lowered by a
+   * previous compilation.
    */
   //@{
   void compile_to_file(const std::string& filename_prefix,
@@ -533,6 +564,28 @@ class Func {
                        Argument b, Argument c, Argument d, Argument e);
   // @}
 
+  /** Compile to object file and header pair like compile_to_file,
+   * but with a version of the function for each of the given
+   * targets, which may differ only in their features. The first call
+   * checks which ones the cpu supports, and all calls go to the first
+   * of those in the list. End the list with a target without
+   * instruction set features to run on any cpu of the architecture. */
+  void compile_to_file(const std::string& filename_prefix,
+                       std::vector<Argument> args,
+                       const std::vector<Target>& targets);
+
+  /** Compile to a static library and header pair, with the given
+   * arguments. The library holds the object file made by
+   * compile_to_file, and the jmlang runtime, so a program needs
+   * nothing else (and in particular, not llvm) to call the
+   * function. Libraries made this way can be linked into the same
+   * program. If any targets are given, the library dispatches
+   * between versions for them at runtime, as in the compile_to_file
+   * that takes targets. */
+  void compile_to_static_library(
+      const std::string& filename_prefix, std::vector<Argument> args,
+      const std::vector<Target>& targets = std::vector<Target>());
+
   /** Eagerly jit compile the function to machine code. This
    * normally happens on the first call to realize. If you're
    * running your halide pipeline inside time-sensitive code and
@@ -562,6 +615,14 @@ class Func {
    \endcode
    * These will clobber Halide's versions. See \file HalideRuntime.h
    * for declarations.
+   *
+   * The default keeps freed blocks in a cache per thread, in size
+   * classes, and reuses them, so a pipeline realized many times
+   * doesn't allocate its buffers from scratch each time. Blocks are
+   * aligned to cache lines, or to pages for big ones. Each thread
+   * caches up to JMLANG_ALLOCATOR_CACHE_MB megabytes (128 by
+   * default; 0 turns caching off). Call jmlang_trim_allocator, or
+   * JITModule::trim_allocator, to free the cached blocks.
    */
   void set_custom_allocator(void* (*malloc)(size_t), void (*free)(void*));
 
@@ -601,6 +662,11 @@ class Func {
    * fails, we may skip over other tasks, and if two tasks return
    * different error codes, we may select one arbitrarily to return.
    *
+   * The default runs the loop on a work-stealing thread pool, with
+   * as many threads as the environment variable JMLANG_NUM_THREADS
+   * says, or one per cpu if it's unset. Nested parallel loops share
+   * the same threads.
+   *
    * If you are statically compiling, you can also just define your
    * own version of the above function, and it will clobber Halide's
    * version.
@@ -608,6 +674,31 @@ class Func {
   void set_custom_do_par_for(int (*custom_do_par_for)(int (*)(int, uint8_t*),
                                                       int, int, uint8_t*));
 
+  /** Share the thread pool fairly with other pipelines. Every
+   * pipeline in the process, jit compiled or not, runs its parallel
+   * loops on one pool. This stops more threads from joining this
+   * pipeline's loops once max_threads are working on them (0, the
+   * default, for no limit), and sets their priority: threads with
+   * nothing to do help the highest priority loop first. A thread
+   * always finishes the iterations it split off itself, so the limit
+   * can't deadlock nested loops, but may briefly be exceeded. If you
+   * are statically compiling, call jmlang_set_par_for_options
+   * instead. */
+  void set_par_for_options(int max_threads, int priority = 0);
+
+  /** Schedule the parallel loops of this pipeline for machines with
+   * several numa nodes. The thread pool's workers are pinned to
+   * cores, spread over the nodes, and each loop is cut into one
+   * contiguous share of iterations per node. The same share goes to
+   * the same node every time, so the rows of a buffer are first
+   * touched by, and so live in the memory of, the node that goes on
+   * to read them. This helps stages limited by memory bandwidth. The
+   * default is what the environment variable JMLANG_NUMA says: set
+   * it to 1 to do this for every pipeline. Does nothing on machines
+   * with one node. If you are statically compiling, call
+   * jmlang_set_numa_aware instead. */
+  void set_numa_aware(bool numa_aware);
+
   /** Set custom routines to call when tracing is enabled. Call this
    * on the output Func of your pipeline. This then sets custom
    * routines for the entire pipeline, not just calls to this
@@ -787,6 +878,21 @@ class Func {
   Func& cuda_tile(Var x, Var y, Var z, int x_size, int y_size, int z_size);
   // @}
 
+  /** Record the typical min and extent of this function in the given
+   * dimension when it is realized as an output. Unlike \ref bound,
+   * this places no constraint on what gets computed; it tells the
+   * auto-scheduler and autotuner what sizes to optimize for. */
+  Func& set_estimate(Var var, Expr min, Expr extent);
+
+  /** Choose how strictly the floating-point math that computes this
+   * function, including its update step, follows IEEE semantics
+   * (see \ref FloatMode). This overrides the target's fp_contract
+   * and fast_math features, so a stage that needs exact results can
+   * stay strict while the rest of the pipeline is compiled with
+   * fast_math, or the other way around. Funcs inlined into this one
+   * take on its mode. */
+  Func& float_mode(FloatMode mode);
+
   /** Scheduling calls that control how the storage for the function
    * is laid out. Right now you can only reorder the dimensions. */
   // @{
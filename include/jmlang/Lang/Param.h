@@ -66,6 +66,21 @@ class Param {
   Expr get_max_value() { return param.get_max_value(); }
   // @}
 
+  /** Get or set the typical value of this parameter. Unlike the
+   * range, this is not a promise about the values the parameter can
+   * take. It is used by heuristics such as the auto-scheduler to
+   * pick between, e.g., schedules for small and large kernels. */
+  // @{
+  void set_estimate(Expr value) {
+    if (value.type() != type_of<T>()) {
+      value = internal::Cast::make(type_of<T>(), value);
+    }
+    param.set_estimate(value);
+  }
+
+  Expr get_estimate() const { return param.get_estimate(); }
+  // @}
+
   /** You can use this parameter as an expression in a halide
    * function definition */
   operator Expr() const {
@@ -82,6 +97,68 @@ class Param {
   operator Argument() const { return Argument(name(), false, type()); }
 };
 
+namespace internal {
+
+/** A handle on one dimension of an image parameter. Returned by
+ * OutputImageParam::dim. */
+class Dimension {
+  Parameter param;
+  int d;
+
+ public:
+  Dimension(const Parameter& p, int d) : param(p), d(d) {
+    assert(d >= 0 && d < 4 && "Image parameters have at most 4 dimensions");
+  }
+
+  /** Get an expression representing the minimum coordinate of the
+   * image in this dimension. */
+  Expr min() const {
+    std::ostringstream s;
+    s << param.name() << ".min." << d;
+    return Variable::make(Int(32), s.str(), param);
+  }
+
+  /** Get an expression representing the extent of the image in
+   * this dimension. */
+  Expr extent() const {
+    std::ostringstream s;
+    s << param.name() << ".extent." << d;
+    return Variable::make(Int(32), s.str(), param);
+  }
+
+  /** Get an expression representing the stride of the image in
+   * this dimension. */
+  Expr stride() const {
+    std::ostringstream s;
+    s << param.name() << ".stride." << d;
+    return Variable::make(Int(32), s.str(), param);
+  }
+
+  /** Set the typical min and extent of the image in this
+   * dimension. Unlike OutputImageParam::set_bounds, this is not a
+   * promise about the images that will be passed in. It is used by
+   * heuristics such as the auto-scheduler. E.g:
+   \code
+   ImageParam im(UInt(8), 2);
+   im.dim(0).set_estimate(0, 1920);
+   im.dim(1).set_estimate(0, 1080);
+   \endcode
+   */
+  Dimension& set_estimate(Expr min, Expr extent) {
+    param.set_min_estimate(d, min);
+    param.set_extent_estimate(d, extent);
+    return *this;
+  }
+
+  /** Get the estimates set by set_estimate. */
+  // @{
+  Expr min_estimate() const { return param.min_estimate(d); }
+  Expr extent_estimate() const { return param.extent_estimate(d); }
+  // @}
+};
+
+}  // namespace internal
+
 /** A handle on the output buffer of a pipeline. Used to make static
  * promises about the output size and stride. */
 class OutputImageParam {
@@ -198,6 +275,13 @@ class OutputImageParam {
   /** Get the dimensionality of this image parameter */
   int dimensions() const { return dims; };
 
+  /** Get a handle on one dimension of this image parameter, e.g. to
+   * set estimates on it. */
+  internal::Dimension dim(int i) const {
+    assert(i >= 0 && i < dims && "Dimension out of range");
+    return internal::Dimension(param, i);
+  }
+
   /** Get an expression giving the extent in dimension 0, which by
    * convention is the width of the image */
   Expr width() const {
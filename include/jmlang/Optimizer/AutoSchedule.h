@@ -0,0 +1,129 @@
+#ifndef JMLANG_OPTIMIZER_AUTO_SCHEDULE_H
+#define JMLANG_OPTIMIZER_AUTO_SCHEDULE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "jmlang/Base/Target.h"
+#include "jmlang/IR/Function.h"
+#include "jmlang/Optimizer/Bounds.h"
+
+namespace jmlang {
+
+/// A description of the machine a pipeline will run on, used by the
+/// auto-scheduler's cost model.
+struct MachineParams {
+  /// The number of threads worth keeping busy.
+  int parallelism;
+
+  /// The width of a SIMD register, in bytes.
+  int vector_bytes;
+
+  /// Cache sizes, in bytes.
+  int64_t l1_size, l2_size, last_level_cache_size;
+
+  /// The cost of moving one byte to or from main memory, relative
+  /// to the cost of one arithmetic operation.
+  float balance;
+
+  /// Sustained main memory bandwidth in bytes per second, and peak
+  /// arithmetic throughput across all cores in operations per
+  /// second. Used for roofline estimates.
+  double memory_bandwidth, peak_ops;
+
+  /// Parameters describing a typical modern multi-core x86 machine.
+  static MachineParams generic() {
+    MachineParams p;
+    p.parallelism = 16;
+    p.vector_bytes = 32;
+    p.l1_size = 32 * 1024;
+    p.l2_size = 256 * 1024;
+    p.last_level_cache_size = 16 * 1024 * 1024;
+    p.balance = 40;
+    p.memory_bandwidth = 40e9;
+    p.peak_ops = 768e9;
+    return p;
+  }
+
+  /// The generic parameters, with the vector width of a target.
+  static MachineParams for_target(const Target& t) {
+    MachineParams p = generic();
+    p.vector_bytes = t.natural_vector_size(UInt(8));
+    return p;
+  }
+};
+
+namespace internal {
+
+/// The scheduling decisions made for a single function, in a form
+/// that search procedures can inspect and perturb before writing
+/// them into the function's Schedule with apply_schedule.
+struct StageChoice {
+  enum ComputeLevel { Inline, Root, ConsumerTile };
+
+  Function func;
+  ComputeLevel compute_level;
+
+  /// For ConsumerTile, the name of the consumer within whose tiles
+  /// this function is computed. The consumer must be computed at
+  /// root with its innermost dimension split, or the function falls
+  /// back to being computed at root.
+  std::string consumer;
+
+  /// Split factors for the two innermost dimensions. Zero leaves the
+  /// dimension unsplit. Ignored for ConsumerTile.
+  int tile[2];
+
+  /// The vector width of the innermost loop. One leaves it scalar.
+  int vector_width;
+
+  /// Whether to parallelize the outermost loop, and the outermost
+  /// loop of the update step where that's known to be safe. Ignored
+  /// for ConsumerTile.
+  bool parallel;
+
+  StageChoice() : compute_level(Root), vector_width(1), parallel(false) {
+    tile[0] = tile[1] = 0;
+  }
+};
+
+/// Scheduling decisions for every function in a pipeline, keyed by
+/// function name.
+typedef std::map<std::string, StageChoice> ScheduleChoices;
+
+/// Use the cost model to choose a schedule for every function the
+/// given outputs depend on. Estimates give the typical region of each
+/// output to be realized, keyed by function name. Outputs not in the
+/// map use the estimates set with Function::set_estimate, and are
+/// assumed to be 1024 wide in any dimension without one. Estimates
+/// set on scalar and image parameters are used to size the regions
+/// of the functions that depend on them.
+ScheduleChoices choose_schedule(const std::vector<Function>& outputs,
+                                const std::map<std::string, Box>& estimates,
+                                const MachineParams& params);
+
+/// Write a set of choices into the Schedules of each function and its
+/// update step, replacing whatever was there. Returns the schedule
+/// written out as Func scheduling calls, for logging or pasting into
+/// the pipeline source.
+std::string apply_schedule(const ScheduleChoices& choices);
+
+/// Compute a schedule for every function the given outputs depend on,
+/// and write it into each Function's Schedule, replacing the default
+/// inline/serial schedule. Equivalent to applying the result of
+/// choose_schedule.
+std::string auto_schedule(const std::vector<Function>& outputs,
+                          const std::map<std::string, Box>& estimates,
+                          const MachineParams& params);
+
+/// Compute a schedule using only the estimates set on the outputs
+/// and the parameters of the pipeline.
+std::string auto_schedule(const std::vector<Function>& outputs,
+                          const MachineParams& params);
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_OPTIMIZER_AUTO_SCHEDULE_H
\ No newline at end of file
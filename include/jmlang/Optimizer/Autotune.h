@@ -0,0 +1,87 @@
+#ifndef JMLANG_OPTIMIZER_AUTOTUNE_H
+#define JMLANG_OPTIMIZER_AUTOTUNE_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "jmlang/Optimizer/AutoSchedule.h"
+
+namespace jmlang {
+namespace internal {
+
+/// Parameters of the search done by autotune.
+struct AutotuneOptions {
+  /// The number of rounds of mutation and selection.
+  int generations;
+
+  /// The number of best candidates kept from one generation to the
+  /// next (the beam width).
+  int population;
+
+  /// The number of new candidates tried per generation.
+  int children;
+
+  /// The number of times each candidate is run. The fastest run is
+  /// taken as its time, to filter out noise from the rest of the
+  /// system.
+  int samples;
+
+  /// Seed for the random number generator, so that searches are
+  /// reproducible.
+  unsigned seed;
+
+  AutotuneOptions()
+      : generations(20), population(8), children(16), samples(5), seed(0) {}
+};
+
+/// Run f the given number of times, and return the fastest time
+/// taken, in seconds.
+double benchmark(const std::function<void()>& f, int samples);
+
+/// Search for a fast schedule for every function the given outputs
+/// depend on, starting from the auto-scheduler's choices. Candidates
+/// mutate split factors, vector widths, compute levels and which
+/// loops are parallel, and the fastest survive to the next
+/// generation. Each candidate is written into the Schedules of the
+/// functions, then 'run' is timed; it should compile the pipeline
+/// and realize it over representative inputs. The fastest schedule
+/// found is applied before returning.
+ScheduleChoices autotune(const std::vector<Function>& outputs,
+                         const std::map<std::string, Box>& estimates,
+                         const MachineParams& params,
+                         const std::function<void()>& run,
+                         const AutotuneOptions& options = AutotuneOptions());
+
+/// Write a schedule to a text file, one function per line.
+void save_schedule(const ScheduleChoices& choices,
+                   const std::string& filename);
+
+/// Read back a schedule written by save_schedule, resolving function
+/// names against everything the given outputs depend on. The result
+/// may be passed to apply_schedule.
+ScheduleChoices load_schedule(const std::vector<Function>& outputs,
+                              const std::string& filename);
+
+/// A main function for a pipeline's autotuning executable. Runs
+/// autotune and saves the best schedule found. Understands the
+/// flags:
+///
+///  -o <file>        where to save the schedule (default: the
+///                   first output's name + ".schedule")
+///  -g <n>           generations
+///  -p <n>           population
+///  -c <n>           children per generation
+///  -s <n>           timing samples per candidate
+///  -seed <n>        random seed
+///
+/// Returns the process exit code.
+int autotune_main(int argc, char** argv, const std::vector<Function>& outputs,
+                  const std::map<std::string, Box>& estimates,
+                  const std::function<void()>& run);
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_OPTIMIZER_AUTOTUNE_H
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef JMLANG_OPTIMIZER_BOUNDS_H
+#define JMLANG_OPTIMIZER_BOUNDS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "jmlang/IR/IR.h"
+#include "jmlang/IR/Parameter.h"
+#include "jmlang/IR/Scope.h"
+
+namespace jmlang {
+namespace internal {
+
+/// A closed range of concrete integer values. Unlike a Range, the
+/// endpoints are numbers rather than expressions, which makes this
+/// the right tool for analyses that reason about typical (estimated)
+/// problem sizes instead of symbolic ones, e.g. cost models.
+struct Interval {
+  int64_t min, max;
+
+  Interval() : min(-unbounded()), max(unbounded()) {}
+  Interval(int64_t min, int64_t max) : min(min), max(max) {}
+
+  /// The magnitude used to represent an unknown endpoint. Interval
+  /// arithmetic saturates at this value instead of overflowing.
+  static int64_t unbounded() { return (int64_t)1 << 48; }
+
+  /// The interval containing every value we care to represent.
+  static Interval everything() { return Interval(); }
+
+  /// Construct the interval containing exactly the single value v.
+  static Interval single_point(int64_t v) { return Interval(v, v); }
+
+  bool is_bounded() const { return min > -unbounded() && max < unbounded(); }
+
+  bool is_single_point() const { return min == max; }
+
+  /// The number of values in the interval.
+  int64_t extent() const { return max < min ? 0 : max - min + 1; }
+
+  /// Grow this interval to also contain the other one.
+  void include(const Interval& other) {
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+  }
+};
+
+/// A multi-dimensional box of concrete intervals.
+typedef std::vector<Interval> Box;
+
+/// The number of points in a box.
+int64_t box_size(const Box& b);
+
+/// Grow the first box to also contain the second one. An empty first
+/// box takes on the dimensionality of the second.
+void merge_boxes(Box& a, const Box& b);
+
+/// Compute the range of concrete values an integer expression can
+/// take, given concrete ranges for the variables it refers to. Free
+/// variables not found in the scope are bounded by any min_value
+/// and max_value constraints on the parameter they refer to, and
+/// otherwise by the range of their type.
+Interval bounds_of_expr_in_scope(Expr expr, const Scope<Interval>& scope);
+
+/// Compute the region of each function or image called by an
+/// expression, given concrete ranges for the variables it refers
+/// to. Keys are the names of the called functions and images.
+std::map<std::string, Box> boxes_required(Expr expr,
+                                          const Scope<Interval>& scope);
+
+/// Evaluate an estimate to a concrete value, given concrete ranges for
+/// the variables it refers to. Returns false if the estimate is
+/// undefined or doesn't evaluate to a single known value.
+bool estimate_value(Expr e, const Scope<Interval>& scope, int64_t* value);
+
+/// Push single-point intervals for the estimates set on a parameter
+/// onto the scope: its value if it's a scalar, or the mins and
+/// extents of its dimensions if it's a buffer. Symbols are named
+/// the same way as the Variables that refer to them in lowered code,
+/// e.g. "input.extent.0".
+void push_estimates(const Parameter& p, Scope<Interval>& scope);
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_OPTIMIZER_BOUNDS_H
\ No newline at end of file
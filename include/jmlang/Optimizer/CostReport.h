@@ -0,0 +1,81 @@
+#ifndef JMLANG_OPTIMIZER_COST_REPORT_H
+#define JMLANG_OPTIMIZER_COST_REPORT_H
+
+#include <map>
+#include <string>
+
+#include "jmlang/IR/IR.h"
+#include "jmlang/Optimizer/AutoSchedule.h"
+#include "jmlang/Optimizer/Bounds.h"
+
+namespace jmlang {
+namespace internal {
+
+/// Static costs attributed to one function of a lowered pipeline.
+struct FunctionCost {
+  /// Arithmetic operations executed while computing the function,
+  /// counting each vector lane separately.
+  double ops;
+
+  /// Bytes loaded while computing the function, and bytes stored to
+  /// its buffer.
+  double bytes_loaded, bytes_stored;
+
+  /// The size in bytes of the largest allocation of the function's
+  /// buffer, and the number of times it is allocated.
+  int64_t allocation_bytes;
+  double allocations;
+
+  /// The number of points stored, and the number of distinct points
+  /// among them. Their ratio is the redundant recompute factor.
+  double points_stored, unique_points;
+
+  /// Whether any loop involved in computing the function had a trip
+  /// count that couldn't be determined, and was counted as one.
+  bool unknown_trip_count;
+
+  FunctionCost()
+      : ops(0),
+        bytes_loaded(0),
+        bytes_stored(0),
+        allocation_bytes(0),
+        allocations(0),
+        points_stored(0),
+        unique_points(0),
+        unknown_trip_count(false) {}
+
+  double recompute_factor() const {
+    return unique_points > 0 ? points_stored / unique_points : 1;
+  }
+
+  /// Arithmetic operations per byte of memory traffic.
+  double arithmetic_intensity() const {
+    double bytes = bytes_loaded + bytes_stored;
+    return bytes > 0 ? ops / bytes : 0;
+  }
+};
+
+/// Walk a lowered statement, and count the costs of computing each
+/// function in it. Loop trip counts and allocation sizes are worked
+/// out from constants, the enclosing lets, the given scope, and any
+/// estimates set on parameters the statement refers to. The
+/// recompute factor is exact for Provide nodes, which use the
+/// function's own coordinates. For flattened Store nodes, it is
+/// relative to the range of indices stored to, so it understates
+/// redundant work when the buffer is reallocated per tile. Work done
+/// outside of any function's production, such as computing bounds,
+/// is reported under the empty name.
+std::map<std::string, FunctionCost> compute_costs(
+    Stmt s, const Scope<Interval>& estimates = Scope<Interval>());
+
+/// Write out a human-readable report of the costs of each function
+/// in a lowered statement, with a roofline estimate of how long each
+/// would take on the given machine and whether it's bound by memory
+/// or arithmetic. Flags allocations that don't fit in L2.
+std::string cost_report(Stmt s, const MachineParams& params,
+                        const Scope<Interval>& estimates = Scope<Interval>());
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_OPTIMIZER_COST_REPORT_H
\ No newline at end of file
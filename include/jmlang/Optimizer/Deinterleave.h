@@ -0,0 +1,23 @@
+#ifndef JMLANG_OPTIMIZER_DEINTERLEAVE_H
+#define JMLANG_OPTIMIZER_DEINTERLEAVE_H
+
+#include "jmlang/IR/IR.h"
+
+namespace jmlang {
+namespace internal {
+
+/// Turn accesses to interleaved data, like the channels of packed rgb
+/// or rgba images, into dense vector loads and stores. Vector loads
+/// with a stride of 2, 3 or 4 from the same buffer in one statement,
+/// whose indices differ by constants, share a single dense load of
+/// the span they cover, and each picks out its lanes with a
+/// shuffle_vector. A run of stores to every channel of the same
+/// pixels becomes one dense store of the values combined with
+/// interleave_vectors. Must run after vectorization and storage
+/// flattening.
+Stmt rewrite_interleavings(Stmt s);
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_OPTIMIZER_DEINTERLEAVE_H
\ No newline at end of file
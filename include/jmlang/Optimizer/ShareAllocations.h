@@ -0,0 +1,27 @@
+#ifndef JMLANG_OPTIMIZER_SHARE_ALLOCATIONS_H
+#define JMLANG_OPTIMIZER_SHARE_ALLOCATIONS_H
+
+#include "jmlang/IR/IR.h"
+
+namespace jmlang {
+namespace internal {
+
+/// Place buffers whose lifetimes don't overlap in the same memory.
+/// Computes the live range of each Allocate that is not inside a loop,
+/// from the first to the last Load or Store of it, and colors the
+/// interference graph the way a register allocator would. Each color
+/// becomes a slot, 64-byte aligned, in a single arena allocated at the
+/// top of the statement. Loads and Stores of the shared buffers are
+/// rewritten to address the arena. Buffers whose address escapes
+/// (e.g. to an extern stage), or whose size depends on something
+/// defined inside the statement, keep their own allocation. The arena
+/// is indexed with 32-bit ints, so nothing is shared if the sizes are
+/// known to add up to more than 2^31 bytes, and otherwise the
+/// statement fails an assertion if they do. Must run after storage
+/// flattening.
+Stmt share_allocations(Stmt s);
+
+}  // namespace internal
+}  // namespace jmlang
+
+#endif  // JMLANG_OPTIMIZER_SHARE_ALLOCATIONS_H
\ No newline at end of file
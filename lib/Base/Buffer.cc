@@ -0,0 +1,22 @@
+#include "jmlang/Base/Buffer.h"
+
+namespace jmlang {
+namespace internal {
+
+template <>
+RefCount& ref_count<BufferContents>(const BufferContents* p) {
+  return p->ref_count;
+}
+
+template <>
+void destroy<BufferContents>(const BufferContents* p) {
+  // Free any device-side allocation.
+  if (p->source_module.free_dev_buffer && p->buf.dev) {
+    p->source_module.free_dev_buffer(const_cast<buffer_t*>(&p->buf));
+  }
+  free(p->allocation);
+  delete p;
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "jmlang/Base/Target.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#include "jmlang/JIT/LLVMHeaders.h"
+
+namespace jmlang {
+
+using std::string;
+
+namespace {
+
+const char* const os_names[] = {"unknown", "linux", "osx", "windows"};
+
+const char* const arch_names[] = {"unknown", "x86"};
+
+const char* const feature_names[] = {
+    "sse41", "avx", "avx2", "fma", "f16c", "avx512", "no_asserts",
+    "fp_contract", "fast_math"};
+
+}  // namespace
+
+int Target::natural_vector_size(Type t) const {
+  int bytes;
+  if (has_feature(AVX512)) {
+    bytes = 64;
+  } else if (has_feature(AVX2) || (has_feature(AVX) && t.is_float())) {
+    // Avx only widened the floating-point instructions.
+    bytes = 32;
+  } else {
+    bytes = 16;
+  }
+  return bytes / t.bytes();
+}
+
+string Target::to_string() const {
+  string result = string(arch_names[arch]) + "-" +
+                  (bits == 32 ? "32" : bits == 64 ? "64" : "0") + "-" +
+                  os_names[os];
+  for (int i = 0; i < FeatureEnd; i++) {
+    if (has_feature((Feature)i)) {
+      result += string("-") + feature_names[i];
+    }
+  }
+  return result;
+}
+
+Target get_host_target() {
+  static Target host = []() {
+    llvm::Triple triple(llvm::sys::getProcessTriple());
+    Target t;
+    if (triple.isOSLinux()) {
+      t.os = Target::Linux;
+    } else if (triple.isMacOSX()) {
+      t.os = Target::OSX;
+    } else if (triple.isOSWindows()) {
+      t.os = Target::Windows;
+    }
+    if (triple.isX86()) {
+      t.arch = Target::X86;
+    }
+    t.bits = triple.isArch64Bit() ? 64 : 32;
+
+    llvm::StringMap<bool> features;
+    if (!llvm::sys::getHostCPUFeatures(features)) {
+      return t;
+    }
+    const struct {
+      Target::Feature feature;
+      const char* llvm_names[5];
+    } host_features[] = {
+        {Target::SSE41, {"sse4.1"}},
+        {Target::AVX, {"avx"}},
+        {Target::AVX2, {"avx2"}},
+        {Target::FMA, {"fma"}},
+        {Target::F16C, {"f16c"}},
+        {Target::AVX512,
+         {"avx512f", "avx512cd", "avx512bw", "avx512dq", "avx512vl"}}};
+    for (size_t i = 0; i < sizeof(host_features) / sizeof(host_features[0]);
+         i++) {
+      bool has = true;
+      for (int j = 0; j < 5 && host_features[i].llvm_names[j]; j++) {
+        has = has && features.lookup(host_features[i].llvm_names[j]);
+      }
+      if (has) {
+        t = t.with_feature(host_features[i].feature);
+      }
+    }
+    return t;
+  }();
+  return host;
+}
+
+Target parse_target_string(const string& s) {
+  Target t;
+  bool has_os = false, has_arch = false, has_bits = false;
+  size_t start = 0;
+  while (start <= s.size()) {
+    size_t end = s.find('-', start);
+    if (end == string::npos) {
+      end = s.size();
+    }
+    string token = s.substr(start, end - start);
+    start = end + 1;
+
+    bool known = false;
+    if (token == "host" && !has_os && !has_arch && !has_bits) {
+      t = get_host_target();
+      has_os = has_arch = has_bits = known = true;
+    } else if ((token == "32" || token == "64") && !has_bits) {
+      t.bits = token == "32" ? 32 : 64;
+      has_bits = known = true;
+    }
+    for (int i = 1; i < 4 && !known; i++) {
+      if (token == os_names[i] && !has_os) {
+        t.os = (Target::OS)i;
+        has_os = known = true;
+      }
+    }
+    for (int i = 1; i < 2 && !known; i++) {
+      if (token == arch_names[i] && !has_arch) {
+        t.arch = (Target::Arch)i;
+        has_arch = known = true;
+      }
+    }
+    for (int i = 0; i < Target::FeatureEnd && !known; i++) {
+      if (token == feature_names[i]) {
+        t = t.with_feature((Target::Feature)i);
+        known = true;
+      }
+    }
+    if (!known) {
+      std::cerr << "Did not understand \"" << token << "\" in target string "
+                << s << ". Targets look like x86-64-linux-avx2, or "
+                << "host-no_asserts. The features are:";
+      for (int i = 0; i < Target::FeatureEnd; i++) {
+        std::cerr << " " << feature_names[i];
+      }
+      std::cerr << "\n";
+      assert(false);
+    }
+  }
+  if (!has_os || !has_arch || !has_bits) {
+    std::cerr << "Target string " << s
+              << " must give the architecture, word size and operating "
+              << "system, as in x86-64-linux, or start with host\n";
+    assert(false);
+  }
+  return t;
+}
+
+Target get_target_from_environment() {
+  const char* target = getenv("JMLANG_TARGET");
+  return target ? parse_target_string(target) : get_host_target();
+}
+
+Target get_jit_target_from_environment() {
+  const char* target = getenv("JMLANG_JIT_TARGET");
+  if (!target) {
+    return get_host_target();
+  }
+  Target t = parse_target_string(target);
+  Target host = get_host_target();
+  if (t.os != host.os || t.arch != host.arch || t.bits != host.bits) {
+    std::cerr << "Can't jit compile for " << t.to_string() << " on "
+              << host.to_string() << "\n";
+    assert(false);
+  }
+  return t;
+}
+
+}  // namespace jmlang
\ No newline at end of file
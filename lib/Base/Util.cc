@@ -46,7 +46,7 @@ string int_to_string(int x) {
   // to the dimensions of some buffer. So this gets called with 0,
   // 1, 2, and 3 a lot, and it's worth optimizing those cases.
   static const string small_ints[] = {"0", "1", "2", "3", "4", "5", "6", "7"};
-  if (x < 8)
+  if (x >= 0 && x < 8)
     return small_ints[x];
   ostringstream ss;
   ss << x;
@@ -0,0 +1,2022 @@
+#include "jmlang/CodeGen/CodeGen.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+
+#include "jmlang/Base/Debug.h"
+#include "jmlang/CodeGen/Runtime.h"
+#include "jmlang/IR/ExprCall.h"
+#include "jmlang/IR/ExprVariable.h"
+#include "jmlang/IR/IROperator.h"
+#include "jmlang/IR/IRPrinter.h"
+#include "jmlang/JIT/LLVMHeaders.h"
+#include "jmlang/Optimizer/Bounds.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::map;
+using std::ostringstream;
+using std::set;
+using std::string;
+using std::vector;
+
+using llvm::BasicBlock;
+using llvm::Value;
+
+namespace {
+
+/// The indices of the fields of buffer_t, in the order declared in
+/// buffer_t.h.
+enum BufferField {
+  BufferDev = 0,
+  BufferHost,
+  BufferExtent,
+  BufferStride,
+  BufferMin,
+  BufferElemSize,
+  BufferHostDirty,
+  BufferDevDirty
+};
+
+/// The llvm triple for a target. Targets matching the host use the
+/// host's exact triple.
+string llvm_triple(const Target& t) {
+  Target host = get_host_target();
+  if (t.os == host.os && t.arch == host.arch && t.bits == host.bits) {
+    return llvm::sys::getProcessTriple();
+  }
+  if (t.arch != Target::X86) {
+    std::cerr << "Can't generate code for " << t.to_string() << "\n";
+    assert(false);
+  }
+  string triple = t.bits == 32 ? "i386" : "x86_64";
+  switch (t.os) {
+    case Target::Linux:
+      return triple + "-unknown-linux-gnu";
+    case Target::OSX:
+      return triple + "-apple-macosx";
+    case Target::Windows:
+      return triple + "-pc-windows-msvc";
+    default:
+      return triple + "-unknown-unknown";
+  }
+}
+
+/// Make a target machine for a target. The cpu is the baseline for
+/// the architecture, with the target's features turned on.
+std::unique_ptr<llvm::TargetMachine> make_target_machine(const Target& t) {
+  string triple = llvm_triple(t);
+  string error;
+  const llvm::Target* target =
+      llvm::TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    std::cerr << "Could not find llvm target for " << triple << ": " << error
+              << "\n";
+    assert(false);
+  }
+
+  llvm::SubtargetFeatures features;
+  const struct {
+    Target::Feature feature;
+    const char* llvm_names;
+  } target_features[] = {
+      {Target::SSE41, "+sse4.1"},
+      {Target::AVX, "+avx"},
+      {Target::AVX2, "+avx2"},
+      {Target::FMA, "+fma"},
+      {Target::F16C, "+f16c"},
+      {Target::AVX512,
+       "+avx512f,+avx512cd,+avx512bw,+avx512dq,+avx512vl"}};
+  for (size_t i = 0; i < sizeof(target_features) / sizeof(target_features[0]);
+       i++) {
+    if (t.has_feature(target_features[i].feature)) {
+      features.AddFeature(target_features[i].llvm_names);
+    }
+  }
+  string cpu = t.bits == 32 ? "pentium4" : "x86-64";
+
+  llvm::TargetOptions options;
+  return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+      triple, cpu, features.getString(), options, llvm::Reloc::PIC_,
+      llvm::None, llvm::CodeGenOpt::Aggressive));
+}
+
+/// The largest power of two, up to 64, known to divide an integer
+/// expression.
+int known_power_of_two_factor(Expr e) {
+  if (const IntImm* imm = e.as<IntImm>()) {
+    int f = 1;
+    while (f < 64 && imm->value % (f * 2) == 0) {
+      f *= 2;
+    }
+    return f;
+  } else if (const Add* add = e.as<Add>()) {
+    return std::min(known_power_of_two_factor(add->a),
+                    known_power_of_two_factor(add->b));
+  } else if (const Sub* sub = e.as<Sub>()) {
+    return std::min(known_power_of_two_factor(sub->a),
+                    known_power_of_two_factor(sub->b));
+  } else if (const Mul* mul = e.as<Mul>()) {
+    return std::min(64, known_power_of_two_factor(mul->a) *
+                            known_power_of_two_factor(mul->b));
+  }
+  return 1;
+}
+
+/// Find the names that a statement refers to that might be defined
+/// outside of it. Buffers are referred to by name.host.
+class FindReferencedNames : public IRGraphVisitor {
+ public:
+  set<string> names;
+
+ private:
+  using IRGraphVisitor::visit;
+
+  void visit(const Variable* op) { names.insert(op->name); }
+
+  void visit(const Load* op) {
+    IRGraphVisitor::visit(op);
+    names.insert(op->name + ".host");
+  }
+
+  void visit(const Store* op) {
+    IRGraphVisitor::visit(op);
+    names.insert(op->name + ".host");
+  }
+};
+
+/// If an integer expression is a value of the type t widened without
+/// changing it, or a constant that t can hold, return it as a value
+/// of type t. Otherwise return an undefined Expr.
+Expr narrow(Expr e, Type t) {
+  Type wide = e.type();
+  if (const Broadcast* b = e.as<Broadcast>()) {
+    Expr value = narrow(b->value, t.element_of());
+    return value.defined() ? Broadcast::make(value, b->width) : Expr();
+  }
+  const Cast* c = e.as<Cast>();
+  if (c && c->value.type() == t && wide.bits > t.bits &&
+      (t.is_uint() || wide.is_int())) {
+    return c->value;
+  }
+  // Constants are IntImms, or casts of them to other integer types.
+  const int* value = as_const_int(c ? c->value : e);
+  if (value && t.is_scalar() && !(wide.is_uint() && *value < 0) &&
+      *value >= t.imin() && *value <= t.imax()) {
+    return make_const(t, *value);
+  }
+  return Expr();
+}
+
+/// Strip the min and max with constants from around an expression,
+/// recording the bounds they clamp it to. Stops at a second min or
+/// max on the same side.
+Expr strip_clamp(Expr e, Expr* lo, Expr* hi) {
+  while (true) {
+    Expr a, b, *bound;
+    if (const Min* op = e.as<Min>()) {
+      a = op->a, b = op->b, bound = hi;
+    } else if (const Max* op = e.as<Max>()) {
+      a = op->a, b = op->b, bound = lo;
+    } else {
+      return e;
+    }
+    if (is_const(a)) {
+      std::swap(a, b);
+    }
+    if (!is_const(b) || bound->defined()) {
+      return e;
+    }
+    *bound = b;
+    e = a;
+  }
+}
+
+/// Whether e is a / 2^bits or a >> bits, and if so, set a.
+bool is_shift_right(Expr e, int bits, Expr* a) {
+  int b;
+  if (const Div* div = e.as<Div>()) {
+    if (is_const_power_of_two(div->b, &b) && b == bits) {
+      *a = div->a;
+      return true;
+    }
+  } else if (const Call* call = e.as<Call>()) {
+    if (call->call_type == Call::Intrinsic &&
+        call->name == Call::shift_right && is_const(call->args[1], bits)) {
+      *a = call->args[0];
+      return true;
+    }
+  }
+  return false;
+}
+
+/// The stride of an interleaved load: a constant 2, 3 or 4. Zero for
+/// other strides.
+int small_stride(Expr stride) {
+  const int* s = as_const_int(stride);
+  return s && *s >= 2 && *s <= 4 ? *s : 0;
+}
+
+/// Whether every lane of a vector index lies in a window of at most
+/// 256 elements, and if so, set base to its first element, offsets to
+/// each lane's offset from base, and size to the window's size. The
+/// window is either constant, because the index is clamped, masked or
+/// narrow, as in a table lookup, or it is a ramp divided by a
+/// constant, as in an upsampling x / 2. Only the lanes of the second
+/// kind can miss the end of the window, so for it, also set extent to
+/// the number of elements they really span; it's undefined otherwise.
+bool small_window(Expr index, Expr* base, Expr* offsets, int* size,
+                  Expr* extent) {
+  const int max_size = 256;
+  int width = index.type().width;
+  if (index.type() != Int(32, width)) {
+    return false;
+  }
+  Interval bounds = bounds_of_expr_in_scope(index, Scope<Interval>());
+  if (bounds.is_bounded() && bounds.extent() <= max_size) {
+    *base = (int)bounds.min;
+    *size = (int)bounds.extent();
+    *extent = Expr();
+  } else {
+    // (ramp / k) + c, with a non-negative stride.
+    Expr e = index;
+    Expr c = 0;
+    while (const Add* add = e.as<Add>()) {
+      const Broadcast* b = add->b.as<Broadcast>();
+      if (!b) {
+        break;
+      }
+      c = c + b->value;
+      e = add->a;
+    }
+    const Div* div = e.as<Div>();
+    const Ramp* ramp = div ? div->a.as<Ramp>() : NULL;
+    const Broadcast* k = div ? div->b.as<Broadcast>() : NULL;
+    const int* stride = ramp ? as_const_int(ramp->stride) : NULL;
+    const int* factor = k ? as_const_int(k->value) : NULL;
+    if (!stride || !factor || *stride < 0 || *factor <= 0) {
+      return false;
+    }
+    // Division rounds down, so lane i is base + (r + stride * i) / k,
+    // where r is the ramp's base mod k. That is never negative, so it
+    // can be divided as unsigned, which is cheaper.
+    *base = ramp->base / *factor + c;
+    *size = (*factor - 1 + *stride * (width - 1)) / *factor + 1;
+    *extent = (ramp->base + *stride * (width - 1)) / *factor -
+              ramp->base / *factor + 1;
+    Expr r = Broadcast::make(ramp->base % *factor, width);
+    Expr divisor = Broadcast::make(make_const(UInt(32), *factor), width);
+    *offsets = cast(Int(32, width),
+                    cast(UInt(32, width), r + Ramp::make(0, *stride, width)) /
+                        divisor);
+    return *size <= max_size;
+  }
+  *offsets = index - Broadcast::make(*base, width);
+  return true;
+}
+
+int vector_width(Value* v) {
+  if (llvm::FixedVectorType* vt =
+          llvm::dyn_cast<llvm::FixedVectorType>(v->getType())) {
+    return (int)vt->getNumElements();
+  }
+  return 1;
+}
+
+}  // namespace
+
+CodeGen::CodeGen(const Target& t)
+    : target(t),
+      module(NULL),
+      function(NULL),
+      context(NULL),
+      builder(NULL),
+      value(NULL),
+      void_t(NULL),
+      i1(NULL),
+      i8(NULL),
+      i16(NULL),
+      i32(NULL),
+      i64(NULL),
+      f16(NULL),
+      f32(NULL),
+      f64(NULL),
+      buffer_t_type(NULL),
+      float_mode(FloatDefault) {
+  initialize_llvm();
+}
+
+CodeGen::~CodeGen() {
+  delete builder;
+  delete module;
+  delete context;
+}
+
+void CodeGen::initialize_llvm() {
+  // Function-local statics are initialized exactly once, even with
+  // multiple threads.
+  static bool initialized = []() {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+    return true;
+  }();
+  (void)initialized;
+}
+
+void CodeGen::compile(Stmt stmt, string name, const vector<Argument>& args) {
+  delete builder;
+  delete module;
+  delete context;
+  context = new llvm::LLVMContext;
+  module = new llvm::Module(name, *context);
+  builder = new llvm::IRBuilder<>(*context);
+  function_name_ = name;
+
+  std::unique_ptr<llvm::TargetMachine> machine = make_target_machine(target);
+  module->setTargetTriple(machine->getTargetTriple().str());
+  module->setDataLayout(machine->createDataLayout());
+
+  void_t = llvm::Type::getVoidTy(*context);
+  i1 = llvm::Type::getInt1Ty(*context);
+  i8 = llvm::Type::getInt8Ty(*context);
+  i16 = llvm::Type::getInt16Ty(*context);
+  i32 = llvm::Type::getInt32Ty(*context);
+  i64 = llvm::Type::getInt64Ty(*context);
+  f16 = llvm::Type::getHalfTy(*context);
+  f32 = llvm::Type::getFloatTy(*context);
+  f64 = llvm::Type::getDoubleTy(*context);
+
+  llvm::Type* dims = llvm::ArrayType::get(i32, 4);
+  buffer_t_type = llvm::StructType::create(
+      *context,
+      {i64, i8->getPointerTo(), dims, dims, dims, i32, i8, i8},
+      "struct.buffer_t");
+
+  // The pipeline function itself.
+  vector<llvm::Type*> arg_types(args.size());
+  for (size_t i = 0; i < args.size(); i++) {
+    arg_types[i] = args[i].is_buffer ? buffer_t_type->getPointerTo()
+                                     : llvm_type_of(args[i].type);
+  }
+  llvm::FunctionType* func_t = llvm::FunctionType::get(i32, arg_types, false);
+  function = llvm::Function::Create(
+      func_t, llvm::GlobalValue::ExternalLinkage, name, module);
+  function->addFnAttr(llvm::Attribute::NoUnwind);
+
+  BasicBlock* entry = BasicBlock::Create(*context, "entry", function);
+  builder->SetInsertPoint(entry);
+  set_float_mode(target.float_mode());
+
+  symbol_table = Scope<Value*>();
+  allocations = Scope<Allocation>();
+  size_t i = 0;
+  for (llvm::Function::arg_iterator arg = function->arg_begin();
+       arg != function->arg_end(); ++arg, ++i) {
+    if (args[i].is_buffer) {
+      arg->setName(args[i].name + ".buffer");
+      function->addParamAttr(i, llvm::Attribute::NoCapture);
+      unpack_buffer(args[i].name, iterator_to_pointer(arg));
+    } else {
+      if (args[i].type.is_bool()) {
+        function->addParamAttr(i, llvm::Attribute::ZExt);
+      }
+      sym_push(args[i].name, iterator_to_pointer(arg));
+    }
+  }
+
+  debug(1) << "Generating llvm bitcode for " << name << "...\n";
+  codegen(stmt);
+  builder->CreateRet(llvm::ConstantInt::get(i32, 0));
+  symbol_table = Scope<Value*>();
+
+  // A wrapper that takes its arguments as an array of pointers, so
+  // that it can be called without knowing the signature.
+  llvm::Type* void_ptr = i8->getPointerTo();
+  llvm::FunctionType* wrapper_t =
+      llvm::FunctionType::get(i32, {void_ptr->getPointerTo()}, false);
+  llvm::Function* wrapper =
+      llvm::Function::Create(wrapper_t, llvm::GlobalValue::ExternalLinkage,
+                             name + "_jit_wrapper", module);
+  wrapper->addFnAttr(llvm::Attribute::NoUnwind);
+  builder->SetInsertPoint(BasicBlock::Create(*context, "entry", wrapper));
+  Value* arg_array = iterator_to_pointer(wrapper->arg_begin());
+  vector<Value*> wrapper_args(args.size());
+  for (size_t i = 0; i < args.size(); i++) {
+    Value* ptr = builder->CreateLoad(
+        void_ptr, builder->CreateConstGEP1_32(void_ptr, arg_array, i));
+    if (args[i].is_buffer) {
+      wrapper_args[i] =
+          builder->CreatePointerCast(ptr, buffer_t_type->getPointerTo());
+    } else {
+      llvm::Type* t = llvm_storage_type_of(args[i].type);
+      Value* v = builder->CreateLoad(
+          t, builder->CreatePointerCast(ptr, t->getPointerTo()));
+      if (args[i].type.is_bool()) {
+        v = builder->CreateICmpNE(v, llvm::ConstantInt::get(i8, 0));
+      }
+      wrapper_args[i] = v;
+    }
+  }
+  builder->CreateRet(builder->CreateCall(function, wrapper_args));
+
+  // Record the target on each function, so that it is kept if the
+  // module is linked with modules for other targets. Code that will
+  // run on the host is tuned for the host's cpu.
+  bool for_host = llvm_triple(target) == llvm::sys::getProcessTriple();
+  for (llvm::Module::iterator f = module->begin(); f != module->end(); ++f) {
+    if (!f->isDeclaration()) {
+      f->addFnAttr("target-cpu", machine->getTargetCPU());
+      f->addFnAttr("target-features", machine->getTargetFeatureString());
+      if (for_host) {
+        f->addFnAttr("tune-cpu", llvm::sys::getHostCPUName());
+      }
+    }
+  }
+
+  if (llvm::verifyModule(*module, &llvm::errs())) {
+    std::cerr << "Generated llvm module for " << name << " is invalid\n";
+    module->print(llvm::errs(), NULL);
+    assert(false);
+  }
+  optimize_module();
+
+  if (debug::debug_level >= 3) {
+    module->print(llvm::errs(), NULL);
+  }
+}
+
+void CodeGen::optimize_module() {
+  std::unique_ptr<llvm::TargetMachine> machine = make_target_machine(target);
+
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  llvm::PipelineTuningOptions options;
+  options.LoopVectorization = true;
+  options.SLPVectorization = true;
+  llvm::PassBuilder pb(machine.get(), options);
+  pb.registerModuleAnalyses(mam);
+  pb.registerCGSCCAnalyses(cgam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+  llvm::ModulePassManager mpm =
+      pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+  mpm.run(*module, mam);
+}
+
+void CodeGen::compile_to_bitcode(const string& filename) {
+  assert(module && "No module to write. Call compile first.");
+  std::error_code error;
+  llvm::raw_fd_ostream out(filename, error, llvm::sys::fs::OF_None);
+  if (error) {
+    std::cerr << "Could not open " << filename << ": " << error.message()
+              << "\n";
+    assert(false);
+  }
+  llvm::WriteBitcodeToFile(*module, out);
+}
+
+void CodeGen::compile_module_to_native(llvm::Module* m,
+                                       const string& filename, bool assembly,
+                                       const Target& t) {
+  std::unique_ptr<llvm::TargetMachine> target = make_target_machine(t);
+  m->setTargetTriple(target->getTargetTriple().str());
+  m->setDataLayout(target->createDataLayout());
+
+  std::error_code error;
+  llvm::raw_fd_ostream out(filename, error, llvm::sys::fs::OF_None);
+  if (error) {
+    std::cerr << "Could not open " << filename << ": " << error.message()
+              << "\n";
+    assert(false);
+  }
+  llvm::legacy::PassManager pm;
+  if (target->addPassesToEmitFile(pm, out, NULL,
+                                  assembly ? llvm::CGFT_AssemblyFile
+                                           : llvm::CGFT_ObjectFile)) {
+    std::cerr << "llvm can't emit a file of this type for the host\n";
+    assert(false);
+  }
+  pm.run(*m);
+}
+
+void CodeGen::compile_to_native(const string& filename, bool assembly) {
+  assert(module && "No module to compile. Call compile first.");
+  // Work on a copy, so that the module can still be used for other
+  // kinds of output.
+  std::unique_ptr<llvm::Module> m = llvm::CloneModule(*module);
+  add_runtime_hooks(m.get(), true);
+  compile_module_to_native(m.get(), filename, assembly, target);
+}
+
+void CodeGen::compile_runtime_to_native(const string& filename) {
+  initialize_llvm();
+  llvm::LLVMContext context;
+  llvm::Module m("jmlang_runtime", context);
+  add_default_runtime(&m);
+  // The runtime goes with code for any cpu of the architecture.
+  Target t = get_target_from_environment();
+  compile_module_to_native(&m, filename, false,
+                           Target(t.os, t.arch, t.bits));
+}
+
+llvm::Module* CodeGen::release_module() {
+  assert(module && "No module to release. Call compile first.");
+  llvm::Module* m = module;
+  delete builder;
+  builder = NULL;
+  module = NULL;
+  context = NULL;
+  return m;
+}
+
+JITModule CodeGen::compile_to_function_pointers(const string& object_path) {
+  assert(module && "No module to compile. Call compile first.");
+  JITModule m;
+  // The JITModule takes ownership of the module and its context.
+  delete builder;
+  builder = NULL;
+  m.compile_module(module, function_name_, object_path);
+  module = NULL;
+  context = NULL;
+  return m;
+}
+
+void CodeGen::sym_push(const string& name, Value* v) {
+  if (!llvm::isa<llvm::Constant>(v)) {
+    v->setName(name);
+  }
+  symbol_table.push(name, v);
+}
+
+void CodeGen::sym_pop(const string& name) { symbol_table.pop(name); }
+
+Value* CodeGen::sym_get(const string& name, bool must_succeed) {
+  if (!symbol_table.contains(name)) {
+    if (must_succeed) {
+      std::cerr << "Symbol not found: " << name << "\n"
+                << "The following names are in scope:\n"
+                << symbol_table << "\n";
+      assert(false);
+    }
+    return NULL;
+  }
+  return symbol_table.get(name);
+}
+
+Value* CodeGen::codegen(Expr e) {
+  assert(e.defined() && "Codegen of undefined expression");
+  value = NULL;
+  e.accept(this);
+  assert(value && "Codegen of expression did not produce a value");
+  return value;
+}
+
+void CodeGen::codegen(Stmt s) {
+  assert(s.defined() && "Codegen of undefined statement");
+  value = NULL;
+  s.accept(this);
+}
+
+llvm::Type* CodeGen::llvm_type_of(Type t) {
+  llvm::Type* scalar;
+  if (t.is_float()) {
+    switch (t.bits) {
+      case 16:
+        scalar = f16;
+        break;
+      case 32:
+        scalar = f32;
+        break;
+      case 64:
+        scalar = f64;
+        break;
+      default:
+        assert(false && "There is no llvm type matching this floating-point "
+                        "bit width");
+        return NULL;
+    }
+  } else if (t.is_handle()) {
+    scalar = i8->getPointerTo();
+  } else {
+    scalar = llvm::IntegerType::get(*context, t.bits);
+  }
+  if (t.is_vector()) {
+    return llvm::FixedVectorType::get(scalar, t.width);
+  }
+  return scalar;
+}
+
+llvm::Type* CodeGen::llvm_storage_type_of(Type t) {
+  if (t.is_bool()) {
+    return llvm_type_of(UInt(8, t.width));
+  }
+  return llvm_type_of(t);
+}
+
+Value* CodeGen::llvm_constant(Type t, int64_t v) {
+  llvm::Type* type = llvm_type_of(t);
+  if (t.is_float()) {
+    return llvm::ConstantFP::get(type, (double)v);
+  } else if (t.is_handle()) {
+    assert(v == 0 && "The only handle constant is NULL");
+    return llvm::ConstantPointerNull::get(
+        llvm::cast<llvm::PointerType>(type->getScalarType()));
+  }
+  return llvm::ConstantInt::get(type, (uint64_t)v, t.is_int());
+}
+
+void CodeGen::unpack_buffer(const string& name, Value* buffer) {
+  sym_push(name + ".buffer", buffer);
+  sym_push(name + ".dev", builder->CreateLoad(
+                              i64, buffer_field_ptr(buffer, BufferDev)));
+  sym_push(name + ".host",
+           builder->CreateLoad(i8->getPointerTo(),
+                               buffer_field_ptr(buffer, BufferHost)));
+  for (int i = 0; i < 4; i++) {
+    string d = int_to_string(i);
+    sym_push(name + ".min." + d,
+             builder->CreateLoad(i32, buffer_field_ptr(buffer, BufferMin, i)));
+    sym_push(name + ".extent." + d,
+             builder->CreateLoad(i32,
+                                 buffer_field_ptr(buffer, BufferExtent, i)));
+    sym_push(name + ".stride." + d,
+             builder->CreateLoad(i32,
+                                 buffer_field_ptr(buffer, BufferStride, i)));
+  }
+  sym_push(name + ".elem_size",
+           builder->CreateLoad(i32, buffer_field_ptr(buffer, BufferElemSize)));
+  Value* zero = llvm::ConstantInt::get(i8, 0);
+  sym_push(name + ".host_dirty",
+           builder->CreateICmpNE(
+               builder->CreateLoad(i8,
+                                   buffer_field_ptr(buffer, BufferHostDirty)),
+               zero));
+  sym_push(name + ".dev_dirty",
+           builder->CreateICmpNE(
+               builder->CreateLoad(i8,
+                                   buffer_field_ptr(buffer, BufferDevDirty)),
+               zero));
+}
+
+Value* CodeGen::buffer_field_ptr(Value* buffer, int field, int dim) {
+  Value* ptr =
+      builder->CreateConstInBoundsGEP2_32(buffer_t_type, buffer, 0, field);
+  if (dim >= 0) {
+    ptr = builder->CreateConstInBoundsGEP2_32(llvm::ArrayType::get(i32, 4), ptr,
+                                              0, dim);
+  }
+  return ptr;
+}
+
+Value* CodeGen::codegen_buffer_pointer(const string& buffer, Type type,
+                                       Value* index) {
+  llvm::Type* elem = llvm_storage_type_of(type.element_of());
+  Value* base = sym_get(buffer + ".host");
+  base = builder->CreatePointerCast(base, elem->getPointerTo());
+  return builder->CreateInBoundsGEP(elem, base, index);
+}
+
+int CodeGen::alignment_of(const string& buffer, Type type, Expr index) {
+  // Allocations are aligned to 32 bytes. Input buffers are only
+  // assumed to be aligned to their element size.
+  int bytes = type.element_of().bytes();
+  int base = allocations.contains(buffer) ? 32 : bytes;
+  return std::min(base, known_power_of_two_factor(index) * bytes);
+}
+
+Value* CodeGen::create_alloca_at_entry(llvm::Type* type, int n,
+                                       const string& name) {
+  BasicBlock* here = builder->GetInsertBlock();
+  BasicBlock::iterator point = builder->GetInsertPoint();
+  BasicBlock* entry = &function->getEntryBlock();
+  builder->SetInsertPoint(entry, entry->getFirstInsertionPt());
+  llvm::AllocaInst* ptr =
+      builder->CreateAlloca(type, llvm::ConstantInt::get(i32, n), name);
+  ptr->setAlignment(llvm::Align(32));
+  builder->SetInsertPoint(here, point);
+  return ptr;
+}
+
+llvm::Function* CodeGen::get_function(const string& name, llvm::Type* ret,
+                                      const vector<llvm::Type*>& args) {
+  llvm::Function* f = module->getFunction(name);
+  if (!f) {
+    llvm::FunctionType* t = llvm::FunctionType::get(ret, args, false);
+    f = llvm::Function::Create(t, llvm::GlobalValue::ExternalLinkage, name,
+                               module);
+  }
+  return f;
+}
+
+void CodeGen::return_with_error_code(Value* error_code) {
+  llvm::Function* free_fn =
+      get_function("jmlang_free", void_t, {i8->getPointerTo()});
+  for (Scope<Allocation>::const_iterator iter = allocations.cbegin();
+       iter != allocations.cend(); ++iter) {
+    Allocation a = iter.value();
+    if (a.on_heap) {
+      builder->CreateCall(free_fn, {a.ptr});
+    }
+  }
+  builder->CreateRet(error_code);
+}
+
+void CodeGen::create_assertion(Value* condition, const string& message,
+                               int error_code) {
+  BasicBlock* success =
+      BasicBlock::Create(*context, "assert_success", function);
+  BasicBlock* failure =
+      BasicBlock::Create(*context, "assert_failure", function);
+  llvm::MDBuilder md(*context);
+  builder->CreateCondBr(condition, success, failure,
+                        md.createBranchWeights(1 << 20, 1));
+
+  builder->SetInsertPoint(failure);
+  llvm::Function* error_fn =
+      get_function("jmlang_error", void_t, {i8->getPointerTo()});
+  builder->CreateCall(error_fn, {builder->CreateGlobalStringPtr(message)});
+  return_with_error_code(llvm::ConstantInt::get(i32, error_code, true));
+
+  builder->SetInsertPoint(success);
+}
+
+Value* CodeGen::slice_vector(Value* vec, int start, int size) {
+  int width = vector_width(vec);
+  if (!vec->getType()->isVectorTy()) {
+    vec = builder->CreateInsertElement(
+        llvm::UndefValue::get(llvm::FixedVectorType::get(vec->getType(), 1)),
+        vec, (uint64_t)0);
+  }
+  vector<int> mask(size);
+  for (int i = 0; i < size; i++) {
+    mask[i] = start + i < width ? start + i : -1;
+  }
+  return builder->CreateShuffleVector(vec, mask);
+}
+
+Value* CodeGen::concat_vectors(const vector<Value*>& v) {
+  assert(!v.empty() && "Concatenation of no vectors");
+  vector<Value*> vecs = v;
+  while (vecs.size() > 1) {
+    vector<Value*> next;
+    for (size_t i = 0; i + 1 < vecs.size(); i += 2) {
+      // The two arguments to a shuffle must have the same type, so
+      // pad the narrower one out with undefined lanes.
+      int wa = vector_width(vecs[i]), wb = vector_width(vecs[i + 1]);
+      int w = std::max(wa, wb);
+      Value* a = slice_vector(vecs[i], 0, w);
+      Value* b = slice_vector(vecs[i + 1], 0, w);
+      vector<int> mask(wa + wb);
+      for (int j = 0; j < wa; j++) {
+        mask[j] = j;
+      }
+      for (int j = 0; j < wb; j++) {
+        mask[wa + j] = w + j;
+      }
+      next.push_back(builder->CreateShuffleVector(a, b, mask));
+    }
+    if (vecs.size() % 2) {
+      next.push_back(vecs.back());
+    }
+    vecs.swap(next);
+  }
+  return vecs[0];
+}
+
+void CodeGen::visit(const IntImm* op) {
+  value = llvm::ConstantInt::getSigned(i32, op->value);
+}
+
+void CodeGen::visit(const FloatImm* op) {
+  value = llvm::ConstantFP::get(f32, op->value);
+}
+
+void CodeGen::visit(const StringImm* op) {
+  value = builder->CreateGlobalStringPtr(op->value);
+}
+
+Value* CodeGen::codegen_window_load(const Load* op) {
+  Type t = op->type;
+  Expr base, offsets, extent;
+  int size;
+  if (!small_window(op->index, &base, &offsets, &size, &extent)) {
+    return NULL;
+  }
+
+  // The permute to use, how many lanes it makes, and how many
+  // elements it picks from. pshufb picks from 16 bytes in each 128
+  // bits, so a piece of the window is repeated across its lanes.
+  int bits = t.is_bool() ? 8 : t.bits;
+  string name;
+  int lanes = 0, piece_size = 0;
+  if (bits == 8 && target.has_feature(Target::AVX512)) {
+    name = "llvm.x86.avx512.pshuf.b.512", lanes = 64, piece_size = 16;
+  } else if (bits == 8 && target.has_feature(Target::AVX2)) {
+    name = "llvm.x86.avx2.pshuf.b", lanes = 32, piece_size = 16;
+  } else if (bits == 8 && target.has_feature(Target::SSE41)) {
+    name = "llvm.x86.ssse3.pshuf.b.128", lanes = 16, piece_size = 16;
+  } else if (bits == 16 && target.has_feature(Target::AVX512)) {
+    name = "llvm.x86.avx512.permvar.hi.512", lanes = 32;
+  } else if (bits == 32 && target.has_feature(Target::AVX512)) {
+    name = "llvm.x86.avx512.permvar.si.512", lanes = 16;
+  } else if (bits == 32 && target.has_feature(Target::AVX2)) {
+    name = "llvm.x86.avx2.permd", lanes = 8;
+  } else if (bits == 64 && target.has_feature(Target::AVX512)) {
+    name = "llvm.x86.avx512.permvar.di.512", lanes = 8;
+  } else {
+    return NULL;
+  }
+  if (!piece_size) {
+    piece_size = lanes;
+  }
+  // A window wider than the permute takes a permute, a compare and a
+  // blend per piece of it, which soon costs more than the gather. For
+  // bytes, the compare and blend are a saturating add and an or, and
+  // the wider pshufbs do 32 or 64 lanes at once, so a whole 256-entry
+  // table, in 16 pieces, is still cheaper than gathering bytes one by
+  // one.
+  int pieces = (size + piece_size - 1) / piece_size;
+  int max_pieces = bits == 8 && lanes > 16 ? 16 : 4;
+  if (pieces > max_pieces) {
+    return NULL;
+  }
+  // A window that may run past the lanes is loaded with a mask, so
+  // that it can't fault. Only avx512 has masked loads of small
+  // elements.
+  if (extent.defined() && bits < 32 && !target.has_feature(Target::AVX512)) {
+    return NULL;
+  }
+
+  // Masked loads of a power of two lanes are cheapest.
+  if (extent.defined()) {
+    int p = 1;
+    while (p < size) {
+      p *= 2;
+    }
+    size = p;
+  }
+  Type window = t.element_of().vector_of(size);
+  llvm::Type* storage = llvm_storage_type_of(window);
+  Value* ptr = codegen_buffer_pointer(op->name, t, codegen(base));
+  ptr = builder->CreatePointerCast(ptr, storage->getPointerTo());
+  llvm::Align align(alignment_of(op->name, t, base));
+  Value* table;
+  if (extent.defined()) {
+    Value* lane_ids = codegen(Ramp::make(0, 1, size));
+    Value* mask = builder->CreateICmpSLT(
+        lane_ids, builder->CreateVectorSplat(size, codegen(extent)));
+    table = builder->CreateMaskedLoad(storage, ptr, align, mask);
+  } else {
+    table = builder->CreateAlignedLoad(storage, ptr, align);
+  }
+  llvm::Type* int_type = llvm::IntegerType::get(*context, bits);
+  table = builder->CreateBitCast(
+      table, llvm::FixedVectorType::get(int_type, size));
+
+  llvm::Function* fn = llvm::Intrinsic::getDeclaration(
+      module, llvm::Function::lookupIntrinsicID(name));
+  Value* index = codegen(offsets);
+  vector<Value*> table_pieces;
+  for (int p = 0; p < pieces; p++) {
+    Value* piece = slice_vector(table, p * piece_size, piece_size);
+    vector<int> repeat(lanes);
+    for (int i = 0; i < lanes; i++) {
+      repeat[i] = i % piece_size;
+    }
+    table_pieces.push_back(builder->CreateShuffleVector(piece, repeat));
+  }
+  vector<Value*> results;
+  for (int i = 0; i < t.width; i += lanes) {
+    Value* idx = slice_vector(index, i, lanes);
+    Value* narrow_idx = builder->CreateIntCast(
+        idx, llvm::FixedVectorType::get(int_type, lanes), true);
+    Value* result = NULL;
+    for (int p = 0; p < pieces; p++) {
+      Value* piece_idx = builder->CreateSub(
+          narrow_idx, llvm_constant(Int(bits, lanes), p * piece_size));
+      if (bits == 8 && pieces > 1) {
+        // pshufb zeroes the lanes whose index has the top bit set.
+        // Adding 0x70 with unsigned saturation sets it exactly for
+        // the lanes outside this piece, which then or together.
+        piece_idx = builder->CreateBinaryIntrinsic(
+            llvm::Intrinsic::uadd_sat, piece_idx,
+            llvm_constant(UInt(8, lanes), 0x70));
+        Value* r = builder->CreateCall(fn, {table_pieces[p], piece_idx});
+        result = result ? builder->CreateOr(result, r) : r;
+        continue;
+      }
+      Value* r = builder->CreateCall(fn, {table_pieces[p], piece_idx});
+      if (result) {
+        Value* in_piece = builder->CreateICmpSGE(
+            idx, llvm_constant(Int(32, lanes), p * lanes));
+        result = builder->CreateSelect(in_piece, r, result);
+      } else {
+        result = r;
+      }
+    }
+    results.push_back(result);
+  }
+  Value* v = slice_vector(concat_vectors(results), 0, t.width);
+  return builder->CreateBitCast(v, llvm_storage_type_of(t));
+}
+
+Value* CodeGen::codegen_fast_div(const Expr& a, const Expr& b, bool mod) {
+  Type t = a.type();
+  if (t.is_float() || t.bits > 32) {
+    return NULL;
+  }
+  Expr d = b;
+  if (const Broadcast* broadcast = d.as<Broadcast>()) {
+    d = broadcast->value;
+  }
+  const int* c = as_const_int(d);
+  const Variable* param = d.as<Variable>();
+  if (c ? *c <= 0 || t.is_uint() : !param || !param->param.defined()) {
+    // llvm already divides unsigned integers by constants without a
+    // divide.
+    return NULL;
+  }
+
+  Value* va = codegen(a);
+  Value* vb = codegen(b);
+  Value* q;
+  if (t.is_uint()) {
+    q = codegen_udiv_by_invariant(va, codegen(d), t);
+  } else {
+    // Rounding down, a / b is the same as -a / -b, and for positive b
+    // and negative a, it's ~(~a / b), where ~a is not negative. So
+    // with y = a, or -a for negative b, as an unsigned magnitude, and
+    // flip set where the signs of a and b differ, a / b is
+    // ((y ^ flip) / |b|) ^ flip, and that division is unsigned.
+    Value* zero = llvm_constant(t, 0);
+    Value* flip = builder->CreateSExt(builder->CreateICmpSLT(va, zero),
+                                      va->getType());
+    Value* y = va;
+    Value* divisor = vb;
+    if (!c) {
+      divisor = codegen(d);
+      Value* sign = builder->CreateAShr(divisor, t.bits - 1);
+      divisor = builder->CreateSub(builder->CreateXor(divisor, sign), sign);
+      Value* negative = builder->CreateICmpNE(
+          sign, llvm::ConstantInt::get(sign->getType(), 0));
+      if (t.is_vector()) {
+        sign = builder->CreateVectorSplat(t.width, sign);
+      }
+      y = builder->CreateSub(builder->CreateXor(va, sign), sign);
+      flip = builder->CreateSelect(
+          negative,
+          builder->CreateSExt(builder->CreateICmpSGT(va, zero),
+                              va->getType()),
+          flip);
+    }
+    Value* x = builder->CreateXor(y, flip);
+    if (c) {
+      q = builder->CreateUDiv(x, divisor);
+    } else {
+      q = codegen_udiv_by_invariant(x, divisor, t);
+    }
+    q = builder->CreateXor(q, flip);
+  }
+  return mod ? builder->CreateSub(va, builder->CreateMul(q, vb)) : q;
+}
+
+Value* CodeGen::codegen_udiv_by_invariant(Value* a, Value* b, Type t) {
+  // From Granlund and Montgomery, "Division by invariant integers
+  // using multiplication": with l = ceil(log2(b)) and
+  // m = 2^bits * (2^l - b) / b + 1, a / b is
+  // (h + ((a - h) >> min(l, 1))) >> max(l - 1, 0), where h is the
+  // high half of m * a.
+  llvm::Type* i64_t = builder->getInt64Ty();
+  Value* d = builder->CreateZExt(b, i64_t);
+  d = builder->CreateBinaryIntrinsic(llvm::Intrinsic::umax, d,
+                                     llvm::ConstantInt::get(i64_t, 1));
+  Value* one = llvm::ConstantInt::get(i64_t, 1);
+  Value* clz = builder->CreateBinaryIntrinsic(
+      llvm::Intrinsic::ctlz, builder->CreateSub(d, one), builder->getFalse());
+  Value* l = builder->CreateSub(llvm::ConstantInt::get(i64_t, 64), clz);
+  Value* m = builder->CreateSub(builder->CreateShl(one, l), d);
+  m = builder->CreateAdd(builder->CreateUDiv(builder->CreateShl(m, t.bits), d),
+                         one);
+  Value* shift1 = builder->CreateBinaryIntrinsic(llvm::Intrinsic::umin, l, one);
+  Value* shift2 = builder->CreateSub(l, shift1);
+
+  llvm::Type* element = llvm_type_of(t.element_of());
+  m = builder->CreateTrunc(m, element);
+  shift1 = builder->CreateTrunc(shift1, element);
+  shift2 = builder->CreateTrunc(shift2, element);
+  if (t.is_vector()) {
+    m = builder->CreateVectorSplat(t.width, m);
+    shift1 = builder->CreateVectorSplat(t.width, shift1);
+    shift2 = builder->CreateVectorSplat(t.width, shift2);
+  }
+  Type wide = UInt(t.bits * 2, t.width);
+  Value* h = builder->CreateMul(builder->CreateZExt(a, llvm_type_of(wide)),
+                                builder->CreateZExt(m, llvm_type_of(wide)));
+  h = builder->CreateLShr(h, llvm_constant(wide, t.bits));
+  h = builder->CreateTrunc(h, a->getType());
+  Value* q = builder->CreateLShr(builder->CreateSub(a, h), shift1);
+  return builder->CreateLShr(builder->CreateAdd(h, q), shift2);
+}
+
+Value* CodeGen::call_intrin(int lanes, const string& name,
+                            const vector<Value*>& args) {
+  llvm::Function* fn = llvm::Intrinsic::getDeclaration(
+      module, llvm::Function::lookupIntrinsicID(name));
+  int width = vector_width(args[0]);
+  vector<Value*> results;
+  for (int i = 0; i < width; i += lanes) {
+    vector<Value*> slices(args.size());
+    for (size_t j = 0; j < args.size(); j++) {
+      slices[j] = slice_vector(args[j], i, lanes);
+    }
+    results.push_back(builder->CreateCall(fn, slices));
+  }
+  return slice_vector(concat_vectors(results), 0, width);
+}
+
+bool CodeGen::codegen_x86_pattern(const Cast* op) {
+  Type t = op->type;
+  Type wide = op->value.type();
+  if (t.is_scalar() || t.is_float() || (t.bits != 8 && t.bits != 16) ||
+      wide.is_float() || wide.bits <= t.bits) {
+    return false;
+  }
+
+  // Saturating adds and subtracts, like u8(min(u16(a) + u16(b), 255)).
+  // llvm lowers its saturating intrinsics to padds, paddus, psubs and
+  // psubus.
+  Expr lo, hi;
+  Expr e = strip_clamp(op->value, &lo, &hi);
+  bool clamped_below = lo.defined() && is_const(lo, t.imin());
+  bool clamped_above = hi.defined() && is_const(hi, t.imax());
+  const Add* add = e.as<Add>();
+  const Sub* sub = e.as<Sub>();
+  Expr a, b;
+  if (add) {
+    a = narrow(add->a, t), b = narrow(add->b, t);
+  } else if (sub) {
+    a = narrow(sub->a, t), b = narrow(sub->b, t);
+  }
+  if (a.defined() && b.defined()) {
+    llvm::Intrinsic::ID id = llvm::Intrinsic::not_intrinsic;
+    if (t.is_int() && clamped_below && clamped_above) {
+      id = add ? llvm::Intrinsic::sadd_sat : llvm::Intrinsic::ssub_sat;
+    } else if (t.is_uint() && add && clamped_above &&
+               (clamped_below || !lo.defined())) {
+      id = llvm::Intrinsic::uadd_sat;
+    } else if (t.is_uint() && sub && wide.is_int() && clamped_below &&
+               (clamped_above || !hi.defined())) {
+      id = llvm::Intrinsic::usub_sat;
+    }
+    if (id != llvm::Intrinsic::not_intrinsic) {
+      value = builder->CreateBinaryIntrinsic(id, codegen(a), codegen(b));
+      return true;
+    }
+  }
+
+  // The rest have x86 intrinsics for each vector size. Use the
+  // widest the target has that isn't wider than the result.
+  int bits = 128;
+  if (t.bits * t.width > 128 && target.has_feature(Target::AVX2)) {
+    bits = 256;
+  }
+  if (t.bits * t.width > 256 && target.has_feature(Target::AVX512)) {
+    bits = 512;
+  }
+  string prefix = bits == 512   ? "llvm.x86.avx512."
+                  : bits == 256 ? "llvm.x86.avx2."
+                                : "llvm.x86.sse2.";
+  string suffix = bits == 512 ? ".512" : "";
+
+  // Rounding averages, like u8((u16(a) + u16(b) + 1) / 2).
+  Expr sum;
+  const Add* round = NULL;
+  const Add* add_ab = NULL;
+  if (t.is_uint() && is_shift_right(op->value, 1, &sum) &&
+      (round = sum.as<Add>()) && is_const(round->b, 1) &&
+      (add_ab = round->a.as<Add>())) {
+    a = narrow(add_ab->a, t), b = narrow(add_ab->b, t);
+    if (a.defined() && b.defined()) {
+      string name = t.bits == 8 ? "pavg.b" : "pavg.w";
+      value = call_intrin(bits / t.bits, prefix + name + suffix,
+                          vec(codegen(a), codegen(b)));
+      return true;
+    }
+  }
+
+  // The high half of a multiply, like i16((i32(a) * i32(b)) / 65536).
+  // The product of two uint16s doesn't fit in an int32.
+  Expr product;
+  const Mul* mul = NULL;
+  if (t.bits == 16 && wide.bits >= (t.is_uint() && wide.is_int() ? 64 : 32) &&
+      is_shift_right(op->value, 16, &product) &&
+      (mul = product.as<Mul>())) {
+    a = narrow(mul->a, t), b = narrow(mul->b, t);
+    if (a.defined() && b.defined()) {
+      string name = t.is_int() ? "pmulh.w" : "pmulhu.w";
+      value = call_intrin(bits / 16, prefix + name + suffix,
+                          vec(codegen(a), codegen(b)));
+      return true;
+    }
+  }
+  return false;
+}
+
+void CodeGen::visit(const Cast* op) {
+  if (codegen_x86_pattern(op)) {
+    return;
+  }
+  Type src = op->value.type();
+  Type dst = op->type;
+  llvm::Type* t = llvm_type_of(dst);
+  value = codegen(op->value);
+
+  if (src == dst) {
+    return;
+  } else if (src.is_handle() && dst.is_handle()) {
+    value = builder->CreateBitCast(value, t);
+  } else if (src.is_handle()) {
+    value = builder->CreatePtrToInt(value, t);
+  } else if (dst.is_handle()) {
+    value = builder->CreateIntToPtr(value, t);
+  } else if (dst.is_bool()) {
+    if (src.is_float()) {
+      value = builder->CreateFCmpUNE(value, llvm_constant(src, 0));
+    } else {
+      value = builder->CreateICmpNE(value, llvm_constant(src, 0));
+    }
+  } else if (src.is_float() && dst.is_float()) {
+    value = builder->CreateFPCast(value, t);
+  } else if (src.is_float()) {
+    value = dst.is_int() ? builder->CreateFPToSI(value, t)
+                         : builder->CreateFPToUI(value, t);
+  } else if (dst.is_float()) {
+    value = src.is_int() ? builder->CreateSIToFP(value, t)
+                         : builder->CreateUIToFP(value, t);
+  } else {
+    // Widening sign-extends signed sources and zero-extends unsigned
+    // ones. Narrowing truncates.
+    value = builder->CreateIntCast(value, t, src.is_int());
+  }
+}
+
+void CodeGen::visit(const Variable* op) { value = sym_get(op->name); }
+
+void CodeGen::visit(const Add* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  value = op->type.is_float() ? builder->CreateFAdd(a, b)
+                              : builder->CreateAdd(a, b);
+}
+
+void CodeGen::visit(const Sub* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  value = op->type.is_float() ? builder->CreateFSub(a, b)
+                              : builder->CreateSub(a, b);
+}
+
+void CodeGen::visit(const Mul* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  value = op->type.is_float() ? builder->CreateFMul(a, b)
+                              : builder->CreateMul(a, b);
+}
+
+void CodeGen::visit(const Div* op) {
+  if (Value* q = codegen_fast_div(op->a, op->b, false)) {
+    value = q;
+    return;
+  }
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  Type t = op->type;
+  if (t.is_float()) {
+    value = builder->CreateFDiv(a, b);
+  } else if (t.is_uint()) {
+    value = builder->CreateUDiv(a, b);
+  } else {
+    // Signed division rounds towards negative infinity. This is the
+    // same sequence as div_imp in Simplify.h.
+    Value* zero = llvm_constant(t, 0);
+    Value* sign = builder->CreateAShr(builder->CreateXor(a, b),
+                                      llvm_constant(t, t.bits - 1));
+    Value* post = builder->CreateSelect(builder->CreateICmpNE(a, zero), sign,
+                                        zero);
+    Value* pre = builder->CreateSelect(builder->CreateICmpSLT(a, zero),
+                                       builder->CreateNeg(post), post);
+    Value* q = builder->CreateSDiv(builder->CreateAdd(a, pre), b);
+    value = builder->CreateAdd(q, post);
+  }
+}
+
+void CodeGen::visit(const Mod* op) {
+  if (Value* r = codegen_fast_div(op->a, op->b, true)) {
+    value = r;
+    return;
+  }
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  Type t = op->type;
+  if (t.is_float()) {
+    // a - b * floor(a / b), as in mod_imp.
+    Value* q = builder->CreateUnaryIntrinsic(llvm::Intrinsic::floor,
+                                             builder->CreateFDiv(a, b));
+    value = builder->CreateFSub(a, builder->CreateFMul(b, q));
+  } else if (t.is_uint()) {
+    value = builder->CreateURem(a, b);
+  } else {
+    // The remainder takes the sign of b.
+    Value* zero = llvm_constant(t, 0);
+    Value* rem = builder->CreateSRem(a, b);
+    Value* wrong_sign = builder->CreateAnd(
+        builder->CreateICmpNE(rem, zero),
+        builder->CreateICmpSLT(builder->CreateXor(rem, b), zero));
+    value = builder->CreateAdd(rem,
+                               builder->CreateSelect(wrong_sign, b, zero));
+  }
+}
+
+void CodeGen::visit(const Min* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  Type t = op->type;
+  Value* cmp = t.is_float()  ? builder->CreateFCmpOLT(a, b)
+               : t.is_int() ? builder->CreateICmpSLT(a, b)
+                            : builder->CreateICmpULT(a, b);
+  value = builder->CreateSelect(cmp, a, b);
+}
+
+void CodeGen::visit(const Max* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  Type t = op->type;
+  Value* cmp = t.is_float()  ? builder->CreateFCmpOGT(a, b)
+               : t.is_int() ? builder->CreateICmpSGT(a, b)
+                            : builder->CreateICmpUGT(a, b);
+  value = builder->CreateSelect(cmp, a, b);
+}
+
+void CodeGen::visit(const EQ* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  value = op->a.type().is_float() ? builder->CreateFCmpOEQ(a, b)
+                                  : builder->CreateICmpEQ(a, b);
+}
+
+void CodeGen::visit(const NE* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  value = op->a.type().is_float() ? builder->CreateFCmpUNE(a, b)
+                                  : builder->CreateICmpNE(a, b);
+}
+
+void CodeGen::visit(const LT* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  Type t = op->a.type();
+  value = t.is_float()  ? builder->CreateFCmpOLT(a, b)
+          : t.is_int() ? builder->CreateICmpSLT(a, b)
+                       : builder->CreateICmpULT(a, b);
+}
+
+void CodeGen::visit(const LE* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  Type t = op->a.type();
+  value = t.is_float()  ? builder->CreateFCmpOLE(a, b)
+          : t.is_int() ? builder->CreateICmpSLE(a, b)
+                       : builder->CreateICmpULE(a, b);
+}
+
+void CodeGen::visit(const GT* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  Type t = op->a.type();
+  value = t.is_float()  ? builder->CreateFCmpOGT(a, b)
+          : t.is_int() ? builder->CreateICmpSGT(a, b)
+                       : builder->CreateICmpUGT(a, b);
+}
+
+void CodeGen::visit(const GE* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  Type t = op->a.type();
+  value = t.is_float()  ? builder->CreateFCmpOGE(a, b)
+          : t.is_int() ? builder->CreateICmpSGE(a, b)
+                       : builder->CreateICmpUGE(a, b);
+}
+
+void CodeGen::visit(const And* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  value = builder->CreateAnd(a, b);
+}
+
+void CodeGen::visit(const Or* op) {
+  Value* a = codegen(op->a);
+  Value* b = codegen(op->b);
+  value = builder->CreateOr(a, b);
+}
+
+void CodeGen::visit(const Not* op) {
+  value = builder->CreateNot(codegen(op->a));
+}
+
+void CodeGen::visit(const Select* op) {
+  Value* cond = codegen(op->condition);
+  Value* a = codegen(op->true_value);
+  Value* b = codegen(op->false_value);
+  value = builder->CreateSelect(cond, a, b);
+}
+
+void CodeGen::visit(const Load* op) {
+  Type t = op->type;
+  llvm::Type* storage = llvm_storage_type_of(t);
+  const Ramp* ramp = op->index.as<Ramp>();
+  const Broadcast* broadcast = op->index.as<Broadcast>();
+
+  if (t.is_scalar()) {
+    Value* ptr = codegen_buffer_pointer(op->name, t, codegen(op->index));
+    value = builder->CreateAlignedLoad(
+        storage, ptr, llvm::Align(alignment_of(op->name, t, op->index)));
+  } else if (ramp && is_one(ramp->stride)) {
+    // A dense vector load.
+    Value* ptr = codegen_buffer_pointer(op->name, t, codegen(ramp->base));
+    ptr = builder->CreatePointerCast(ptr, storage->getPointerTo());
+    value = builder->CreateAlignedLoad(
+        storage, ptr, llvm::Align(alignment_of(op->name, t, ramp->base)));
+  } else if (ramp && small_stride(ramp->stride)) {
+    // Interleaved data, like the channels of an rgb image. Load the
+    // span the lanes cover densely, and pick the lanes out with a
+    // shuffle, which is much faster than a gather. The span ends at
+    // the last lane, so it reads nothing past what the gather would.
+    int stride = small_stride(ramp->stride);
+    int span = stride * (t.width - 1) + 1;
+    llvm::Type* dense = llvm_storage_type_of(t.element_of().vector_of(span));
+    Value* ptr = codegen_buffer_pointer(op->name, t, codegen(ramp->base));
+    ptr = builder->CreatePointerCast(ptr, dense->getPointerTo());
+    value = builder->CreateAlignedLoad(
+        dense, ptr, llvm::Align(alignment_of(op->name, t, ramp->base)));
+    vector<int> mask(t.width);
+    for (int i = 0; i < t.width; i++) {
+      mask[i] = i * stride;
+    }
+    value = builder->CreateShuffleVector(value, mask);
+  } else if (broadcast) {
+    // Load one scalar and broadcast it.
+    Type scalar = t.element_of();
+    Value* ptr =
+        codegen_buffer_pointer(op->name, scalar, codegen(broadcast->value));
+    Value* v = builder->CreateAlignedLoad(
+        llvm_storage_type_of(scalar), ptr,
+        llvm::Align(alignment_of(op->name, scalar, broadcast->value)));
+    value = builder->CreateVectorSplat(t.width, v);
+  } else if (Value* window = codegen_window_load(op)) {
+    value = window;
+  } else {
+    // A gather. Load each lane separately.
+    Type scalar = t.element_of();
+    Value* index = codegen(op->index);
+    Value* v = llvm::UndefValue::get(storage);
+    for (int i = 0; i < t.width; i++) {
+      Value* idx = builder->CreateExtractElement(index, (uint64_t)i);
+      Value* ptr = codegen_buffer_pointer(op->name, scalar, idx);
+      Value* lane = builder->CreateAlignedLoad(
+          llvm_storage_type_of(scalar), ptr, llvm::Align(scalar.bytes()));
+      v = builder->CreateInsertElement(v, lane, (uint64_t)i);
+    }
+    value = v;
+  }
+
+  if (t.is_bool()) {
+    value = builder->CreateICmpNE(value, llvm_constant(UInt(8, t.width), 0));
+  }
+}
+
+void CodeGen::visit(const Ramp* op) {
+  Type t = op->type;
+  Value* base = codegen(op->base);
+  Value* stride = codegen(op->stride);
+  // base + stride * <0, 1, 2, ...>
+  vector<llvm::Constant*> lanes(op->width);
+  for (int i = 0; i < op->width; i++) {
+    lanes[i] = llvm::cast<llvm::Constant>(llvm_constant(t.element_of(), i));
+  }
+  Value* lane_ids = llvm::ConstantVector::get(lanes);
+  base = builder->CreateVectorSplat(op->width, base);
+  stride = builder->CreateVectorSplat(op->width, stride);
+  if (t.is_float()) {
+    value = builder->CreateFAdd(base, builder->CreateFMul(stride, lane_ids));
+  } else {
+    value = builder->CreateAdd(base, builder->CreateMul(stride, lane_ids));
+  }
+}
+
+void CodeGen::visit(const Broadcast* op) {
+  value = builder->CreateVectorSplat(op->width, codegen(op->value));
+}
+
+void CodeGen::visit(const Call* op) {
+  if (op->call_type == Call::Extern) {
+    value = codegen_extern_call(op);
+  } else if (op->call_type == Call::Intrinsic) {
+    value = codegen_intrinsic(op);
+  } else {
+    std::cerr << "Call to " << op->name
+              << " should have been replaced by a Load before codegen\n";
+    assert(false);
+  }
+}
+
+Value* CodeGen::codegen_extern_call(const Call* op) {
+  vector<Value*> args(op->args.size());
+  for (size_t i = 0; i < op->args.size(); i++) {
+    args[i] = codegen(op->args[i]);
+  }
+
+  // Math functions are named like sin_f32. Those with llvm
+  // intrinsics get the vector version of the intrinsic, and the rest
+  // are scalar calls into libm.
+  string name = op->name;
+  size_t underscore = name.rfind('_');
+  string base = underscore == string::npos ? name : name.substr(0, underscore);
+  string suffix =
+      underscore == string::npos ? "" : name.substr(underscore + 1);
+  bool is_math = suffix == "f32" || suffix == "f64";
+
+  if (is_math && args.empty() &&
+      (base == "inf" || base == "neg_inf" || base == "nan")) {
+    llvm::Type* t = llvm_type_of(op->type.element_of());
+    Value* v = base == "nan" ? llvm::ConstantFP::getNaN(t)
+                             : llvm::ConstantFP::getInfinity(t, base != "inf");
+    return op->type.is_vector() ? builder->CreateVectorSplat(op->type.width, v)
+                                : v;
+  } else if (is_math) {
+    static const struct {
+      const char* name;
+      llvm::Intrinsic::ID id;
+    } intrinsics[] = {{"sqrt", llvm::Intrinsic::sqrt},
+                      {"sin", llvm::Intrinsic::sin},
+                      {"cos", llvm::Intrinsic::cos},
+                      {"exp", llvm::Intrinsic::exp},
+                      {"log", llvm::Intrinsic::log},
+                      {"pow", llvm::Intrinsic::pow},
+                      {"floor", llvm::Intrinsic::floor},
+                      {"ceil", llvm::Intrinsic::ceil},
+                      {"abs", llvm::Intrinsic::fabs}};
+    for (size_t i = 0; i < sizeof(intrinsics) / sizeof(intrinsics[0]); i++) {
+      if (base == intrinsics[i].name) {
+        llvm::Function* fn = llvm::Intrinsic::getDeclaration(
+            module, intrinsics[i].id, {llvm_type_of(op->type)});
+        return builder->CreateCall(fn, args);
+      }
+    }
+    if (base == "round") {
+      // Ties round up.
+      Value* half = llvm::ConstantFP::get(llvm_type_of(op->type), 0.5);
+      return builder->CreateUnaryIntrinsic(llvm::Intrinsic::floor,
+                                           builder->CreateFAdd(args[0], half));
+    }
+  } else if (base == "abs" && op->type.is_int()) {
+    Value* zero = llvm_constant(op->type, 0);
+    return builder->CreateSelect(builder->CreateICmpSLT(args[0], zero),
+                                 builder->CreateNeg(args[0]), args[0]);
+  }
+
+  // A call to a scalar function, once per lane.
+  string symbol = name;
+  if (is_math) {
+    symbol = suffix == "f32" ? base + "f" : base;
+  }
+  vector<llvm::Type*> arg_types(args.size());
+  for (size_t i = 0; i < args.size(); i++) {
+    arg_types[i] = llvm_type_of(op->args[i].type().element_of());
+  }
+  llvm::Function* fn = get_function(
+      symbol, llvm_type_of(op->type.element_of()), arg_types);
+  if (is_math) {
+    fn->setDoesNotThrow();
+    fn->setDoesNotAccessMemory();
+  }
+
+  if (op->type.is_scalar()) {
+    return builder->CreateCall(fn, args);
+  }
+  Value* result = llvm::UndefValue::get(llvm_type_of(op->type));
+  for (int lane = 0; lane < op->type.width; lane++) {
+    vector<Value*> lane_args(args.size());
+    for (size_t i = 0; i < args.size(); i++) {
+      lane_args[i] = args[i]->getType()->isVectorTy()
+                         ? builder->CreateExtractElement(args[i],
+                                                         (uint64_t)lane)
+                         : args[i];
+    }
+    result = builder->CreateInsertElement(
+        result, builder->CreateCall(fn, lane_args), (uint64_t)lane);
+  }
+  return result;
+}
+
+Value* CodeGen::codegen_intrinsic(const Call* op) {
+  const string& name = op->name;
+  Type t = op->type;
+
+  if (name == Call::bitwise_and || name == Call::bitwise_or ||
+      name == Call::bitwise_xor || name == Call::bitwise_not) {
+    // Bitwise operations on floats act on their bits.
+    llvm::Type* int_t = llvm_type_of(Int(t.bits, t.width));
+    vector<Value*> args(op->args.size());
+    for (size_t i = 0; i < op->args.size(); i++) {
+      args[i] = codegen(op->args[i]);
+      if (t.is_float()) {
+        args[i] = builder->CreateBitCast(args[i], int_t);
+      }
+    }
+    Value* v;
+    if (name == Call::bitwise_and) {
+      v = builder->CreateAnd(args[0], args[1]);
+    } else if (name == Call::bitwise_or) {
+      v = builder->CreateOr(args[0], args[1]);
+    } else if (name == Call::bitwise_xor) {
+      v = builder->CreateXor(args[0], args[1]);
+    } else {
+      v = builder->CreateNot(args[0]);
+    }
+    return t.is_float() ? builder->CreateBitCast(v, llvm_type_of(t)) : v;
+  } else if (name == Call::shift_left) {
+    return builder->CreateShl(codegen(op->args[0]), codegen(op->args[1]));
+  } else if (name == Call::shift_right) {
+    Value* a = codegen(op->args[0]);
+    Value* b = codegen(op->args[1]);
+    return t.is_int() ? builder->CreateAShr(a, b) : builder->CreateLShr(a, b);
+  } else if (name == Call::reinterpret) {
+    Type src = op->args[0].type();
+    Value* v = codegen(op->args[0]);
+    if (src.is_handle() && !t.is_handle()) {
+      return builder->CreatePtrToInt(v, llvm_type_of(t));
+    } else if (t.is_handle() && !src.is_handle()) {
+      return builder->CreateIntToPtr(v, llvm_type_of(t));
+    }
+    return builder->CreateBitCast(v, llvm_type_of(t));
+  } else if (name == Call::shuffle_vector) {
+    Value* v = codegen(op->args[0]);
+    vector<int> mask(op->args.size() - 1);
+    for (size_t i = 1; i < op->args.size(); i++) {
+      const int* idx = as_const_int(op->args[i]);
+      assert(idx && "shuffle_vector indices must be constant");
+      mask[i - 1] = *idx;
+    }
+    if (mask.size() == 1) {
+      return builder->CreateExtractElement(v, (uint64_t)mask[0]);
+    }
+    return builder->CreateShuffleVector(slice_vector(v, 0, vector_width(v)),
+                                        mask);
+  } else if (name == Call::interleave_vectors) {
+    // Lane i of argument j goes to lane i * n + j.
+    int n = (int)op->args.size();
+    int w = op->args[0].type().width;
+    vector<Value*> args(n);
+    for (int j = 0; j < n; j++) {
+      args[j] = codegen(op->args[j]);
+    }
+    if (n == 1) {
+      return args[0];
+    }
+    vector<int> mask(n * w);
+    for (int i = 0; i < w; i++) {
+      for (int j = 0; j < n; j++) {
+        mask[i * n + j] = j * w + i;
+      }
+    }
+    return builder->CreateShuffleVector(concat_vectors(args), mask);
+  } else if (name == Call::lerp) {
+    // zero + (one - zero) * weight, with integer weights normalized to
+    // [0, 1], and integer results rounded to nearest.
+    Expr zero = op->args[0], one = op->args[1], weight = op->args[2];
+    Type ft = Float(t.is_float() ? t.bits : (t.bits >= 32 ? 64 : 32), t.width);
+    Expr w = cast(ft, weight);
+    if (!weight.type().is_float()) {
+      w = w / cast(ft, weight.type().max());
+    }
+    Expr e = cast(ft, zero) + (cast(ft, one) - cast(ft, zero)) * w;
+    if (!t.is_float()) {
+      e = floor(e + cast(ft, Expr(0.5f)));
+    }
+    return codegen(cast(t, e));
+  } else if (name == Call::create_buffer_t) {
+    // create_buffer_t(host, elem_size, min0, extent0, stride0, min1, ...)
+    assert(op->args.size() >= 2 && (op->args.size() - 2) % 3 == 0 &&
+           "Wrong number of arguments to create_buffer_t");
+    Value* buffer = create_alloca_at_entry(buffer_t_type, 1, "buffer");
+    builder->CreateStore(llvm::ConstantInt::get(i64, 0),
+                         buffer_field_ptr(buffer, BufferDev));
+    Value* host = builder->CreatePointerCast(codegen(op->args[0]),
+                                             i8->getPointerTo());
+    builder->CreateStore(host, buffer_field_ptr(buffer, BufferHost));
+    builder->CreateStore(codegen(op->args[1]),
+                         buffer_field_ptr(buffer, BufferElemSize));
+    int dims = (int)(op->args.size() - 2) / 3;
+    for (int i = 0; i < 4; i++) {
+      Value* zero = llvm::ConstantInt::get(i32, 0);
+      Value* min = i < dims ? codegen(op->args[2 + i * 3]) : zero;
+      Value* extent = i < dims ? codegen(op->args[3 + i * 3]) : zero;
+      Value* stride = i < dims ? codegen(op->args[4 + i * 3]) : zero;
+      builder->CreateStore(min, buffer_field_ptr(buffer, BufferMin, i));
+      builder->CreateStore(extent, buffer_field_ptr(buffer, BufferExtent, i));
+      builder->CreateStore(stride, buffer_field_ptr(buffer, BufferStride, i));
+    }
+    builder->CreateStore(llvm::ConstantInt::get(i8, 0),
+                         buffer_field_ptr(buffer, BufferHostDirty));
+    builder->CreateStore(llvm::ConstantInt::get(i8, 0),
+                         buffer_field_ptr(buffer, BufferDevDirty));
+    return builder->CreatePointerCast(buffer, llvm_type_of(t));
+  } else if (name == Call::extract_buffer_min ||
+             name == Call::extract_buffer_extent) {
+    Value* buffer = builder->CreatePointerCast(codegen(op->args[0]),
+                                               buffer_t_type->getPointerTo());
+    const int* dim = as_const_int(op->args[1]);
+    assert(dim && *dim >= 0 && *dim < 4 && "Bad buffer dimension");
+    int field = name == Call::extract_buffer_min ? BufferMin : BufferExtent;
+    return builder->CreateLoad(i32, buffer_field_ptr(buffer, field, *dim));
+  } else if (name == Call::rewrite_buffer) {
+    // rewrite_buffer(buffer, elem_size, min0, extent0, stride0, ...)
+    Value* buffer = builder->CreatePointerCast(codegen(op->args[0]),
+                                               buffer_t_type->getPointerTo());
+    builder->CreateStore(codegen(op->args[1]),
+                         buffer_field_ptr(buffer, BufferElemSize));
+    int dims = (int)(op->args.size() - 2) / 3;
+    for (int i = 0; i < dims; i++) {
+      builder->CreateStore(codegen(op->args[2 + i * 3]),
+                           buffer_field_ptr(buffer, BufferMin, i));
+      builder->CreateStore(codegen(op->args[3 + i * 3]),
+                           buffer_field_ptr(buffer, BufferExtent, i));
+      builder->CreateStore(codegen(op->args[4 + i * 3]),
+                           buffer_field_ptr(buffer, BufferStride, i));
+    }
+    return llvm_constant(t, 0);
+  } else if (name == Call::profiling_timer) {
+    llvm::Function* fn = llvm::Intrinsic::getDeclaration(
+        module, llvm::Intrinsic::readcyclecounter);
+    return builder->CreateIntCast(builder->CreateCall(fn), llvm_type_of(t),
+                                  false);
+  } else if (name == Call::trace) {
+    // trace(func_name, event, value_index, value, coordinates...)
+    // calls jmlang_trace with the arguments of JITModule::TraceFn, and
+    // evaluates to the traced value.
+    assert(op->args.size() >= 4 && "Wrong number of arguments to trace");
+    Type vt = op->args[3].type();
+    Value* func_name = codegen(op->args[0]);
+    Value* event = codegen(op->args[1]);
+    Value* value_index = codegen(op->args[2]);
+    Value* v = codegen(op->args[3]);
+    llvm::Type* storage = llvm_storage_type_of(vt);
+    Value* value_ptr = create_alloca_at_entry(storage, 1, "trace_value");
+    builder->CreateStore(
+        vt.is_bool() ? builder->CreateZExt(v, storage) : v, value_ptr);
+    int num_coords = (int)op->args.size() - 4;
+    Value* coords = create_alloca_at_entry(i32, std::max(num_coords, 1),
+                                           "trace_coords");
+    for (int i = 0; i < num_coords; i++) {
+      builder->CreateStore(
+          codegen(op->args[4 + i]),
+          builder->CreateConstInBoundsGEP1_32(i32, coords, i));
+    }
+    int type_code = vt.is_int() ? 0 : vt.is_uint() ? 1 : vt.is_float() ? 2 : 3;
+    llvm::Type* void_ptr = i8->getPointerTo();
+    llvm::Function* fn =
+        get_function("jmlang_trace", void_t,
+                     {void_ptr, i32, i32, i32, i32, i32, void_ptr, i32,
+                      i32->getPointerTo()});
+    builder->CreateCall(
+        fn, {func_name, event, llvm::ConstantInt::get(i32, type_code),
+             llvm::ConstantInt::get(i32, vt.bits),
+             llvm::ConstantInt::get(i32, vt.width), value_index,
+             builder->CreatePointerCast(value_ptr, void_ptr),
+             llvm::ConstantInt::get(i32, num_coords), coords});
+    if (vt == t) {
+      return v;
+    }
+    return llvm_constant(t, 0);
+  }
+
+  std::cerr << "Codegen of intrinsic " << name << " is not supported\n";
+  assert(false);
+  return NULL;
+}
+
+void CodeGen::visit(const Let* op) {
+  sym_push(op->name, codegen(op->value));
+  value = codegen(op->body);
+  sym_pop(op->name);
+}
+
+void CodeGen::visit(const LetStmt* op) {
+  sym_push(op->name, codegen(op->value));
+  codegen(op->body);
+  sym_pop(op->name);
+}
+
+void CodeGen::visit(const AssertStmt* op) {
+  if (target.has_feature(Target::NoAsserts)) {
+    return;
+  }
+  create_assertion(codegen(op->condition), op->message);
+}
+
+void CodeGen::set_float_mode(FloatMode mode) {
+  llvm::FastMathFlags flags;
+  if (mode == FloatFast) {
+    flags.setFast();
+  } else if (mode == FloatContract) {
+    flags.setAllowContract();
+  }
+  builder->setFastMathFlags(flags);
+  float_mode = mode;
+}
+
+void CodeGen::set_float_mode(const string& func) {
+  // Functions without a mode of their own use the target's, not that
+  // of the function they are computed in.
+  std::map<string, FloatMode>::const_iterator iter = float_modes.find(func);
+  if (iter != float_modes.end() && iter->second != FloatDefault) {
+    set_float_mode(iter->second);
+  } else {
+    set_float_mode(target.float_mode());
+  }
+}
+
+void CodeGen::visit(const Pipeline* op) {
+  FloatMode outer = float_mode;
+  set_float_mode(op->name);
+  codegen(op->produce);
+  if (op->update.defined()) {
+    codegen(op->update);
+  }
+  set_float_mode(outer);
+  codegen(op->consume);
+}
+
+void CodeGen::visit(const For* op) {
+  // Loops are named after the function they compute, as in f.s0.x.
+  FloatMode outer = float_mode;
+  set_float_mode(op->name.substr(0, op->name.find('.')));
+  if (op->for_type == For::Parallel) {
+    codegen_parallel_for(op);
+    set_float_mode(outer);
+    return;
+  }
+  // Vectorized and unrolled loops should have been expanded by
+  // lowering. If they haven't been, running them serially is still
+  // correct.
+  Value* min = codegen(op->min);
+  Value* extent = codegen(op->extent);
+  Value* max = builder->CreateNSWAdd(min, extent);
+
+  BasicBlock* preheader = builder->GetInsertBlock();
+  BasicBlock* loop = BasicBlock::Create(*context, op->name + "_loop", function);
+  BasicBlock* after =
+      BasicBlock::Create(*context, op->name + "_after_loop", function);
+  builder->CreateCondBr(builder->CreateICmpSLT(min, max), loop, after);
+
+  builder->SetInsertPoint(loop);
+  llvm::PHINode* phi = builder->CreatePHI(i32, 2);
+  phi->addIncoming(min, preheader);
+  sym_push(op->name, phi);
+  codegen(op->body);
+  sym_pop(op->name);
+
+  Value* next = builder->CreateNSWAdd(phi, llvm::ConstantInt::get(i32, 1));
+  phi->addIncoming(next, builder->GetInsertBlock());
+  builder->CreateCondBr(builder->CreateICmpNE(next, max), loop, after);
+
+  builder->SetInsertPoint(after);
+  set_float_mode(outer);
+}
+
+void CodeGen::codegen_parallel_for(const For* op) {
+  Value* min = codegen(op->min);
+  Value* extent = codegen(op->extent);
+
+  // Pack everything the body refers to that's defined outside of it
+  // into a closure.
+  FindReferencedNames refs;
+  op->body.accept(&refs);
+  vector<string> names;
+  vector<Value*> values;
+  vector<llvm::Type*> types;
+  for (set<string>::iterator iter = refs.names.begin();
+       iter != refs.names.end(); ++iter) {
+    if (*iter != op->name && symbol_table.contains(*iter)) {
+      names.push_back(*iter);
+      values.push_back(symbol_table.get(*iter));
+      types.push_back(values.back()->getType());
+    }
+  }
+  llvm::StructType* closure_t = llvm::StructType::get(*context, types);
+  Value* closure =
+      create_alloca_at_entry(closure_t, 1, op->name + ".closure");
+  for (size_t i = 0; i < values.size(); i++) {
+    builder->CreateStore(values[i], builder->CreateConstInBoundsGEP2_32(
+                                        closure_t, closure, 0, i));
+  }
+
+  // The task function, which runs one iteration of the loop.
+  llvm::Type* void_ptr = i8->getPointerTo();
+  llvm::FunctionType* task_t =
+      llvm::FunctionType::get(i32, {i32, void_ptr}, false);
+  llvm::Function* task =
+      llvm::Function::Create(task_t, llvm::GlobalValue::InternalLinkage,
+                             function_name_ + "_par_for_" + op->name, module);
+  task->addFnAttr(llvm::Attribute::NoUnwind);
+
+  BasicBlock* call_site = builder->GetInsertBlock();
+  llvm::Function* parent = function;
+  Scope<Value*> parent_symbols = symbol_table;
+  Scope<Allocation> parent_allocations = allocations;
+
+  // Allocations made outside the loop are still visible for the
+  // purposes of alignment, but aren't the task's to free.
+  function = task;
+  symbol_table = Scope<Value*>();
+  allocations = Scope<Allocation>();
+  for (Scope<Allocation>::const_iterator iter = parent_allocations.cbegin();
+       iter != parent_allocations.cend(); ++iter) {
+    Allocation a = {NULL, false};
+    allocations.push(iter.name(), a);
+  }
+
+  builder->SetInsertPoint(BasicBlock::Create(*context, "entry", task));
+  llvm::Function::arg_iterator arg = task->arg_begin();
+  Value* loop_var = iterator_to_pointer(arg++);
+  Value* task_closure = builder->CreatePointerCast(
+      iterator_to_pointer(arg), closure_t->getPointerTo());
+  for (size_t i = 0; i < names.size(); i++) {
+    sym_push(names[i],
+             builder->CreateLoad(types[i], builder->CreateConstInBoundsGEP2_32(
+                                               closure_t, task_closure, 0, i)));
+  }
+  sym_push(op->name, loop_var);
+  codegen(op->body);
+  builder->CreateRet(llvm::ConstantInt::get(i32, 0));
+
+  function = parent;
+  symbol_table = parent_symbols;
+  allocations = parent_allocations;
+  builder->SetInsertPoint(call_site);
+
+  llvm::Function* do_par_for = get_function(
+      "jmlang_do_par_for", i32,
+      {task_t->getPointerTo(), i32, i32, void_ptr});
+  Value* result = builder->CreateCall(
+      do_par_for, {task, min, extent,
+                   builder->CreatePointerCast(closure, void_ptr)});
+
+  // If any task failed, pass its error code on.
+  BasicBlock* success =
+      BasicBlock::Create(*context, op->name + "_par_for_success", function);
+  BasicBlock* failure =
+      BasicBlock::Create(*context, op->name + "_par_for_failure", function);
+  llvm::MDBuilder md(*context);
+  builder->CreateCondBr(
+      builder->CreateICmpEQ(result, llvm::ConstantInt::get(i32, 0)), success,
+      failure, md.createBranchWeights(1 << 20, 1));
+  builder->SetInsertPoint(failure);
+  return_with_error_code(result);
+  builder->SetInsertPoint(success);
+}
+
+void CodeGen::visit(const Store* op) {
+  Type t = op->value.type();
+  llvm::Type* storage = llvm_storage_type_of(t);
+  Value* v = codegen(op->value);
+  if (t.is_bool()) {
+    v = builder->CreateZExt(v, storage);
+  }
+  const Ramp* ramp = op->index.as<Ramp>();
+
+  if (t.is_scalar()) {
+    Value* ptr = codegen_buffer_pointer(op->name, t, codegen(op->index));
+    builder->CreateAlignedStore(
+        v, ptr, llvm::Align(alignment_of(op->name, t, op->index)));
+  } else if (ramp && is_one(ramp->stride)) {
+    // A dense vector store.
+    Value* ptr = codegen_buffer_pointer(op->name, t, codegen(ramp->base));
+    ptr = builder->CreatePointerCast(ptr, storage->getPointerTo());
+    builder->CreateAlignedStore(
+        v, ptr, llvm::Align(alignment_of(op->name, t, ramp->base)));
+  } else {
+    // A scatter. Store each lane separately.
+    Type scalar = t.element_of();
+    Value* index = codegen(op->index);
+    for (int i = 0; i < t.width; i++) {
+      Value* idx = builder->CreateExtractElement(index, (uint64_t)i);
+      Value* ptr = codegen_buffer_pointer(op->name, scalar, idx);
+      builder->CreateAlignedStore(
+          builder->CreateExtractElement(v, (uint64_t)i), ptr,
+          llvm::Align(scalar.bytes()));
+    }
+  }
+}
+
+void CodeGen::visit(const Provide* op) {
+  std::cerr << "Provide to " << op->name
+            << " should have been replaced by a Store before codegen\n";
+  assert(false);
+}
+
+void CodeGen::visit(const Allocate* op) {
+  int bytes = op->type.bytes();
+  const int* const_size = as_const_int(op->size);
+
+  Allocation a;
+  if (const_size && (int64_t)*const_size * bytes <= stack_allocation_limit) {
+    Value* ptr = create_alloca_at_entry(llvm_storage_type_of(op->type),
+                                        *const_size, op->name);
+    a.ptr = builder->CreatePointerCast(ptr, i8->getPointerTo());
+    a.on_heap = false;
+  } else {
+    Value* size = builder->CreateSExt(codegen(op->size), i64);
+    size = builder->CreateMul(size, llvm::ConstantInt::get(i64, bytes));
+    llvm::Function* malloc_fn =
+        get_function("jmlang_malloc", i8->getPointerTo(), {i64});
+    a.ptr = builder->CreateCall(malloc_fn, {size});
+    a.on_heap = true;
+    create_assertion(builder->CreateIsNotNull(a.ptr),
+                     "Out of memory allocating " + op->name);
+  }
+
+  sym_push(op->name + ".host", a.ptr);
+  allocations.push(op->name, a);
+  codegen(op->body);
+
+  // Free it if the body didn't.
+  if (allocations.contains(op->name) &&
+      allocations.get(op->name).ptr == a.ptr) {
+    if (a.on_heap) {
+      builder->CreateCall(
+          get_function("jmlang_free", void_t, {i8->getPointerTo()}), {a.ptr});
+    }
+    allocations.pop(op->name);
+  }
+  sym_pop(op->name + ".host");
+}
+
+void CodeGen::visit(const Free* op) {
+  Allocation a = allocations.get(op->name);
+  if (a.on_heap) {
+    builder->CreateCall(
+        get_function("jmlang_free", void_t, {i8->getPointerTo()}), {a.ptr});
+  }
+  allocations.pop(op->name);
+}
+
+void CodeGen::visit(const Realize* op) {
+  std::cerr << "Realize of " << op->name
+            << " should have been replaced by an Allocate before codegen\n";
+  assert(false);
+}
+
+void CodeGen::visit(const Block* op) {
+  codegen(op->first);
+  if (op->rest.defined()) {
+    codegen(op->rest);
+  }
+}
+
+void CodeGen::visit(const IfThenElse* op) {
+  Value* cond = codegen(op->condition);
+  BasicBlock* then_bb = BasicBlock::Create(*context, "then", function);
+  BasicBlock* after_bb = BasicBlock::Create(*context, "after", function);
+  BasicBlock* else_bb =
+      op->else_case.defined() ? BasicBlock::Create(*context, "else", function)
+                              : after_bb;
+  builder->CreateCondBr(cond, then_bb, else_bb);
+
+  builder->SetInsertPoint(then_bb);
+  codegen(op->then_case);
+  builder->CreateBr(after_bb);
+
+  if (op->else_case.defined()) {
+    builder->SetInsertPoint(else_bb);
+    codegen(op->else_case);
+    builder->CreateBr(after_bb);
+  }
+
+  builder->SetInsertPoint(after_bb);
+}
+
+void CodeGen::visit(const Evaluate* op) { codegen(op->value); }
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
@@ -0,0 +1,1524 @@
+#include "jmlang/CodeGen/CodeGen_C.h"
+
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+#include "jmlang/Base/Util.h"
+#include "jmlang/CodeGen/Outputs.h"
+#include "jmlang/IR/ExprCall.h"
+#include "jmlang/IR/ExprVariable.h"
+#include "jmlang/IR/IROperator.h"
+#include "jmlang/IR/IRPrinter.h"
+#include "jmlang/IR/Scope.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::ostringstream;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+/// The declarations generated code needs, and the default runtime.
+const char* const preamble =
+    "#include <math.h>\n"
+    "#include <stdbool.h>\n"
+    "#include <stddef.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include <time.h>\n"
+    "\n";
+
+const char* const runtime_declarations =
+    "void *jmlang_malloc(size_t);\n"
+    "void jmlang_free(void *);\n"
+    "void jmlang_error(const char *);\n"
+    "int jmlang_do_par_for(int (*)(int, uint8_t *), int, int, uint8_t *);\n"
+    "void jmlang_trace(const char *, int, int, int, int, int, const void *,\n"
+    "                  int, const int *);\n"
+    "\n"
+    "static inline uint64_t jmlang_profiling_timer(void) {\n"
+    "#if defined(__x86_64__) || defined(__i386__)\n"
+    "  return __builtin_ia32_rdtsc();\n"
+    "#else\n"
+    "  return (uint64_t)clock();\n"
+    "#endif\n"
+    "}\n"
+    "\n";
+
+/// The same runtime as the one in runtime/, which add_runtime_hooks
+/// and add_default_runtime link, in C.
+const char* const runtime =
+    "#if !defined(JMLANG_NO_RUNTIME) && !defined(JMLANG_C_RUNTIME_DEFINED)\n"
+    "#define JMLANG_C_RUNTIME_DEFINED\n"
+    "/* Everything is weak, so that pipelines in several files share one\n"
+    "   runtime, and so that a program can replace any of it. */\n"
+    "#define JMLANG_WEAK __attribute__((weak))\n"
+    "\n"
+    "typedef int (*jmlang_task_t)(int, uint8_t *);\n"
+    "\n"
+    "/* 32-byte aligned, with the pointer malloc returned just below. */\n"
+    "static void *jmlang_c_default_malloc(size_t size) {\n"
+    "  uint8_t *p = (uint8_t *)malloc(size + 32 + sizeof(void *));\n"
+    "  uint8_t *aligned;\n"
+    "  if (!p) {\n"
+    "    return NULL;\n"
+    "  }\n"
+    "  aligned = p + sizeof(void *);\n"
+    "  aligned += (32 - (uintptr_t)aligned % 32) % 32;\n"
+    "  ((void **)aligned)[-1] = p;\n"
+    "  return aligned;\n"
+    "}\n"
+    "\n"
+    "static void jmlang_c_default_free(void *ptr) {\n"
+    "  if (ptr) {\n"
+    "    free(((void **)ptr)[-1]);\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "static void jmlang_c_default_error(const char *msg) {\n"
+    "  fprintf(stderr, \"Error: %s\\n\", msg);\n"
+    "}\n"
+    "\n"
+    "static int jmlang_c_default_do_task(jmlang_task_t f, int i,\n"
+    "                                    uint8_t *closure) {\n"
+    "  return f(i, closure);\n"
+    "}\n"
+    "\n"
+    "JMLANG_WEAK void *(*jmlang_c_malloc_hook)(size_t) =\n"
+    "    jmlang_c_default_malloc;\n"
+    "JMLANG_WEAK void (*jmlang_c_free_hook)(void *) = "
+    "jmlang_c_default_free;\n"
+    "JMLANG_WEAK void (*jmlang_c_error_hook)(const char *) =\n"
+    "    jmlang_c_default_error;\n"
+    "JMLANG_WEAK int (*jmlang_c_do_task_hook)(jmlang_task_t, int,\n"
+    "                                         uint8_t *) =\n"
+    "    jmlang_c_default_do_task;\n"
+    "JMLANG_WEAK int (*jmlang_c_do_par_for_hook)(jmlang_task_t, int, int,\n"
+    "                                            uint8_t *) = NULL;\n"
+    "JMLANG_WEAK void (*jmlang_c_trace_hook)(const char *, int, int, int, "
+    "int,\n"
+    "                                       int, const void *, int,\n"
+    "                                       const int *) = NULL;\n"
+    "\n"
+    "JMLANG_WEAK void *jmlang_malloc(size_t size) {\n"
+    "  return jmlang_c_malloc_hook(size);\n"
+    "}\n"
+    "\n"
+    "JMLANG_WEAK void jmlang_free(void *ptr) { jmlang_c_free_hook(ptr); }\n"
+    "\n"
+    "JMLANG_WEAK void jmlang_error(const char *msg) {\n"
+    "  jmlang_c_error_hook(msg);\n"
+    "}\n"
+    "\n"
+    "JMLANG_WEAK int jmlang_do_task(jmlang_task_t f, int i, "
+    "uint8_t *closure) {\n"
+    "  return jmlang_c_do_task_hook(f, i, closure);\n"
+    "}\n"
+    "\n"
+    "/* By default, runs the iterations one after another, stopping at\n"
+    "   the first error. */\n"
+    "JMLANG_WEAK int jmlang_do_par_for(jmlang_task_t f, int min, "
+    "int extent,\n"
+    "                                  uint8_t *closure) {\n"
+    "  int i;\n"
+    "  if (jmlang_c_do_par_for_hook) {\n"
+    "    return jmlang_c_do_par_for_hook(f, min, extent, closure);\n"
+    "  }\n"
+    "  for (i = min; i < min + extent; i++) {\n"
+    "    int result = jmlang_do_task(f, i, closure);\n"
+    "    if (result != 0) {\n"
+    "      return result;\n"
+    "    }\n"
+    "  }\n"
+    "  return 0;\n"
+    "}\n"
+    "\n"
+    "JMLANG_WEAK void jmlang_trace(const char *func, int event, "
+    "int type_code,\n"
+    "                              int bits, int width, int value_index,\n"
+    "                              const void *value, int num_coords,\n"
+    "                              const int *coords) {\n"
+    "  if (jmlang_c_trace_hook) {\n"
+    "    jmlang_c_trace_hook(func, event, type_code, bits, width, "
+    "value_index,\n"
+    "                        value, num_coords, coords);\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "JMLANG_WEAK void jmlang_set_error_handler(void (*handler)(const char "
+    "*)) {\n"
+    "  jmlang_c_error_hook = handler ? handler : jmlang_c_default_error;\n"
+    "}\n"
+    "\n"
+    "JMLANG_WEAK void jmlang_set_custom_allocator(void *(*m)(size_t),\n"
+    "                                             void (*f)(void *)) {\n"
+    "  jmlang_c_malloc_hook = m ? m : jmlang_c_default_malloc;\n"
+    "  jmlang_c_free_hook = f ? f : jmlang_c_default_free;\n"
+    "}\n"
+    "\n"
+    "JMLANG_WEAK void jmlang_set_custom_do_task(\n"
+    "    int (*do_task)(jmlang_task_t, int, uint8_t *)) {\n"
+    "  jmlang_c_do_task_hook = do_task ? do_task : "
+    "jmlang_c_default_do_task;\n"
+    "}\n"
+    "\n"
+    "JMLANG_WEAK void jmlang_set_custom_do_par_for(\n"
+    "    int (*do_par_for)(jmlang_task_t, int, int, uint8_t *)) {\n"
+    "  jmlang_c_do_par_for_hook = do_par_for;\n"
+    "}\n"
+    "\n"
+    "JMLANG_WEAK void jmlang_set_custom_trace(\n"
+    "    void (*trace)(const char *, int, int, int, int, int, "
+    "const void *,\n"
+    "                  int, const int *)) {\n"
+    "  jmlang_c_trace_hook = trace;\n"
+    "}\n"
+    "\n"
+    "/* Loops run serially here, so there's nothing to limit. */\n"
+    "JMLANG_WEAK void jmlang_set_par_for_options(int max_threads, "
+    "int priority) {\n"
+    "  (void)max_threads;\n"
+    "  (void)priority;\n"
+    "}\n"
+    "\n"
+    "JMLANG_WEAK void jmlang_set_numa_aware(int numa_aware) {\n"
+    "  (void)numa_aware;\n"
+    "}\n"
+    "\n"
+    "/* The default allocator here doesn't cache blocks. */\n"
+    "JMLANG_WEAK void jmlang_trim_allocator(void) {}\n"
+    "#endif\n"
+    "\n";
+
+/// A name safe to use as a C identifier.
+string c_name(const string& name) {
+  string result;
+  for (size_t i = 0; i < name.size(); i++) {
+    char c = name[i];
+    result += isalnum((unsigned char)c) ? c : '_';
+  }
+  if (result.empty() || isdigit((unsigned char)result[0])) {
+    result = "_" + result;
+  }
+  return result;
+}
+
+/// Whether a C expression is a plain variable, which can have its
+/// address taken.
+bool is_identifier(const string& s) {
+  if (s.empty() || isdigit((unsigned char)s[0])) {
+    return false;
+  }
+  for (size_t i = 0; i < s.size(); i++) {
+    if (!isalnum((unsigned char)s[i]) && s[i] != '_') {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// A C string literal. Octal escapes, unlike hex ones, can't run into
+/// the characters that follow them.
+string c_string_literal(const string& s) {
+  ostringstream result;
+  result << '"';
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      result << '\\' << c;
+    } else if (c == '\n') {
+      result << "\\n";
+    } else if (c >= ' ' && c <= '~') {
+      result << c;
+    } else {
+      result << '\\' << (char)('0' + (c >> 6)) << (char)('0' + ((c >> 3) & 7))
+             << (char)('0' + (c & 7));
+    }
+  }
+  result << '"';
+  return result.str();
+}
+
+/// Declare a variable of a C type, where pointer types like "void *"
+/// go next to the name.
+string declaration(const string& type, const string& name) {
+  return type + (type[type.size() - 1] == '*' ? "" : " ") + name;
+}
+
+/// Declare a variable that is never assigned again.
+string const_declaration(const string& type, const string& name) {
+  return type[type.size() - 1] == '*' ? type + "const " + name
+                                      : "const " + type + " " + name;
+}
+
+/// The names of the variables and buffers a statement refers to.
+class FindReferencedNames : public IRGraphVisitor {
+ public:
+  set<string> names;
+
+ private:
+  using IRGraphVisitor::visit;
+
+  void visit(const Variable* op) { names.insert(op->name); }
+
+  void visit(const Load* op) {
+    IRGraphVisitor::visit(op);
+    names.insert(op->name + ".host");
+  }
+
+  void visit(const Store* op) {
+    IRGraphVisitor::visit(op);
+    names.insert(op->name + ".host");
+  }
+};
+
+/// The parts of the C file shared by the printers of a pipeline and
+/// of the bodies of its parallel loops.
+struct CFile {
+  int next_id;
+  /// Typedefs for the vector types used, and declarations of extern
+  /// functions called.
+  vector<string> declarations;
+  set<string> declared;
+  /// The task functions of parallel loops, innermost first.
+  ostringstream functions;
+
+  CFile() : next_id(0) {}
+
+  void declare(const string& name, const string& declaration) {
+    if (declared.insert(name).second) {
+      declarations.push_back(declaration);
+    }
+  }
+};
+
+/// Prints one C function. Every expression is evaluated into its own
+/// local variable, in the order CodeGen evaluates it.
+class CodeGen_C : public IRPrinter {
+ public:
+  CodeGen_C(std::ostream& s, CFile* f, const string& name)
+      : IRPrinter(s), file(f), function_name(name) {}
+
+  /// Print the pipeline function itself.
+  void compile(Stmt s, const vector<Argument>& args);
+
+  /// Print the task function for a parallel loop, which takes the
+  /// given captured symbols in a closure.
+  void compile_task(const For* op, const string& task_name,
+                    const vector<string>& names,
+                    const vector<string>& types);
+
+ private:
+  CFile* file;
+  string function_name;
+
+  /// A symbol's C expression, and its C type.
+  struct Symbol {
+    string value;
+    string type;
+  };
+  Scope<Symbol> symbols;
+
+  /// The allocations made by Allocate nodes in the current function.
+  /// Heap allocations are freed on the way out if an error occurs.
+  struct Allocation {
+    string ptr;
+    bool on_heap;
+  };
+  Scope<Allocation> allocations;
+
+  /// The C expression for the most recently printed expression.
+  string id;
+
+  /// Allocations smaller than this many bytes with a constant size go
+  /// on the stack, as in CodeGen.
+  static const int stack_allocation_limit = 16 * 1024;
+
+  string unique_name(const string& prefix) {
+    return prefix + "_" + int_to_string(file->next_id++);
+  }
+
+  void push(const string& name, const string& value, const string& type) {
+    Symbol s = {value, type};
+    symbols.push(name, s);
+  }
+
+  string print_expr(Expr e) {
+    e.accept(this);
+    return id;
+  }
+
+  /// The C type of a jmlang type. Vectors of bools are masks, with
+  /// int8_t lanes that are zero or all ones, as vector comparisons
+  /// make them.
+  string c_type(Type t);
+
+  /// The type a jmlang type is stored as in memory. Bools take a
+  /// byte.
+  Type storage_type(Type t) {
+    return t.is_bool() ? UInt(8, t.width) : t;
+  }
+
+  /// The type of the mask vector comparisons of a type produce.
+  Type mask_type(Type t) {
+    return Int(t.is_bool() ? 8 : t.bits, t.width);
+  }
+
+  /// Declare a new local holding a C expression, and return its name.
+  string print_assignment(Type t, const string& rhs) {
+    string name = unique_name("");
+    do_indent();
+    stream << const_declaration(c_type(t), name) << " = " << rhs << ";\n";
+    return name;
+  }
+
+  /// A C expression as a variable, which can have its address taken.
+  string print_lvalue(Type t, const string& e) {
+    return is_identifier(e) ? e : print_assignment(t, e);
+  }
+
+  /// Build a value one lane at a time, from a C expression for each
+  /// lane, given the suffix (like [_lane]) that picks out a lane of
+  /// a vector. Scalars are built directly.
+  string print_lanewise(Type t,
+                        const std::function<string(const string&)>& lane);
+
+  /// A lane of a value, given the suffix that picks out the lane of
+  /// a vector. Scalars stand for vectors of any width.
+  string lane(Type t, const string& v, const string& suffix) {
+    return t.is_vector() ? v + suffix : v;
+  }
+
+  /// Choose between two vectors with a mask of the same lane width.
+  string print_bit_select(Type t, const string& mask, const string& a,
+                          const string& b);
+
+  /// Turn a comparison mask into a vector of bools.
+  string print_mask_to_bool(Type mask_t, const string& mask);
+
+  string print_broadcast(Type t, const string& v);
+
+  string print_reinterpret(Type from, Type to, const string& v);
+
+  /// Arithmetic that wraps, done in the unsigned type, as signed
+  /// overflow is undefined in C.
+  string print_wrapping(Type t, const string& a, const string& op,
+                        const string& b);
+
+  string print_comparison(Expr a, Expr b, const string& op);
+
+  string print_extern_call(const Call* op);
+
+  string print_intrinsic(const Call* op);
+
+  /// Print code that frees any heap allocations and returns the
+  /// given error code.
+  void print_return(const string& code);
+
+  /// Print a loop that runs a statement once per lane.
+  void print_lane_loop(int width, const string& statement) {
+    do_indent();
+    stream << "for (int _lane = 0; _lane < " << width << "; _lane++) {\n";
+    do_indent();
+    stream << "  " << statement << ";\n";
+    do_indent();
+    stream << "}\n";
+  }
+
+  void print_parallel_for(const For* op);
+
+  using IRPrinter::visit;
+
+  void visit(const IntImm*);
+  void visit(const FloatImm*);
+  void visit(const StringImm*);
+  void visit(const Cast*);
+  void visit(const Variable*);
+  void visit(const Add*);
+  void visit(const Sub*);
+  void visit(const Mul*);
+  void visit(const Div*);
+  void visit(const Mod*);
+  void visit(const Min*);
+  void visit(const Max*);
+  void visit(const EQ*);
+  void visit(const NE*);
+  void visit(const LT*);
+  void visit(const LE*);
+  void visit(const GT*);
+  void visit(const GE*);
+  void visit(const And*);
+  void visit(const Or*);
+  void visit(const Not*);
+  void visit(const Select*);
+  void visit(const Load*);
+  void visit(const Ramp*);
+  void visit(const Broadcast*);
+  void visit(const Call*);
+  void visit(const Let*);
+  void visit(const LetStmt*);
+  void visit(const AssertStmt*);
+  void visit(const Pipeline*);
+  void visit(const For*);
+  void visit(const Store*);
+  void visit(const Provide*);
+  void visit(const Allocate*);
+  void visit(const Free*);
+  void visit(const Realize*);
+  void visit(const Block*);
+  void visit(const IfThenElse*);
+  void visit(const Evaluate*);
+};
+
+string CodeGen_C::c_type(Type t) {
+  Type e = t.element_of();
+  string base;
+  if (e.is_handle()) {
+    assert(t.is_scalar() && "Vectors of handles can't be compiled to C");
+    return "void *";
+  } else if (e.is_float()) {
+    if (e.bits != 32 && e.bits != 64) {
+      std::cerr << "Can't compile " << e.bits << "-bit floats to C\n";
+      assert(false);
+    }
+    if (t.is_scalar()) {
+      return e.bits == 32 ? "float" : "double";
+    }
+    base = e.bits == 32 ? "float" : "double";
+  } else if (e.is_bool()) {
+    if (t.is_scalar()) {
+      return "bool";
+    }
+    e = Int(8);
+    base = "int8_t";
+  } else {
+    if (e.bits != 8 && e.bits != 16 && e.bits != 32 && e.bits != 64) {
+      std::cerr << "Can't compile " << e.bits << "-bit integers to C\n";
+      assert(false);
+    }
+    base = string(e.is_uint() ? "uint" : "int") + int_to_string(e.bits) + "_t";
+    if (t.is_scalar()) {
+      return base;
+    }
+  }
+
+  if (t.width & (t.width - 1)) {
+    std::cerr << "Can't compile vectors of width " << t.width
+              << " to C. The width must be a power of two.\n";
+    assert(false);
+  }
+  string name = string(e.is_float() ? "float" : e.is_uint() ? "uint" : "int") +
+                int_to_string(e.bits) + "x" + int_to_string(t.width) + "_t";
+  file->declare(name, "typedef " + base + " " + name +
+                          " __attribute__((vector_size(" +
+                          int_to_string(e.bytes() * t.width) + ")));");
+  return name;
+}
+
+string CodeGen_C::print_lanewise(
+    Type t, const std::function<string(const string&)>& lane) {
+  if (t.is_scalar()) {
+    return print_assignment(t, lane(""));
+  }
+  string name = unique_name("");
+  do_indent();
+  stream << c_type(t) << " " << name << ";\n";
+  print_lane_loop(t.width, name + "[_lane] = " + lane("[_lane]"));
+  return name;
+}
+
+string CodeGen_C::print_bit_select(Type t, const string& mask,
+                                   const string& a, const string& b) {
+  string m = c_type(mask_type(t));
+  return print_assignment(t, "(" + c_type(t) + ")(((" + m + ")" + a + " & " +
+                                 mask + ") | ((" + m + ")" + b + " & ~" +
+                                 mask + "))");
+}
+
+string CodeGen_C::print_mask_to_bool(Type mask_t, const string& mask) {
+  Type t = Bool(mask_t.width);
+  if (mask_t.bits == 8) {
+    return print_assignment(t, mask);
+  }
+  return print_assignment(
+      t, "__builtin_convertvector(" + mask + ", " + c_type(t) + ")");
+}
+
+string CodeGen_C::print_broadcast(Type t, const string& v) {
+  // Bools become masks.
+  string lane = t.is_bool() ? "(int8_t)-" + v : v;
+  string rhs = "{";
+  for (int i = 0; i < t.width; i++) {
+    rhs += (i > 0 ? ", " : "") + lane;
+  }
+  return print_assignment(t, rhs + "}");
+}
+
+string CodeGen_C::print_reinterpret(Type from, Type to, const string& v) {
+  if (from == to) {
+    return v;
+  } else if (from.is_handle() || to.is_handle()) {
+    return print_assignment(to, "(" + c_type(to) + ")(intptr_t)" + v);
+  } else if (to.is_vector()) {
+    // Casts between vector types of the same size keep the bits.
+    return print_assignment(to, "(" + c_type(to) + ")" + v);
+  }
+  string src = print_lvalue(from, v);
+  string name = unique_name("");
+  do_indent();
+  stream << c_type(to) << " " << name << ";\n";
+  do_indent();
+  stream << "memcpy(&" << name << ", &" << src << ", sizeof(" << name
+         << "));\n";
+  return name;
+}
+
+string CodeGen_C::print_wrapping(Type t, const string& a, const string& op,
+                                 const string& b) {
+  if (t.is_int() && (t.bits >= 32 || t.is_vector())) {
+    string u = c_type(UInt(t.bits, t.width));
+    return print_assignment(t, "(" + c_type(t) + ")((" + u + ")" + a + " " +
+                                   op + " (" + u + ")" + b + ")");
+  }
+  return print_assignment(t, a + " " + op + " " + b);
+}
+
+string CodeGen_C::print_comparison(Expr a, Expr b, const string& op) {
+  string va = print_expr(a);
+  string vb = print_expr(b);
+  Type t = a.type();
+  if (t.is_scalar()) {
+    return print_assignment(Bool(), va + " " + op + " " + vb);
+  }
+  Type mask_t = mask_type(t);
+  return print_mask_to_bool(mask_t,
+                            print_assignment(mask_t, va + " " + op + " " + vb));
+}
+
+void CodeGen_C::print_return(const string& code) {
+  for (Scope<Allocation>::const_iterator iter = allocations.cbegin();
+       iter != allocations.cend(); ++iter) {
+    if (iter.value().on_heap) {
+      do_indent();
+      stream << "jmlang_free(" << iter.value().ptr << ");\n";
+    }
+  }
+  do_indent();
+  stream << "return " << code << ";\n";
+}
+
+void CodeGen_C::compile(Stmt s, const vector<Argument>& args) {
+  stream << "int " << function_name << "(";
+  for (size_t i = 0; i < args.size(); i++) {
+    if (i > 0) {
+      stream << ", ";
+    }
+    if (args[i].is_buffer) {
+      stream << "buffer_t *" << c_name(args[i].name) << "_buffer";
+    } else {
+      stream << declaration(c_type(args[i].type), c_name(args[i].name));
+    }
+  }
+  stream << ") {\n";
+  indent = 2;
+
+  // Unpack the fields of the buffers that the statement uses, as
+  // CodeGen::unpack_buffer does.
+  FindReferencedNames refs;
+  s.accept(&refs);
+  for (size_t i = 0; i < args.size(); i++) {
+    string name = args[i].name;
+    if (!args[i].is_buffer) {
+      push(name, c_name(name), c_type(args[i].type));
+      continue;
+    }
+    string buffer = c_name(name) + "_buffer";
+    push(name + ".buffer", buffer, "buffer_t *");
+    vector<string> fields, types;
+    fields.push_back("dev");
+    types.push_back("uint64_t");
+    fields.push_back("host");
+    types.push_back("uint8_t *");
+    for (int d = 0; d < 4; d++) {
+      const char* dim_fields[] = {"min", "extent", "stride"};
+      for (int j = 0; j < 3; j++) {
+        fields.push_back(string(dim_fields[j]) + "." + int_to_string(d));
+        types.push_back("int32_t");
+      }
+    }
+    fields.push_back("elem_size");
+    types.push_back("int32_t");
+    fields.push_back("host_dirty");
+    types.push_back("bool");
+    fields.push_back("dev_dirty");
+    types.push_back("bool");
+    for (size_t j = 0; j < fields.size(); j++) {
+      string symbol = name + "." + fields[j];
+      if (!refs.names.count(symbol)) {
+        continue;
+      }
+      // min.0 is min[0] in the struct.
+      string field = fields[j];
+      size_t dot = field.find('.');
+      if (dot != string::npos) {
+        field = field.substr(0, dot) + "[" + field.substr(dot + 1) + "]";
+      }
+      string local = c_name(symbol);
+      do_indent();
+      stream << const_declaration(types[j], local) << " = " << buffer << "->"
+             << field << ";\n";
+      push(symbol, local, types[j]);
+    }
+  }
+
+  print(s);
+  do_indent();
+  stream << "return 0;\n";
+  stream << "}\n";
+}
+
+void CodeGen_C::compile_task(const For* op, const string& task_name,
+                             const vector<string>& names,
+                             const vector<string>& types) {
+  stream << "struct " << task_name << "_closure {\n";
+  for (size_t i = 0; i < names.size(); i++) {
+    stream << "  " << declaration(types[i], "f" + int_to_string(i)) << ";\n";
+  }
+  if (names.empty()) {
+    stream << "  char unused;\n";
+  }
+  stream << "};\n"
+         << "\n"
+         << "static int " << task_name << "(int " << c_name(op->name)
+         << ", uint8_t *closure_arg) {\n";
+  indent = 2;
+  do_indent();
+  stream << "const struct " << task_name << "_closure *closure = (const struct "
+         << task_name << "_closure *)closure_arg;\n";
+  if (names.empty()) {
+    do_indent();
+    stream << "(void)closure;\n";
+  }
+  for (size_t i = 0; i < names.size(); i++) {
+    string local = unique_name(c_name(names[i]));
+    do_indent();
+    stream << const_declaration(types[i], local) << " = closure->f" << i
+           << ";\n";
+    push(names[i], local, types[i]);
+  }
+  push(op->name, c_name(op->name), "int32_t");
+  print(op->body);
+  do_indent();
+  stream << "return 0;\n";
+  stream << "}\n"
+         << "\n";
+}
+
+void CodeGen_C::visit(const IntImm* op) {
+  // The most negative int32 isn't a literal in C.
+  id = op->value == INT32_MIN ? "(-2147483647 - 1)" : int_to_string(op->value);
+}
+
+void CodeGen_C::visit(const FloatImm* op) {
+  float f = op->value;
+  if (std::isnan(f)) {
+    id = "(float)NAN";
+  } else if (std::isinf(f)) {
+    id = f > 0 ? "(float)INFINITY" : "(-(float)INFINITY)";
+  } else {
+    // Enough digits to get back the same float.
+    ostringstream s;
+    s << std::setprecision(9) << f;
+    string digits = s.str();
+    if (digits.find_first_of(".e") == string::npos) {
+      digits += ".0";
+    }
+    id = digits + "f";
+    if (f < 0) {
+      id = "(" + id + ")";
+    }
+  }
+}
+
+void CodeGen_C::visit(const StringImm* op) {
+  id = c_string_literal(op->value);
+}
+
+void CodeGen_C::visit(const Cast* op) {
+  Type src = op->value.type();
+  Type dst = op->type;
+  string v = print_expr(op->value);
+  if (src == dst) {
+    id = v;
+  } else if (src.is_handle() || dst.is_handle()) {
+    id = print_reinterpret(src, dst, v);
+  } else if (dst.is_scalar()) {
+    // Bools convert to zero or one, and to bool by comparing to zero,
+    // as in CodeGen.
+    id = dst.is_bool() ? print_assignment(dst, v + " != 0")
+                       : print_assignment(dst, "(" + c_type(dst) + ")" + v);
+  } else if (dst.is_bool()) {
+    Type mask_t = mask_type(src);
+    id = print_mask_to_bool(mask_t, print_assignment(mask_t, v + " != 0"));
+  } else {
+    // Masks are minus one for true.
+    id = print_assignment(dst, "__builtin_convertvector(" +
+                                   string(src.is_bool() ? "-" : "") + v +
+                                   ", " + c_type(dst) + ")");
+  }
+}
+
+void CodeGen_C::visit(const Variable* op) {
+  id = symbols.get(op->name).value;
+}
+
+void CodeGen_C::visit(const Add* op) {
+  string a = print_expr(op->a);
+  string b = print_expr(op->b);
+  id = print_wrapping(op->type, a, "+", b);
+}
+
+void CodeGen_C::visit(const Sub* op) {
+  string a = print_expr(op->a);
+  string b = print_expr(op->b);
+  id = print_wrapping(op->type, a, "-", b);
+}
+
+void CodeGen_C::visit(const Mul* op) {
+  string a = print_expr(op->a);
+  string b = print_expr(op->b);
+  id = print_wrapping(op->type, a, "*", b);
+}
+
+void CodeGen_C::visit(const Div* op) {
+  Type t = op->type;
+  string a = print_expr(op->a);
+  string b = print_expr(op->b);
+  if (t.is_float() || t.is_uint()) {
+    id = print_assignment(t, a + " / " + b);
+    return;
+  }
+  // Signed division rounds towards negative infinity, so round the
+  // quotient down when there's a remainder of the other sign to b.
+  string q = print_assignment(t, a + " / " + b);
+  string r = print_assignment(t, a + " % " + b);
+  string wrong_sign = "((" + r + " != 0) & ((" + r + " ^ " + b + ") < 0))";
+  // Vector comparisons are minus one for true.
+  id = print_assignment(t, q + (t.is_vector() ? " + " : " - ") + wrong_sign);
+}
+
+void CodeGen_C::visit(const Mod* op) {
+  Type t = op->type;
+  string a = print_expr(op->a);
+  string b = print_expr(op->b);
+  if (t.is_float()) {
+    // a - b * floor(a / b), as in CodeGen.
+    string floor_fn = t.bits == 32 ? "floorf" : "floor";
+    id = print_lanewise(t, [&](const string& l) {
+      string la = lane(t, a, l), lb = lane(t, b, l);
+      return la + " - " + lb + " * " + floor_fn + "(" + la + " / " + lb + ")";
+    });
+  } else if (t.is_uint()) {
+    id = print_assignment(t, a + " % " + b);
+  } else {
+    // The remainder takes the sign of b.
+    string r = print_assignment(t, a + " % " + b);
+    string wrong_sign = "((" + r + " != 0) & ((" + r + " ^ " + b + ") < 0))";
+    id = t.is_vector()
+             ? print_assignment(t, r + " + (" + b + " & " + wrong_sign + ")")
+             : print_assignment(t, r + " + (" + wrong_sign + " ? " + b +
+                                       " : 0)");
+  }
+}
+
+void CodeGen_C::visit(const Min* op) {
+  Type t = op->type;
+  string a = print_expr(op->a);
+  string b = print_expr(op->b);
+  if (t.is_scalar()) {
+    id = print_assignment(t, a + " < " + b + " ? " + a + " : " + b);
+  } else {
+    id = print_bit_select(t, print_assignment(mask_type(t), a + " < " + b), a,
+                          b);
+  }
+}
+
+void CodeGen_C::visit(const Max* op) {
+  Type t = op->type;
+  string a = print_expr(op->a);
+  string b = print_expr(op->b);
+  if (t.is_scalar()) {
+    id = print_assignment(t, a + " > " + b + " ? " + a + " : " + b);
+  } else {
+    id = print_bit_select(t, print_assignment(mask_type(t), a + " > " + b), a,
+                          b);
+  }
+}
+
+void CodeGen_C::visit(const EQ* op) {
+  id = print_comparison(op->a, op->b, "==");
+}
+
+void CodeGen_C::visit(const NE* op) {
+  id = print_comparison(op->a, op->b, "!=");
+}
+
+void CodeGen_C::visit(const LT* op) {
+  id = print_comparison(op->a, op->b, "<");
+}
+
+void CodeGen_C::visit(const LE* op) {
+  id = print_comparison(op->a, op->b, "<=");
+}
+
+void CodeGen_C::visit(const GT* op) {
+  id = print_comparison(op->a, op->b, ">");
+}
+
+void CodeGen_C::visit(const GE* op) {
+  id = print_comparison(op->a, op->b, ">=");
+}
+
+void CodeGen_C::visit(const And* op) {
+  string a = print_expr(op->a);
+  string b = print_expr(op->b);
+  id = print_assignment(op->type,
+                        a + (op->type.is_scalar() ? " && " : " & ") + b);
+}
+
+void CodeGen_C::visit(const Or* op) {
+  string a = print_expr(op->a);
+  string b = print_expr(op->b);
+  id = print_assignment(op->type,
+                        a + (op->type.is_scalar() ? " || " : " | ") + b);
+}
+
+void CodeGen_C::visit(const Not* op) {
+  string a = print_expr(op->a);
+  id = print_assignment(op->type, (op->type.is_scalar() ? "!" : "~") + a);
+}
+
+void CodeGen_C::visit(const Select* op) {
+  Type t = op->type;
+  string cond = print_expr(op->condition);
+  string a = print_expr(op->true_value);
+  string b = print_expr(op->false_value);
+  if (op->condition.type().is_scalar()) {
+    id = print_assignment(t, cond + " ? " + a + " : " + b);
+    return;
+  }
+  Type mask_t = mask_type(t);
+  string mask =
+      mask_t.bits == 8
+          ? cond
+          : print_assignment(mask_t, "__builtin_convertvector(" + cond + ", " +
+                                         c_type(mask_t) + ")");
+  id = print_bit_select(t, mask, a, b);
+}
+
+void CodeGen_C::visit(const Load* op) {
+  Type t = op->type;
+  Type storage = storage_type(t);
+  string ptr = "((const " + c_type(storage.element_of()) + " *)" +
+               symbols.get(op->name + ".host").value + ")";
+  const Ramp* ramp = op->index.as<Ramp>();
+  const Broadcast* broadcast = op->index.as<Broadcast>();
+
+  string v;
+  if (t.is_scalar()) {
+    v = print_assignment(storage, ptr + "[" + print_expr(op->index) + "]");
+  } else if (ramp && is_one(ramp->stride)) {
+    // A dense vector load. memcpy makes no assumptions about
+    // alignment.
+    string base = print_expr(ramp->base);
+    v = unique_name("");
+    do_indent();
+    stream << c_type(storage) << " " << v << ";\n";
+    do_indent();
+    stream << "memcpy(&" << v << ", " << ptr << " + " << base << ", sizeof("
+           << v << "));\n";
+  } else if (broadcast) {
+    string index = print_expr(broadcast->value);
+    v = print_broadcast(
+        storage, print_assignment(storage.element_of(),
+                                  ptr + "[" + index + "]"));
+  } else {
+    // A gather.
+    string index = print_expr(op->index);
+    v = print_lanewise(storage, [&](const string& l) {
+      return ptr + "[" + index + l + "]";
+    });
+  }
+
+  if (!t.is_bool()) {
+    id = v;
+  } else if (t.is_scalar()) {
+    id = print_assignment(t, v + " != 0");
+  } else {
+    id = print_mask_to_bool(Int(8, t.width), print_assignment(Int(8, t.width),
+                                                              v + " != 0"));
+  }
+}
+
+void CodeGen_C::visit(const Ramp* op) {
+  string base = print_expr(op->base);
+  string stride = print_expr(op->stride);
+  string rhs = "{" + base;
+  for (int i = 1; i < op->width; i++) {
+    rhs += ", " + base + " + " + stride + " * " + int_to_string(i);
+  }
+  id = print_assignment(op->type, rhs + "}");
+}
+
+void CodeGen_C::visit(const Broadcast* op) {
+  id = print_broadcast(op->type, print_expr(op->value));
+}
+
+void CodeGen_C::visit(const Call* op) {
+  if (op->call_type == Call::Extern) {
+    id = print_extern_call(op);
+  } else if (op->call_type == Call::Intrinsic) {
+    id = print_intrinsic(op);
+  } else {
+    std::cerr << "Call to " << op->name
+              << " should have been replaced by a Load before codegen\n";
+    assert(false);
+  }
+}
+
+string CodeGen_C::print_extern_call(const Call* op) {
+  Type t = op->type;
+  vector<string> args(op->args.size());
+  for (size_t i = 0; i < op->args.size(); i++) {
+    args[i] = print_expr(op->args[i]);
+  }
+
+  // Math functions are named like sin_f32, and map onto libm.
+  string name = op->name;
+  size_t underscore = name.rfind('_');
+  string base = underscore == string::npos ? name : name.substr(0, underscore);
+  string suffix =
+      underscore == string::npos ? "" : name.substr(underscore + 1);
+  bool is_math = suffix == "f32" || suffix == "f64";
+  string f = suffix == "f32" ? "f" : "";
+
+  if (is_math && args.empty() &&
+      (base == "inf" || base == "neg_inf" || base == "nan")) {
+    string v = "(" + c_type(t.element_of()) + ")" +
+               (base == "nan" ? "NAN" : "INFINITY");
+    return print_lanewise(t, [&](const string&) {
+      return base == "neg_inf" ? "-" + v : v;
+    });
+  } else if (is_math && base == "round") {
+    // Ties round up.
+    return print_lanewise(t, [&](const string& l) {
+      return "floor" + f + "(" + lane(t, args[0], l) + " + 0.5" + f + ")";
+    });
+  } else if (base == "abs" && t.is_int()) {
+    string u = c_type(UInt(t.bits));
+    return print_lanewise(t, [&](const string& l) {
+      string a = lane(t, args[0], l);
+      return "(" + c_type(t.element_of()) + ")(" + a + " < 0 ? 0 - (" + u +
+             ")" + a + " : (" + u + ")" + a + ")";
+    });
+  }
+
+  string symbol = name;
+  if (is_math) {
+    symbol = (base == "abs" ? "fabs" : base) + f;
+  } else {
+    // Declare other extern functions from the types they're called
+    // with.
+    string declaration = c_type(t.element_of()) + " " + name + "(";
+    for (size_t i = 0; i < op->args.size(); i++) {
+      declaration +=
+          (i > 0 ? ", " : "") + c_type(op->args[i].type().element_of());
+    }
+    file->declare(name, declaration + (op->args.empty() ? "void);" : ");"));
+  }
+  return print_lanewise(t, [&](const string& l) {
+    string call = symbol + "(";
+    for (size_t i = 0; i < args.size(); i++) {
+      call += (i > 0 ? ", " : "") + lane(op->args[i].type(), args[i], l);
+    }
+    return call + ")";
+  });
+}
+
+string CodeGen_C::print_intrinsic(const Call* op) {
+  const string& name = op->name;
+  Type t = op->type;
+
+  if (name == Call::bitwise_and || name == Call::bitwise_or ||
+      name == Call::bitwise_xor || name == Call::bitwise_not) {
+    // Bitwise operations on floats act on their bits.
+    Type int_t = Int(t.bits, t.width);
+    vector<string> args(op->args.size());
+    for (size_t i = 0; i < op->args.size(); i++) {
+      args[i] = print_expr(op->args[i]);
+      if (t.is_float()) {
+        args[i] = print_reinterpret(t, int_t, args[i]);
+      }
+    }
+    string v;
+    if (name == Call::bitwise_not) {
+      v = print_assignment(t.is_float() ? int_t : t, "~" + args[0]);
+    } else {
+      string op_str = name == Call::bitwise_and  ? " & "
+                      : name == Call::bitwise_or ? " | "
+                                                 : " ^ ";
+      v = print_assignment(t.is_float() ? int_t : t,
+                           args[0] + op_str + args[1]);
+    }
+    return t.is_float() ? print_reinterpret(int_t, t, v) : v;
+  } else if (name == Call::shift_left) {
+    string a = print_expr(op->args[0]);
+    string b = print_expr(op->args[1]);
+    // Shifting negative numbers left is undefined in C.
+    string u = c_type(UInt(t.bits, t.width));
+    return print_assignment(t, "(" + c_type(t) + ")((" + u + ")" + a +
+                                   " << " + b + ")");
+  } else if (name == Call::shift_right) {
+    string a = print_expr(op->args[0]);
+    string b = print_expr(op->args[1]);
+    return print_assignment(t, a + " >> " + b);
+  } else if (name == Call::reinterpret) {
+    return print_reinterpret(op->args[0].type(), t,
+                             print_expr(op->args[0]));
+  } else if (name == Call::shuffle_vector) {
+    string v = print_expr(op->args[0]);
+    vector<string> lanes;
+    for (size_t i = 1; i < op->args.size(); i++) {
+      const int* idx = as_const_int(op->args[i]);
+      assert(idx && "shuffle_vector indices must be constant");
+      lanes.push_back(v + "[" + int_to_string(*idx) + "]");
+    }
+    if (lanes.size() == 1) {
+      return print_assignment(t, t.is_bool() ? lanes[0] + " != 0" : lanes[0]);
+    }
+    string rhs = "{";
+    for (size_t i = 0; i < lanes.size(); i++) {
+      rhs += (i > 0 ? ", " : "") + lanes[i];
+    }
+    return print_assignment(t, rhs + "}");
+  } else if (name == Call::interleave_vectors) {
+    // Lane i of argument j goes to lane i * n + j.
+    int n = (int)op->args.size();
+    int w = op->args[0].type().width;
+    vector<string> args(n);
+    for (int j = 0; j < n; j++) {
+      args[j] = print_expr(op->args[j]);
+    }
+    if (n == 1) {
+      return args[0];
+    }
+    string rhs = "{";
+    for (int i = 0; i < w; i++) {
+      for (int j = 0; j < n; j++) {
+        Type arg_t = op->args[j].type();
+        string l = lane(arg_t, args[j], "[" + int_to_string(i) + "]");
+        if (arg_t.is_bool() && arg_t.is_scalar()) {
+          l = "(int8_t)-" + l;
+        }
+        rhs += (i + j > 0 ? ", " : "") + l;
+      }
+    }
+    return print_assignment(t, rhs + "}");
+  } else if (name == Call::lerp) {
+    // The same expression CodeGen generates.
+    Expr zero = op->args[0], one = op->args[1], weight = op->args[2];
+    Type ft = Float(t.is_float() ? t.bits : (t.bits >= 32 ? 64 : 32), t.width);
+    Expr w = cast(ft, weight);
+    if (!weight.type().is_float()) {
+      w = w / cast(ft, weight.type().max());
+    }
+    Expr e = cast(ft, zero) + (cast(ft, one) - cast(ft, zero)) * w;
+    if (!t.is_float()) {
+      e = floor(e + cast(ft, Expr(0.5f)));
+    }
+    return print_expr(cast(t, e));
+  } else if (name == Call::create_buffer_t) {
+    // create_buffer_t(host, elem_size, min0, extent0, stride0, min1, ...)
+    assert(op->args.size() >= 2 && (op->args.size() - 2) % 3 == 0 &&
+           "Wrong number of arguments to create_buffer_t");
+    vector<string> args(op->args.size());
+    for (size_t i = 0; i < op->args.size(); i++) {
+      args[i] = print_expr(op->args[i]);
+    }
+    string b = unique_name("buffer");
+    do_indent();
+    stream << "buffer_t " << b << ";\n";
+    do_indent();
+    stream << "memset(&" << b << ", 0, sizeof(" << b << "));\n";
+    do_indent();
+    stream << b << ".host = (uint8_t *)" << args[0] << ";\n";
+    do_indent();
+    stream << b << ".elem_size = " << args[1] << ";\n";
+    int dims = (int)(op->args.size() - 2) / 3;
+    for (int i = 0; i < dims && i < 4; i++) {
+      const char* fields[] = {"min", "extent", "stride"};
+      for (int j = 0; j < 3; j++) {
+        do_indent();
+        stream << b << "." << fields[j] << "[" << i
+               << "] = " << args[2 + i * 3 + j] << ";\n";
+      }
+    }
+    return print_assignment(t, "&" + b);
+  } else if (name == Call::extract_buffer_min ||
+             name == Call::extract_buffer_extent) {
+    string b = print_expr(op->args[0]);
+    const int* dim = as_const_int(op->args[1]);
+    assert(dim && *dim >= 0 && *dim < 4 && "Bad buffer dimension");
+    return print_assignment(
+        t, "((buffer_t *)" + b + ")->" +
+               (name == Call::extract_buffer_min ? "min[" : "extent[") +
+               int_to_string(*dim) + "]");
+  } else if (name == Call::rewrite_buffer) {
+    // rewrite_buffer(buffer, elem_size, min0, extent0, stride0, ...)
+    vector<string> args(op->args.size());
+    for (size_t i = 0; i < op->args.size(); i++) {
+      args[i] = print_expr(op->args[i]);
+    }
+    string b = "((buffer_t *)" + args[0] + ")";
+    do_indent();
+    stream << b << "->elem_size = " << args[1] << ";\n";
+    int dims = (int)(op->args.size() - 2) / 3;
+    for (int i = 0; i < dims; i++) {
+      const char* fields[] = {"min", "extent", "stride"};
+      for (int j = 0; j < 3; j++) {
+        do_indent();
+        stream << b << "->" << fields[j] << "[" << i
+               << "] = " << args[2 + i * 3 + j] << ";\n";
+      }
+    }
+    return "0";
+  } else if (name == Call::profiling_timer) {
+    return print_assignment(t,
+                            "(" + c_type(t) + ")jmlang_profiling_timer()");
+  } else if (name == Call::trace) {
+    // trace(func_name, event, value_index, value, coordinates...)
+    // calls jmlang_trace, and evaluates to the traced value.
+    assert(op->args.size() >= 4 && "Wrong number of arguments to trace");
+    Type vt = op->args[3].type();
+    string func_name = print_expr(op->args[0]);
+    string event = print_expr(op->args[1]);
+    string value_index = print_expr(op->args[2]);
+    string v = print_expr(op->args[3]);
+    int num_coords = (int)op->args.size() - 4;
+    string coords = "{";
+    for (int i = 0; i < num_coords; i++) {
+      coords += (i > 0 ? ", " : "") + print_expr(op->args[4 + i]);
+    }
+    if (num_coords == 0) {
+      coords += "0";
+    }
+    // Bools are stored as bytes of zero or one.
+    string stored =
+        !vt.is_bool()       ? v
+        : vt.is_scalar()    ? "(uint8_t)" + v
+                            : "(" + c_type(UInt(8, vt.width)) + ")-" + v;
+    string value = print_lvalue(storage_type(vt), stored);
+    string coords_name = unique_name("coords");
+    do_indent();
+    stream << "const int32_t " << coords_name << "[] = " << coords << "};\n";
+    int type_code = vt.is_int() ? 0 : vt.is_uint() ? 1 : vt.is_float() ? 2 : 3;
+    do_indent();
+    stream << "jmlang_trace(" << func_name << ", " << event << ", "
+           << type_code << ", " << vt.bits << ", " << vt.width << ", "
+           << value_index << ", &" << value << ", " << num_coords << ", "
+           << coords_name << ");\n";
+    return vt == t ? v : "0";
+  }
+
+  std::cerr << "Codegen of intrinsic " << name << " to C is not supported\n";
+  assert(false);
+  return "";
+}
+
+void CodeGen_C::visit(const Let* op) {
+  push(op->name, print_expr(op->value), c_type(op->value.type()));
+  id = print_expr(op->body);
+  symbols.pop(op->name);
+}
+
+void CodeGen_C::visit(const LetStmt* op) {
+  push(op->name, print_expr(op->value), c_type(op->value.type()));
+  print(op->body);
+  symbols.pop(op->name);
+}
+
+void CodeGen_C::visit(const AssertStmt* op) {
+  string cond = print_expr(op->condition);
+  do_indent();
+  stream << "if (!" << cond << ") {\n";
+  indent += 2;
+  do_indent();
+  stream << "jmlang_error(" << c_string_literal(op->message) << ");\n";
+  print_return("-1");
+  indent -= 2;
+  do_indent();
+  stream << "}\n";
+}
+
+void CodeGen_C::visit(const Pipeline* op) {
+  do_indent();
+  stream << "// produce " << op->name << "\n";
+  print(op->produce);
+  if (op->update.defined()) {
+    do_indent();
+    stream << "// update " << op->name << "\n";
+    print(op->update);
+  }
+  do_indent();
+  stream << "// consume " << op->name << "\n";
+  print(op->consume);
+}
+
+void CodeGen_C::visit(const For* op) {
+  if (op->for_type == For::Parallel) {
+    print_parallel_for(op);
+    return;
+  }
+  // Vectorized and unrolled loops should have been expanded by
+  // lowering. If they haven't been, running them serially is still
+  // correct.
+  string min = print_expr(op->min);
+  string extent = print_expr(op->extent);
+  string end = print_assignment(Int(32), min + " + " + extent);
+  string var = c_name(op->name);
+  do_indent();
+  stream << "for (int32_t " << var << " = " << min << "; " << var << " < "
+         << end << "; " << var << "++) {\n";
+  indent += 2;
+  push(op->name, var, "int32_t");
+  print(op->body);
+  symbols.pop(op->name);
+  indent -= 2;
+  do_indent();
+  stream << "}\n";
+}
+
+void CodeGen_C::print_parallel_for(const For* op) {
+  string min = print_expr(op->min);
+  string extent = print_expr(op->extent);
+
+  // Pack everything the body refers to that's defined outside of it
+  // into a closure, and outline the body into a task function, as
+  // CodeGen does.
+  FindReferencedNames refs;
+  op->body.accept(&refs);
+  vector<string> names, values, types;
+  for (set<string>::iterator iter = refs.names.begin();
+       iter != refs.names.end(); ++iter) {
+    if (*iter != op->name && symbols.contains(*iter)) {
+      Symbol s = symbols.get(*iter);
+      names.push_back(*iter);
+      values.push_back(s.value);
+      types.push_back(s.type);
+    }
+  }
+  string task = unique_name(function_name + "_par_for_" + c_name(op->name));
+  ostringstream task_source;
+  CodeGen_C task_printer(task_source, file, function_name);
+  // Allocations made outside the loop aren't the task's to free.
+  for (Scope<Allocation>::const_iterator iter = allocations.cbegin();
+       iter != allocations.cend(); ++iter) {
+    Allocation a = {"", false};
+    task_printer.allocations.push(iter.name(), a);
+  }
+  task_printer.compile_task(op, task, names, types);
+  file->functions << task_source.str();
+
+  string closure = unique_name("closure");
+  do_indent();
+  stream << "struct " << task << "_closure " << closure << ";\n";
+  for (size_t i = 0; i < names.size(); i++) {
+    do_indent();
+    stream << closure << ".f" << i << " = " << values[i] << ";\n";
+  }
+  string result = print_assignment(
+      Int(32), "jmlang_do_par_for(" + task + ", " + min + ", " + extent +
+                   ", (uint8_t *)&" + closure + ")");
+  // If any task failed, pass its error code on.
+  do_indent();
+  stream << "if (" << result << " != 0) {\n";
+  indent += 2;
+  print_return(result);
+  indent -= 2;
+  do_indent();
+  stream << "}\n";
+}
+
+void CodeGen_C::visit(const Store* op) {
+  Type t = op->value.type();
+  Type storage = storage_type(t);
+  string ptr = "((" + c_type(storage.element_of()) + " *)" +
+               symbols.get(op->name + ".host").value + ")";
+  string v = print_expr(op->value);
+  if (t.is_bool() && t.is_vector()) {
+    // Masks are minus one for true.
+    v = print_assignment(storage, "(" + c_type(storage) + ")-" + v);
+  }
+  const Ramp* ramp = op->index.as<Ramp>();
+
+  if (t.is_scalar()) {
+    string index = print_expr(op->index);
+    do_indent();
+    stream << ptr << "[" << index << "] = " << v << ";\n";
+  } else if (ramp && is_one(ramp->stride)) {
+    // A dense vector store.
+    string base = print_expr(ramp->base);
+    v = print_lvalue(storage, v);
+    do_indent();
+    stream << "memcpy(" << ptr << " + " << base << ", &" << v << ", sizeof("
+           << v << "));\n";
+  } else {
+    // A scatter. Store each lane separately.
+    string index = print_expr(op->index);
+    print_lane_loop(t.width, ptr + "[" + lane(op->index.type(), index,
+                                               "[_lane]") +
+                                 "] = " + lane(t, v, "[_lane]"));
+  }
+}
+
+void CodeGen_C::visit(const Provide* op) {
+  std::cerr << "Provide to " << op->name
+            << " should have been replaced by a Store before codegen\n";
+  assert(false);
+}
+
+void CodeGen_C::visit(const Allocate* op) {
+  int bytes = op->type.bytes();
+  const int* const_size = as_const_int(op->size);
+  string elem = c_type(storage_type(op->type).element_of());
+
+  Allocation a;
+  if (const_size && (int64_t)*const_size * bytes <= stack_allocation_limit) {
+    string array = unique_name(c_name(op->name));
+    do_indent();
+    stream << elem << " " << array << "[" << std::max(*const_size, 1)
+           << "] __attribute__((aligned(32)));\n";
+    a.ptr = "(uint8_t *)" + array;
+    a.on_heap = false;
+  } else {
+    string size = print_expr(op->size);
+    a.ptr = unique_name(c_name(op->name));
+    a.on_heap = true;
+    do_indent();
+    stream << "uint8_t *" << a.ptr << " = (uint8_t *)jmlang_malloc((size_t)"
+           << size << " * " << bytes << ");\n";
+    do_indent();
+    stream << "if (!" << a.ptr << ") {\n";
+    indent += 2;
+    do_indent();
+    stream << "jmlang_error("
+           << c_string_literal("Out of memory allocating " + op->name)
+           << ");\n";
+    print_return("-1");
+    indent -= 2;
+    do_indent();
+    stream << "}\n";
+  }
+
+  push(op->name + ".host", a.ptr, "uint8_t *");
+  allocations.push(op->name, a);
+  print(op->body);
+
+  // Free it if the body didn't.
+  if (allocations.contains(op->name) &&
+      allocations.get(op->name).ptr == a.ptr) {
+    if (a.on_heap) {
+      do_indent();
+      stream << "jmlang_free(" << a.ptr << ");\n";
+    }
+    allocations.pop(op->name);
+  }
+  symbols.pop(op->name + ".host");
+}
+
+void CodeGen_C::visit(const Free* op) {
+  Allocation a = allocations.get(op->name);
+  if (a.on_heap) {
+    do_indent();
+    stream << "jmlang_free(" << a.ptr << ");\n";
+  }
+  allocations.pop(op->name);
+}
+
+void CodeGen_C::visit(const Realize* op) {
+  std::cerr << "Realize of " << op->name
+            << " should have been replaced by an Allocate before codegen\n";
+  assert(false);
+}
+
+void CodeGen_C::visit(const Block* op) {
+  print(op->first);
+  if (op->rest.defined()) {
+    print(op->rest);
+  }
+}
+
+void CodeGen_C::visit(const IfThenElse* op) {
+  string cond = print_expr(op->condition);
+  do_indent();
+  stream << "if (" << cond << ") {\n";
+  indent += 2;
+  print(op->then_case);
+  indent -= 2;
+  if (op->else_case.defined()) {
+    do_indent();
+    stream << "} else {\n";
+    indent += 2;
+    print(op->else_case);
+    indent -= 2;
+  }
+  do_indent();
+  stream << "}\n";
+}
+
+void CodeGen_C::visit(const Evaluate* op) {
+  string v = print_expr(op->value);
+  if (is_identifier(v)) {
+    do_indent();
+    stream << "(void)" << v << ";\n";
+  }
+}
+
+}  // namespace
+
+void compile_to_c(const string& filename, Stmt s, const string& name,
+                  const vector<Argument>& args) {
+  CFile file;
+  ostringstream body;
+  CodeGen_C cg(body, &file, c_name(name));
+  cg.compile(s, args);
+
+  std::ofstream f(filename.c_str());
+  if (!f.is_open()) {
+    std::cerr << "Could not open " << filename << " for writing\n";
+    assert(false);
+  }
+  f << preamble << buffer_t_declaration() << "\n"
+    << runtime_declarations << runtime;
+  for (size_t i = 0; i < file.declarations.size(); i++) {
+    f << file.declarations[i] << "\n";
+  }
+  if (!file.declarations.empty()) {
+    f << "\n";
+  }
+  f << file.functions.str() << body.str();
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "jmlang/CodeGen/MultiTarget.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "jmlang/Base/Debug.h"
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/CodeGen/Runtime.h"
+#include "jmlang/JIT/LLVMHeaders.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::string;
+using std::vector;
+
+using llvm::BasicBlock;
+using llvm::Value;
+
+namespace {
+
+/// Emits code that checks, with cpuid, which of the target features
+/// the cpu running it supports.
+class CPUFeatures {
+  llvm::IRBuilder<>& builder;
+  llvm::Type* i32;
+
+  /// Run cpuid with the given leaf, and return eax, ebx, ecx, edx.
+  vector<Value*> cpuid(uint32_t leaf) {
+    llvm::StructType* result_t = llvm::StructType::get(i32, i32, i32, i32);
+    llvm::FunctionType* t =
+        llvm::FunctionType::get(result_t, {i32, i32}, false);
+    llvm::InlineAsm* cpuid = llvm::InlineAsm::get(
+        t, "cpuid",
+        "={ax},={bx},={cx},={dx},{ax},{cx},~{dirflag},~{fpsr},~{flags}", false);
+    Value* regs = builder.CreateCall(
+        t, cpuid,
+        {llvm::ConstantInt::get(i32, leaf), llvm::ConstantInt::get(i32, 0)});
+    vector<Value*> result(4);
+    for (unsigned i = 0; i < 4; i++) {
+      result[i] = builder.CreateExtractValue(regs, {i});
+    }
+    return result;
+  }
+
+  /// Whether all the given bits are set.
+  Value* has_bits(Value* reg, uint32_t bits) {
+    Value* mask = llvm::ConstantInt::get(i32, bits);
+    return builder.CreateICmpEQ(builder.CreateAnd(reg, mask), mask);
+  }
+
+ public:
+  /// Whether the cpu supports each Target::Feature that affects the
+  /// instructions used.
+  Value* supported[Target::FeatureEnd];
+
+  CPUFeatures(llvm::IRBuilder<>& b, llvm::Function* f) : builder(b) {
+    llvm::LLVMContext& context = builder.getContext();
+    i32 = llvm::Type::getInt32Ty(context);
+    Value* zero = llvm::ConstantInt::get(i32, 0);
+
+    Value* max_leaf = cpuid(0)[0];
+    vector<Value*> leaf1 = cpuid(1);
+    // Leaves above the maximum return junk, so only believe them if
+    // they exist.
+    Value* leaf7_ebx = builder.CreateSelect(
+        builder.CreateICmpUGE(max_leaf, llvm::ConstantInt::get(i32, 7)),
+        cpuid(7)[1], zero);
+
+    // Which register state the os saves, from xgetbv. That
+    // instruction faults unless the os has enabled it.
+    Value* osxsave = has_bits(leaf1[2], 1 << 27);
+    BasicBlock* before = builder.GetInsertBlock();
+    BasicBlock* get_xcr0 = BasicBlock::Create(context, "xgetbv", f);
+    BasicBlock* after = BasicBlock::Create(context, "after_xgetbv", f);
+    builder.CreateCondBr(osxsave, get_xcr0, after);
+    builder.SetInsertPoint(get_xcr0);
+    llvm::StructType* xgetbv_result_t = llvm::StructType::get(i32, i32);
+    llvm::FunctionType* xgetbv_t =
+        llvm::FunctionType::get(xgetbv_result_t, {i32}, false);
+    llvm::InlineAsm* xgetbv = llvm::InlineAsm::get(
+        xgetbv_t, "xgetbv", "={ax},={dx},{cx},~{dirflag},~{fpsr},~{flags}",
+        false);
+    Value* xcr0_low = builder.CreateExtractValue(
+        builder.CreateCall(xgetbv_t, xgetbv, {zero}), {0});
+    builder.CreateBr(after);
+    builder.SetInsertPoint(after);
+    llvm::PHINode* xcr0 = builder.CreatePHI(i32, 2);
+    xcr0->addIncoming(zero, before);
+    xcr0->addIncoming(xcr0_low, get_xcr0);
+
+    Value* yes = builder.getTrue();
+    for (int i = 0; i < Target::FeatureEnd; i++) {
+      supported[i] = yes;
+    }
+    supported[Target::SSE41] = has_bits(leaf1[2], 1 << 19);
+    // The avx instructions also need the os to save the ymm registers.
+    Value* avx = builder.CreateAnd(has_bits(leaf1[2], 1 << 28),
+                                   has_bits(xcr0, 0x6));
+    supported[Target::AVX] = avx;
+    supported[Target::AVX2] =
+        builder.CreateAnd(avx, has_bits(leaf7_ebx, 1 << 5));
+    supported[Target::FMA] =
+        builder.CreateAnd(avx, has_bits(leaf1[2], 1 << 12));
+    supported[Target::F16C] =
+        builder.CreateAnd(avx, has_bits(leaf1[2], 1 << 29));
+    // avx512f, dq, cd, bw and vl, and os support for the zmm and mask
+    // registers.
+    const uint32_t avx512_leaf7_ebx =
+        (1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31);
+    supported[Target::AVX512] = builder.CreateAnd(
+        avx, builder.CreateAnd(has_bits(leaf7_ebx, avx512_leaf7_ebx),
+                               has_bits(xcr0, 0xe6)));
+  }
+
+  /// Whether the cpu supports all of a target's features.
+  Value* supports(const Target& t) {
+    Value* result = builder.getTrue();
+    for (int i = 0; i < Target::FeatureEnd; i++) {
+      if (t.has_feature((Target::Feature)i)) {
+        result = builder.CreateAnd(result, supported[i]);
+      }
+    }
+    return result;
+  }
+};
+
+}  // namespace
+
+void compile_multitarget_to_native(
+    const string& filename, Stmt s, const string& name,
+    const vector<Argument>& args, const vector<Target>& targets,
+    const std::map<string, FloatMode>& float_modes) {
+  assert(!targets.empty() && "No targets to compile for");
+  Target base(targets[0].os, targets[0].arch, targets[0].bits);
+  for (size_t i = 0; i < targets.size(); i++) {
+    if (targets[i].os != base.os || targets[i].arch != base.arch ||
+        targets[i].bits != base.bits || base.arch != Target::X86) {
+      std::cerr << "Can't choose between targets " << targets[0].to_string()
+                << " and " << targets[i].to_string()
+                << " at runtime. They must all be for the same x86 "
+                << "operating system and word size.\n";
+      assert(false);
+    }
+    for (size_t j = 0; j < i; j++) {
+      assert(targets[i] != targets[j] && "Duplicate target");
+    }
+  }
+
+  // Compile each version, and link them into one module. Each
+  // function carries the cpu and features it was compiled for.
+  CodeGen::initialize_llvm();
+  llvm::LLVMContext context;
+  std::unique_ptr<llvm::Module> module(new llvm::Module(name, context));
+  llvm::Linker linker(*module);
+  vector<string> names;
+  for (size_t i = 0; i < targets.size(); i++) {
+    string version = name + "_" + targets[i].to_string();
+    std::replace(version.begin(), version.end(), '-', '_');
+    debug(1) << "Compiling " << version << "...\n";
+    CodeGen cg(targets[i]);
+    cg.set_float_modes(float_modes);
+    cg.compile(s, version, args);
+
+    // Move the module into the shared context by way of bitcode.
+    llvm::SmallVector<char, 0> bitcode;
+    {
+      std::unique_ptr<llvm::Module> m(cg.release_module());
+      std::unique_ptr<llvm::LLVMContext> m_context(&m->getContext());
+      llvm::raw_svector_ostream out(bitcode);
+      llvm::WriteBitcodeToFile(*m, out);
+      m.reset();
+    }
+    llvm::Expected<std::unique_ptr<llvm::Module>> m = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()),
+                              version),
+        context);
+    if (!m) {
+      std::cerr << "Could not read back " << version << ": "
+                << llvm::toString(m.takeError()) << "\n";
+      assert(false);
+    }
+    // Pipelines compiled ahead of time don't need the jit's wrapper.
+    if (llvm::Function* wrapper =
+            (*m)->getFunction(version + "_jit_wrapper")) {
+      wrapper->eraseFromParent();
+    }
+    bool failed = linker.linkInModule(std::move(*m));
+    assert(!failed && "Could not link versions of pipeline");
+    (void)failed;
+    names.push_back(version);
+  }
+
+  // Only the dispatcher is called from outside. The versions stay
+  // external until linking is done, as the linker drops unreferenced
+  // internal functions.
+  for (size_t i = 0; i < names.size(); i++) {
+    module->getFunction(names[i])->setLinkage(
+        llvm::GlobalValue::InternalLinkage);
+  }
+
+  // The dispatcher. It tail calls the chosen version, which it keeps
+  // in a global after the first call.
+  llvm::Function* first = module->getFunction(names[0]);
+  llvm::FunctionType* func_t = first->getFunctionType();
+  llvm::PointerType* func_ptr_t = func_t->getPointerTo();
+  llvm::Type* i32 = llvm::Type::getInt32Ty(context);
+  llvm::GlobalVariable* chosen = new llvm::GlobalVariable(
+      *module, func_ptr_t, false, llvm::GlobalValue::InternalLinkage,
+      llvm::ConstantPointerNull::get(func_ptr_t), name + ".chosen");
+  llvm::Function* dispatcher = llvm::Function::Create(
+      func_t, llvm::GlobalValue::ExternalLinkage, name, module.get());
+  dispatcher->addFnAttr(llvm::Attribute::NoUnwind);
+  for (unsigned i = 0; i < func_t->getNumParams(); i++) {
+    if (first->hasParamAttribute(i, llvm::Attribute::ZExt)) {
+      dispatcher->addParamAttr(i, llvm::Attribute::ZExt);
+    }
+  }
+
+  llvm::IRBuilder<> builder(context);
+  BasicBlock* entry = BasicBlock::Create(context, "entry", dispatcher);
+  BasicBlock* choose = BasicBlock::Create(context, "choose", dispatcher);
+  BasicBlock* call = BasicBlock::Create(context, "call", dispatcher);
+  BasicBlock* unsupported =
+      BasicBlock::Create(context, "unsupported", dispatcher);
+
+  builder.SetInsertPoint(entry);
+  Value* f = builder.CreateLoad(func_ptr_t, chosen);
+  builder.CreateCondBr(builder.CreateIsNull(f), choose, call,
+                       llvm::MDBuilder(context).createBranchWeights(1, 1000));
+
+  builder.SetInsertPoint(choose);
+  CPUFeatures features(builder, dispatcher);
+  // The first target in the list that the cpu supports wins.
+  Value* best = llvm::ConstantPointerNull::get(func_ptr_t);
+  for (size_t i = targets.size(); i > 0; i--) {
+    best = builder.CreateSelect(features.supports(targets[i - 1]),
+                                module->getFunction(names[i - 1]), best);
+  }
+  builder.CreateStore(best, chosen);
+  BasicBlock* chose = builder.GetInsertBlock();
+  builder.CreateCondBr(builder.CreateIsNull(best), unsupported, call);
+
+  builder.SetInsertPoint(unsupported);
+  llvm::FunctionType* error_t = llvm::FunctionType::get(
+      builder.getVoidTy(), {builder.getInt8PtrTy()}, false);
+  builder.CreateCall(
+      module->getOrInsertFunction("jmlang_error", error_t),
+      {builder.CreateGlobalStringPtr(
+          "No version of " + name + " was compiled for this cpu")});
+  builder.CreateRet(llvm::ConstantInt::get(i32, -1));
+
+  builder.SetInsertPoint(call);
+  llvm::PHINode* target = builder.CreatePHI(func_ptr_t, 2);
+  target->addIncoming(f, entry);
+  target->addIncoming(best, chose);
+  vector<Value*> call_args;
+  for (llvm::Function::arg_iterator arg = dispatcher->arg_begin();
+       arg != dispatcher->arg_end(); ++arg) {
+    call_args.push_back(iterator_to_pointer(arg));
+  }
+  llvm::CallInst* result = builder.CreateCall(func_t, target, call_args);
+  result->setTailCall();
+  builder.CreateRet(result);
+
+  if (llvm::verifyModule(*module, &llvm::errs())) {
+    std::cerr << "Multi-target module for " << name << " is invalid\n";
+    assert(false);
+  }
+
+  add_runtime_hooks(module.get(), true);
+  // The dispatcher and runtime hooks must run on any cpu.
+  CodeGen::compile_module_to_native(module.get(), filename, false, base);
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
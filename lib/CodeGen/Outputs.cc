@@ -0,0 +1,159 @@
+#include "jmlang/CodeGen/Outputs.h"
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+
+#include "jmlang/Base/Util.h"
+#include "jmlang/JIT/LLVMHeaders.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+/// The C type of a scalar argument.
+string c_type(Type t) {
+  assert(t.width == 1 && "Vector arguments are not supported");
+  if (t.is_bool()) {
+    return "bool";
+  } else if (t.is_handle()) {
+    return "void *";
+  } else if (t.is_float()) {
+    if (t.bits == 32) {
+      return "float";
+    } else if (t.bits == 64) {
+      return "double";
+    }
+  } else if (t.bits == 8 || t.bits == 16 || t.bits == 32 || t.bits == 64) {
+    return string(t.is_uint() ? "uint" : "int") + int_to_string(t.bits) +
+           "_t";
+  }
+  std::cerr << "Can't represent an argument of this type in C: " << t.bits
+            << " bits\n";
+  assert(false);
+  return "";
+}
+
+/// A name safe to use as a C preprocessor symbol.
+string macro_name(const string& name) {
+  string result;
+  for (size_t i = 0; i < name.size(); i++) {
+    char c = name[i];
+    result += isalnum((unsigned char)c) ? (char)toupper(c) : '_';
+  }
+  return result;
+}
+
+}  // namespace
+
+string buffer_t_declaration() {
+  return "#if !defined(BUFFER_T_DEFINED) && "
+         "!defined(JMLANG_BASE_BUFFER_T_H)\n"
+         "#define BUFFER_T_DEFINED\n"
+         "typedef struct buffer_t {\n"
+         "  uint64_t dev;\n"
+         "  uint8_t *host;\n"
+         "  int32_t extent[4];\n"
+         "  int32_t stride[4];\n"
+         "  int32_t min[4];\n"
+         "  int32_t elem_size;\n"
+         "  bool host_dirty;\n"
+         "  bool dev_dirty;\n"
+         "} buffer_t;\n"
+         "#endif\n";
+}
+
+void compile_to_header(const string& filename, const string& name,
+                       const vector<Argument>& args) {
+  std::ofstream f(filename.c_str());
+  if (!f.is_open()) {
+    std::cerr << "Could not open " << filename << " for writing\n";
+    assert(false);
+  }
+  string guard = "JMLANG_" + macro_name(name) + "_H";
+  f << "#ifndef " << guard << "\n"
+    << "#define " << guard << "\n"
+    << "\n"
+    << "#include <stdbool.h>\n"
+    << "#include <stddef.h>\n"
+    << "#include <stdint.h>\n"
+    << "\n"
+    << buffer_t_declaration() << "\n"
+    << "#ifdef __cplusplus\n"
+    << "extern \"C\" {\n"
+    << "#endif\n"
+    << "\n"
+    << "/* Returns zero on success, or a negative error code. */\n"
+    << "int " << name << "(";
+  for (size_t i = 0; i < args.size(); i++) {
+    if (i > 0) {
+      f << ", ";
+    }
+    if (args[i].is_buffer) {
+      f << "buffer_t *" << args[i].name;
+    } else {
+      string t = c_type(args[i].type);
+      f << t << (t[t.size() - 1] == '*' ? "" : " ") << args[i].name;
+    }
+  }
+  f << ");\n"
+    << "\n"
+    << "/* Replace the runtime's handlers. Null restores the default. */\n"
+    << "void jmlang_set_error_handler(void (*handler)(const char *));\n"
+    << "void jmlang_set_custom_allocator(void *(*malloc)(size_t),\n"
+    << "                                 void (*free)(void *));\n"
+    << "void jmlang_set_custom_do_task(\n"
+    << "    int (*do_task)(int (*)(int, uint8_t *), int, uint8_t *));\n"
+    << "void jmlang_set_custom_do_par_for(\n"
+    << "    int (*do_par_for)(int (*)(int, uint8_t *), int, int, uint8_t *));\n"
+    << "void jmlang_set_custom_trace(\n"
+    << "    void (*trace)(const char *, int, int, int, int, int,\n"
+    << "                  const void *, int, const int *));\n"
+    << "\n"
+    << "/* Limit the threads this pipeline's parallel loops use at once\n"
+    << "   (0 for no limit), and set their priority in the thread pool. */\n"
+    << "void jmlang_set_par_for_options(int max_threads, int priority);\n"
+    << "\n"
+    << "/* Whether to give each numa node its own contiguous share of this\n"
+    << "   pipeline's parallel loops. The default is set by JMLANG_NUMA. */\n"
+    << "void jmlang_set_numa_aware(int numa_aware);\n"
+    << "\n"
+    << "/* Free the blocks the default allocator keeps for reuse. */\n"
+    << "void jmlang_trim_allocator(void);\n"
+    << "\n"
+    << "#ifdef __cplusplus\n"
+    << "}  // extern \"C\"\n"
+    << "#endif\n"
+    << "\n"
+    << "#endif\n";
+}
+
+void create_static_library(const string& filename,
+                           const vector<string>& objects) {
+  vector<llvm::NewArchiveMember> members;
+  for (size_t i = 0; i < objects.size(); i++) {
+    llvm::Expected<llvm::NewArchiveMember> member =
+        llvm::NewArchiveMember::getFile(objects[i], true);
+    if (!member) {
+      std::cerr << "Could not read " << objects[i] << ": "
+                << llvm::toString(member.takeError()) << "\n";
+      assert(false);
+    }
+    members.push_back(std::move(*member));
+  }
+  llvm::Error error = llvm::writeArchive(filename, members, true,
+                                         llvm::object::Archive::K_GNU, true,
+                                         false);
+  if (error) {
+    std::cerr << "Could not write " << filename << ": "
+              << llvm::toString(std::move(error)) << "\n";
+    assert(false);
+  }
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "jmlang/CodeGen/Runtime.h"
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "jmlang/JIT/LLVMHeaders.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::string;
+
+namespace {
+
+/// Load one file of the runtime into the context of a module, for
+/// linking into it. The bitcode is read lazily, straight from the
+/// library's copy of it.
+std::unique_ptr<llvm::Module> load_runtime(const RuntimeBitcode& bitcode,
+                                           llvm::Module* m, bool shared) {
+  llvm::MemoryBufferRef buffer(
+      llvm::StringRef((const char*)bitcode.data, bitcode.size),
+      bitcode.name);
+  llvm::Expected<std::unique_ptr<llvm::Module>> runtime =
+      llvm::getLazyBitcodeModule(buffer, m->getContext());
+  if (!runtime) {
+    std::cerr << "Could not load the " << bitcode.name << " runtime: "
+              << llvm::toString(runtime.takeError()) << "\n";
+    assert(false);
+  }
+  std::unique_ptr<llvm::Module> r = std::move(*runtime);
+
+  // The runtime is built for the host, but doesn't depend on the cpu,
+  // so it goes with code for any target of the same architecture.
+  r->setTargetTriple(m->getTargetTriple());
+  r->setDataLayout(m->getDataLayout());
+
+  if (!shared) {
+    // Give each module its own copy of the runtime's state.
+    for (llvm::GlobalVariable& v : r->globals()) {
+      if (!v.isDeclaration()) {
+        v.setLinkage(llvm::GlobalValue::InternalLinkage);
+      }
+    }
+  }
+  return r;
+}
+
+void link_runtime(llvm::Module* m, std::unique_ptr<llvm::Module> runtime) {
+  string name = runtime->getModuleIdentifier();
+  if (llvm::Linker::linkModules(*m, std::move(runtime))) {
+    std::cerr << "Could not link the " << name << " runtime\n";
+    assert(false);
+  }
+}
+
+}  // namespace
+
+void add_runtime_hooks(llvm::Module* m, bool shared) {
+  assert(runtime_bitcode_count > 0 &&
+         strcmp(runtime_bitcode[0].name, "hooks") == 0 &&
+         "The runtime's hooks must come first");
+  link_runtime(m, load_runtime(runtime_bitcode[0], m, shared));
+}
+
+void add_default_runtime(llvm::Module* m) {
+  for (int i = 1; i < runtime_bitcode_count; i++) {
+    link_runtime(m, load_runtime(runtime_bitcode[i], m, true));
+  }
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
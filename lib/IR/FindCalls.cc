@@ -0,0 +1,97 @@
+#include "jmlang/IR/FindCalls.h"
+
+#include "jmlang/IR/ExprCall.h"
+#include "jmlang/IR/IRVisitor.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::map;
+using std::string;
+
+namespace {
+
+/// Find all the internal jmlang calls in an expr.
+class FindCalls : public IRVisitor {
+ public:
+  map<string, Function> calls;
+
+  using IRVisitor::visit;
+
+  void include_function(Function f) {
+    map<string, Function>::iterator iter = calls.find(f.name());
+    if (iter == calls.end()) {
+      calls[f.name()] = f;
+    } else {
+      assert(iter->second.same_as(f) &&
+             "Can't compile a pipeline using multiple functions with same "
+             "name");
+    }
+  }
+
+  void visit(const Call* call) {
+    IRVisitor::visit(call);
+    if (call->call_type == Call::Jmlang) {
+      include_function(call->func);
+    }
+  }
+};
+
+void populate_environment(Function f, map<string, Function>& env,
+                          bool recursive = true) {
+  map<string, Function>::const_iterator iter = env.find(f.name());
+  if (iter != env.end()) {
+    assert(iter->second.same_as(f) &&
+           "Can't compile a pipeline using multiple functions with same name");
+    return;
+  }
+
+  FindCalls calls;
+  for (size_t i = 0; i < f.values().size(); i++) {
+    f.values()[i].accept(&calls);
+  }
+
+  // Consider reductions
+  for (size_t i = 0; i < f.reduction_args().size(); i++) {
+    f.reduction_args()[i].accept(&calls);
+  }
+  for (size_t i = 0; i < f.reduction_values().size(); i++) {
+    f.reduction_values()[i].accept(&calls);
+  }
+
+  // Consider extern calls
+  for (size_t i = 0; i < f.extern_arguments().size(); i++) {
+    ExternFuncArgument arg = f.extern_arguments()[i];
+    if (arg.is_func()) {
+      calls.include_function(Function(arg.func));
+    }
+  }
+
+  if (!recursive) {
+    env.insert(calls.calls.begin(), calls.calls.end());
+  } else {
+    env[f.name()] = f;
+
+    for (map<string, Function>::const_iterator iter = calls.calls.begin();
+         iter != calls.calls.end(); ++iter) {
+      populate_environment(iter->second, env);
+    }
+  }
+}
+
+}  // namespace
+
+map<string, Function> find_transitive_calls(Function root) {
+  map<string, Function> res;
+  populate_environment(root, res, true);
+  return res;
+}
+
+map<string, Function> find_direct_calls(Function root) {
+  map<string, Function> res;
+  populate_environment(root, res, false);
+  return res;
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "jmlang/IR/Function.h"
+
+#include "jmlang/IR/IR.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::string;
+using std::vector;
+
+template <>
+RefCount& ref_count<FunctionContents>(const FunctionContents* f) {
+  return f->ref_count;
+}
+
+template <>
+void destroy<FunctionContents>(const FunctionContents* f) {
+  delete f;
+}
+
+void Function::set_estimate(const string& var, Expr min, Expr extent) {
+  bool found = false;
+  for (size_t i = 0; i < args().size(); i++) {
+    found |= args()[i] == var;
+  }
+  if (!found) {
+    std::cerr << "Can't set an estimate for " << var << " in " << name()
+              << ", because it is not one of the function's arguments\n";
+    assert(false);
+  }
+
+  vector<Schedule::Bound>& estimates = contents.ptr->estimates;
+  for (size_t i = 0; i < estimates.size(); i++) {
+    if (estimates[i].var == var) {
+      estimates[i].min = min;
+      estimates[i].extent = extent;
+      return;
+    }
+  }
+  Schedule::Bound b = {var, min, extent};
+  estimates.push_back(b);
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
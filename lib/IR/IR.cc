@@ -0,0 +1,47 @@
+#include "jmlang/IR/IR.h"
+
+#include "jmlang/IR/ExprCall.h"
+
+namespace jmlang {
+namespace internal {
+
+namespace {
+
+IntImm make_immortal_int(int x) {
+  IntImm i;
+  i.ref_count.increment();
+  i.type = Int(32);
+  i.value = x;
+  return i;
+}
+
+}  // namespace
+
+IntImm IntImm::small_int_cache[] = {
+    make_immortal_int(-8), make_immortal_int(-7), make_immortal_int(-6),
+    make_immortal_int(-5), make_immortal_int(-4), make_immortal_int(-3),
+    make_immortal_int(-2), make_immortal_int(-1), make_immortal_int(0),
+    make_immortal_int(1),  make_immortal_int(2),  make_immortal_int(3),
+    make_immortal_int(4),  make_immortal_int(5),  make_immortal_int(6),
+    make_immortal_int(7),  make_immortal_int(8)};
+
+const std::string Call::debug_to_file = "debug_to_file";
+const std::string Call::shuffle_vector = "shuffle_vector";
+const std::string Call::interleave_vectors = "interleave_vectors";
+const std::string Call::reinterpret = "reinterpret";
+const std::string Call::bitwise_and = "bitwise_and";
+const std::string Call::bitwise_not = "bitwise_not";
+const std::string Call::bitwise_xor = "bitwise_xor";
+const std::string Call::bitwise_or = "bitwise_or";
+const std::string Call::shift_left = "shift_left";
+const std::string Call::shift_right = "shift_right";
+const std::string Call::rewrite_buffer = "rewrite_buffer";
+const std::string Call::profiling_timer = "profiling_timer";
+const std::string Call::lerp = "lerp";
+const std::string Call::create_buffer_t = "create_buffer_t";
+const std::string Call::extract_buffer_min = "extract_buffer_min";
+const std::string Call::extract_buffer_extent = "extract_buffer_extent";
+const std::string Call::trace = "trace";
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
@@ -389,8 +389,14 @@ class IREquals : public IRVisitor {
     if (compare_names(s->name, op->name))
       return;
 
+    if (compare_types(s->type, op->type))
+      return;
+
     expr = s->size;
     op->size.accept(this);
+
+    stmt = s->body;
+    op->body.accept(this);
   }
 
   void visit(const Realize* op) {
@@ -432,7 +438,7 @@ class IREquals : public IRVisitor {
 
     if (!s->rest.defined() && op->rest.defined()) {
       result = -1;
-    } else if (s->rest.defined() && op->rest.defined()) {
+    } else if (s->rest.defined() && !op->rest.defined()) {
       result = 1;
     } else {
       stmt = s->first;
@@ -466,8 +472,16 @@ class IREquals : public IRVisitor {
     stmt = s->then_case;
     op->then_case.accept(this);
 
-    stmt = s->else_case;
-    op->else_case.accept(this);
+    if (result) {
+      return;
+    } else if (!s->else_case.defined() && op->else_case.defined()) {
+      result = -1;
+    } else if (s->else_case.defined() && !op->else_case.defined()) {
+      result = 1;
+    } else if (s->else_case.defined()) {
+      stmt = s->else_case;
+      op->else_case.accept(this);
+    }
   }
 
   void visit(const Evaluate* op) {
@@ -513,4 +527,4 @@ bool equal(Expr a, Expr b) { return deep_compare(a, b) == 0; }
 bool equal(Stmt a, Stmt b) { return deep_compare(a, b) == 0; }
 
 }  // namespace internal
-}  // namespace jmlang
+}  // namespace jmlang
\ No newline at end of file
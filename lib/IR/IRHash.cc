@@ -0,0 +1,285 @@
+#include "jmlang/IR/IRHash.h"
+
+#include <cstring>
+#include <map>
+
+#include "jmlang/IR/ExprCall.h"
+#include "jmlang/IR/ExprVariable.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::map;
+using std::string;
+
+uint64_t hash_string(const string& s) {
+  // 64-bit FNV-1a
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < s.size(); i++) {
+    h ^= (unsigned char)s[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+namespace {
+
+/// Computes the hash of each node from the hashes of its children,
+/// and the node's kind and fields. Hashes everything that equal
+/// compares.
+class HashIR : public IRVisitor {
+  /// The hash of each node visited so far.
+  map<const IRNode*, uint64_t> cache;
+
+  /// The hash of the node being visited.
+  uint64_t h;
+
+  void start(const char* kind) { h = hash_string(kind); }
+
+  void start(const char* kind, Type t) {
+    start(kind);
+    mix(t);
+  }
+
+  void mix(uint64_t v) { h = hash_combine(h, v); }
+
+  void mix(const string& s) { mix(hash_string(s)); }
+
+  void mix(Type t) {
+    mix((uint64_t)t.type_kind);
+    mix((uint64_t)t.bits);
+    mix((uint64_t)t.width);
+  }
+
+  void mix(Expr e) { mix(hash(e)); }
+
+  void mix(Stmt s) { mix(hash(s)); }
+
+  template <typename T>
+  void visit_binary_operator(const T* op, const char* kind) {
+    start(kind, op->type);
+    mix(op->a);
+    mix(op->b);
+  }
+
+  using IRVisitor::visit;
+
+  void visit(const IntImm* op) {
+    start("IntImm", op->type);
+    mix((uint64_t)(int64_t)op->value);
+  }
+
+  void visit(const FloatImm* op) {
+    start("FloatImm", op->type);
+    uint32_t bits;
+    memcpy(&bits, &op->value, sizeof(bits));
+    mix((uint64_t)bits);
+  }
+
+  void visit(const StringImm* op) {
+    start("StringImm", op->type);
+    mix(op->value);
+  }
+
+  void visit(const Cast* op) {
+    start("Cast", op->type);
+    mix(op->value);
+  }
+
+  void visit(const Variable* op) {
+    start("Variable", op->type);
+    mix(op->name);
+  }
+
+  void visit(const Add* op) { visit_binary_operator(op, "Add"); }
+  void visit(const Sub* op) { visit_binary_operator(op, "Sub"); }
+  void visit(const Mul* op) { visit_binary_operator(op, "Mul"); }
+  void visit(const Div* op) { visit_binary_operator(op, "Div"); }
+  void visit(const Mod* op) { visit_binary_operator(op, "Mod"); }
+  void visit(const Min* op) { visit_binary_operator(op, "Min"); }
+  void visit(const Max* op) { visit_binary_operator(op, "Max"); }
+  void visit(const EQ* op) { visit_binary_operator(op, "EQ"); }
+  void visit(const NE* op) { visit_binary_operator(op, "NE"); }
+  void visit(const LT* op) { visit_binary_operator(op, "LT"); }
+  void visit(const LE* op) { visit_binary_operator(op, "LE"); }
+  void visit(const GT* op) { visit_binary_operator(op, "GT"); }
+  void visit(const GE* op) { visit_binary_operator(op, "GE"); }
+  void visit(const And* op) { visit_binary_operator(op, "And"); }
+  void visit(const Or* op) { visit_binary_operator(op, "Or"); }
+
+  void visit(const Not* op) {
+    start("Not", op->type);
+    mix(op->a);
+  }
+
+  void visit(const Select* op) {
+    start("Select", op->type);
+    mix(op->condition);
+    mix(op->true_value);
+    mix(op->false_value);
+  }
+
+  void visit(const Load* op) {
+    start("Load", op->type);
+    mix(op->name);
+    mix(op->index);
+  }
+
+  void visit(const Ramp* op) {
+    start("Ramp", op->type);
+    mix(op->base);
+    mix(op->stride);
+  }
+
+  void visit(const Broadcast* op) {
+    start("Broadcast", op->type);
+    mix(op->value);
+  }
+
+  void visit(const Call* op) {
+    start("Call", op->type);
+    mix(op->name);
+    mix((uint64_t)op->call_type);
+    mix((uint64_t)op->value_index);
+    mix((uint64_t)op->args.size());
+    for (size_t i = 0; i < op->args.size(); i++) {
+      mix(op->args[i]);
+    }
+  }
+
+  void visit(const Let* op) {
+    start("Let", op->type);
+    mix(op->name);
+    mix(op->value);
+    mix(op->body);
+  }
+
+  void visit(const LetStmt* op) {
+    start("LetStmt");
+    mix(op->name);
+    mix(op->value);
+    mix(op->body);
+  }
+
+  void visit(const AssertStmt* op) {
+    start("AssertStmt");
+    mix(op->message);
+    mix(op->condition);
+  }
+
+  void visit(const Pipeline* op) {
+    start("Pipeline");
+    mix(op->name);
+    mix(op->produce);
+    mix(op->update);
+    mix(op->consume);
+  }
+
+  void visit(const For* op) {
+    start("For");
+    mix(op->name);
+    mix((uint64_t)op->for_type);
+    mix(op->min);
+    mix(op->extent);
+    mix(op->body);
+  }
+
+  void visit(const Store* op) {
+    start("Store");
+    mix(op->name);
+    mix(op->value);
+    mix(op->index);
+  }
+
+  void visit(const Provide* op) {
+    start("Provide");
+    mix(op->name);
+    mix((uint64_t)op->values.size());
+    for (size_t i = 0; i < op->values.size(); i++) {
+      mix(op->values[i]);
+    }
+    mix((uint64_t)op->args.size());
+    for (size_t i = 0; i < op->args.size(); i++) {
+      mix(op->args[i]);
+    }
+  }
+
+  void visit(const Allocate* op) {
+    start("Allocate", op->type);
+    mix(op->name);
+    mix(op->size);
+    mix(op->body);
+  }
+
+  void visit(const Free* op) {
+    start("Free");
+    mix(op->name);
+  }
+
+  void visit(const Realize* op) {
+    start("Realize");
+    mix(op->name);
+    mix((uint64_t)op->types.size());
+    for (size_t i = 0; i < op->types.size(); i++) {
+      mix(op->types[i]);
+    }
+    mix((uint64_t)op->bounds.size());
+    for (size_t i = 0; i < op->bounds.size(); i++) {
+      mix(op->bounds[i].min);
+      mix(op->bounds[i].extent);
+    }
+    mix(op->body);
+  }
+
+  void visit(const Block* op) {
+    start("Block");
+    mix(op->first);
+    mix(op->rest);
+  }
+
+  void visit(const IfThenElse* op) {
+    start("IfThenElse");
+    mix(op->condition);
+    mix(op->then_case);
+    mix(op->else_case);
+  }
+
+  void visit(const Evaluate* op) {
+    start("Evaluate");
+    mix(op->value);
+  }
+
+ public:
+  uint64_t hash(const IRHandle& node) {
+    if (!node.defined()) {
+      return 0;
+    }
+    map<const IRNode*, uint64_t>::iterator iter = cache.find(node.ptr);
+    if (iter != cache.end()) {
+      return iter->second;
+    }
+    // Children overwrite h, so save the hash of the node being
+    // visited.
+    uint64_t saved = h;
+    node.accept(this);
+    uint64_t result = h;
+    h = saved;
+    cache[node.ptr] = result;
+    return result;
+  }
+};
+
+}  // namespace
+
+uint64_t structural_hash(Expr e) {
+  HashIR hasher;
+  return hasher.hash(e);
+}
+
+uint64_t structural_hash(Stmt s) {
+  HashIR hasher;
+  return hasher.hash(s);
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
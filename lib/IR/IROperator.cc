@@ -219,6 +219,10 @@ void match_types(Expr& a, Expr& b) {
 
   Type ta = a.type(), tb = b.type();
 
+  // Widening may have been all it took.
+  if (ta == tb)
+    return;
+
   if (!ta.is_float() && tb.is_float()) {
     // int(a) * float(b) -> float(b)
     // uint(a) * float(b) -> float(b)
@@ -247,8 +251,8 @@ void match_types(Expr& a, Expr& b) {
   } else if (!ta.is_float() && !tb.is_float()) {
     // int(a) * (u)int(b) -> int(max(a, b))
     int bits = std::max(ta.bits, tb.bits);
-    a = cast(Int(bits), a);
-    b = cast(Int(bits), b);
+    a = cast(Int(bits, ta.width), a);
+    b = cast(Int(bits, tb.width), b);
   } else {
     std::cerr << "Could not match types: " << ta << ", " << tb << std::endl;
     assert(false && "Failed type coercion");
@@ -256,18 +260,131 @@ void match_types(Expr& a, Expr& b) {
 }
 
 // Fast math ops based on those from Syrah (http://github.com/boulos/syrah).
+// They work lane by lane on vectors of any width, so they vectorize
+// along with the expression around them instead of calling libm once
+// per lane.
+
+namespace {
+
+/// A special value such as inf_f32, of type t.
+Expr special_value(Type t, const char* name) {
+  return Call::make(t, name, std::vector<Expr>(), Call::Extern);
+}
+
+/// A Float(64) constant, possibly a vector, as the sum of two floats,
+/// because FloatImm only holds a float. Good to about 48 bits.
+Expr double_const(Type t, double v) {
+  float hi = (float)v;
+  float lo = (float)(v - hi);
+  return cast(t, Expr(hi)) + cast(t, Expr(lo));
+}
+
+/// Evaluate the polynomial with the given coefficients, highest
+/// degree first, at x.
+Expr polynomial(Expr x, const float* coeffs, int n) {
+  Expr result = cast(x.type(), Expr(coeffs[0]));
+  for (int i = 1; i < n; i++) {
+    result = result * x + coeffs[i];
+  }
+  return result;
+}
+
+/// 2^k as a float, for an integer k from -126 to 127.
+Expr pow2(Type t, Expr k) { return reinterpret(t, (k + 127) << 23); }
+
+/// e^r * 2^k, for |r| <= ln(2)/2 and an integer k from -152 to 129.
+/// The power of two is applied in two halves, so that results in the
+/// denormal range round properly instead of flushing to zero, and
+/// results that are too large become inf.
+Expr exp_reduced(Expr r, Expr k) {
+  // The polynomial from cephes's expf, within an ulp of e^r over the
+  // reduced range.
+  static const float coeffs[] = {1.9875691500e-4f, 1.3981999507e-3f,
+                                 8.3334519073e-3f, 4.1665795894e-2f,
+                                 1.6666665459e-1f, 5.0000001201e-1f};
+  Type t = r.type();
+  Expr result = polynomial(r, coeffs, 6) * (r * r) + r + 1.0f;
+  Expr k1 = k >> 1;
+  return result * pow2(t, k1) * pow2(t, k - k1);
+}
+
+/// Split x into r + k * pi/2, with |r| <= pi/4 and k an integer.
+void range_reduce_trig(Expr x, bool precise, Expr* r, Expr* k) {
+  Expr k_real = floor(x * 0.636619747f + 0.5f);
+  if (precise) {
+    // Cephes's three part split of pi/2. The first two parts have few
+    // enough bits that multiplying them by k is exact for |k| < 2^12.
+    *r = ((x - k_real * 1.5703125f) - k_real * 4.837512969970703125e-4f) -
+         k_real * 7.54978995489188216e-8f;
+  } else {
+    *r = (x - k_real * 1.57079637f) + k_real * 4.37113883e-8f;
+  }
+  // Far enough from zero, the products above lose all their
+  // precision, and past about 3e9 k doesn't fit in an int. The result
+  // is meaningless there, but keeping r within the range of the
+  // polynomials keeps it in [-1, 1], and clamping k keeps the
+  // conversion defined. With the constants first, a nan r, from inf
+  // or nan, passes through.
+  *r = max(-0.8f, min(0.8f, *r));
+  k_real = clamp(k_real, -1073741824.0f, 1073741824.0f);
+  *k = cast(Int(32, x.type().width), k_real);
+}
+
+/// The sine of r, for |r| <= pi/4.
+Expr sin_reduced(Expr r, bool precise) {
+  static const float precise_coeffs[] = {-1.9515295891e-4f, 8.3321608736e-3f,
+                                         -1.6666654611e-1f};
+  static const float fast_coeffs[] = {8.163282464e-3f, -1.666339040e-1f};
+  Expr z = r * r;
+  Expr p = precise ? polynomial(z, precise_coeffs, 3)
+                   : polynomial(z, fast_coeffs, 2);
+  return p * z * r + r;
+}
+
+/// The cosine of r, for |r| <= pi/4.
+Expr cos_reduced(Expr r, bool precise) {
+  static const float precise_coeffs[] = {2.443315711809948e-5f,
+                                         -1.388731625493765e-3f,
+                                         4.166664568298827e-2f};
+  static const float fast_coeffs[] = {-1.364871121e-3f, 4.166107113e-2f};
+  Expr z = r * r;
+  Expr p = precise ? polynomial(z, precise_coeffs, 3)
+                   : polynomial(z, fast_coeffs, 2);
+  return p * z * z - z * 0.5f + 1.0f;
+}
+
+/// The sine of x, or the cosine if cosine is true, which is the sine
+/// of x + pi/2.
+Expr sin_or_cos(Expr x, bool cosine, bool precise) {
+  Expr r, k;
+  range_reduce_trig(x, precise, &r, &k);
+  if (cosine) {
+    k += 1;
+  }
+  Type it = k.type();
+  Expr odd = (k & make_const(it, 1)) == 1;
+  Expr negate = (k & make_const(it, 2)) == 2;
+  Expr result =
+      select(odd, cos_reduced(r, precise), sin_reduced(r, precise));
+  result = select(negate, 0.0f - result, result);
+  // The polynomial rounds the sine of -0 to +0.
+  return cosine ? result : select(x == 0.0f, x, result);
+}
+
+}  // namespace
 
 // Factor a float into 2^exponent * reduced, where reduced is between 0.75
 // and 1.5
 void range_reduce_log(Expr input, Expr* reduced, Expr* exponent) {
-  Expr int_version = reinterpret<int>(input);
+  Type it = Int(32, input.type().width);
+  Expr int_version = reinterpret(it, input);
 
   // single precision = SEEE EEEE EMMM MMMM MMMM MMMM MMMM MMMM
   // exponent mask    = 0111 1111 1000 0000 0000 0000 0000 0000
   //                    0x7  0xF  0x8  0x0  0x0  0x0  0x0  0x0
   // non-exponent     = 1000 0000 0111 1111 1111 1111 1111 1111
   //                  = 0x8  0x0  0x7  0xF  0xF  0xF  0xF  0xF
-  int non_exponent_mask = 0x807fffff;
+  Expr non_exponent_mask = make_const(it, 0x807fffff);
 
   // Extract a version with no exponent (between 1.0 and 2.0)
   Expr no_exponent = int_version & non_exponent_mask;
@@ -284,7 +401,7 @@ void range_reduce_log(Expr input, Expr* reduced, Expr* exponent) {
   Expr blended =
       (int_version & non_exponent_mask) | (new_biased_exponent << 23);
 
-  *reduced = reinterpret<float>(blended);
+  *reduced = reinterpret(input.type(), blended);
 
   /*
   // Floats represent exponents using 8 bits, which encode the range
@@ -310,7 +427,7 @@ void range_reduce_log(Expr input, Expr* reduced, Expr* exponent) {
 }
 
 Expr jmlang_log(Expr x_full) {
-  assert(x_full.type() == Float(32));
+  assert(x_full.type().element_of() == Float(32));
 
   if (is_const(x_full)) {
     x_full = simplify(x_full);
@@ -320,90 +437,141 @@ Expr jmlang_log(Expr x_full) {
     }
   }
 
-  Expr nan =
-      Call::make(Float(32), "nan_f32", std::vector<Expr>(), Call::Extern);
-  Expr neg_inf =
-      Call::make(Float(32), "neg_inf_f32", std::vector<Expr>(), Call::Extern);
+  Type t = x_full.type();
+  Type it = Int(32, t.width);
+  Expr nan = special_value(t, "nan_f32");
+  Expr inf = special_value(t, "inf_f32");
+  Expr neg_inf = special_value(t, "neg_inf_f32");
 
-  Expr use_nan = x_full < 0.0f;       // log of a negative returns nan
+  Expr use_nan = !(x_full >= 0.0f);   // log of a negative or nan is nan
   Expr use_neg_inf = x_full == 0.0f;  // log of zero is -inf
-  Expr exceptional = use_nan | use_neg_inf;
+  Expr use_inf = x_full > 3.40282347e38f;
+  Expr exceptional = use_nan || use_neg_inf || use_inf;
+
+  // Scale denormals up by 2^23 so they reduce like normal floats, and
+  // take the 23 off the exponent afterwards.
+  Expr denormal = x_full < 1.17549435e-38f;
+  Expr x = select(denormal, x_full * 8388608.0f, x_full);
 
   // Avoid producing nans or infs by generating ln(1.0f) instead and
   // then fixing it later.
-  Expr patched = select(exceptional, 1.0f, x_full);
+  Expr patched = select(exceptional, cast(t, 1.0f), x);
   Expr reduced, exponent;
   range_reduce_log(patched, &reduced, &exponent);
+  exponent -= select(denormal, make_const(it, 23), make_const(it, 0));
 
   // Very close to the Taylor series for log about 1, but tuned to
   // have minimum relative error in the reduced domain (0.75 - 1.5).
-
+  static const float coeffs[] = {
+      0.05111976432738144643f,  -0.11793923497136414580f,
+      0.14971993724699017569f,  -0.16862004708254804686f,
+      0.19980668101718729313f,  -0.24991211576292837737f,
+      0.33333435275479328386f,  -0.50000106292873236491f};
   Expr x1 = reduced - 1.0f;
-  Expr result = 0.0f;
-  result = x1 * result + 0.05111976432738144643f;
-  result = x1 * result + -0.11793923497136414580f;
-  result = x1 * result + 0.14971993724699017569f;
-  result = x1 * result + -0.16862004708254804686f;
-  result = x1 * result + 0.19980668101718729313f;
-  result = x1 * result + -0.24991211576292837737f;
-  result = x1 * result + 0.33333435275479328386f;
-  result = x1 * result + -0.50000106292873236491f;
-  result = x1 * x1 * result + x1;
+  Expr result = x1 * x1 * polynomial(x1, coeffs, 8) + x1;
 
-  result += cast<float>(exponent) * logf(2.0);
+  // Add exponent * ln(2), with ln(2) in two parts so that the larger
+  // product is exact.
+  Expr e = cast(t, exponent);
+  result = (result - e * 2.12194440e-4f) + e * 0.693359375f;
 
-  return select(exceptional, select(use_nan, nan, neg_inf), result);
+  return select(exceptional,
+                select(use_nan, nan, select(use_inf, inf, neg_inf)), result);
 }
 
 Expr jmlang_exp(Expr x_full) {
-  assert(x_full.type() == Float(32));
+  assert(x_full.type().element_of() == Float(32));
 
   if (is_const(x_full)) {
     x_full = simplify(x_full);
     const float* f = as_const_float(x_full);
     if (f) {
-      return logf(*f);
+      return expf(*f);
     }
   }
 
-  float ln2_part1 = 0.6931457519f;
-  float ln2_part2 = 1.4286067653e-6f;
-  float one_over_ln2 = 1.0f / logf(2.0f);
-
-  Expr scaled = x_full * one_over_ln2;
-  Expr k_real = floor(scaled);
-  Expr k = cast<int>(k_real);
-
-  Expr x = x_full - k_real * ln2_part1;
-  x -= k_real * ln2_part2;
+  // Beyond these the result is zero or inf anyway, and clamping keeps
+  // k in the range exp_reduced handles.
+  Expr x = clamp(x_full, -105.0f, 89.0f);
 
-  Expr result = 0.0f;
-  result = x * result + 0.00031965933071842413f;
-  result = x * result + 0.00119156835564003744f;
-  result = x * result + 0.00848988645943932717f;
-  result = x * result + 0.04160188091348320655f;
-  result = x * result + 0.16667983794100929562f;
-  result = x * result + 0.49999899033463041098f;
-  result = x * result + 1.0f;
-  result = x * result + 1.0f;
+  // Write x as r + k * ln(2), with ln(2) in two parts so that the
+  // larger product is exact.
+  Expr k_real = floor(x * 1.44269502f + 0.5f);
+  Expr r = (x - k_real * 0.693359375f) + k_real * 2.12194440e-4f;
 
-  // Compute 2^k.
-  int fpbias = 127;
-  Expr biased = k + fpbias;
-
-  Expr inf =
-      Call::make(Float(32), "inf_f32", std::vector<Expr>(), Call::Extern);
+  Expr result = exp_reduced(r, cast(Int(32, x.type().width), k_real));
+  return select(x_full != x_full, x_full, result);
+}
 
-  // Shift the bits up into the exponent field and reinterpret this
-  // thing as float.
-  Expr two_to_the_n = reinterpret<float>(biased << 23);
-  result *= two_to_the_n;
+Expr jmlang_pow(Expr x, Expr y) {
+  assert(x.type().element_of() == Float(32) && x.type() == y.type());
+
+  Type t = x.type();
+  Type it = Int(32, t.width);
+  Type dt = Float(64, t.width);
+  Expr zero = cast(t, 0.0f);
+  Expr one = cast(t, 1.0f);
+  Expr inf = special_value(t, "inf_f32");
+  Expr nan = special_value(t, "nan_f32");
+
+  // Reduce |x| as log does, patching out zero, inf and nan.
+  Expr ax = select(x < 0.0f, 0.0f - x, x);
+  Expr finite = ax > 0.0f && ax <= 3.40282347e38f;
+  Expr denormal = ax < 1.17549435e-38f;
+  Expr patched = select(finite, select(denormal, ax * 8388608.0f, ax), one);
+  Expr reduced, exponent;
+  range_reduce_log(patched, &reduced, &exponent);
+  exponent -= select(denormal, make_const(it, 23), make_const(it, 0));
+
+  // The rest of log(|x|), and its product with y, are in double, so
+  // that y doesn't magnify the error in the log. log(m) is 2 *
+  // atanh(s), for s = (m - 1) / (m + 1), which is at most 0.2 for m
+  // in the reduced range, so a few terms of the series for atanh are
+  // plenty.
+  Expr m = cast(dt, reduced);
+  Expr s = (m - 1.0f) / (m + 1.0f);
+  Expr s2 = s * s;
+  Expr series = double_const(dt, 1.0 / 13);
+  for (int i = 5; i >= 0; i--) {
+    series = series * s2 + double_const(dt, 1.0 / (2 * i + 1));
+  }
+  Expr log_x =
+      cast(dt, exponent) * double_const(dt, M_LN2) + 2.0f * s * series;
+  Expr z = clamp(cast(dt, y) * log_x, -105.0f, 89.0f);
+
+  // Then exp(z) as in exp, reducing in double.
+  Expr k_real = floor(z * double_const(dt, M_LOG2E) + 0.5f);
+  Expr r = cast(t, z - k_real * double_const(dt, M_LN2));
+  Expr result = exp_reduced(r, cast(it, k_real));
+
+  // |x|^y for the values patched out above. Powers of one are one
+  // even for infinite y.
+  Expr y_negative = y < 0.0f;
+  result = select(ax == 0.0f, select(y_negative, inf, zero), result);
+  result = select(ax > 3.40282347e38f, select(y_negative, zero, inf), result);
+  result = select(ax == 1.0f, one, result);
+
+  // A finite negative x has a real power only when y is an integer.
+  // Then, as for -0 and -inf, the power is negative when y is odd,
+  // which a multiply makes true of zeros too.
+  Expr y_integer = floor(y) == y;
+  Expr y_odd = y_integer && floor(y * 0.5f) != y * 0.5f;
+  Expr x_negative = reinterpret(it, x) < 0;
+  result = select(x_negative && y_odd, result * -1.0f, result);
+  result = select(x < 0.0f && finite && !y_integer, nan, result);
+
+  result = select(x != x || y != y, nan, result);
+  return select(y == 0.0f || x == 1.0f, one, result);
+}
 
-  // Catch overflow and underflow
-  result = select(biased < 255, result, inf);
-  result = select(biased > 0, result, 0.0f);
+Expr jmlang_sin(Expr x) {
+  assert(x.type().element_of() == Float(32));
+  return sin_or_cos(x, false, true);
+}
 
-  return result;
+Expr jmlang_cos(Expr x) {
+  assert(x.type().element_of() == Float(32));
+  return sin_or_cos(x, true, true);
 }
 
 Expr raise_to_integer_power(Expr e, int p) {
@@ -428,41 +596,36 @@ Expr raise_to_integer_power(Expr e, int p) {
 }  // namespace internal
 
 Expr fast_log(Expr x) {
-  assert(x.type() == Float(32) && "fast_log only works for Float(32)");
+  assert(x.type().element_of() == Float(32) &&
+         "fast_log only works for Float(32)");
 
   Expr reduced, exponent;
   range_reduce_log(x, &reduced, &exponent);
 
+  static const float coeffs[] = {
+      0.07640318789187280912f, -0.16252961013874300811f,
+      0.20625219040645212387f, -0.25110261010892864775f,
+      0.33320464908377461777f, -0.49997513376789826101f};
   Expr x1 = reduced - 1.0f;
-  Expr result = 0.0f;
-
-  result = x1 * result + 0.07640318789187280912f;
-  result = x1 * result + -0.16252961013874300811f;
-  result = x1 * result + 0.20625219040645212387f;
-  result = x1 * result + -0.25110261010892864775f;
-  result = x1 * result + 0.33320464908377461777f;
-  result = x1 * result + -0.49997513376789826101f;
-  result *= x1 * x1;
-  result += x1;
+  Expr result = x1 * x1 * internal::polynomial(x1, coeffs, 6) + x1;
 
-  return result + cast<float>(exponent) * logf(2);
+  return result + cast(x.type(), exponent) * logf(2);
 }
 
 Expr fast_exp(Expr x_full) {
-  assert(x_full.type() == Float(32) && "fast_exp only works for Float(32)");
+  assert(x_full.type().element_of() == Float(32) &&
+         "fast_exp only works for Float(32)");
 
+  Type t = x_full.type();
   Expr scaled = x_full / logf(2.0);
   Expr k_real = floor(scaled);
-  Expr k = cast<int>(k_real);
+  Expr k = cast(Int(32, t.width), k_real);
   Expr x = x_full - k_real * logf(2.0);
 
-  Expr result = 0.0f;
-  result = x * result + 0.01314350012789660196f;
-  result = x * result + 0.03668965196652099192f;
-  result = x * result + 0.16873890085469545053f;
-  result = x * result + 0.49970514590562437052f;
-  result = x * result + 1.0f;
-  result = x * result + 1.0f;
+  static const float coeffs[] = {
+      0.01314350012789660196f, 0.03668965196652099192f,
+      0.16873890085469545053f, 0.49970514590562437052f, 1.0f, 1.0f};
+  Expr result = internal::polynomial(x, coeffs, 6);
 
   // Compute 2^k.
   int fpbias = 127;
@@ -470,10 +633,22 @@ Expr fast_exp(Expr x_full) {
 
   // Shift the bits up into the exponent field and reinterpret this
   // thing as float.
-  Expr two_to_the_n = reinterpret<float>(biased << 23);
+  Expr two_to_the_n = reinterpret(t, biased << 23);
   result *= two_to_the_n;
 
   return result;
 }
 
+Expr fast_sin(Expr x) {
+  assert(x.type().element_of() == Float(32) &&
+         "fast_sin only works for Float(32)");
+  return internal::sin_or_cos(x, false, false);
+}
+
+Expr fast_cos(Expr x) {
+  assert(x.type().element_of() == Float(32) &&
+         "fast_cos only works for Float(32)");
+  return internal::sin_or_cos(x, true, false);
+}
+
 }  // namespace jmlang
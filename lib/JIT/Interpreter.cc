@@ -0,0 +1,978 @@
+#include "jmlang/JIT/Interpreter.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+
+#include "jmlang/Base/Util.h"
+#include "jmlang/IR/ExprCall.h"
+#include "jmlang/IR/ExprVariable.h"
+#include "jmlang/IR/IROperator.h"
+#include "jmlang/IR/IRVisitor.h"
+#include "jmlang/IR/Scope.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+/// One lane of a value. Integers are kept sign or zero extended from
+/// their width, handles as their address, and floats as doubles
+/// rounded to their width.
+union Lane {
+  int64_t i;
+  double f;
+};
+
+/// The lanes of a value. Scalars, by far the most common values,
+/// don't allocate.
+class Lanes {
+  Lane small[4];
+  vector<Lane> large;
+  int n;
+
+ public:
+  explicit Lanes(int width = 1) : n(width) {
+    if (n > 4) {
+      large.resize(n);
+    }
+  }
+
+  int size() const { return n; }
+
+  Lane& operator[](int i) { return n > 4 ? large[i] : small[i]; }
+
+  const Lane& operator[](int i) const { return n > 4 ? large[i] : small[i]; }
+};
+
+struct Value {
+  Type type;
+  Lanes lanes;
+
+  Value() : type(Int(32)), lanes(1) {}
+
+  explicit Value(Type t) : type(t), lanes(t.width) {}
+
+  /// A lane, where scalars stand for vectors of any width.
+  const Lane& lane(int i) const { return lanes[type.is_scalar() ? 0 : i]; }
+};
+
+Value scalar(Type t, int64_t v) {
+  Value result(t);
+  result.lanes[0].i = v;
+  return result;
+}
+
+/// Wrap an integer to the range of its type.
+int64_t wrap(Type t, int64_t v) {
+  if (t.bits >= 64 || t.is_handle()) {
+    return v;
+  } else if (t.is_int()) {
+    int shift = 64 - t.bits;
+    return (int64_t)((uint64_t)v << shift) >> shift;
+  }
+  return (int64_t)((uint64_t)v & (((uint64_t)1 << t.bits) - 1));
+}
+
+/// Round a float to the precision of its type.
+double round_float(Type t, double v) {
+  return t.bits == 32 ? (double)(float)v : v;
+}
+
+/// Bits of a float, as an integer of the same width.
+int64_t float_bits(Type t, double v) {
+  if (t.bits == 32) {
+    float f = (float)v;
+    int32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+  }
+  int64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return bits;
+}
+
+double bits_float(Type t, int64_t bits) {
+  if (t.bits == 32) {
+    int32_t b = (int32_t)bits;
+    float f;
+    memcpy(&f, &b, sizeof(f));
+    return f;
+  }
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+/// The size of one element of a type in memory. Bools take a byte.
+int storage_bytes(Type t) { return t.is_handle() ? sizeof(void*) : t.bytes(); }
+
+Lane read(Type t, const uint8_t* ptr) {
+  Lane l;
+  if (t.is_float()) {
+    if (t.bits == 32) {
+      float f;
+      memcpy(&f, ptr, sizeof(f));
+      l.f = f;
+    } else {
+      memcpy(&l.f, ptr, sizeof(l.f));
+    }
+  } else if (t.is_handle()) {
+    void* p;
+    memcpy(&p, ptr, sizeof(p));
+    l.i = (int64_t)(intptr_t)p;
+  } else if (t.is_bool()) {
+    l.i = *ptr != 0;
+  } else {
+    int64_t v = 0;
+    memcpy(&v, ptr, t.bytes());
+    l.i = wrap(t, v);
+  }
+  return l;
+}
+
+void write(Type t, uint8_t* ptr, Lane l) {
+  if (t.is_float()) {
+    if (t.bits == 32) {
+      float f = (float)l.f;
+      memcpy(ptr, &f, sizeof(f));
+    } else {
+      memcpy(ptr, &l.f, sizeof(l.f));
+    }
+  } else if (t.is_handle()) {
+    void* p = (void*)(intptr_t)l.i;
+    memcpy(ptr, &p, sizeof(p));
+  } else {
+    // Little-endian, like every target CodeGen supports.
+    memcpy(ptr, &l.i, storage_bytes(t));
+  }
+}
+
+typedef double (*MathFn1)(double);
+typedef double (*MathFn2)(double, double);
+
+double round_half_up(double x) { return std::floor(x + 0.5); }
+
+/// The libm function a math call like sin_f32 stands for.
+MathFn1 math_function(const string& name) {
+  static const struct {
+    const char* name;
+    MathFn1 fn;
+  } functions[] = {
+      {"sqrt", std::sqrt},   {"sin", std::sin},   {"cos", std::cos},
+      {"tan", std::tan},     {"asin", std::asin}, {"acos", std::acos},
+      {"atan", std::atan},   {"sinh", std::sinh}, {"cosh", std::cosh},
+      {"tanh", std::tanh},   {"asinh", std::asinh}, {"acosh", std::acosh},
+      {"atanh", std::atanh}, {"exp", std::exp},   {"log", std::log},
+      {"floor", std::floor}, {"ceil", std::ceil}, {"abs", std::fabs},
+      {"round", round_half_up}};
+  for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); i++) {
+    if (name == functions[i].name) {
+      return functions[i].fn;
+    }
+  }
+  return NULL;
+}
+
+MathFn2 math_function2(const string& name) {
+  if (name == "pow") {
+    return std::pow;
+  } else if (name == "atan2") {
+    return std::atan2;
+  }
+  return NULL;
+}
+
+/// Split an extern call name like sin_f32 into its base and suffix.
+void split_extern_name(const string& name, string* base, string* suffix) {
+  size_t underscore = name.rfind('_');
+  *base = underscore == string::npos ? name : name.substr(0, underscore);
+  *suffix = underscore == string::npos ? "" : name.substr(underscore + 1);
+}
+
+bool is_constant_name(const string& base) {
+  return base == "inf" || base == "neg_inf" || base == "nan";
+}
+
+/// Checks whether a statement uses anything the interpreter can't do.
+class CheckInterpretable : public IRVisitor {
+ public:
+  bool ok;
+
+  CheckInterpretable() : ok(true) {}
+
+  using IRVisitor::visit;
+
+ private:
+  void check_type(Type t) {
+    if (t.is_float() && t.bits != 32 && t.bits != 64) {
+      ok = false;
+    }
+  }
+
+  void visit(const Cast* op) {
+    check_type(op->type);
+    IRVisitor::visit(op);
+  }
+
+  void visit(const Variable* op) { check_type(op->type); }
+
+  void visit(const Load* op) {
+    check_type(op->type);
+    IRVisitor::visit(op);
+  }
+
+  void visit(const Call* op) {
+    check_type(op->type);
+    if (op->call_type == Call::Extern) {
+      string base, suffix;
+      split_extern_name(op->name, &base, &suffix);
+      bool is_math = suffix == "f32" || suffix == "f64";
+      bool known =
+          (is_math && op->args.size() == 1 && math_function(base)) ||
+          (is_math && op->args.size() == 2 && math_function2(base)) ||
+          (is_math && op->args.empty() && is_constant_name(base)) ||
+          (base == "abs" && op->type.is_int());
+      ok = ok && known;
+    } else if (op->call_type != Call::Intrinsic ||
+               op->name == Call::debug_to_file) {
+      ok = false;
+    }
+    IRVisitor::visit(op);
+  }
+
+  void visit(const Provide*) { ok = false; }
+
+  void visit(const Realize*) { ok = false; }
+};
+
+/// The state of one run of a statement.
+class Evaluator : public IRVisitor {
+ public:
+  Evaluator(JITModule::ErrorHandler e, void* (*m)(size_t), void (*f)(void*),
+            JITModule::TraceFn t)
+      : result(0), error_handler(e), custom_malloc(m), custom_free(f),
+        trace(t) {}
+
+  /// Zero, or the error code of the first failure.
+  int result;
+
+  Scope<Value> symbols;
+
+  void define(const string& name, Value v) { symbols.push(name, v); }
+
+  void define(const string& name, Type t, int64_t v) {
+    symbols.push(name, scalar(t, v));
+  }
+
+  /// Define the symbols CodeGen::unpack_buffer does.
+  void unpack_buffer(const string& name, buffer_t* b) {
+    define(name + ".buffer", Handle(), (int64_t)(intptr_t)b);
+    define(name + ".dev", UInt(64), (int64_t)b->dev);
+    define(name + ".host", Handle(), (int64_t)(intptr_t)b->host);
+    for (int i = 0; i < 4; i++) {
+      string d = int_to_string(i);
+      define(name + ".min." + d, Int(32), b->min[i]);
+      define(name + ".extent." + d, Int(32), b->extent[i]);
+      define(name + ".stride." + d, Int(32), b->stride[i]);
+    }
+    define(name + ".elem_size", Int(32), b->elem_size);
+    define(name + ".host_dirty", Bool(), b->host_dirty);
+    define(name + ".dev_dirty", Bool(), b->dev_dirty);
+  }
+
+  void exec(Stmt s) {
+    if (result == 0) {
+      s.accept(this);
+    }
+  }
+
+  /// Free anything still allocated after a failure.
+  void free_all() {
+    while (!heap.empty()) {
+      free_memory(heap.back());
+      heap.pop_back();
+    }
+  }
+
+ private:
+  JITModule::ErrorHandler error_handler;
+  void* (*custom_malloc)(size_t);
+  void (*custom_free)(void*);
+  JITModule::TraceFn trace;
+
+  Value value;
+
+  /// Allocations that haven't been freed yet, innermost last.
+  vector<void*> heap;
+
+  /// Buffers made by create_buffer_t, which live until the end of
+  /// the run.
+  std::list<buffer_t> buffers;
+
+  using IRVisitor::visit;
+
+  Value eval(Expr e) {
+    e.accept(this);
+    return value;
+  }
+
+  void fail(const string& message, int code = -1) {
+    if (error_handler) {
+      error_handler(message.c_str());
+    } else {
+      std::cerr << "Error: " << message << "\n";
+    }
+    result = code;
+  }
+
+  void* allocate_memory(size_t bytes) {
+    if (custom_malloc) {
+      return custom_malloc(bytes);
+    }
+    // The same alignment as the default runtime.
+    return aligned_alloc(32, (std::max<size_t>(bytes, 1) + 31) & ~(size_t)31);
+  }
+
+  void free_memory(void* ptr) {
+    if (custom_free) {
+      custom_free(ptr);
+    } else {
+      free(ptr);
+    }
+  }
+
+  /// Free an allocation, if it hasn't been already.
+  void release(void* ptr) {
+    for (size_t i = heap.size(); i > 0; i--) {
+      if (heap[i - 1] == ptr) {
+        free_memory(ptr);
+        heap.erase(heap.begin() + (i - 1));
+        return;
+      }
+    }
+  }
+
+  uint8_t* host_pointer(const string& buffer) {
+    return (uint8_t*)(intptr_t)symbols.get(buffer + ".host").lanes[0].i;
+  }
+
+  void visit(const IntImm* op) { value = scalar(Int(32), op->value); }
+
+  void visit(const FloatImm* op) {
+    value = Value(Float(32));
+    value.lanes[0].f = op->value;
+  }
+
+  void visit(const StringImm* op) {
+    value = scalar(Handle(), (int64_t)(intptr_t)op->value.c_str());
+  }
+
+  void visit(const Cast* op) {
+    Type src = op->value.type();
+    Type dst = op->type;
+    Value v = eval(op->value);
+    value = Value(dst);
+    for (int i = 0; i < dst.width; i++) {
+      Lane in = v.lane(i);
+      Lane& out = value.lanes[i];
+      if (dst.is_bool() && !src.is_handle()) {
+        out.i = src.is_float() ? in.f != 0 : in.i != 0;
+      } else if (src.is_float() && dst.is_float()) {
+        out.f = round_float(dst, in.f);
+      } else if (src.is_float()) {
+        out.i = wrap(dst, dst.is_int() ? (int64_t)in.f
+                                       : (int64_t)(uint64_t)in.f);
+      } else if (dst.is_float()) {
+        out.f = round_float(dst, src.is_int() ? (double)in.i
+                                              : (double)(uint64_t)in.i);
+      } else {
+        out.i = wrap(dst, in.i);
+      }
+    }
+  }
+
+  void visit(const Variable* op) { value = symbols.get(op->name); }
+
+  /// Apply an operation lane by lane to two values of the result
+  /// type.
+  template <typename IntOp, typename FloatOp>
+  void binary(Type t, Expr a, Expr b, IntOp int_op, FloatOp float_op) {
+    Value va = eval(a);
+    Value vb = eval(b);
+    value = Value(t);
+    for (int i = 0; i < t.width; i++) {
+      if (t.is_float()) {
+        value.lanes[i].f =
+            round_float(t, float_op(va.lane(i).f, vb.lane(i).f));
+      } else {
+        value.lanes[i].i = wrap(t, int_op(t, va.lane(i).i, vb.lane(i).i));
+      }
+    }
+  }
+
+  void visit(const Add* op) {
+    binary(
+        op->type, op->a, op->b,
+        [](Type, int64_t a, int64_t b) {
+          return (int64_t)((uint64_t)a + (uint64_t)b);
+        },
+        [](double a, double b) { return a + b; });
+  }
+
+  void visit(const Sub* op) {
+    binary(
+        op->type, op->a, op->b,
+        [](Type, int64_t a, int64_t b) {
+          return (int64_t)((uint64_t)a - (uint64_t)b);
+        },
+        [](double a, double b) { return a - b; });
+  }
+
+  void visit(const Mul* op) {
+    binary(
+        op->type, op->a, op->b,
+        [](Type, int64_t a, int64_t b) {
+          return (int64_t)((uint64_t)a * (uint64_t)b);
+        },
+        [](double a, double b) { return a * b; });
+  }
+
+  void visit(const Div* op) {
+    // Signed division rounds towards negative infinity. Division by
+    // zero, undefined in compiled code, gives zero.
+    binary(
+        op->type, op->a, op->b,
+        [](Type t, int64_t a, int64_t b) -> int64_t {
+          if (b == 0) {
+            return 0;
+          } else if (t.is_uint()) {
+            return (int64_t)((uint64_t)a / (uint64_t)b);
+          } else if (b == -1) {
+            return (int64_t)(0 - (uint64_t)a);
+          }
+          int64_t q = a / b;
+          return (a % b != 0 && ((a < 0) != (b < 0))) ? q - 1 : q;
+        },
+        [](double a, double b) { return a / b; });
+  }
+
+  void visit(const Mod* op) {
+    // The remainder takes the sign of b.
+    Type t = op->type;
+    binary(
+        t, op->a, op->b,
+        [](Type t, int64_t a, int64_t b) -> int64_t {
+          if (b == 0 || (t.is_int() && b == -1)) {
+            return 0;
+          } else if (t.is_uint()) {
+            return (int64_t)((uint64_t)a % (uint64_t)b);
+          }
+          int64_t r = a % b;
+          return (r != 0 && ((r < 0) != (b < 0))) ? r + b : r;
+        },
+        [t](double a, double b) {
+          double q = std::floor(round_float(t, a / b));
+          return a - round_float(t, b * q);
+        });
+  }
+
+  /// Whether a < b, for lanes of the given type.
+  static bool less(Type t, Lane a, Lane b) {
+    if (t.is_float()) {
+      return a.f < b.f;
+    } else if (t.is_int()) {
+      return a.i < b.i;
+    }
+    return (uint64_t)a.i < (uint64_t)b.i;
+  }
+
+  static bool equal(Type t, Lane a, Lane b) {
+    return t.is_float() ? a.f == b.f : a.i == b.i;
+  }
+
+  void visit(const Min* op) {
+    Type t = op->type;
+    Value a = eval(op->a);
+    Value b = eval(op->b);
+    value = Value(t);
+    for (int i = 0; i < t.width; i++) {
+      value.lanes[i] = less(t, a.lane(i), b.lane(i)) ? a.lane(i) : b.lane(i);
+    }
+  }
+
+  void visit(const Max* op) {
+    Type t = op->type;
+    Value a = eval(op->a);
+    Value b = eval(op->b);
+    value = Value(t);
+    for (int i = 0; i < t.width; i++) {
+      value.lanes[i] = less(t, b.lane(i), a.lane(i)) ? a.lane(i) : b.lane(i);
+    }
+  }
+
+  /// Compare two values lane by lane. Comparisons of NaN are false,
+  /// except for NE.
+  template <typename Cmp>
+  void compare(Type t, Expr a, Expr b, Cmp cmp) {
+    Type arg_t = a.type();
+    Value va = eval(a);
+    Value vb = eval(b);
+    value = Value(t);
+    for (int i = 0; i < t.width; i++) {
+      value.lanes[i].i = cmp(arg_t, va.lane(i), vb.lane(i));
+    }
+  }
+
+  void visit(const EQ* op) {
+    compare(op->type, op->a, op->b,
+            [](Type t, Lane a, Lane b) { return equal(t, a, b); });
+  }
+
+  void visit(const NE* op) {
+    compare(op->type, op->a, op->b,
+            [](Type t, Lane a, Lane b) { return !equal(t, a, b); });
+  }
+
+  void visit(const LT* op) {
+    compare(op->type, op->a, op->b,
+            [](Type t, Lane a, Lane b) { return less(t, a, b); });
+  }
+
+  void visit(const LE* op) {
+    compare(op->type, op->a, op->b, [](Type t, Lane a, Lane b) {
+      return less(t, a, b) || equal(t, a, b);
+    });
+  }
+
+  void visit(const GT* op) {
+    compare(op->type, op->a, op->b,
+            [](Type t, Lane a, Lane b) { return less(t, b, a); });
+  }
+
+  void visit(const GE* op) {
+    compare(op->type, op->a, op->b, [](Type t, Lane a, Lane b) {
+      return less(t, b, a) || equal(t, a, b);
+    });
+  }
+
+  void visit(const And* op) {
+    compare(op->type, op->a, op->b,
+            [](Type, Lane a, Lane b) { return a.i && b.i; });
+  }
+
+  void visit(const Or* op) {
+    compare(op->type, op->a, op->b,
+            [](Type, Lane a, Lane b) { return a.i || b.i; });
+  }
+
+  void visit(const Not* op) {
+    Value a = eval(op->a);
+    value = Value(op->type);
+    for (int i = 0; i < op->type.width; i++) {
+      value.lanes[i].i = !a.lane(i).i;
+    }
+  }
+
+  void visit(const Select* op) {
+    Value cond = eval(op->condition);
+    Value a = eval(op->true_value);
+    Value b = eval(op->false_value);
+    value = Value(op->type);
+    for (int i = 0; i < op->type.width; i++) {
+      value.lanes[i] = cond.lane(i).i ? a.lane(i) : b.lane(i);
+    }
+  }
+
+  void visit(const Load* op) {
+    Type scalar_t = op->type.element_of();
+    int bytes = storage_bytes(scalar_t);
+    Value index = eval(op->index);
+    uint8_t* host = host_pointer(op->name);
+    value = Value(op->type);
+    for (int i = 0; i < op->type.width; i++) {
+      value.lanes[i] = read(scalar_t, host + index.lane(i).i * bytes);
+    }
+  }
+
+  void visit(const Ramp* op) {
+    Type t = op->type;
+    Value base = eval(op->base);
+    Value stride = eval(op->stride);
+    value = Value(t);
+    for (int i = 0; i < op->width; i++) {
+      if (t.is_float()) {
+        value.lanes[i].f =
+            round_float(t, base.lanes[0].f + stride.lanes[0].f * i);
+      } else {
+        value.lanes[i].i = wrap(t, (int64_t)((uint64_t)base.lanes[0].i +
+                                             (uint64_t)stride.lanes[0].i * i));
+      }
+    }
+  }
+
+  void visit(const Broadcast* op) {
+    Value v = eval(op->value);
+    value = Value(op->type);
+    for (int i = 0; i < op->width; i++) {
+      value.lanes[i] = v.lanes[0];
+    }
+  }
+
+  void visit(const Call* op) {
+    if (op->call_type == Call::Extern) {
+      extern_call(op);
+    } else if (op->call_type == Call::Intrinsic) {
+      intrinsic(op);
+    } else {
+      std::cerr << "Call to " << op->name
+                << " should have been replaced by a Load before "
+                << "interpretation\n";
+      assert(false);
+    }
+  }
+
+  void extern_call(const Call* op) {
+    Type t = op->type;
+    string base, suffix;
+    split_extern_name(op->name, &base, &suffix);
+    vector<Value> args(op->args.size());
+    for (size_t i = 0; i < op->args.size(); i++) {
+      args[i] = eval(op->args[i]);
+    }
+    value = Value(t);
+
+    if (base == "abs" && t.is_int()) {
+      for (int i = 0; i < t.width; i++) {
+        int64_t a = args[0].lane(i).i;
+        value.lanes[i].i = wrap(t, a < 0 ? (int64_t)(0 - (uint64_t)a) : a);
+      }
+      return;
+    }
+
+    MathFn1 fn1 = args.size() == 1 ? math_function(base) : NULL;
+    MathFn2 fn2 = args.size() == 2 ? math_function2(base) : NULL;
+    for (int i = 0; i < t.width; i++) {
+      double r;
+      if (fn1) {
+        r = fn1(args[0].lane(i).f);
+      } else if (fn2) {
+        r = fn2(args[0].lane(i).f, args[1].lane(i).f);
+      } else if (base == "inf") {
+        r = INFINITY;
+      } else if (base == "neg_inf") {
+        r = -INFINITY;
+      } else if (base == "nan") {
+        r = NAN;
+      } else {
+        std::cerr << "Can't interpret a call to " << op->name << "\n";
+        assert(false);
+        r = 0;
+      }
+      value.lanes[i].f = round_float(t, r);
+    }
+  }
+
+  buffer_t* buffer_arg(Expr e) {
+    return (buffer_t*)(intptr_t)eval(e).lanes[0].i;
+  }
+
+  void intrinsic(const Call* op) {
+    const string& name = op->name;
+    Type t = op->type;
+
+    if (name == Call::bitwise_and || name == Call::bitwise_or ||
+        name == Call::bitwise_xor || name == Call::bitwise_not) {
+      // Bitwise operations on floats act on their bits.
+      vector<Value> args(op->args.size());
+      for (size_t i = 0; i < op->args.size(); i++) {
+        args[i] = eval(op->args[i]);
+      }
+      value = Value(t);
+      for (int i = 0; i < t.width; i++) {
+        int64_t a = t.is_float() ? float_bits(t, args[0].lane(i).f)
+                                 : args[0].lane(i).i;
+        int64_t b = 0;
+        if (args.size() > 1) {
+          b = t.is_float() ? float_bits(t, args[1].lane(i).f)
+                           : args[1].lane(i).i;
+        }
+        int64_t r = name == Call::bitwise_and   ? a & b
+                    : name == Call::bitwise_or  ? a | b
+                    : name == Call::bitwise_xor ? a ^ b
+                                                : ~a;
+        if (t.is_float()) {
+          value.lanes[i].f = bits_float(t, r);
+        } else {
+          value.lanes[i].i = wrap(t, r);
+        }
+      }
+    } else if (name == Call::shift_left || name == Call::shift_right) {
+      Value a = eval(op->args[0]);
+      Value b = eval(op->args[1]);
+      value = Value(t);
+      for (int i = 0; i < t.width; i++) {
+        int64_t x = a.lane(i).i;
+        int shift = (int)(b.lane(i).i & 63);
+        int64_t r;
+        if (name == Call::shift_left) {
+          r = (int64_t)((uint64_t)x << shift);
+        } else if (t.is_int()) {
+          r = x >> shift;
+        } else {
+          r = (int64_t)((uint64_t)x >> shift);
+        }
+        value.lanes[i].i = wrap(t, r);
+      }
+    } else if (name == Call::reinterpret) {
+      Type src = op->args[0].type();
+      Value v = eval(op->args[0]);
+      value = Value(t);
+      for (int i = 0; i < t.width; i++) {
+        int64_t bits =
+            src.is_float() ? float_bits(src, v.lane(i).f) : v.lane(i).i;
+        if (t.is_float()) {
+          value.lanes[i].f = bits_float(t, bits);
+        } else {
+          value.lanes[i].i = wrap(t, bits);
+        }
+      }
+    } else if (name == Call::shuffle_vector) {
+      Value v = eval(op->args[0]);
+      value = Value(t);
+      for (size_t i = 1; i < op->args.size(); i++) {
+        const int* idx = as_const_int(op->args[i]);
+        assert(idx && "shuffle_vector indices must be constant");
+        value.lanes[i - 1] = v.lane(*idx);
+      }
+    } else if (name == Call::interleave_vectors) {
+      // Lane i of argument j goes to lane i * n + j.
+      int n = (int)op->args.size();
+      int w = op->args[0].type().width;
+      Value result(t);
+      for (int j = 0; j < n; j++) {
+        Value v = eval(op->args[j]);
+        for (int i = 0; i < w; i++) {
+          result.lanes[i * n + j] = v.lane(i);
+        }
+      }
+      value = result;
+    } else if (name == Call::lerp) {
+      // The same expression CodeGen generates.
+      Expr zero = op->args[0], one = op->args[1], weight = op->args[2];
+      Type ft =
+          Float(t.is_float() ? t.bits : (t.bits >= 32 ? 64 : 32), t.width);
+      Expr w = cast(ft, weight);
+      if (!weight.type().is_float()) {
+        w = w / cast(ft, weight.type().max());
+      }
+      Expr e = cast(ft, zero) + (cast(ft, one) - cast(ft, zero)) * w;
+      if (!t.is_float()) {
+        e = floor(e + cast(ft, Expr(0.5f)));
+      }
+      value = eval(cast(t, e));
+    } else if (name == Call::create_buffer_t) {
+      // create_buffer_t(host, elem_size, min0, extent0, stride0, min1, ...)
+      buffers.push_back(buffer_t());
+      buffer_t* b = &buffers.back();
+      memset(b, 0, sizeof(*b));
+      b->host = (uint8_t*)(intptr_t)eval(op->args[0]).lanes[0].i;
+      b->elem_size = (int32_t)eval(op->args[1]).lanes[0].i;
+      int dims = (int)(op->args.size() - 2) / 3;
+      for (int i = 0; i < dims && i < 4; i++) {
+        b->min[i] = (int32_t)eval(op->args[2 + i * 3]).lanes[0].i;
+        b->extent[i] = (int32_t)eval(op->args[3 + i * 3]).lanes[0].i;
+        b->stride[i] = (int32_t)eval(op->args[4 + i * 3]).lanes[0].i;
+      }
+      value = scalar(t, (int64_t)(intptr_t)b);
+    } else if (name == Call::extract_buffer_min ||
+               name == Call::extract_buffer_extent) {
+      buffer_t* b = buffer_arg(op->args[0]);
+      const int* dim = as_const_int(op->args[1]);
+      assert(dim && *dim >= 0 && *dim < 4 && "Bad buffer dimension");
+      value = scalar(t, name == Call::extract_buffer_min ? b->min[*dim]
+                                                         : b->extent[*dim]);
+    } else if (name == Call::rewrite_buffer) {
+      // rewrite_buffer(buffer, elem_size, min0, extent0, stride0, ...)
+      buffer_t* b = buffer_arg(op->args[0]);
+      b->elem_size = (int32_t)eval(op->args[1]).lanes[0].i;
+      int dims = (int)(op->args.size() - 2) / 3;
+      for (int i = 0; i < dims; i++) {
+        b->min[i] = (int32_t)eval(op->args[2 + i * 3]).lanes[0].i;
+        b->extent[i] = (int32_t)eval(op->args[3 + i * 3]).lanes[0].i;
+        b->stride[i] = (int32_t)eval(op->args[4 + i * 3]).lanes[0].i;
+      }
+      value = scalar(t, 0);
+    } else if (name == Call::profiling_timer) {
+      value = scalar(
+          t, wrap(t, std::chrono::steady_clock::now().time_since_epoch()
+                         .count()));
+    } else if (name == Call::trace) {
+      // trace(func_name, event, value_index, value, coordinates...),
+      // as in CodeGen.
+      assert(op->args.size() >= 4 && "Wrong number of arguments to trace");
+      Type vt = op->args[3].type();
+      Value func_name = eval(op->args[0]);
+      Value event = eval(op->args[1]);
+      Value value_index = eval(op->args[2]);
+      Value v = eval(op->args[3]);
+      vector<int> coords(std::max<size_t>(op->args.size() - 4, 1));
+      for (size_t i = 4; i < op->args.size(); i++) {
+        coords[i - 4] = (int)eval(op->args[i]).lanes[0].i;
+      }
+      if (trace) {
+        int bytes = storage_bytes(vt.element_of());
+        vector<uint8_t> storage(bytes * vt.width);
+        for (int i = 0; i < vt.width; i++) {
+          write(vt.element_of(), &storage[i * bytes], v.lanes[i]);
+        }
+        int type_code =
+            vt.is_int() ? 0 : vt.is_uint() ? 1 : vt.is_float() ? 2 : 3;
+        trace((const char*)(intptr_t)func_name.lanes[0].i,
+              (int)event.lanes[0].i, type_code, vt.bits, vt.width,
+              (int)value_index.lanes[0].i, &storage[0],
+              (int)op->args.size() - 4, &coords[0]);
+      }
+      value = vt == t ? v : scalar(t, 0);
+    } else {
+      std::cerr << "Interpretation of intrinsic " << name
+                << " is not supported\n";
+      assert(false);
+    }
+  }
+
+  void visit(const Let* op) {
+    symbols.push(op->name, eval(op->value));
+    value = eval(op->body);
+    symbols.pop(op->name);
+  }
+
+  void visit(const LetStmt* op) {
+    symbols.push(op->name, eval(op->value));
+    exec(op->body);
+    symbols.pop(op->name);
+  }
+
+  void visit(const AssertStmt* op) {
+    if (!eval(op->condition).lanes[0].i) {
+      fail(op->message);
+    }
+  }
+
+  void visit(const Pipeline* op) {
+    exec(op->produce);
+    if (op->update.defined()) {
+      exec(op->update);
+    }
+    exec(op->consume);
+  }
+
+  void visit(const For* op) {
+    // Every kind of loop runs serially.
+    int32_t min = (int32_t)eval(op->min).lanes[0].i;
+    int32_t extent = (int32_t)eval(op->extent).lanes[0].i;
+    for (int32_t i = min; i < min + extent && result == 0; i++) {
+      symbols.push(op->name, scalar(Int(32), i));
+      exec(op->body);
+      symbols.pop(op->name);
+    }
+  }
+
+  void visit(const Store* op) {
+    Type scalar_t = op->value.type().element_of();
+    int bytes = storage_bytes(scalar_t);
+    Value v = eval(op->value);
+    Value index = eval(op->index);
+    uint8_t* host = host_pointer(op->name);
+    for (int i = 0; i < index.type.width; i++) {
+      write(scalar_t, host + index.lane(i).i * bytes, v.lane(i));
+    }
+  }
+
+  void visit(const Allocate* op) {
+    int64_t size = eval(op->size).lanes[0].i;
+    void* ptr = allocate_memory((size_t)size * storage_bytes(op->type));
+    if (!ptr) {
+      fail("Out of memory allocating " + op->name);
+      return;
+    }
+    heap.push_back(ptr);
+    define(op->name + ".host", Handle(), (int64_t)(intptr_t)ptr);
+    exec(op->body);
+    // Free it if the body didn't.
+    release(ptr);
+    symbols.pop(op->name + ".host");
+  }
+
+  void visit(const Free* op) { release(host_pointer(op->name)); }
+
+  void visit(const Block* op) {
+    exec(op->first);
+    if (op->rest.defined()) {
+      exec(op->rest);
+    }
+  }
+
+  void visit(const IfThenElse* op) {
+    if (eval(op->condition).lanes[0].i) {
+      exec(op->then_case);
+    } else if (op->else_case.defined()) {
+      exec(op->else_case);
+    }
+  }
+
+  void visit(const Evaluate* op) { eval(op->value); }
+};
+
+}  // namespace
+
+Interpreter::Interpreter(Stmt s, const vector<Argument>& a)
+    : stmt(s),
+      args(a),
+      error_handler(NULL),
+      custom_malloc(NULL),
+      custom_free(NULL),
+      trace(NULL) {}
+
+bool Interpreter::can_interpret(Stmt s) {
+  CheckInterpretable check;
+  s.accept(&check);
+  return check.ok;
+}
+
+int Interpreter::run(const void** arg_values) const {
+  Evaluator e(error_handler, custom_malloc, custom_free, trace);
+  for (size_t i = 0; i < args.size(); i++) {
+    if (args[i].is_buffer) {
+      e.unpack_buffer(args[i].name, (buffer_t*)arg_values[i]);
+    } else {
+      Value v(args[i].type);
+      v.lanes[0] = read(args[i].type, (const uint8_t*)arg_values[i]);
+      e.define(args[i].name, v);
+    }
+  }
+  e.exec(stmt);
+  e.free_all();
+  return e.result;
+}
+
+void Interpreter::set_error_handler(JITModule::ErrorHandler handler) {
+  error_handler = handler;
+}
+
+void Interpreter::set_custom_allocator(void* (*malloc)(size_t),
+                                       void (*free)(void*)) {
+  custom_malloc = malloc;
+  custom_free = free;
+}
+
+void Interpreter::set_custom_trace(JITModule::TraceFn t) { trace = t; }
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
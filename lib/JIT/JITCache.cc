@@ -0,0 +1,322 @@
+#include "jmlang/JIT/JITCache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include "jmlang/Base/Debug.h"
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/CodeGen/Runtime.h"
+#include "jmlang/IR/IREquality.h"
+#include "jmlang/IR/IRHash.h"
+#include "jmlang/IR/IRPrinter.h"
+#include "jmlang/JIT/LLVMHeaders.h"
+
+#ifndef JMLANG_VERSION
+#define JMLANG_VERSION "unknown"
+#endif
+
+namespace jmlang {
+namespace internal {
+
+using std::list;
+using std::multimap;
+using std::string;
+using std::vector;
+
+namespace {
+
+/// A description of the machine code CodeGen makes on this host.
+const string& host_target() {
+  static string target = []() {
+    string t = llvm::sys::getProcessTriple() + "-" +
+               llvm::sys::getHostCPUName().str();
+    llvm::StringMap<bool> features;
+    if (llvm::sys::getHostCPUFeatures(features)) {
+      std::map<string, bool> sorted;
+      for (llvm::StringMap<bool>::iterator iter = features.begin();
+           iter != features.end(); ++iter) {
+        sorted[iter->getKey().str()] = iter->getValue();
+      }
+      for (std::map<string, bool>::iterator iter = sorted.begin();
+           iter != sorted.end(); ++iter) {
+        t += (iter->second ? ",+" : ",-") + iter->first;
+      }
+    }
+    return t;
+  }();
+  return target;
+}
+
+bool same_arguments(const vector<Argument>& a, const vector<Argument>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].name != b[i].name || a[i].is_buffer != b[i].is_buffer ||
+        (!a[i].is_buffer && !(a[i].type == b[i].type))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct CacheEntry {
+  uint64_t hash;
+  Stmt stmt;
+  vector<Argument> args;
+  Target target;
+  JITHandlers handlers;
+  JITModule module;
+};
+
+/// The cache. Entries are kept in order of use, most recent first,
+/// and indexed by hash.
+struct JITCache {
+  std::mutex lock;
+  list<CacheEntry> entries;
+  multimap<uint64_t, list<CacheEntry>::iterator> index;
+  size_t limit, code_size;
+  JITCacheStats stats;
+
+  JITCache() : limit(64 << 20), code_size(0) {
+    stats.hits = stats.misses = stats.disk_hits = stats.evictions = 0;
+  }
+
+  /// Find an entry and mark it as most recently used. Must hold the
+  /// lock.
+  bool find(uint64_t hash, Stmt s, const vector<Argument>& args,
+            const Target& target, const JITHandlers& handlers,
+            JITModule* result) {
+    typedef multimap<uint64_t, list<CacheEntry>::iterator>::iterator Iter;
+    std::pair<Iter, Iter> range = index.equal_range(hash);
+    for (Iter iter = range.first; iter != range.second; ++iter) {
+      list<CacheEntry>::iterator entry = iter->second;
+      if (entry->target == target && entry->handlers == handlers &&
+          same_arguments(entry->args, args) && equal(entry->stmt, s)) {
+        entries.splice(entries.begin(), entries, entry);
+        *result = entry->module;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Drop least recently used entries until the cache fits in its
+  /// limit, keeping at least the most recent one. Must hold the lock.
+  void evict() {
+    while (code_size > limit && entries.size() > 1) {
+      list<CacheEntry>::iterator entry = --entries.end();
+      typedef multimap<uint64_t, list<CacheEntry>::iterator>::iterator Iter;
+      std::pair<Iter, Iter> range = index.equal_range(entry->hash);
+      for (Iter iter = range.first; iter != range.second; ++iter) {
+        if (iter->second == entry) {
+          index.erase(iter);
+          break;
+        }
+      }
+      code_size -= entry->module.code_size();
+      entries.erase(entry);
+      stats.evictions++;
+    }
+  }
+};
+
+JITCache& cache() {
+  static JITCache c;
+  return c;
+}
+
+/// The directory to keep compiled object files in, from the
+/// environment variable JMLANG_JIT_CACHE_DIR. Empty if unset.
+string disk_cache_dir() {
+  const char* dir = getenv("JMLANG_JIT_CACHE_DIR");
+  return dir ? dir : "";
+}
+
+/// Everything that determines the object file compiled from a
+/// statement. Saved alongside the object file, and compared on
+/// loading, so that a hash collision or a file from another version,
+/// or built with another runtime, can't be mistaken for a match.
+string describe(uint64_t hash, Stmt s, const string& name,
+                const vector<Argument>& args, const Target& target) {
+  std::ostringstream desc;
+  desc << "jmlang " << JMLANG_VERSION << " llvm " << LLVM_VERSION << "\n"
+       << "runtime " << runtime_bitcode_digest << "\n"
+       << "target " << target.to_string() << "\n"
+       << "host " << host_target() << "\n"
+       << "function " << name << "\n";
+  for (size_t i = 0; i < args.size(); i++) {
+    desc << "argument " << args[i].name << " ";
+    if (args[i].is_buffer) {
+      desc << "buffer\n";
+    } else {
+      desc << args[i].type << "\n";
+    }
+  }
+  desc << "hash " << std::hex << hash << std::dec << "\n" << s;
+  return desc.str();
+}
+
+string read_file(const string& path) {
+  std::ifstream f(path.c_str(), std::ios::binary);
+  std::ostringstream contents;
+  contents << f.rdbuf();
+  return f ? contents.str() : "";
+}
+
+/// Write a file under a temporary name, then move it into place, so
+/// that other processes using the same directory never see a partial
+/// file.
+void write_file(const string& path, const string& contents) {
+  int fd;
+  llvm::SmallString<256> tmp_path;
+  if (llvm::sys::fs::createUniqueFile(path + "-%%%%%%.tmp", fd, tmp_path)) {
+    return;
+  }
+  {
+    llvm::raw_fd_ostream out(fd, true);
+    out << contents;
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      llvm::sys::fs::remove(tmp_path);
+      return;
+    }
+  }
+  if (llvm::sys::fs::rename(tmp_path, path)) {
+    llvm::sys::fs::remove(tmp_path);
+  }
+}
+
+void set_handlers(const JITModule& m, const JITHandlers& handlers) {
+  m.set_error_handler(handlers.error_handler);
+  m.set_custom_allocator(handlers.custom_malloc, handlers.custom_free);
+  m.set_custom_trace(handlers.trace);
+  m.set_par_for_options(handlers.max_threads, handlers.priority);
+  if (handlers.numa_aware >= 0) {
+    m.set_numa_aware(handlers.numa_aware);
+  }
+}
+
+/// Compile a statement, or load it from the on-disk cache if it's
+/// there and the cache is enabled.
+JITModule compile_or_load(uint64_t hash, Stmt s, const string& name,
+                          const vector<Argument>& args, const Target& target,
+                          bool* loaded) {
+  *loaded = false;
+  string dir = disk_cache_dir();
+  string path;
+  string description;
+  if (!dir.empty()) {
+    description = describe(hash, s, name, args, target);
+    std::ostringstream p;
+    p << dir << "/" << name << "-" << std::hex << hash_string(description);
+    path = p.str();
+    JITModule m;
+    if (read_file(path + ".key") == description &&
+        m.load_object(path + ".o", name)) {
+      debug(1) << "Loaded " << name << " from " << path << ".o\n";
+      *loaded = true;
+      return m;
+    }
+    if (llvm::sys::fs::create_directories(dir)) {
+      debug(1) << "Could not create jit cache directory " << dir << "\n";
+      path.clear();
+    }
+  }
+
+  CodeGen cg(target);
+  cg.compile(s, name, args);
+  JITModule m =
+      cg.compile_to_function_pointers(path.empty() ? "" : path + ".o");
+  if (!path.empty()) {
+    // Written after the object file, so that a key file always has a
+    // complete object file to go with it.
+    write_file(path + ".key", description);
+  }
+  return m;
+}
+
+}  // namespace
+
+JITModule compile_jit_cached(Stmt s, const string& name,
+                             const vector<Argument>& args,
+                             const JITHandlers& handlers) {
+  Target target = get_jit_target_from_environment();
+  uint64_t hash = hash_combine(structural_hash(s),
+                               hash_string(target.to_string() + " on " +
+                                           host_target()));
+  for (size_t i = 0; i < args.size(); i++) {
+    hash = hash_combine(hash, hash_string(args[i].name));
+  }
+
+  JITCache& c = cache();
+  JITModule result;
+  {
+    std::lock_guard<std::mutex> lock(c.lock);
+    if (c.find(hash, s, args, target, handlers, &result)) {
+      c.stats.hits++;
+      debug(1) << "Reusing jit compiled module for " << name << "\n";
+      return result;
+    }
+    c.stats.misses++;
+  }
+
+  // Compile without holding the lock, so that other pipelines can be
+  // compiled or found in the meantime. The handlers aren't part of
+  // the machine code, so modules that differ only in their handlers
+  // share an object file on disk.
+  bool loaded;
+  result = compile_or_load(hash, s, name, args, target, &loaded);
+  set_handlers(result, handlers);
+
+  std::lock_guard<std::mutex> lock(c.lock);
+  if (loaded) {
+    c.stats.disk_hits++;
+  }
+  JITModule existing;
+  if (c.find(hash, s, args, target, handlers, &existing)) {
+    // Another thread compiled the same thing first. Use theirs, so
+    // that there's only one copy in use.
+    return existing;
+  }
+  CacheEntry entry = {hash, s, args, target, handlers, result};
+  c.entries.push_front(entry);
+  c.index.insert(std::make_pair(hash, c.entries.begin()));
+  c.code_size += result.code_size();
+  c.evict();
+  return result;
+}
+
+void set_jit_cache_limit(size_t bytes) {
+  JITCache& c = cache();
+  std::lock_guard<std::mutex> lock(c.lock);
+  c.limit = bytes;
+  c.evict();
+}
+
+void clear_jit_cache() {
+  JITCache& c = cache();
+  std::lock_guard<std::mutex> lock(c.lock);
+  c.stats.evictions += c.entries.size();
+  c.entries.clear();
+  c.index.clear();
+  c.code_size = 0;
+}
+
+JITCacheStats jit_cache_stats() {
+  JITCache& c = cache();
+  std::lock_guard<std::mutex> lock(c.lock);
+  JITCacheStats stats = c.stats;
+  stats.entries = c.entries.size();
+  stats.code_size = c.code_size;
+  return stats;
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
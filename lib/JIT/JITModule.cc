@@ -1,26 +1,142 @@
 #include "jmlang/JIT/JITModule.h"
 
 #include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include "jmlang/Base/Debug.h"
+#include "jmlang/Base/Util.h"
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/CodeGen/Runtime.h"
 #include "jmlang/JIT/LLVMHeaders.h"
 
 namespace jmlang {
 namespace internal {
 
-// Wraps an execution engine. Takes ownership of the given module and
-// the memory for jit compiled code.
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+/// Check for an llvm error, and bail out with a message if there
+/// was one.
+template <typename T>
+T check(llvm::Expected<T> value, const string& what) {
+  if (!value) {
+    std::cerr << what << ": " << llvm::toString(value.takeError()) << "\n";
+    assert(false);
+  }
+  return std::forward<T>(*value);
+}
+
+void check(llvm::Error error, const string& what) {
+  if (error) {
+    std::cerr << what << ": " << llvm::toString(std::move(error)) << "\n";
+    assert(false);
+  }
+}
+
+/// An object file the jit is making from a module: its size once
+/// made, and where to save a copy of it, if anywhere.
+struct PendingObject {
+  size_t size;
+  string save_path;
+};
+
+/// The objects being made, by the identifier of the module they're
+/// made from.
+std::mutex pending_objects_lock;
+map<string, PendingObject> pending_objects;
+
+/// Write an object file to disk. The file is written under a
+/// temporary name and then renamed, so that other processes sharing
+/// the path never see a partial file.
+void save_object(const llvm::MemoryBuffer& obj, const string& path) {
+  int fd;
+  llvm::SmallString<256> tmp_path;
+  if (llvm::sys::fs::createUniqueFile(path + "-%%%%%%.tmp", fd, tmp_path)) {
+    debug(1) << "Could not save object file " << path << "\n";
+    return;
+  }
+  {
+    llvm::raw_fd_ostream out(fd, true);
+    out << obj.getBuffer();
+    out.close();
+    if (out.has_error()) {
+      out.clear_error();
+      llvm::sys::fs::remove(tmp_path);
+      return;
+    }
+  }
+  if (llvm::sys::fs::rename(tmp_path, path)) {
+    llvm::sys::fs::remove(tmp_path);
+  }
+}
+
+/// Called by the jit with each object file it makes from a module.
+void object_made(const llvm::MemoryBuffer& obj) {
+  // The buffer is named after the module it was made from, plus a
+  // suffix.
+  string id = obj.getBufferIdentifier().str();
+  string save_path;
+  {
+    std::lock_guard<std::mutex> lock(pending_objects_lock);
+    for (map<string, PendingObject>::iterator iter = pending_objects.begin();
+         iter != pending_objects.end(); ++iter) {
+      if (starts_with(id, iter->first + "-")) {
+        iter->second.size += obj.getBufferSize();
+        save_path = iter->second.save_path;
+        break;
+      }
+    }
+  }
+  if (!save_path.empty()) {
+    save_object(obj, save_path);
+  }
+}
+
+/// The jit shared by every compiled pipeline in the process. Setting
+/// it up is the expensive part of jit compilation, so it's done once,
+/// on first use. Modules are compiled on a pool of threads. It's
+/// never destroyed, as modules held in static objects may outlive any
+/// static that would own it.
+llvm::orc::LLJIT& jit() {
+  static llvm::orc::LLJIT* instance = []() {
+    CodeGen::initialize_llvm();
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::unique_ptr<llvm::orc::LLJIT> j = check(
+        llvm::orc::LLJITBuilder().setNumCompileThreads(threads).create(),
+        "Could not create jit");
+    j->getObjTransformLayer().setTransform(
+        [](std::unique_ptr<llvm::MemoryBuffer> obj)
+            -> llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> {
+          object_made(*obj);
+          return obj;
+        });
+    return j.release();
+  }();
+  return *instance;
+}
+
+}  // namespace
+
+// Owns the jit dylib holding a module's compiled code. Each pipeline
+// gets its own dylib in the shared jit, so that its symbols don't
+// collide with other pipelines and its code can be freed on its own.
 class JITModuleHolder {
  public:
   mutable RefCount ref_count;
 
-  JITModuleHolder(llvm::ExecutionEngine* ee, llvm::Module* m,
-                  void (*stop_threads)(), void (*stop_trace)())
-      : execution_engine(ee),
-        module(m),
-        context(&m->getContext()),
-        shutdown_thread_pool(stop_threads),
+  JITModuleHolder(llvm::orc::JITDylib* d, size_t size,
+                  void (*release)(), void (*stop_trace)())
+      : dylib(d),
+        code_size(size),
+        release_thread_pool(release),
         shutdown_trace(stop_trace) {}
 
   ~JITModuleHolder() {
@@ -30,16 +146,20 @@ class JITModuleHolder {
       (*cleanup_routines[i])();
     }
 
-    shutdown_thread_pool();
+    if (release_thread_pool) {
+      release_thread_pool();
+    }
     shutdown_trace();
-    delete execution_engine;
-    delete context;
+    check(jit().getExecutionSession().removeJITDylib(*dylib),
+          "Could not free jit compiled code");
   }
 
-  llvm::ExecutionEngine* execution_engine;
-  llvm::Module* module;
-  llvm::LLVMContext* context;
-  void (*shutdown_thread_pool)();
+  llvm::orc::JITDylib* dylib;
+  size_t code_size;
+  /** Drop this module's reference to the process-wide thread pool,
+   * which stops its workers once no module holds one. Null if the
+   * pool belongs to the program's own runtime. */
+  void (*release_thread_pool)();
   void (*shutdown_trace)();
 
   /** Do any target-specific module cleanup. */
@@ -56,8 +176,185 @@ void destroy<JITModuleHolder>(const JITModuleHolder* f) {
   delete f;
 }
 
-void JITModule::compile_module(CodeGen* cg, llvm::Module* m,
-                               const std::string& function_name) {}
+namespace {
+
+/// Let symbols a dylib doesn't define, e.g. calls into libm, resolve
+/// to symbols in the process.
+void search_process(llvm::orc::JITDylib& dylib) {
+  dylib.addGenerator(
+      check(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+                jit().getDataLayout().getGlobalPrefix()),
+            "Could not search the process for symbols"));
+}
+
+/// The dylib holding the one copy of the runtime's default functions
+/// (the allocator, error handler, thread pool and tracing) that every
+/// jit compiled pipeline links against. If the program already has a
+/// runtime, from a pipeline compiled ahead of time, that one is used
+/// instead, so that jit and ahead of time pipelines share one thread
+/// pool.
+///
+/// The program's runtime is also used by code the jit knows nothing
+/// about, which doesn't hold references to the pool, so its pool is
+/// left running for the life of the process.
+bool runtime_in_process = false;
+
+llvm::orc::JITDylib& runtime_dylib() {
+  static llvm::orc::JITDylib* instance = []() {
+    llvm::orc::LLJIT& j = jit();
+    llvm::orc::JITDylib& dylib = check(j.createJITDylib("jmlang_runtime"),
+                                       "Could not create the runtime dylib");
+    search_process(dylib);
+    if (llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(
+            "jmlang_pool_do_par_for")) {
+      debug(1) << "Using the runtime linked into the program\n";
+      runtime_in_process = true;
+      return &dylib;
+    }
+    std::unique_ptr<llvm::LLVMContext> context(new llvm::LLVMContext);
+    std::unique_ptr<llvm::Module> m(
+        new llvm::Module("jmlang_runtime", *context));
+    m->setTargetTriple(j.getTargetTriple().str());
+    m->setDataLayout(j.getDataLayout());
+    add_default_runtime(m.get());
+    check(j.addIRModule(dylib, llvm::orc::ThreadSafeModule(
+                                   std::move(m), std::move(context))),
+          "Could not add the runtime to jit");
+    return &dylib;
+  }();
+  return *instance;
+}
+
+/// Make a new dylib in the jit to hold a module's code.
+llvm::orc::JITDylib& create_dylib(const string& name) {
+  llvm::orc::JITDylib& runtime = runtime_dylib();
+  llvm::orc::JITDylib& dylib =
+      check(jit().createJITDylib(name), "Could not create jit dylib " + name);
+  dylib.addToLinkOrder(runtime);
+  search_process(dylib);
+  return dylib;
+}
+
+void* lookup(llvm::orc::JITDylib& dylib, const string& name) {
+  return llvm::jitTargetAddressToPointer<void*>(
+      check(jit().lookup(dylib, name), "Could not find " + name)
+          .getAddress());
+}
+
+}  // namespace
+
+void JITModule::link(llvm::orc::JITDylib* dylib,
+                     const std::string& function_name, size_t size) {
+  debug(1) << "JIT compiling " << function_name << "...\n";
+  function = lookup(*dylib, function_name);
+  wrapped_function = reinterpret_bits<int (*)(const void**)>(
+      lookup(*dylib, function_name + "_jit_wrapper"));
+
+  struct {
+    const char* name;
+    void** ptr;
+  } runtime[] = {
+      {"jmlang_set_error_handler", (void**)&set_error_handler},
+      {"jmlang_set_custom_allocator", (void**)&set_custom_allocator},
+      {"jmlang_set_custom_do_par_for", (void**)&set_custom_do_par_for},
+      {"jmlang_set_custom_do_task", (void**)&set_custom_do_task},
+      {"jmlang_set_custom_trace", (void**)&set_custom_trace},
+      {"jmlang_set_par_for_options", (void**)&set_par_for_options},
+      {"jmlang_set_numa_aware", (void**)&set_numa_aware}};
+  for (size_t i = 0; i < sizeof(runtime) / sizeof(runtime[0]); i++) {
+    *runtime[i].ptr = lookup(*dylib, runtime[i].name);
+  }
+
+  // The process-wide state lives in the runtime's dylib, which a
+  // lookup in the module's dylib doesn't search.
+  void (*retain)();
+  void (*release)();
+  struct {
+    const char* name;
+    void** ptr;
+  } shared[] = {
+      {"jmlang_shutdown_thread_pool", (void**)&shutdown_thread_pool},
+      {"jmlang_shutdown_trace", (void**)&shutdown_trace},
+      {"jmlang_trim_allocator", (void**)&trim_allocator},
+      {"jmlang_thread_pool_retain", (void**)&retain},
+      {"jmlang_thread_pool_release", (void**)&release}};
+  for (size_t i = 0; i < sizeof(shared) / sizeof(shared[0]); i++) {
+    *shared[i].ptr = lookup(runtime_dylib(), shared[i].name);
+  }
+
+  if (runtime_in_process) {
+    release = nullptr;
+  } else {
+    retain();
+  }
+  module = new JITModuleHolder(dylib, size, release, shutdown_trace);
+}
+
+void JITModule::compile_module(llvm::Module* m,
+                               const std::string& function_name,
+                               const std::string& object_path) {
+  // The default functions the hooks call come from the runtime dylib.
+  add_runtime_hooks(m, false);
+
+  string dylib_name = unique_name("jit_" + function_name);
+  llvm::orc::JITDylib& dylib = create_dylib(dylib_name);
+
+  {
+    std::lock_guard<std::mutex> lock(pending_objects_lock);
+    PendingObject pending = {0, object_path};
+    pending_objects[dylib_name] = pending;
+  }
+
+  // The jit takes ownership of the module and its context.
+  m->setModuleIdentifier(dylib_name);
+  std::unique_ptr<llvm::LLVMContext> context(&m->getContext());
+  check(jit().addIRModule(dylib, llvm::orc::ThreadSafeModule(
+                                     std::unique_ptr<llvm::Module>(m),
+                                     std::move(context))),
+        "Could not add module to jit");
+
+  // Looking up the function makes the jit compile the module.
+  lookup(dylib, function_name);
+  size_t size;
+  {
+    std::lock_guard<std::mutex> lock(pending_objects_lock);
+    size = pending_objects[dylib_name].size;
+    pending_objects.erase(dylib_name);
+  }
+  link(&dylib, function_name, size);
+}
+
+bool JITModule::load_object(const std::string& object_path,
+                            const std::string& function_name) {
+  // Object files of a page or more are mapped rather than read.
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> obj =
+      llvm::MemoryBuffer::getFile(object_path, false, false);
+  if (!obj) {
+    return false;
+  }
+  size_t size = (*obj)->getBufferSize();
+
+  llvm::orc::JITDylib& dylib =
+      create_dylib(unique_name("jit_" + function_name));
+  llvm::Error error = jit().addObjectFile(dylib, std::move(*obj));
+  llvm::Expected<llvm::JITEvaluatedSymbol> sym =
+      error ? llvm::Expected<llvm::JITEvaluatedSymbol>(std::move(error))
+            : jit().lookup(dylib, function_name);
+  if (!sym) {
+    // A corrupt or stale file. The caller can compile instead.
+    debug(1) << "Could not load object file " << object_path << ": "
+             << llvm::toString(sym.takeError()) << "\n";
+    check(jit().getExecutionSession().removeJITDylib(dylib),
+          "Could not free jit dylib");
+    return false;
+  }
+  link(&dylib, function_name, size);
+  return true;
+}
+
+size_t JITModule::code_size() const {
+  return module.defined() ? module.ptr->code_size : 0;
+}
 
 }  // namespace internal
 }  // namespace jmlang
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "jmlang/JIT/TieredModule.h"
+
+#include <chrono>
+
+#include "jmlang/Base/Debug.h"
+#include "jmlang/JIT/JITCache.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::string;
+using std::vector;
+
+TieredModule::TieredModule(Stmt s, const string& n,
+                           const vector<Argument>& a, const JITHandlers& h)
+    : stmt(s),
+      name(n),
+      arguments(a),
+      handlers(h),
+      interpreter(s, a),
+      interpretable(Interpreter::can_interpret(s)),
+      ready(false),
+      dirty(false) {
+  interpreter.set_error_handler(h.error_handler);
+  interpreter.set_custom_allocator(h.custom_malloc, h.custom_free);
+  interpreter.set_custom_trace(h.trace);
+  std::lock_guard<std::mutex> lock(mutex);
+  compile();
+}
+
+void TieredModule::compile() {
+  Stmt s = stmt;
+  string n = name;
+  vector<Argument> a = arguments;
+  JITHandlers h = handlers;
+  ready.store(false, std::memory_order_release);
+  compiling = std::async(std::launch::async, [s, n, a, h]() {
+                return compile_jit_cached(s, n, a, h);
+              }).share();
+}
+
+std::shared_future<JITModule> TieredModule::compilation() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (dirty) {
+    vector<std::shared_future<JITModule> > running;
+    for (size_t i = 0; i < superseded.size(); i++) {
+      if (superseded[i].wait_for(std::chrono::seconds(0)) !=
+          std::future_status::ready) {
+        running.push_back(superseded[i]);
+      }
+    }
+    running.push_back(compiling);
+    superseded.swap(running);
+    compile();
+    dirty = false;
+  }
+  return compiling;
+}
+
+bool TieredModule::finished(const std::shared_future<JITModule>& c) {
+  if (!ready.load(std::memory_order_acquire) &&
+      c.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+    ready.store(true, std::memory_order_release);
+  }
+  return ready.load(std::memory_order_acquire);
+}
+
+bool TieredModule::compiled() { return finished(compilation()); }
+
+JITModule TieredModule::compiled_module() { return compilation().get(); }
+
+int TieredModule::run(const void** args) {
+  std::shared_future<JITModule> c = compilation();
+  if (interpretable && !finished(c)) {
+    debug(2) << "Interpreting while the jit compiles\n";
+    return interpreter.run(args);
+  }
+  return c.get().wrapped_function(args);
+}
+
+void TieredModule::set_error_handler(JITModule::ErrorHandler handler) {
+  interpreter.set_error_handler(handler);
+  std::lock_guard<std::mutex> lock(mutex);
+  handlers.error_handler = handler;
+  dirty = true;
+}
+
+void TieredModule::set_custom_allocator(void* (*malloc)(size_t),
+                                        void (*free)(void*)) {
+  interpreter.set_custom_allocator(malloc, free);
+  std::lock_guard<std::mutex> lock(mutex);
+  handlers.custom_malloc = malloc;
+  handlers.custom_free = free;
+  dirty = true;
+}
+
+void TieredModule::set_custom_trace(JITModule::TraceFn t) {
+  interpreter.set_custom_trace(t);
+  std::lock_guard<std::mutex> lock(mutex);
+  handlers.trace = t;
+  dirty = true;
+}
+
+void TieredModule::set_par_for_options(int threads, int p) {
+  std::lock_guard<std::mutex> lock(mutex);
+  handlers.max_threads = threads;
+  handlers.priority = p;
+  dirty = true;
+}
+
+void TieredModule::set_numa_aware(bool n) {
+  std::lock_guard<std::mutex> lock(mutex);
+  handlers.numa_aware = n;
+  dirty = true;
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
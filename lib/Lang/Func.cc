@@ -0,0 +1,191 @@
+#include "jmlang/Lang/Func.h"
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/CodeGen/CodeGen_C.h"
+#include "jmlang/CodeGen/MultiTarget.h"
+#include "jmlang/CodeGen/Outputs.h"
+#include "jmlang/IR/FindCalls.h"
+#include "jmlang/Optimizer/CostReport.h"
+
+namespace jmlang {
+
+using std::string;
+using std::vector;
+
+Func& Func::set_estimate(Var var, Expr min, Expr extent) {
+  func.set_estimate(var.name(), min, extent);
+  return *this;
+}
+
+Func& Func::float_mode(FloatMode mode) {
+  func.set_float_mode(mode);
+  return *this;
+}
+
+void Func::set_par_for_options(int max_threads, int priority) {
+  par_for_max_threads = max_threads;
+  par_for_priority = priority;
+  if (compiled_module.set_par_for_options) {
+    compiled_module.set_par_for_options(max_threads, priority);
+  }
+}
+
+void Func::set_numa_aware(bool numa) {
+  numa_aware = numa;
+  if (compiled_module.set_numa_aware) {
+    compiled_module.set_numa_aware(numa);
+  }
+}
+
+void Func::compile_to_cost_report(const string& filename) {
+  assert(lowered.defined() &&
+         "Func must be compiled before a cost report can be generated");
+
+  // The output buffers are the size of the estimated output region.
+  internal::Scope<internal::Interval> estimates;
+  const vector<internal::Schedule::Bound>& bounds = func.estimates();
+  const vector<internal::Parameter>& outputs = func.output_buffers();
+  for (size_t i = 0; i < bounds.size(); i++) {
+    int64_t min, extent;
+    if (!internal::estimate_value(bounds[i].min, estimates, &min) ||
+        !internal::estimate_value(bounds[i].extent, estimates, &extent)) {
+      continue;
+    }
+    for (int d = 0; d < func.dimensions(); d++) {
+      if (func.args()[d] != bounds[i].var) {
+        continue;
+      }
+      for (size_t j = 0; j < outputs.size(); j++) {
+        std::ostringstream min_name, extent_name;
+        min_name << outputs[j].name() << ".min." << d;
+        extent_name << outputs[j].name() << ".extent." << d;
+        estimates.push(min_name.str(), internal::Interval::single_point(min));
+        estimates.push(extent_name.str(),
+                       internal::Interval::single_point(extent));
+      }
+    }
+  }
+
+  std::ofstream f(filename.c_str());
+  assert(f.is_open() && "Could not open cost report file for writing");
+  f << internal::cost_report(
+      lowered, MachineParams::for_target(get_target_from_environment()),
+      estimates);
+}
+
+namespace {
+
+/// The name of the function compiled to a file, which is the last
+/// component of the filename prefix.
+string function_name_for(const string& filename_prefix) {
+  size_t slash = filename_prefix.find_last_of("/\\");
+  return slash == string::npos ? filename_prefix
+                               : filename_prefix.substr(slash + 1);
+}
+
+/// The floating-point modes chosen by the functions in the pipeline
+/// that computes f.
+std::map<string, FloatMode> float_modes_for(internal::Function f) {
+  std::map<string, internal::Function> funcs =
+      internal::find_transitive_calls(f);
+  std::map<string, FloatMode> modes;
+  for (std::map<string, internal::Function>::iterator iter = funcs.begin();
+       iter != funcs.end(); ++iter) {
+    if (iter->second.float_mode() != FloatDefault) {
+      modes[iter->first] = iter->second.float_mode();
+    }
+  }
+  return modes;
+}
+
+}  // namespace
+
+void Func::compile_to_file(const string& filename_prefix,
+                           vector<Argument> args) {
+  compile_to_file(filename_prefix, args, vector<Target>());
+}
+
+void Func::compile_to_file(const string& filename_prefix,
+                           vector<Argument> args,
+                           const vector<Target>& targets) {
+  assert(lowered.defined() &&
+         "Func must be lowered before it can be compiled to a file");
+
+  const vector<internal::Parameter>& outputs = func.output_buffers();
+  for (size_t i = 0; i < outputs.size(); i++) {
+    args.push_back(Argument(outputs[i].name(), true, outputs[i].type()));
+  }
+
+  string name = function_name_for(filename_prefix);
+  if (targets.empty()) {
+    internal::CodeGen cg(get_target_from_environment());
+    cg.set_float_modes(float_modes_for(func));
+    cg.compile(lowered, name, args);
+    cg.compile_to_native(filename_prefix + ".o");
+  } else {
+    internal::compile_multitarget_to_native(filename_prefix + ".o", lowered,
+                                            name, args, targets,
+                                            float_modes_for(func));
+  }
+  internal::compile_to_header(filename_prefix + ".h", name, args);
+}
+
+void Func::compile_to_file(const string& filename_prefix) {
+  compile_to_file(filename_prefix, vector<Argument>());
+}
+
+void Func::compile_to_file(const string& filename_prefix, Argument a) {
+  compile_to_file(filename_prefix, internal::vec(a));
+}
+
+void Func::compile_to_file(const string& filename_prefix, Argument a,
+                           Argument b) {
+  compile_to_file(filename_prefix, internal::vec(a, b));
+}
+
+void Func::compile_to_file(const string& filename_prefix, Argument a,
+                           Argument b, Argument c) {
+  compile_to_file(filename_prefix, internal::vec(a, b, c));
+}
+
+void Func::compile_to_file(const string& filename_prefix, Argument a,
+                           Argument b, Argument c, Argument d) {
+  compile_to_file(filename_prefix, internal::vec(a, b, c, d));
+}
+
+void Func::compile_to_file(const string& filename_prefix, Argument a,
+                           Argument b, Argument c, Argument d, Argument e) {
+  compile_to_file(filename_prefix, internal::vec(a, b, c, d, e));
+}
+
+void Func::compile_to_c(const string& filename, vector<Argument> args,
+                        const string& fn_name) {
+  assert(lowered.defined() &&
+         "Func must be lowered before it can be compiled to C");
+
+  const vector<internal::Parameter>& outputs = func.output_buffers();
+  for (size_t i = 0; i < outputs.size(); i++) {
+    args.push_back(Argument(outputs[i].name(), true, outputs[i].type()));
+  }
+
+  internal::compile_to_c(filename, lowered,
+                         fn_name.empty() ? func.name() : fn_name, args);
+}
+
+void Func::compile_to_static_library(const string& filename_prefix,
+                                     vector<Argument> args,
+                                     const vector<Target>& targets) {
+  compile_to_file(filename_prefix, args, targets);
+  string runtime = filename_prefix + ".runtime.o";
+  internal::CodeGen::compile_runtime_to_native(runtime);
+  internal::create_static_library(
+      filename_prefix + ".a", internal::vec(filename_prefix + ".o", runtime));
+  remove(runtime.c_str());
+}
+
+}  // namespace jmlang
\ No newline at end of file
@@ -0,0 +1,812 @@
+#include "jmlang/Optimizer/AutoSchedule.h"
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+#include "jmlang/Base/Debug.h"
+#include "jmlang/IR/ExprCall.h"
+#include "jmlang/IR/ExprVariable.h"
+#include "jmlang/IR/IRVisitor.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::map;
+using std::ostringstream;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+/// Counts the arithmetic and the loads needed to compute one point
+/// of an expression, and the number of call sites to each producer.
+class CountOps : public IRVisitor {
+ public:
+  int64_t ops, loads;
+  map<string, int64_t> calls;
+  map<string, Function> funcs;
+  map<string, Parameter> parameters;
+
+  CountOps() : ops(0), loads(0) {}
+
+ private:
+  using IRVisitor::visit;
+
+  void visit_binary(const Expr& a, const Expr& b, int64_t cost) {
+    ops += cost;
+    a.accept(this);
+    b.accept(this);
+  }
+
+  void visit(const Cast* op) {
+    ops++;
+    op->value.accept(this);
+  }
+  void visit(const Add* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const Sub* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const Mul* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const Div* op) {
+    visit_binary(op->a, op->b, op->type.is_float() ? 4 : 8);
+  }
+  void visit(const Mod* op) { visit_binary(op->a, op->b, 8); }
+  void visit(const Min* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const Max* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const EQ* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const NE* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const LT* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const LE* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const GT* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const GE* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const And* op) { visit_binary(op->a, op->b, 1); }
+  void visit(const Or* op) { visit_binary(op->a, op->b, 1); }
+
+  void visit(const Not* op) {
+    ops++;
+    op->a.accept(this);
+  }
+
+  void visit(const Select* op) {
+    ops++;
+    IRVisitor::visit(op);
+  }
+
+  void visit(const Variable* op) {
+    if (op->param.defined()) {
+      parameters[op->param.name()] = op->param;
+    }
+  }
+
+  void visit(const Call* op) {
+    IRVisitor::visit(op);
+    if (op->param.defined()) {
+      parameters[op->param.name()] = op->param;
+    }
+    if (op->call_type == Call::Jmlang) {
+      loads++;
+      calls[op->name]++;
+      funcs[op->name] = op->func;
+    } else if (op->call_type == Call::Image) {
+      loads++;
+    } else if (op->call_type == Call::Extern) {
+      // Transcendentals and friends are much more expensive than
+      // a single arithmetic op.
+      ops += 16;
+    } else {
+      ops++;
+    }
+  }
+};
+
+struct FuncInfo {
+  Function func;
+  bool is_output;
+
+  /// The estimated region of the function required by the whole
+  /// pipeline.
+  Box region;
+
+  /// Arithmetic and loads per point computed.
+  int64_t ops, loads;
+
+  /// Call sites per point to each (non-inlined) producer.
+  map<string, int64_t> calls;
+
+  set<string> consumers;
+
+  bool inlined;
+
+  /// The tile of the two innermost dimensions used by the cost
+  /// model, if the function is computed at root.
+  int64_t tile[2];
+
+  FuncInfo()
+      : is_output(false), ops(0), loads(0), inlined(false) {
+    tile[0] = tile[1] = 0;
+  }
+
+  int64_t points() const { return box_size(region); }
+
+  int bytes_per_point() const {
+    int bytes = 0;
+    for (size_t i = 0; i < func.output_types().size(); i++) {
+      bytes += func.output_types()[i].bytes();
+    }
+    return bytes;
+  }
+
+  bool is_pure() const {
+    return !func.has_reduction_definition() && !func.has_extern_definition();
+  }
+};
+
+class AutoScheduler {
+  const MachineParams& params;
+  map<string, FuncInfo> env;
+
+  /// The parameters the pipeline refers to, and the ranges implied by
+  /// any estimates set on them.
+  map<string, Parameter> parameters;
+  Scope<Interval> param_estimates;
+
+  /// Function names ordered so that every consumer precedes all of
+  /// its producers.
+  vector<string> order;
+
+  ScheduleChoices choices;
+
+ public:
+  AutoScheduler(const MachineParams& p) : params(p) {}
+
+  ScheduleChoices run(const vector<Function>& outputs,
+                      const map<string, Box>& estimates) {
+    set<string> visited;
+    for (size_t i = 0; i < outputs.size(); i++) {
+      find_functions(outputs[i], visited);
+    }
+    std::reverse(order.begin(), order.end());
+    find_param_estimates();
+
+    for (size_t i = 0; i < outputs.size(); i++) {
+      FuncInfo& info = env[outputs[i].name()];
+      info.is_output = true;
+      map<string, Box>::const_iterator iter =
+          estimates.find(outputs[i].name());
+      if (iter != estimates.end()) {
+        assert((int)iter->second.size() == outputs[i].dimensions() &&
+               "Estimate has the wrong dimensionality for its output");
+        info.region = iter->second;
+      } else {
+        info.region = output_estimate(outputs[i]);
+      }
+    }
+
+    propagate_regions();
+    choose_inlining();
+    choose_tiling_and_fusion();
+    return choices;
+  }
+
+ private:
+  /// Find every function reachable from f, appending them to the
+  /// order in a post-order traversal.
+  void find_functions(Function f, set<string>& visited) {
+    if (visited.count(f.name())) {
+      return;
+    }
+    visited.insert(f.name());
+
+    FuncInfo& info = env[f.name()];
+    info.func = f;
+    CountOps counter;
+    for (size_t i = 0; i < f.values().size(); i++) {
+      f.values()[i].accept(&counter);
+    }
+    for (size_t i = 0; i < f.reduction_values().size(); i++) {
+      f.reduction_values()[i].accept(&counter);
+    }
+    for (size_t i = 0; i < f.reduction_args().size(); i++) {
+      f.reduction_args()[i].accept(&counter);
+    }
+    for (size_t i = 0; i < f.extern_arguments().size(); i++) {
+      const ExternFuncArgument& arg = f.extern_arguments()[i];
+      if (arg.is_func()) {
+        Function g(arg.func);
+        counter.calls[g.name()]++;
+        counter.funcs[g.name()] = g;
+      }
+    }
+    info.ops = counter.ops;
+    info.loads = counter.loads;
+    info.calls = counter.calls;
+    parameters.insert(counter.parameters.begin(), counter.parameters.end());
+
+    for (map<string, Function>::iterator iter = counter.funcs.begin();
+         iter != counter.funcs.end(); ++iter) {
+      find_functions(iter->second, visited);
+      env[iter->first].consumers.insert(f.name());
+    }
+    order.push_back(f.name());
+  }
+
+  /// Find the estimates set on the parameters of the pipeline.
+  void find_param_estimates() {
+    for (map<string, Parameter>::iterator iter = parameters.begin();
+         iter != parameters.end(); ++iter) {
+      push_estimates(iter->second, param_estimates);
+    }
+  }
+
+  bool estimate_value(Expr e, int64_t* value) {
+    return internal::estimate_value(e, param_estimates, value);
+  }
+
+  /// The region of an output given by the estimates set on it,
+  /// defaulting to 1024 wide in dimensions without one.
+  Box output_estimate(const Function& f) {
+    Box region(f.dimensions(), Interval(0, 1023));
+    vector<bool> found(f.dimensions(), false);
+    const vector<Schedule::Bound>& estimates = f.estimates();
+    for (size_t i = 0; i < estimates.size(); i++) {
+      for (int d = 0; d < f.dimensions(); d++) {
+        int64_t min, extent;
+        if (f.args()[d] == estimates[i].var &&
+            estimate_value(estimates[i].min, &min) &&
+            estimate_value(estimates[i].extent, &extent)) {
+          region[d] = Interval(min, min + extent - 1);
+          found[d] = true;
+        }
+      }
+    }
+    for (int d = 0; d < f.dimensions(); d++) {
+      if (!found[d]) {
+        debug(1) << "No estimate for " << f.name() << "." << f.args()[d]
+                 << ", assuming 1024\n";
+      }
+    }
+    return region;
+  }
+
+  /// The region of each producer required to compute the given
+  /// region of a function, looking through any functions that
+  /// have been inlined into it.
+  map<string, Box> required_regions(const FuncInfo& info, const Box& region) {
+    const Function& f = info.func;
+    map<string, Box> result;
+
+    if (f.has_extern_definition()) {
+      // We can't see inside an extern stage, so assume it needs
+      // the same region of each of its inputs as it produces.
+      for (map<string, int64_t>::const_iterator iter = info.calls.begin();
+           iter != info.calls.end(); ++iter) {
+        const FuncInfo& p = env[iter->first];
+        Box b(p.func.dimensions(), Interval(0, 0));
+        for (size_t i = 0; i < b.size() && i < region.size(); i++) {
+          b[i] = region[i];
+        }
+        merge_boxes(result[iter->first], b);
+      }
+      return result;
+    }
+
+    Scope<Interval> scope = param_estimates;
+    for (int i = 0; i < f.dimensions(); i++) {
+      scope.push(f.args()[i], region[i]);
+    }
+    if (f.has_reduction_definition()) {
+      const vector<ReductionVariable>& rvars = f.reduction_domain().domain();
+      for (size_t i = 0; i < rvars.size(); i++) {
+        Interval min = bounds_of_expr_in_scope(rvars[i].min, scope);
+        Interval extent = bounds_of_expr_in_scope(rvars[i].extent, scope);
+        scope.push(rvars[i].var,
+                   Interval(min.min, min.max + std::max<int64_t>(
+                                                    extent.max, 1) - 1));
+      }
+    }
+
+    vector<Expr> exprs = f.values();
+    exprs.insert(exprs.end(), f.reduction_values().begin(),
+                 f.reduction_values().end());
+    exprs.insert(exprs.end(), f.reduction_args().begin(),
+                 f.reduction_args().end());
+    for (size_t i = 0; i < exprs.size(); i++) {
+      map<string, Box> boxes = boxes_required(exprs[i], scope);
+      for (map<string, Box>::iterator iter = boxes.begin();
+           iter != boxes.end(); ++iter) {
+        map<string, FuncInfo>::iterator p = env.find(iter->first);
+        if (p != env.end() && p->second.inlined) {
+          // Look through the inlined function to what it calls.
+          map<string, Box> inner =
+              required_regions(p->second, iter->second);
+          for (map<string, Box>::iterator j = inner.begin();
+               j != inner.end(); ++j) {
+            merge_boxes(result[j->first], j->second);
+          }
+        } else {
+          merge_boxes(result[iter->first], iter->second);
+        }
+      }
+    }
+    return result;
+  }
+
+  /// Starting from the output estimates, work out how much of each
+  /// function the whole pipeline requires.
+  void propagate_regions() {
+    for (size_t i = 0; i < order.size(); i++) {
+      FuncInfo& info = env[order[i]];
+      if (info.region.empty()) {
+        // Not used by anything we could analyze.
+        info.region = Box(info.func.dimensions(), Interval(0, 1023));
+      }
+      map<string, Box> boxes = required_regions(info, info.region);
+      for (map<string, Box>::iterator iter = boxes.begin();
+           iter != boxes.end(); ++iter) {
+        map<string, FuncInfo>::iterator p = env.find(iter->first);
+        if (p == env.end()) {
+          // An input image.
+          continue;
+        }
+        Box& r = p->second.region;
+        merge_boxes(r, iter->second);
+        for (size_t j = 0; j < r.size(); j++) {
+          if (!r[j].is_bounded()) {
+            debug(1) << "Unbounded access to " << iter->first
+                     << " in dimension " << j << ", assuming 1024\n";
+            r[j] = Interval(0, 1023);
+          }
+        }
+      }
+    }
+  }
+
+  /// The cost of moving a byte between the core and the level of the
+  /// memory hierarchy that a working set of the given size lives in.
+  double cost_per_byte(int64_t working_set) const {
+    if (working_set <= params.l1_size) {
+      return params.balance / 40.0;
+    } else if (working_set <= params.l2_size) {
+      return params.balance / 10.0;
+    } else if (working_set <= params.last_level_cache_size) {
+      return params.balance / 3.0;
+    }
+    return params.balance;
+  }
+
+  /// The number of times a function is called in total by its
+  /// consumers.
+  int64_t total_calls(const FuncInfo& info) {
+    int64_t calls = 0;
+    for (set<string>::iterator iter = info.consumers.begin();
+         iter != info.consumers.end(); ++iter) {
+      const FuncInfo& c = env[*iter];
+      map<string, int64_t>::const_iterator n = c.calls.find(info.func.name());
+      if (n != c.calls.end()) {
+        calls += n->second * c.points();
+      }
+    }
+    return calls;
+  }
+
+  /// The cost of computing a function at root and storing it.
+  double root_cost(const FuncInfo& info, int64_t calls) {
+    int64_t points = info.points();
+    int64_t bytes = info.bytes_per_point();
+    double l1 = cost_per_byte(0);
+    return (info.ops + info.loads * bytes * l1) * (double)points +
+           (double)(points + calls) * bytes * cost_per_byte(points * bytes);
+  }
+
+  bool can_inline(const FuncInfo& info) {
+    if (info.is_output || !info.is_pure() || info.consumers.empty() ||
+        !info.func.has_pure_definition()) {
+      return false;
+    }
+    for (set<string>::iterator iter = info.consumers.begin();
+         iter != info.consumers.end(); ++iter) {
+      if (env[*iter].func.has_extern_definition()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Decide which functions to inline, producers first, so that by
+  /// the time we consider a consumer its cost includes everything
+  /// inlined into it.
+  void choose_inlining() {
+    for (size_t i = order.size(); i > 0; i--) {
+      FuncInfo& info = env[order[i - 1]];
+      if (!can_inline(info)) {
+        continue;
+      }
+      int64_t calls = total_calls(info);
+      double l1 = cost_per_byte(0);
+      double inline_cost =
+          (info.ops + info.loads * info.bytes_per_point() * l1) *
+          (double)calls;
+      double materialize_cost = root_cost(info, calls);
+      debug(2) << "Inlining " << info.func.name() << " costs " << inline_cost
+               << ", computing it at root costs " << materialize_cost << "\n";
+      if (inline_cost > materialize_cost) {
+        continue;
+      }
+
+      info.inlined = true;
+
+      // The consumers now do the work of this function directly.
+      const string& name = info.func.name();
+      for (set<string>::iterator iter = info.consumers.begin();
+           iter != info.consumers.end(); ++iter) {
+        FuncInfo& c = env[*iter];
+        int64_t n = c.calls[name];
+        c.calls.erase(name);
+        c.ops += n * info.ops;
+        c.loads += n * (info.loads - 1);
+        for (map<string, int64_t>::iterator p = info.calls.begin();
+             p != info.calls.end(); ++p) {
+          c.calls[p->first] += n * p->second;
+          env[p->first].consumers.insert(*iter);
+        }
+      }
+      for (map<string, int64_t>::iterator p = info.calls.begin();
+           p != info.calls.end(); ++p) {
+        env[p->first].consumers.erase(name);
+      }
+    }
+  }
+
+  /// The bytes touched while computing one tile of a function,
+  /// including the footprint of everything it loads.
+  int64_t working_set(const FuncInfo& info, const Box& tile) {
+    int64_t bytes = box_size(tile) * info.bytes_per_point();
+    map<string, Box> boxes = required_regions(info, tile);
+    for (map<string, Box>::iterator iter = boxes.begin(); iter != boxes.end();
+         ++iter) {
+      map<string, FuncInfo>::iterator p = env.find(iter->first);
+      int elem = p == env.end() ? 4 : p->second.bytes_per_point();
+      bytes += box_size(iter->second) * elem;
+    }
+    return bytes;
+  }
+
+  /// A box covering one tile at the start of the region.
+  Box tile_box(const FuncInfo& info, int64_t tx, int64_t ty) {
+    Box b = info.region;
+    for (size_t i = 0; i < b.size(); i++) {
+      int64_t extent = i == 0 ? tx : i == 1 ? ty : 1;
+      b[i].max = b[i].min + std::min(extent, b[i].extent()) - 1;
+    }
+    return b;
+  }
+
+  int vector_width(const FuncInfo& info) {
+    int bytes = 1;
+    for (size_t i = 0; i < info.func.output_types().size(); i++) {
+      bytes = std::max(bytes, info.func.output_types()[i].bytes());
+    }
+    return std::max(1, params.vector_bytes / bytes);
+  }
+
+  /// Pick tile sizes for the two innermost dimensions that keep the
+  /// working set within half of L2 and leave enough tiles to keep
+  /// every core busy. Prefers large tiles, since they amortize the
+  /// overlap between the footprints of neighbouring tiles.
+  void choose_tile(FuncInfo& info) {
+    static const int64_t candidates[] = {8, 16, 32, 64, 128, 256};
+    const int num_candidates = sizeof(candidates) / sizeof(candidates[0]);
+    int dims = info.func.dimensions();
+    if (dims == 0) {
+      return;
+    }
+
+    int64_t extent[2] = {info.region[0].extent(),
+                         dims > 1 ? info.region[1].extent() : 1};
+    int64_t other_points = info.points() / std::max<int64_t>(
+                                               1, extent[0] * extent[1]);
+    int64_t best_points = 0;
+    bool best_parallel = false;
+    for (int i = 0; i < num_candidates; i++) {
+      for (int j = 0; j < (dims > 1 ? num_candidates : 1); j++) {
+        int64_t tx = std::min(candidates[i], extent[0]);
+        int64_t ty = dims > 1 ? std::min(candidates[j], extent[1]) : 1;
+        if (tx < std::min<int64_t>(vector_width(info), extent[0])) {
+          continue;
+        }
+        if (working_set(info, tile_box(info, tx, ty)) > params.l2_size / 2) {
+          continue;
+        }
+        int64_t tiles = ((extent[0] + tx - 1) / tx) *
+                        ((extent[1] + ty - 1) / ty) * other_points;
+        bool parallel = tiles >= params.parallelism;
+        int64_t points = tx * ty;
+        if ((parallel && !best_parallel) ||
+            (parallel == best_parallel &&
+             (points > best_points ||
+              (points == best_points && tx > info.tile[0])))) {
+          best_points = points;
+          best_parallel = parallel;
+          info.tile[0] = tx;
+          info.tile[1] = ty;
+        }
+      }
+    }
+  }
+
+  /// Should this function be computed per tile of its consumer
+  /// rather than at root?
+  bool should_fuse(FuncInfo& info) {
+    if (info.is_output || !info.is_pure() || info.consumers.size() != 1) {
+      return false;
+    }
+    const FuncInfo& c = env[*info.consumers.begin()];
+    const StageChoice& cc = choices[c.func.name()];
+    if (cc.compute_level != StageChoice::Root || cc.tile[0] == 0 ||
+        !c.is_pure()) {
+      return false;
+    }
+
+    Box tile = tile_box(c, c.tile[0], c.tile[1]);
+    map<string, Box> boxes = required_regions(c, tile);
+    map<string, Box>::iterator b = boxes.find(info.func.name());
+    if (b == boxes.end()) {
+      return false;
+    }
+    int64_t tiles = c.points() / std::max<int64_t>(1, box_size(tile));
+    int64_t computed = box_size(b->second) * tiles;
+    int64_t bytes = info.bytes_per_point();
+    int64_t calls = total_calls(info);
+    double l1 = cost_per_byte(0);
+    double fused_cost =
+        (info.ops + info.loads * bytes * l1) * (double)computed +
+        (double)(computed + calls) * bytes *
+            cost_per_byte(box_size(b->second) * bytes);
+    double unfused_cost = root_cost(info, calls);
+    debug(2) << "Computing " << info.func.name() << " per tile of "
+             << c.func.name() << " costs " << fused_cost
+             << ", computing it at root costs " << unfused_cost << "\n";
+    return fused_cost < unfused_cost;
+  }
+
+  /// Decide what's computed at root and what's computed per tile of
+  /// its consumer, consumers first, so that producers can see the
+  /// tiling chosen for what consumes them.
+  void choose_tiling_and_fusion() {
+    for (size_t i = 0; i < order.size(); i++) {
+      FuncInfo& info = env[order[i]];
+      StageChoice& choice = choices[order[i]];
+      choice.func = info.func;
+      if (info.inlined) {
+        choice.compute_level = StageChoice::Inline;
+      } else if (should_fuse(info)) {
+        choice.compute_level = StageChoice::ConsumerTile;
+        choice.consumer = *info.consumers.begin();
+        const FuncInfo& c = env[choice.consumer];
+        if (c.tile[0] >= vector_width(info)) {
+          choice.vector_width = vector_width(info);
+        }
+      } else {
+        choose_root(info, choice);
+      }
+    }
+  }
+
+  void choose_root(FuncInfo& info, StageChoice& choice) {
+    choice.compute_level = StageChoice::Root;
+    if (info.func.has_extern_definition()) {
+      // Extern stages have no loops of their own to schedule.
+      return;
+    }
+    int dims = info.func.dimensions();
+    if (dims == 0) {
+      return;
+    }
+
+    choose_tile(info);
+    int64_t inner_extent = info.region[0].extent();
+    int64_t outer_extent = info.region.back().extent();
+    if (info.tile[0] < info.region[0].extent() ||
+        (dims > 1 && info.tile[1] < info.region[1].extent())) {
+      choice.tile[0] = (int)info.tile[0];
+      inner_extent = info.tile[0];
+      if (dims > 1) {
+        choice.tile[1] = (int)info.tile[1];
+      }
+      if (dims <= 2) {
+        outer_extent = (info.region[dims - 1].extent() +
+                        info.tile[dims - 1] - 1) /
+                       info.tile[dims - 1];
+      }
+    }
+    if (inner_extent >= vector_width(info)) {
+      choice.vector_width = vector_width(info);
+    }
+    choice.parallel = outer_extent > 1;
+  }
+};
+
+void split(Schedule& s, const string& old, const string& outer,
+           const string& inner, int factor) {
+  bool found = false;
+  for (size_t i = 0; !found && i < s.dims.size(); i++) {
+    if (s.dims[i].var == old) {
+      found = true;
+      s.dims[i].var = inner;
+      Schedule::Dim d = {outer, s.dims[i].for_type};
+      s.dims.insert(s.dims.begin() + i + 1, d);
+    }
+  }
+  assert(found && "Could not find dimension to split");
+  Schedule::Split sp = {old, outer, inner, factor, Schedule::Split::SplitVar};
+  s.splits.push_back(sp);
+}
+
+/// Reset a schedule to the default: serial loops over the pure
+/// arguments, stored in the same order.
+void reset_schedule(Schedule& s, const vector<string>& args) {
+  s.splits.clear();
+  s.dims.clear();
+  for (size_t i = 0; i < args.size(); i++) {
+    Schedule::Dim d = {args[i], For::Serial};
+    s.dims.push_back(d);
+  }
+  s.storage_dims = args;
+}
+
+/// Reset the schedule of a function's update step to the default:
+/// serial loops over the reduction variables, inside serial loops
+/// over the pure arguments.
+void reset_update_schedule(Function f) {
+  Schedule& s = f.reduction_schedule();
+  s.splits.clear();
+  s.dims.clear();
+  const vector<ReductionVariable>& rvars = f.reduction_domain().domain();
+  for (size_t i = 0; i < rvars.size(); i++) {
+    Schedule::Dim d = {rvars[i].var, For::Serial};
+    s.dims.push_back(d);
+  }
+  for (size_t i = 0; i < f.args().size(); i++) {
+    Schedule::Dim d = {f.args()[i], For::Serial};
+    s.dims.push_back(d);
+  }
+}
+
+/// Vectorize the innermost dimension of a schedule.
+void vectorize_innermost(Schedule& s, int width, ostringstream& src) {
+  if (s.dims.empty() || width <= 1) {
+    return;
+  }
+  string var = s.dims[0].var;
+  split(s, var, var, var + "_v", width);
+  s.dims[0].for_type = For::Vectorized;
+  src << ".vectorize(" << var << ", " << width << ")";
+}
+
+/// Parallelize the outermost pure dimension of the update step,
+/// when the update is known not to race across it.
+void parallelize_update(Function f, ostringstream& src) {
+  Schedule& s = f.reduction_schedule();
+  if (s.dims.empty()) {
+    return;
+  }
+
+  // A pure variable used as the same argument on the left-hand-side
+  // means distinct iterations touch distinct points.
+  const string& outer = s.dims.back().var;
+  const vector<Expr>& args = f.reduction_args();
+  for (size_t i = 0; i < args.size() && i < f.args().size(); i++) {
+    const Variable* v = args[i].as<Variable>();
+    if (v && v->name == outer && f.args()[i] == outer) {
+      s.dims.back().for_type = For::Parallel;
+      src << f.name() << ".update().parallel(" << outer << ");\n";
+      return;
+    }
+  }
+}
+
+void apply_root(const StageChoice& choice, ostringstream& src) {
+  Function f = choice.func;
+  Schedule& s = f.schedule();
+  const vector<string>& args = f.args();
+  src << f.name();
+  if (!args.empty() && choice.tile[0] > 0 && args.size() > 1 &&
+      choice.tile[1] > 0) {
+    const string &x = args[0], &y = args[1];
+    split(s, x, x + "_o", x + "_i", choice.tile[0]);
+    split(s, y, y + "_o", y + "_i", choice.tile[1]);
+    // Move y_i inside x_o.
+    std::swap(s.dims[1], s.dims[2]);
+    src << ".tile(" << x << ", " << y << ", " << x << "_o, " << y << "_o, "
+        << x << "_i, " << y << "_i, " << choice.tile[0] << ", "
+        << choice.tile[1] << ")";
+  } else {
+    for (size_t i = 0; i < 2 && i < args.size(); i++) {
+      if (choice.tile[i] > 0) {
+        const string& x = args[i];
+        split(s, x, x + "_o", x + "_i", choice.tile[i]);
+        src << ".split(" << x << ", " << x << "_o, " << x << "_i, "
+            << choice.tile[i] << ")";
+      }
+    }
+  }
+  vectorize_innermost(s, choice.vector_width, src);
+  if (choice.parallel && !s.dims.empty()) {
+    s.dims.back().for_type = For::Parallel;
+    src << ".parallel(" << s.dims.back().var << ")";
+  }
+  s.compute_level = s.store_level = Schedule::LoopLevel::root();
+  src << ".compute_root();\n";
+
+  if (choice.parallel && f.has_reduction_definition()) {
+    parallelize_update(f, src);
+  }
+}
+
+}  // namespace
+
+string apply_schedule(const ScheduleChoices& choices) {
+  ostringstream src;
+  for (ScheduleChoices::const_iterator iter = choices.begin();
+       iter != choices.end(); ++iter) {
+    const StageChoice& choice = iter->second;
+    Function f = choice.func;
+    Schedule& s = f.schedule();
+    reset_schedule(s, f.args());
+    // Undo what an earlier set of choices did to the update step too,
+    // so that each call gives the schedule of these choices alone.
+    if (f.has_reduction_definition()) {
+      reset_update_schedule(f);
+    }
+
+    if (choice.compute_level == StageChoice::Inline) {
+      s.compute_level = s.store_level = Schedule::LoopLevel();
+      src << f.name() << ".compute_inline();\n";
+      continue;
+    }
+
+    if (choice.compute_level == StageChoice::ConsumerTile) {
+      // Compute within the innermost loop over tiles of the
+      // consumer, if it has one.
+      ScheduleChoices::const_iterator c = choices.find(choice.consumer);
+      if (c != choices.end() &&
+          c->second.compute_level == StageChoice::Root &&
+          c->second.tile[0] > 0 && !c->second.func.args().empty()) {
+        string at = c->second.func.args()[0] + "_o";
+        s.compute_level = s.store_level =
+            Schedule::LoopLevel(choice.consumer, at);
+        src << f.name() << ".compute_at(" << choice.consumer << ", " << at
+            << ")";
+        vectorize_innermost(s, choice.vector_width, src);
+        src << ";\n";
+        continue;
+      }
+    }
+
+    apply_root(choice, src);
+  }
+  return src.str();
+}
+
+ScheduleChoices choose_schedule(const vector<Function>& outputs,
+                                const map<string, Box>& estimates,
+                                const MachineParams& params) {
+  AutoScheduler scheduler(params);
+  return scheduler.run(outputs, estimates);
+}
+
+string auto_schedule(const vector<Function>& outputs,
+                     const map<string, Box>& estimates,
+                     const MachineParams& params) {
+  string result = apply_schedule(choose_schedule(outputs, estimates, params));
+  debug(1) << "Auto-schedule:\n" << result;
+  return result;
+}
+
+string auto_schedule(const vector<Function>& outputs,
+                     const MachineParams& params) {
+  return auto_schedule(outputs, map<string, Box>(), params);
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
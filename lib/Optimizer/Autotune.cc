@@ -0,0 +1,392 @@
+#include "jmlang/Optimizer/Autotune.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+
+#include "jmlang/Base/Debug.h"
+#include "jmlang/IR/FindCalls.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::map;
+using std::ostringstream;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+const char* level_name(StageChoice::ComputeLevel level) {
+  switch (level) {
+    case StageChoice::Inline:
+      return "inline";
+    case StageChoice::Root:
+      return "root";
+    case StageChoice::ConsumerTile:
+      return "consumer_tile";
+  }
+  return "";
+}
+
+/// Write a schedule out in the format read by load_schedule. Also
+/// used as a key to avoid timing the same candidate twice.
+string serialize(const ScheduleChoices& choices) {
+  ostringstream s;
+  for (ScheduleChoices::const_iterator iter = choices.begin();
+       iter != choices.end(); ++iter) {
+    const StageChoice& c = iter->second;
+    s << iter->first << " " << level_name(c.compute_level) << " "
+      << (c.consumer.empty() ? "-" : c.consumer) << " " << c.tile[0] << " "
+      << c.tile[1] << " " << c.vector_width << " " << (c.parallel ? 1 : 0)
+      << "\n";
+  }
+  return s.str();
+}
+
+map<string, Function> find_functions(const vector<Function>& outputs) {
+  map<string, Function> env;
+  for (size_t i = 0; i < outputs.size(); i++) {
+    map<string, Function> calls = find_transitive_calls(outputs[i]);
+    env.insert(calls.begin(), calls.end());
+  }
+  return env;
+}
+
+struct Candidate {
+  ScheduleChoices choices;
+  double time;
+
+  bool operator<(const Candidate& other) const { return time < other.time; }
+};
+
+class Autotuner {
+  const MachineParams& params;
+  const std::function<void()>& run;
+  const AutotuneOptions& options;
+  std::mt19937 rng;
+
+  map<string, Function> env;
+  map<string, set<string> > consumers;
+  set<string> outputs;
+  vector<string> names;
+
+  /// Times of every candidate tried so far, keyed by serialized
+  /// schedule.
+  map<string, double> tried;
+
+ public:
+  Autotuner(const vector<Function>& outs, const MachineParams& p,
+            const std::function<void()>& r, const AutotuneOptions& o)
+      : params(p), run(r), options(o), rng(o.seed) {
+    env = find_functions(outs);
+    for (size_t i = 0; i < outs.size(); i++) {
+      outputs.insert(outs[i].name());
+    }
+    for (map<string, Function>::iterator iter = env.begin();
+         iter != env.end(); ++iter) {
+      names.push_back(iter->first);
+      map<string, Function> calls = find_direct_calls(iter->second);
+      for (map<string, Function>::iterator c = calls.begin();
+           c != calls.end(); ++c) {
+        consumers[c->first].insert(iter->first);
+      }
+    }
+  }
+
+  ScheduleChoices search(const ScheduleChoices& start) {
+    vector<Candidate> beam;
+    Candidate seed = {start, evaluate(start)};
+    beam.push_back(seed);
+
+    for (int g = 0; g < options.generations; g++) {
+      vector<Candidate> next = beam;
+      for (int k = 0; k < options.children; k++) {
+        ScheduleChoices child = beam[random(beam.size())].choices;
+        if (beam.size() > 1 && random(4) == 0) {
+          child = crossover(child, beam[random(beam.size())].choices);
+        }
+        for (int n = 1 + random(2); n > 0; n--) {
+          mutate(child);
+        }
+        repair(child);
+        if (tried.count(serialize(child))) {
+          continue;
+        }
+        Candidate c = {child, evaluate(child)};
+        next.push_back(c);
+      }
+      std::stable_sort(next.begin(), next.end());
+      if ((int)next.size() > options.population) {
+        next.resize(options.population);
+      }
+      beam = next;
+      debug(1) << "Autotune generation " << g << ": best time "
+               << beam[0].time << "s\n";
+    }
+
+    apply_schedule(beam[0].choices);
+    return beam[0].choices;
+  }
+
+ private:
+  int random(size_t n) {
+    return std::uniform_int_distribution<int>(0, (int)n - 1)(rng);
+  }
+
+  double evaluate(const ScheduleChoices& choices) {
+    string key = serialize(choices);
+    map<string, double>::iterator iter = tried.find(key);
+    if (iter != tried.end()) {
+      return iter->second;
+    }
+    apply_schedule(choices);
+    double t = benchmark(run, options.samples);
+    debug(2) << "Candidate took " << t << "s:\n" << key;
+    tried[key] = t;
+    return t;
+  }
+
+  bool is_pure(const Function& f) const {
+    return f.has_pure_definition() && !f.has_reduction_definition() &&
+           !f.has_extern_definition();
+  }
+
+  bool can_inline(const string& name) {
+    const Function& f = env[name];
+    if (outputs.count(name) || !is_pure(f) || consumers[name].empty()) {
+      return false;
+    }
+    const set<string>& cs = consumers[name];
+    for (set<string>::const_iterator iter = cs.begin(); iter != cs.end();
+         ++iter) {
+      if (env[*iter].has_extern_definition()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool can_fuse(const string& name) {
+    return !outputs.count(name) && is_pure(env[name]) &&
+           !consumers[name].empty();
+  }
+
+  int natural_vector_width(const Function& f) const {
+    int bytes = 1;
+    for (size_t i = 0; i < f.output_types().size(); i++) {
+      bytes = std::max(bytes, f.output_types()[i].bytes());
+    }
+    return std::max(1, params.vector_bytes / bytes);
+  }
+
+  void mutate(ScheduleChoices& choices) {
+    static const int tiles[] = {0, 8, 16, 32, 64, 128, 256};
+    const string& name = names[random(names.size())];
+    StageChoice& c = choices[name];
+    c.func = env[name];
+
+    switch (random(5)) {
+      case 0: {
+        vector<StageChoice::ComputeLevel> levels;
+        levels.push_back(StageChoice::Root);
+        if (can_inline(name)) {
+          levels.push_back(StageChoice::Inline);
+        }
+        if (can_fuse(name)) {
+          levels.push_back(StageChoice::ConsumerTile);
+        }
+        c.compute_level = levels[random(levels.size())];
+        if (c.compute_level == StageChoice::ConsumerTile) {
+          vector<string> cs(consumers[name].begin(), consumers[name].end());
+          c.consumer = cs[random(cs.size())];
+        } else {
+          c.consumer.clear();
+        }
+        break;
+      }
+      case 1:
+      case 2:
+        c.tile[random(2)] = tiles[random(sizeof(tiles) / sizeof(tiles[0]))];
+        break;
+      case 3: {
+        int w = natural_vector_width(c.func);
+        int widths[] = {1, std::max(1, w / 2), w, w * 2};
+        c.vector_width = widths[random(4)];
+        break;
+      }
+      default:
+        c.parallel = !c.parallel;
+    }
+  }
+
+  ScheduleChoices crossover(const ScheduleChoices& a,
+                            const ScheduleChoices& b) {
+    ScheduleChoices child = a;
+    for (ScheduleChoices::const_iterator iter = b.begin(); iter != b.end();
+         ++iter) {
+      if (random(2)) {
+        child[iter->first] = iter->second;
+      }
+    }
+    return child;
+  }
+
+  /// Fix up choices that mutation or crossover have made
+  /// inconsistent, so that we don't waste time benchmarking
+  /// schedules that apply_schedule would quietly change.
+  void repair(ScheduleChoices& choices) {
+    for (ScheduleChoices::iterator iter = choices.begin();
+         iter != choices.end(); ++iter) {
+      StageChoice& c = iter->second;
+      if (c.compute_level == StageChoice::Inline) {
+        c.tile[0] = c.tile[1] = 0;
+        c.vector_width = 1;
+        c.parallel = false;
+      } else if (c.compute_level == StageChoice::ConsumerTile) {
+        ScheduleChoices::iterator consumer = choices.find(c.consumer);
+        if (consumer == choices.end() ||
+            consumer->second.compute_level != StageChoice::Root ||
+            consumer->second.tile[0] == 0) {
+          c.compute_level = StageChoice::Root;
+          c.consumer.clear();
+        } else {
+          c.tile[0] = c.tile[1] = 0;
+          c.parallel = false;
+        }
+      }
+    }
+  }
+};
+
+}  // namespace
+
+double benchmark(const std::function<void()>& f, int samples) {
+  double best = 0;
+  for (int i = 0; i < samples; i++) {
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+    f();
+    std::chrono::duration<double> elapsed =
+        std::chrono::high_resolution_clock::now() - start;
+    if (i == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  return best;
+}
+
+ScheduleChoices autotune(const vector<Function>& outputs,
+                         const map<string, Box>& estimates,
+                         const MachineParams& params,
+                         const std::function<void()>& run,
+                         const AutotuneOptions& options) {
+  Autotuner tuner(outputs, params, run, options);
+  return tuner.search(choose_schedule(outputs, estimates, params));
+}
+
+void save_schedule(const ScheduleChoices& choices, const string& filename) {
+  std::ofstream f(filename.c_str());
+  assert(f.is_open() && "Could not open schedule file for writing");
+  f << "# name compute_level consumer tile_x tile_y vector_width parallel\n"
+    << serialize(choices);
+}
+
+ScheduleChoices load_schedule(const vector<Function>& outputs,
+                              const string& filename) {
+  map<string, Function> env = find_functions(outputs);
+  ScheduleChoices choices;
+
+  std::ifstream f(filename.c_str());
+  assert(f.is_open() && "Could not open schedule file for reading");
+  string line;
+  while (std::getline(f, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream s(line);
+    string name, level, consumer;
+    int parallel = 0;
+    StageChoice c;
+    s >> name >> level >> consumer >> c.tile[0] >> c.tile[1] >>
+        c.vector_width >> parallel;
+    assert(!s.fail() && "Malformed line in schedule file");
+
+    map<string, Function>::iterator iter = env.find(name);
+    if (iter == env.end()) {
+      std::cerr << "Schedule file refers to unknown function " << name
+                << "\n";
+      assert(false);
+    }
+    c.func = iter->second;
+    if (level == "inline") {
+      c.compute_level = StageChoice::Inline;
+    } else if (level == "root") {
+      c.compute_level = StageChoice::Root;
+    } else if (level == "consumer_tile") {
+      c.compute_level = StageChoice::ConsumerTile;
+    } else {
+      assert(false && "Unknown compute level in schedule file");
+    }
+    if (consumer != "-") {
+      c.consumer = consumer;
+    }
+    c.parallel = parallel != 0;
+    choices[name] = c;
+  }
+  return choices;
+}
+
+int autotune_main(int argc, char** argv, const vector<Function>& outputs,
+                  const map<string, Box>& estimates,
+                  const std::function<void()>& run) {
+  assert(!outputs.empty() && "Nothing to autotune");
+  AutotuneOptions options;
+  string filename = outputs[0].name() + ".schedule";
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!value) {
+      std::cerr << "Missing value for " << arg << "\n";
+      return 1;
+    }
+    if (!strcmp(arg, "-o")) {
+      filename = value;
+    } else if (!strcmp(arg, "-g")) {
+      options.generations = atoi(value);
+    } else if (!strcmp(arg, "-p")) {
+      options.population = atoi(value);
+    } else if (!strcmp(arg, "-c")) {
+      options.children = atoi(value);
+    } else if (!strcmp(arg, "-s")) {
+      options.samples = atoi(value);
+    } else if (!strcmp(arg, "-seed")) {
+      options.seed = (unsigned)atoi(value);
+    } else {
+      std::cerr << "Unknown argument " << arg << "\n"
+                << "Usage: " << argv[0]
+                << " [-o file] [-g generations] [-p population]"
+                   " [-c children] [-s samples] [-seed n]\n";
+      return 1;
+    }
+    i++;
+  }
+
+  ScheduleChoices best = autotune(
+      outputs, estimates,
+      MachineParams::for_target(get_jit_target_from_environment()), run,
+      options);
+  save_schedule(best, filename);
+  std::cout << apply_schedule(best);
+  return 0;
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
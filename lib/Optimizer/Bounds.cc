@@ -0,0 +1,334 @@
+#include "jmlang/Optimizer/Bounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "jmlang/IR/ExprCall.h"
+#include "jmlang/IR/ExprVariable.h"
+#include "jmlang/IR/IROperator.h"
+#include "jmlang/IR/IRVisitor.h"
+#include "jmlang/Optimizer/Simplify.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::map;
+using std::string;
+
+namespace {
+
+int64_t saturate(int64_t x) {
+  return std::min(std::max(x, -Interval::unbounded()), Interval::unbounded());
+}
+
+int64_t sat_add(int64_t a, int64_t b) { return saturate(a + b); }
+
+int64_t sat_mul(int64_t a, int64_t b) {
+  // Both operands are within 2^48, so the product fits in a
+  // long double without losing the sign or magnitude we clamp to.
+  long double p = (long double)a * (long double)b;
+  long double lim = (long double)Interval::unbounded();
+  if (p > lim)
+    return Interval::unbounded();
+  if (p < -lim)
+    return -Interval::unbounded();
+  return (int64_t)p;
+}
+
+/// Floor division, matching the semantics of jmlang's Div.
+int64_t floor_div(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  if ((a % b != 0) && ((a < 0) != (b < 0)))
+    q--;
+  return q;
+}
+
+Interval type_bounds(Type t) {
+  if (t.is_bool()) {
+    return Interval(0, 1);
+  } else if (t.is_uint() && t.bits < 48) {
+    return Interval(0, ((int64_t)1 << t.bits) - 1);
+  } else if (t.is_int() && t.bits <= 48) {
+    return Interval(-((int64_t)1 << (t.bits - 1)),
+                    ((int64_t)1 << (t.bits - 1)) - 1);
+  }
+  return Interval::everything();
+}
+
+class ConstBounds : public IRVisitor {
+  const Scope<Interval>& outer;
+  Scope<Interval> inner;
+
+ public:
+  Interval interval;
+
+  ConstBounds(const Scope<Interval>& s) : outer(s) {}
+
+  Interval bounds(Expr e) {
+    e.accept(this);
+    return interval;
+  }
+
+ private:
+  using IRVisitor::visit;
+
+  void visit(const IntImm* op) { interval = Interval::single_point(op->value); }
+
+  void visit(const FloatImm* op) {
+    interval = Interval((int64_t)std::floor(op->value),
+                        (int64_t)std::ceil(op->value));
+  }
+
+  void visit(const Cast* op) {
+    Interval v = bounds(op->value);
+    Interval t = type_bounds(op->type);
+    if (op->type.is_float() || (v.min >= t.min && v.max <= t.max)) {
+      interval = v;
+    } else {
+      // The cast may wrap, so all we know is the range of the type.
+      interval = t;
+    }
+  }
+
+  void visit(const Variable* op) {
+    if (inner.contains(op->name)) {
+      interval = inner.get(op->name);
+    } else if (outer.contains(op->name)) {
+      interval = outer.get(op->name);
+    } else {
+      interval = type_bounds(op->type);
+      Parameter p = op->param;
+      if (p.defined() && !p.is_buffer()) {
+        if (const int* mn = as_const_int(p.get_min_value())) {
+          interval.min = *mn;
+        }
+        if (const int* mx = as_const_int(p.get_max_value())) {
+          interval.max = *mx;
+        }
+      }
+    }
+  }
+
+  void visit(const Add* op) {
+    Interval a = bounds(op->a), b = bounds(op->b);
+    interval = Interval(sat_add(a.min, b.min), sat_add(a.max, b.max));
+  }
+
+  void visit(const Sub* op) {
+    Interval a = bounds(op->a), b = bounds(op->b);
+    interval = Interval(sat_add(a.min, -b.max), sat_add(a.max, -b.min));
+  }
+
+  void visit(const Mul* op) {
+    Interval a = bounds(op->a), b = bounds(op->b);
+    int64_t c[] = {sat_mul(a.min, b.min), sat_mul(a.min, b.max),
+                   sat_mul(a.max, b.min), sat_mul(a.max, b.max)};
+    interval = Interval(*std::min_element(c, c + 4),
+                        *std::max_element(c, c + 4));
+  }
+
+  void visit(const Div* op) {
+    Interval a = bounds(op->a), b = bounds(op->b);
+    if (b.min > 0 || b.max < 0) {
+      int64_t c[] = {floor_div(a.min, b.min), floor_div(a.min, b.max),
+                     floor_div(a.max, b.min), floor_div(a.max, b.max)};
+      interval = Interval(*std::min_element(c, c + 4),
+                          *std::max_element(c, c + 4));
+    } else {
+      interval = type_bounds(op->type);
+    }
+  }
+
+  void visit(const Mod* op) {
+    Interval a = bounds(op->a), b = bounds(op->b);
+    if (b.min > 0) {
+      if (a.min >= 0 && a.max < b.min) {
+        interval = a;
+      } else {
+        interval = Interval(0, b.max - 1);
+      }
+    } else {
+      interval = type_bounds(op->type);
+    }
+  }
+
+  void visit(const Min* op) {
+    Interval a = bounds(op->a), b = bounds(op->b);
+    interval = Interval(std::min(a.min, b.min), std::min(a.max, b.max));
+  }
+
+  void visit(const Max* op) {
+    Interval a = bounds(op->a), b = bounds(op->b);
+    interval = Interval(std::max(a.min, b.min), std::max(a.max, b.max));
+  }
+
+  void visit_bool() { interval = Interval(0, 1); }
+  void visit(const EQ*) { visit_bool(); }
+  void visit(const NE*) { visit_bool(); }
+  void visit(const LT*) { visit_bool(); }
+  void visit(const LE*) { visit_bool(); }
+  void visit(const GT*) { visit_bool(); }
+  void visit(const GE*) { visit_bool(); }
+  void visit(const And*) { visit_bool(); }
+  void visit(const Or*) { visit_bool(); }
+  void visit(const Not*) { visit_bool(); }
+
+  void visit(const Select* op) {
+    Interval t = bounds(op->true_value);
+    interval = t;
+    interval.include(bounds(op->false_value));
+  }
+
+  void visit(const Load* op) { interval = type_bounds(op->type); }
+
+  void visit(const Ramp* op) {
+    Interval base = bounds(op->base), stride = bounds(op->stride);
+    Interval last(sat_add(base.min, sat_mul(stride.min, op->width - 1)),
+                  sat_add(base.max, sat_mul(stride.max, op->width - 1)));
+    interval = base;
+    interval.include(last);
+  }
+
+  void visit(const Broadcast* op) { interval = bounds(op->value); }
+
+  void visit(const Call* op) {
+    if (op->call_type == Call::Intrinsic && op->name == Call::bitwise_and) {
+      // Masking with a non-negative constant bounds the result.
+      Interval b = bounds(op->args[1]);
+      if (b.min >= 0 && b.is_single_point()) {
+        interval = Interval(0, b.max);
+        return;
+      }
+    } else if (op->call_type == Call::Intrinsic &&
+               op->name == Call::shift_right) {
+      Interval a = bounds(op->args[0]), b = bounds(op->args[1]);
+      if (b.is_single_point() && b.min >= 0 && b.min < 48) {
+        interval = Interval(a.min >> b.min, a.max >> b.min);
+        return;
+      }
+    }
+    interval = type_bounds(op->type);
+  }
+
+  void visit(const Let* op) {
+    Interval v = bounds(op->value);
+    inner.push(op->name, v);
+    interval = bounds(op->body);
+    inner.pop(op->name);
+  }
+};
+
+class BoxesRequired : public IRVisitor {
+  const Scope<Interval>& outer;
+  Scope<Interval> lets;
+
+ public:
+  map<string, Box> boxes;
+
+  BoxesRequired(const Scope<Interval>& s) : outer(s) {}
+
+ private:
+  using IRVisitor::visit;
+
+  Interval bounds(Expr e) {
+    if (lets.cbegin() != lets.cend()) {
+      // Fold let-bound intervals into a scope we can hand off.
+      Scope<Interval> s;
+      for (Scope<Interval>::const_iterator iter = outer.cbegin();
+           iter != outer.cend(); ++iter) {
+        s.push(iter.name(), iter.value());
+      }
+      for (Scope<Interval>::const_iterator iter = lets.cbegin();
+           iter != lets.cend(); ++iter) {
+        s.push(iter.name(), iter.value());
+      }
+      return bounds_of_expr_in_scope(e, s);
+    }
+    return bounds_of_expr_in_scope(e, outer);
+  }
+
+  void visit(const Let* op) {
+    op->value.accept(this);
+    lets.push(op->name, bounds(op->value));
+    op->body.accept(this);
+    lets.pop(op->name);
+  }
+
+  void visit(const Call* op) {
+    IRVisitor::visit(op);
+    if (op->call_type != Call::Jmlang && op->call_type != Call::Image) {
+      return;
+    }
+    Box b(op->args.size());
+    for (size_t i = 0; i < op->args.size(); i++) {
+      b[i] = bounds(op->args[i]);
+    }
+    merge_boxes(boxes[op->name], b);
+  }
+};
+
+}  // namespace
+
+int64_t box_size(const Box& b) {
+  int64_t size = 1;
+  for (size_t i = 0; i < b.size(); i++) {
+    size = sat_mul(size, b[i].extent());
+  }
+  return size;
+}
+
+void merge_boxes(Box& a, const Box& b) {
+  if (a.empty()) {
+    a = b;
+    return;
+  }
+  assert(a.size() == b.size() && "Merging boxes of differing dimensionality");
+  for (size_t i = 0; i < a.size(); i++) {
+    a[i].include(b[i]);
+  }
+}
+
+Interval bounds_of_expr_in_scope(Expr expr, const Scope<Interval>& scope) {
+  ConstBounds b(scope);
+  return b.bounds(expr);
+}
+
+map<string, Box> boxes_required(Expr expr, const Scope<Interval>& scope) {
+  BoxesRequired b(scope);
+  expr.accept(&b);
+  return b.boxes;
+}
+
+bool estimate_value(Expr e, const Scope<Interval>& scope, int64_t* value) {
+  if (!e.defined()) {
+    return false;
+  }
+  Interval i = bounds_of_expr_in_scope(e, scope);
+  *value = i.min;
+  return i.is_single_point() && i.is_bounded();
+}
+
+void push_estimates(const Parameter& p, Scope<Interval>& scope) {
+  int64_t v;
+  if (!p.is_buffer()) {
+    if (estimate_value(p.get_estimate(), scope, &v)) {
+      scope.push(p.name(), Interval::single_point(v));
+    }
+    return;
+  }
+  for (int i = 0; i < 4; i++) {
+    std::ostringstream min_name, extent_name;
+    min_name << p.name() << ".min." << i;
+    extent_name << p.name() << ".extent." << i;
+    if (estimate_value(p.min_estimate(i), scope, &v)) {
+      scope.push(min_name.str(), Interval::single_point(v));
+    }
+    if (estimate_value(p.extent_estimate(i), scope, &v)) {
+      scope.push(extent_name.str(), Interval::single_point(v));
+    }
+  }
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
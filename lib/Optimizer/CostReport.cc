@@ -0,0 +1,370 @@
+#include "jmlang/Optimizer/CostReport.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "jmlang/IR/ExprCall.h"
+#include "jmlang/IR/ExprVariable.h"
+#include "jmlang/IR/IRVisitor.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::map;
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+namespace {
+
+/// Find the parameters referred to by a statement.
+class FindParameters : public IRGraphVisitor {
+ public:
+  map<string, Parameter> parameters;
+
+ private:
+  using IRGraphVisitor::visit;
+
+  void visit(const Variable* op) {
+    if (op->param.defined()) {
+      parameters[op->param.name()] = op->param;
+    }
+  }
+
+  void visit(const Load* op) {
+    IRGraphVisitor::visit(op);
+    if (op->param.defined()) {
+      parameters[op->param.name()] = op->param;
+    }
+  }
+
+  void visit(const Call* op) {
+    IRGraphVisitor::visit(op);
+    if (op->param.defined()) {
+      parameters[op->param.name()] = op->param;
+    }
+  }
+};
+
+/// The function a buffer belongs to. Buffers for functions with
+/// multiple outputs are named "f.0", "f.1", etc.
+string function_name(const string& buffer) {
+  return buffer.substr(0, buffer.find('.'));
+}
+
+class ComputeCosts : public IRVisitor {
+ public:
+  map<string, FunctionCost> costs;
+
+  ComputeCosts(const Scope<Interval>& estimates)
+      : scope(estimates), trips(1), unknown_trips(false) {}
+
+  void finish() {
+    // Overlap between the regions stored by different allocations of
+    // a flattened buffer can't be seen, so count them as distinct.
+    for (map<string, Interval>::iterator iter = index_range.begin();
+         iter != index_range.end(); ++iter) {
+      FunctionCost& c = costs[function_name(iter->first)];
+      c.unique_points +=
+          iter->second.extent() * std::max(c.allocations, 1.0);
+    }
+    for (map<string, Box>::iterator iter = provide_region.begin();
+         iter != provide_region.end(); ++iter) {
+      costs[iter->first].unique_points += box_size(iter->second);
+    }
+  }
+
+ private:
+  using IRVisitor::visit;
+
+  Scope<Interval> scope;
+
+  /// The number of times the node being visited is executed.
+  double trips;
+
+  /// Whether any enclosing loop has an unknown trip count.
+  bool unknown_trips;
+
+  /// The function whose production we're inside.
+  string current;
+
+  /// The range of indices stored to each flattened buffer, and the
+  /// region provided to each function.
+  map<string, Interval> index_range;
+  map<string, Box> provide_region;
+
+  FunctionCost& cost() { return costs[current]; }
+
+  Interval bounds(Expr e) { return bounds_of_expr_in_scope(e, scope); }
+
+  void count(Type t) {
+    cost().ops += trips * t.width;
+    cost().unknown_trip_count |= unknown_trips;
+  }
+
+  void visit_binary(const Expr& a, const Expr& b, Type t) {
+    count(t);
+    a.accept(this);
+    b.accept(this);
+  }
+
+  void visit(const Cast* op) {
+    count(op->type);
+    op->value.accept(this);
+  }
+  void visit(const Add* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const Sub* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const Mul* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const Div* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const Mod* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const Min* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const Max* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const EQ* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const NE* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const LT* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const LE* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const GT* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const GE* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const And* op) { visit_binary(op->a, op->b, op->type); }
+  void visit(const Or* op) { visit_binary(op->a, op->b, op->type); }
+
+  void visit(const Not* op) {
+    count(op->type);
+    op->a.accept(this);
+  }
+
+  void visit(const Select* op) {
+    count(op->type);
+    IRVisitor::visit(op);
+  }
+
+  void visit(const Load* op) {
+    IRVisitor::visit(op);
+    cost().bytes_loaded += trips * op->type.bytes() * op->type.width;
+  }
+
+  void visit(const Call* op) {
+    IRVisitor::visit(op);
+    if (op->call_type == Call::Jmlang || op->call_type == Call::Image) {
+      // An unflattened load.
+      cost().bytes_loaded += trips * op->type.bytes() * op->type.width;
+    } else {
+      count(op->type);
+    }
+  }
+
+  void visit(const Let* op) {
+    op->value.accept(this);
+    scope.push(op->name, bounds(op->value));
+    op->body.accept(this);
+    scope.pop(op->name);
+  }
+
+  void visit(const LetStmt* op) {
+    op->value.accept(this);
+    scope.push(op->name, bounds(op->value));
+    op->body.accept(this);
+    scope.pop(op->name);
+  }
+
+  void visit(const Pipeline* op) {
+    string old = current;
+    current = op->name;
+    op->produce.accept(this);
+    if (op->update.defined()) {
+      op->update.accept(this);
+    }
+    current = old;
+    op->consume.accept(this);
+  }
+
+  void visit(const For* op) {
+    op->min.accept(this);
+    op->extent.accept(this);
+
+    Interval min = bounds(op->min), extent = bounds(op->extent);
+    double old_trips = trips;
+    bool old_unknown = unknown_trips;
+    if (extent.is_bounded() && min.is_bounded()) {
+      trips *= std::max<int64_t>(extent.max, 0);
+      scope.push(op->name,
+                 Interval(min.min, min.max + std::max<int64_t>(extent.max, 1) -
+                                       1));
+    } else {
+      unknown_trips = true;
+      scope.push(op->name, Interval::everything());
+    }
+    op->body.accept(this);
+    scope.pop(op->name);
+    trips = old_trips;
+    unknown_trips = old_unknown;
+  }
+
+  void visit(const Store* op) {
+    IRVisitor::visit(op);
+    Type t = op->value.type();
+    FunctionCost& c = costs[function_name(op->name)];
+    c.bytes_stored += trips * t.bytes() * t.width;
+    c.points_stored += trips * t.width;
+    c.unknown_trip_count |= unknown_trips;
+
+    Interval index = bounds(op->index);
+    if (index.is_bounded()) {
+      map<string, Interval>::iterator iter = index_range.find(op->name);
+      if (iter == index_range.end()) {
+        index_range[op->name] = index;
+      } else {
+        iter->second.include(index);
+      }
+    }
+  }
+
+  void visit(const Provide* op) {
+    IRVisitor::visit(op);
+    FunctionCost& c = costs[op->name];
+    for (size_t i = 0; i < op->values.size(); i++) {
+      c.bytes_stored += trips * op->values[i].type().bytes();
+    }
+    c.points_stored += trips;
+    c.unknown_trip_count |= unknown_trips;
+
+    Box region(op->args.size());
+    for (size_t i = 0; i < op->args.size(); i++) {
+      region[i] = bounds(op->args[i]);
+      if (!region[i].is_bounded()) {
+        return;
+      }
+    }
+    merge_boxes(provide_region[op->name], region);
+  }
+
+  void record_allocation(const string& name, Interval size, int bytes) {
+    FunctionCost& c = costs[function_name(name)];
+    if (size.is_bounded()) {
+      c.allocation_bytes = std::max(c.allocation_bytes, size.max * bytes);
+    }
+    c.allocations += trips;
+  }
+
+  void visit(const Allocate* op) {
+    record_allocation(op->name, bounds(op->size), op->type.bytes());
+    IRVisitor::visit(op);
+  }
+
+  void visit(const Realize* op) {
+    int64_t points = 1;
+    bool bounded = true;
+    for (size_t i = 0; i < op->bounds.size(); i++) {
+      Interval extent = bounds(op->bounds[i].extent);
+      bounded &= extent.is_bounded();
+      points *= std::max<int64_t>(extent.max, 0);
+    }
+    int bytes = 0;
+    for (size_t i = 0; i < op->types.size(); i++) {
+      bytes += op->types[i].bytes();
+    }
+    record_allocation(
+        op->name,
+        bounded ? Interval::single_point(points) : Interval::everything(),
+        bytes);
+    IRVisitor::visit(op);
+  }
+};
+
+string human_readable(double x, const char* unit) {
+  static const char* prefixes[] = {"", "K", "M", "G", "T", "P"};
+  int i = 0;
+  while (x >= 1000 && i < 5) {
+    x /= 1000;
+    i++;
+  }
+  ostringstream s;
+  s << std::fixed << std::setprecision(i == 0 ? 0 : 2) << x << " "
+    << prefixes[i] << unit;
+  return s.str();
+}
+
+string milliseconds(double seconds) {
+  ostringstream s;
+  s << std::setprecision(3) << seconds * 1000 << " ms";
+  return s.str();
+}
+
+}  // namespace
+
+map<string, FunctionCost> compute_costs(Stmt s,
+                                        const Scope<Interval>& estimates) {
+  FindParameters params;
+  s.accept(&params);
+  Scope<Interval> scope = estimates;
+  for (map<string, Parameter>::iterator iter = params.parameters.begin();
+       iter != params.parameters.end(); ++iter) {
+    push_estimates(iter->second, scope);
+  }
+
+  ComputeCosts c(scope);
+  s.accept(&c);
+  c.finish();
+  return c.costs;
+}
+
+string cost_report(Stmt s, const MachineParams& params,
+                   const Scope<Interval>& estimates) {
+  map<string, FunctionCost> costs = compute_costs(s, estimates);
+
+  ostringstream r;
+  r << "Machine: " << human_readable(params.peak_ops, "op/s") << " peak, "
+    << human_readable(params.memory_bandwidth, "B/s") << " memory, "
+    << human_readable(params.l2_size, "B") << " L2\n"
+    << "Ridge point: " << params.peak_ops / params.memory_bandwidth
+    << " ops/byte\n\n";
+
+  double total_time = 0;
+  for (map<string, FunctionCost>::iterator iter = costs.begin();
+       iter != costs.end(); ++iter) {
+    const FunctionCost& c = iter->second;
+    double bytes = c.bytes_loaded + c.bytes_stored;
+    double intensity = c.arithmetic_intensity();
+    double attainable =
+        std::min(params.peak_ops, intensity * params.memory_bandwidth);
+    double time = std::max(c.ops / params.peak_ops,
+                           bytes / params.memory_bandwidth);
+    total_time += time;
+
+    r << (iter->first.empty() ? "<pipeline>" : iter->first) << ":\n"
+      << "  arithmetic ops:       " << human_readable(c.ops, "op") << "\n"
+      << "  bytes loaded:         " << human_readable(c.bytes_loaded, "B")
+      << "\n"
+      << "  bytes stored:         " << human_readable(c.bytes_stored, "B")
+      << "\n";
+    if (c.allocations > 0) {
+      r << "  allocation:           "
+        << human_readable(c.allocation_bytes, "B") << " x "
+        << (int64_t)c.allocations << "\n";
+      if (c.allocation_bytes > params.l2_size) {
+        r << "  warning: allocation exceeds L2\n";
+      }
+    }
+    if (c.points_stored > 0) {
+      r << "  recompute factor:     " << std::fixed << std::setprecision(2)
+        << c.recompute_factor() << "\n";
+    }
+    r << "  arithmetic intensity: " << std::fixed << std::setprecision(2)
+      << intensity << " ops/byte\n"
+      << "  roofline:             " << human_readable(attainable, "op/s")
+      << " attainable, "
+      << (intensity * params.memory_bandwidth < params.peak_ops ? "memory"
+                                                                  : "compute")
+      << " bound, " << milliseconds(time) << "\n";
+    if (c.unknown_trip_count) {
+      r << "  warning: some loop trip counts are unknown and were counted "
+           "as one\n";
+    }
+  }
+  r << "\nEstimated total: " << milliseconds(total_time) << "\n";
+  return r.str();
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
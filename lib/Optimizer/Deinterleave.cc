@@ -0,0 +1,350 @@
+#include "jmlang/Optimizer/Deinterleave.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "jmlang/IR/ExprCall.h"
+#include "jmlang/IR/ExprVariable.h"
+#include "jmlang/IR/IREquality.h"
+#include "jmlang/IR/IRMutator.h"
+#include "jmlang/IR/IROperator.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::map;
+using std::pair;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+/// The stride of a vector index that is a Ramp with a constant stride
+/// of 2, 3 or 4, or zero for any other index.
+int small_stride(Expr index) {
+  const Ramp* ramp = index.as<Ramp>();
+  const int* stride = ramp ? as_const_int(ramp->stride) : NULL;
+  return stride && *stride >= 2 && *stride <= 4 ? *stride : 0;
+}
+
+/// Split an expression into a part that isn't a constant plus a
+/// constant offset.
+Expr split_offset(Expr e, int* offset) {
+  *offset = 0;
+  while (true) {
+    const Add* add = e.as<Add>();
+    const Sub* sub = e.as<Sub>();
+    const int* c = NULL;
+    if (add && (c = as_const_int(add->b))) {
+      *offset += *c;
+      e = add->a;
+    } else if (add && (c = as_const_int(add->a))) {
+      *offset += *c;
+      e = add->b;
+    } else if (sub && (c = as_const_int(sub->b))) {
+      *offset -= *c;
+      e = sub->a;
+    } else {
+      return e;
+    }
+  }
+}
+
+/// Whether two expressions differ by a constant, and if so, set diff
+/// to a - b.
+bool constant_difference(Expr a, Expr b, int* diff) {
+  int ca, cb;
+  Expr va = split_offset(a, &ca);
+  Expr vb = split_offset(b, &cb);
+  if (!equal(va, vb)) {
+    return false;
+  }
+  *diff = ca - cb;
+  return true;
+}
+
+/// The expression plus a constant, folding it into any constant
+/// already added.
+Expr add_offset(Expr e, int offset) {
+  int c;
+  Expr v = split_offset(e, &c);
+  c += offset;
+  return c == 0 ? v : v + c;
+}
+
+/// Find the names bound by lets inside an expression.
+class FindLetNames : public IRGraphVisitor {
+ public:
+  set<string> names;
+
+ private:
+  using IRGraphVisitor::visit;
+
+  void visit(const Let* op) {
+    names.insert(op->name);
+    IRGraphVisitor::visit(op);
+  }
+};
+
+/// Check if an expression refers to any of a set of names, or loads
+/// from any of them.
+class UsesNames : public IRGraphVisitor {
+  const set<string>& names;
+
+ public:
+  bool result;
+
+  UsesNames(const set<string>& n) : names(n), result(false) {}
+
+ private:
+  using IRGraphVisitor::visit;
+
+  void visit(const Variable* op) { result |= names.count(op->name) > 0; }
+
+  void visit(const Load* op) {
+    result |= names.count(op->name) > 0;
+    IRGraphVisitor::visit(op);
+  }
+};
+
+bool uses_names(Expr e, const set<string>& names) {
+  UsesNames uses(names);
+  e.accept(&uses);
+  return uses.result;
+}
+
+/// Find the vector loads with a small constant stride.
+class FindStridedLoads : public IRGraphVisitor {
+ public:
+  vector<const Load*> loads;
+
+ private:
+  using IRGraphVisitor::visit;
+
+  void visit(const Load* op) {
+    if (op->type.is_vector() && small_stride(op->index)) {
+      loads.push_back(op);
+    }
+    IRGraphVisitor::visit(op);
+  }
+};
+
+/// Replace some loads with other expressions.
+class ReplaceLoads : public IRMutator {
+  const map<const Load*, Expr>& replacements;
+
+ public:
+  ReplaceLoads(const map<const Load*, Expr>& r) : replacements(r) {}
+
+ private:
+  using IRMutator::visit;
+
+  void visit(const Load* op) {
+    map<const Load*, Expr>::const_iterator iter = replacements.find(op);
+    if (iter != replacements.end()) {
+      expr = iter->second;
+    } else {
+      IRMutator::visit(op);
+    }
+  }
+};
+
+/// Strided loads from one buffer with the same type and stride, whose
+/// indices differ by constants, with the offset of each from the
+/// first.
+struct LoadGroup {
+  const Load* first;
+  int stride;
+  vector<pair<const Load*, int> > loads;
+};
+
+/// Make the strided loads in an expression share dense loads, bound
+/// to lets around the whole expression.
+Expr deinterleave_loads(Expr e) {
+  FindStridedLoads finder;
+  e.accept(&finder);
+  if (finder.loads.empty()) {
+    return e;
+  }
+  // Loads that depend on a let inside the expression can't move out
+  // to the top of it.
+  FindLetNames lets;
+  e.accept(&lets);
+
+  vector<LoadGroup> groups;
+  for (size_t i = 0; i < finder.loads.size(); i++) {
+    const Load* load = finder.loads[i];
+    if (uses_names(load->index, lets.names)) {
+      continue;
+    }
+    int stride = small_stride(load->index);
+    Expr base = load->index.as<Ramp>()->base;
+    bool grouped = false;
+    for (size_t j = 0; j < groups.size() && !grouped; j++) {
+      LoadGroup& g = groups[j];
+      int offset;
+      if (g.first->name == load->name && g.first->type == load->type &&
+          g.stride == stride &&
+          constant_difference(base, g.first->index.as<Ramp>()->base,
+                              &offset) &&
+          std::abs(offset) < stride * load->type.width) {
+        g.loads.push_back(std::make_pair(load, offset));
+        grouped = true;
+      }
+    }
+    if (!grouped) {
+      LoadGroup g;
+      g.first = load;
+      g.stride = stride;
+      g.loads.push_back(std::make_pair(load, 0));
+      groups.push_back(g);
+    }
+  }
+
+  // The dense load covers from the first lane of the lowest load to
+  // the last lane of the highest, so it only reads elements between
+  // ones the strided loads read.
+  map<const Load*, Expr> replacements;
+  vector<pair<string, Expr> > dense_loads;
+  for (size_t i = 0; i < groups.size(); i++) {
+    const LoadGroup& g = groups[i];
+    int lo = 0, hi = 0;
+    for (size_t j = 0; j < g.loads.size(); j++) {
+      lo = std::min(lo, g.loads[j].second);
+      hi = std::max(hi, g.loads[j].second);
+    }
+    int width = g.first->type.width;
+    int span = hi - lo + g.stride * (width - 1) + 1;
+    Expr base = add_offset(g.first->index.as<Ramp>()->base, lo);
+    Type t = g.first->type.element_of().vector_of(span);
+    string name = unique_name('d');
+    dense_loads.push_back(std::make_pair(
+        name, Load::make(t, g.first->name, Ramp::make(base, 1, span),
+                         g.first->image, g.first->param)));
+    Expr dense = Variable::make(t, name);
+    for (size_t j = 0; j < g.loads.size(); j++) {
+      vector<Expr> args(width + 1);
+      args[0] = dense;
+      for (int k = 0; k < width; k++) {
+        args[k + 1] = g.loads[j].second - lo + g.stride * k;
+      }
+      replacements[g.loads[j].first] = Call::make(
+          g.first->type, Call::shuffle_vector, args, Call::Intrinsic);
+    }
+  }
+
+  e = ReplaceLoads(replacements).mutate(e);
+  for (size_t i = dense_loads.size(); i > 0; i--) {
+    e = Let::make(dense_loads[i - 1].first, dense_loads[i - 1].second, e);
+  }
+  return e;
+}
+
+/// If the stores starting at stmts[i] write every channel of the same
+/// pixels, one after another, return a single dense store of all of
+/// them, and set n to the number of stores it replaces.
+Stmt interleave_stores(const vector<Stmt>& stmts, size_t i, size_t* n) {
+  const Store* first = stmts[i].as<Store>();
+  int stride = first ? small_stride(first->index) : 0;
+  if (!stride || first->value.type().is_scalar() ||
+      i + stride > stmts.size()) {
+    return Stmt();
+  }
+  Type t = first->value.type();
+  set<string> buffer;
+  buffer.insert(first->name);
+
+  // Each channel's value, in order of offset from the first store.
+  vector<Expr> values(2 * stride - 1);
+  int lo = 0, hi = 0;
+  for (int j = 0; j < stride; j++) {
+    const Store* store = stmts[i + j].as<Store>();
+    int offset;
+    if (!store || store->name != first->name ||
+        store->value.type() != t || small_stride(store->index) != stride ||
+        !constant_difference(store->index.as<Ramp>()->base,
+                             first->index.as<Ramp>()->base, &offset) ||
+        offset <= -stride || offset >= stride ||
+        values[offset + stride - 1].defined() ||
+        uses_names(store->value, buffer)) {
+      return Stmt();
+    }
+    values[offset + stride - 1] = store->value;
+    lo = std::min(lo, offset);
+    hi = std::max(hi, offset);
+  }
+  // The offsets are distinct, so this means they are consecutive.
+  if (hi - lo != stride - 1) {
+    return Stmt();
+  }
+  vector<Expr> channels(values.begin() + lo + stride - 1,
+                        values.begin() + lo + 2 * stride - 1);
+  Expr base = add_offset(first->index.as<Ramp>()->base, lo);
+  Type interleaved = t.element_of().vector_of(t.width * stride);
+  *n = stride;
+  return Store::make(first->name,
+                     Call::make(interleaved, Call::interleave_vectors,
+                                channels, Call::Intrinsic),
+                     Ramp::make(base, 1, t.width * stride));
+}
+
+class RewriteInterleavings : public IRMutator {
+  using IRMutator::visit;
+
+  void visit(const Store* op) {
+    Expr value = deinterleave_loads(mutate(op->value));
+    if (value.same_as(op->value)) {
+      stmt = op;
+    } else {
+      stmt = Store::make(op->name, value, op->index);
+    }
+  }
+
+  void visit(const LetStmt* op) {
+    Expr value = deinterleave_loads(mutate(op->value));
+    Stmt body = mutate(op->body);
+    if (value.same_as(op->value) && body.same_as(op->body)) {
+      stmt = op;
+    } else {
+      stmt = LetStmt::make(op->name, value, body);
+    }
+  }
+
+  void visit(const Block* op) {
+    vector<Stmt> stmts;
+    Stmt s = op;
+    while (const Block* block = s.as<Block>()) {
+      stmts.push_back(mutate(block->first));
+      s = block->rest;
+    }
+    if (s.defined()) {
+      stmts.push_back(mutate(s));
+    }
+
+    vector<Stmt> result;
+    for (size_t i = 0; i < stmts.size();) {
+      size_t n = 1;
+      Stmt store = interleave_stores(stmts, i, &n);
+      result.push_back(store.defined() ? store : stmts[i]);
+      i += n;
+    }
+
+    stmt = result.back();
+    for (size_t i = result.size() - 1; i > 0; i--) {
+      stmt = Block::make(result[i - 1], stmt);
+    }
+  }
+};
+
+}  // namespace
+
+Stmt rewrite_interleavings(Stmt s) {
+  return RewriteInterleavings().mutate(s);
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
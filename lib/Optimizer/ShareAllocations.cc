@@ -0,0 +1,392 @@
+#include "jmlang/Optimizer/ShareAllocations.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include "jmlang/Base/Debug.h"
+#include "jmlang/IR/IRMutator.h"
+#include "jmlang/IR/IROperator.h"
+#include "jmlang/IR/IRPrinter.h"
+
+namespace jmlang {
+namespace internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+/// Find all the names bound by lets and loops.
+class FindBoundNames : public IRGraphVisitor {
+ public:
+  set<string> names;
+
+ private:
+  using IRGraphVisitor::visit;
+
+  void visit(const Let* op) {
+    names.insert(op->name);
+    IRGraphVisitor::visit(op);
+  }
+
+  void visit(const LetStmt* op) {
+    names.insert(op->name);
+    IRGraphVisitor::visit(op);
+  }
+
+  void visit(const For* op) {
+    names.insert(op->name);
+    IRGraphVisitor::visit(op);
+  }
+};
+
+/// Check if an expression refers to any of a set of names.
+class UsesNames : public IRGraphVisitor {
+  const set<string>& names;
+
+ public:
+  bool result;
+
+  UsesNames(const set<string>& n) : names(n), result(false) {}
+
+ private:
+  using IRGraphVisitor::visit;
+
+  void visit(const Variable* op) { result |= names.count(op->name) > 0; }
+};
+
+struct LiveRange {
+  Type type;
+  Expr size;
+  int64_t first, last;
+  bool used, eligible;
+};
+
+/// Compute the live range of each allocation outside of any loop, in
+/// terms of a counter that ticks at each access in program order. An
+/// access anywhere inside a loop keeps the buffer live for the whole
+/// loop, as other buffers accessed later in the loop body are also
+/// accessed before it on the next iteration.
+class ComputeLiveRanges : public IRVisitor {
+  const set<string>& bound;
+  int loop_depth;
+  int64_t counter, loop_start;
+  set<string> used_in_loop;
+
+  /// Variables that might refer to the address of a buffer.
+  set<string> variables;
+
+ public:
+  map<string, LiveRange> ranges;
+
+  ComputeLiveRanges(const set<string>& b)
+      : bound(b), loop_depth(0), counter(0), loop_start(0) {}
+
+  /// Mark buffers whose address escapes as ineligible.
+  void finish() {
+    for (map<string, LiveRange>::iterator iter = ranges.begin();
+         iter != ranges.end(); ++iter) {
+      for (set<string>::iterator v = variables.begin(); v != variables.end();
+           ++v) {
+        if (*v == iter->first || starts_with(*v, iter->first + ".")) {
+          iter->second.eligible = false;
+        }
+      }
+    }
+  }
+
+ private:
+  using IRVisitor::visit;
+
+  void use(const string& name) {
+    map<string, LiveRange>::iterator iter = ranges.find(name);
+    if (iter == ranges.end()) {
+      return;
+    }
+    LiveRange& r = iter->second;
+    int64_t pos;
+    if (loop_depth > 0) {
+      pos = loop_start;
+      used_in_loop.insert(name);
+    } else {
+      pos = counter++;
+    }
+    if (!r.used) {
+      r.first = pos;
+      r.used = true;
+    }
+    r.last = std::max(r.last, pos);
+  }
+
+  void visit(const Variable* op) { variables.insert(op->name); }
+
+  void visit(const Load* op) {
+    IRVisitor::visit(op);
+    use(op->name);
+  }
+
+  void visit(const Store* op) {
+    IRVisitor::visit(op);
+    use(op->name);
+  }
+
+  void visit(const For* op) {
+    op->min.accept(this);
+    op->extent.accept(this);
+    if (loop_depth == 0) {
+      loop_start = counter++;
+    }
+    loop_depth++;
+    op->body.accept(this);
+    loop_depth--;
+    if (loop_depth == 0) {
+      int64_t end = counter++;
+      for (set<string>::iterator iter = used_in_loop.begin();
+           iter != used_in_loop.end(); ++iter) {
+        LiveRange& r = ranges[*iter];
+        r.last = std::max(r.last, end);
+      }
+      used_in_loop.clear();
+    }
+  }
+
+  void visit(const Allocate* op) {
+    if (loop_depth == 0) {
+      LiveRange r;
+      r.type = op->type;
+      r.size = op->size;
+      r.first = r.last = 0;
+      r.used = false;
+      UsesNames uses(bound);
+      op->size.accept(&uses);
+      r.eligible = !uses.result && !ranges.count(op->name);
+      if (ranges.count(op->name)) {
+        // Allocated twice under the same name. Leave both alone.
+        ranges[op->name].eligible = false;
+      } else {
+        ranges[op->name] = r;
+      }
+    }
+    IRVisitor::visit(op);
+  }
+};
+
+class RewriteSharedAllocations : public IRMutator {
+  const string& arena;
+
+  /// The offset into the arena of each shared buffer, in elements of
+  /// the buffer's type.
+  const map<string, Expr>& offsets;
+
+ public:
+  RewriteSharedAllocations(const string& a, const map<string, Expr>& o)
+      : arena(a), offsets(o) {}
+
+ private:
+  using IRMutator::visit;
+
+  Expr offset_index(const string& name, Expr index) {
+    Expr offset = offsets.find(name)->second;
+    if (index.type().width > 1) {
+      offset = Broadcast::make(offset, index.type().width);
+    }
+    return index + offset;
+  }
+
+  void visit(const Load* op) {
+    Expr index = mutate(op->index);
+    if (offsets.count(op->name)) {
+      expr = Load::make(op->type, arena, offset_index(op->name, index),
+                        op->image, op->param);
+    } else if (index.same_as(op->index)) {
+      expr = op;
+    } else {
+      expr = Load::make(op->type, op->name, index, op->image, op->param);
+    }
+  }
+
+  void visit(const Store* op) {
+    Expr value = mutate(op->value);
+    Expr index = mutate(op->index);
+    if (offsets.count(op->name)) {
+      stmt = Store::make(arena, value, offset_index(op->name, index));
+    } else if (value.same_as(op->value) && index.same_as(op->index)) {
+      stmt = op;
+    } else {
+      stmt = Store::make(op->name, value, index);
+    }
+  }
+
+  void visit(const Allocate* op) {
+    if (offsets.count(op->name)) {
+      stmt = mutate(op->body);
+    } else {
+      IRMutator::visit(op);
+    }
+  }
+
+  void visit(const Free* op) {
+    if (offsets.count(op->name)) {
+      stmt = Stmt();
+    } else {
+      stmt = op;
+    }
+  }
+
+  void visit(const Block* op) {
+    Stmt first = mutate(op->first);
+    Stmt rest = op->rest.defined() ? mutate(op->rest) : Stmt();
+    if (!first.defined()) {
+      stmt = rest;
+    } else if (!rest.defined()) {
+      stmt = first;
+    } else if (first.same_as(op->first) && rest.same_as(op->rest)) {
+      stmt = op;
+    } else {
+      stmt = Block::make(first, rest);
+    }
+  }
+};
+
+struct Slot {
+  int64_t end;
+  Expr bytes;
+  vector<string> buffers;
+  /// The size in bytes, if every buffer in the slot has a constant
+  /// size, or -1.
+  int64_t const_bytes;
+};
+
+/// The most bytes the arena can hold. It's indexed with 32-bit ints.
+const int64_t max_arena_bytes = 0x7fffffff;
+
+bool starts_before(const std::pair<string, LiveRange>& a,
+                   const std::pair<string, LiveRange>& b) {
+  return a.second.first < b.second.first;
+}
+
+}  // namespace
+
+Stmt share_allocations(Stmt s) {
+  FindBoundNames bound;
+  s.accept(&bound);
+  ComputeLiveRanges live(bound.names);
+  s.accept(&live);
+  live.finish();
+
+  vector<std::pair<string, LiveRange> > candidates;
+  for (map<string, LiveRange>::iterator iter = live.ranges.begin();
+       iter != live.ranges.end(); ++iter) {
+    if (iter->second.eligible && iter->second.used) {
+      candidates.push_back(*iter);
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(), starts_before);
+
+  // Greedy interval coloring: give each buffer the first slot whose
+  // previous occupant is dead by the time this one is first used.
+  vector<Slot> slots;
+  map<string, size_t> slot_of;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    const string& name = candidates[i].first;
+    const LiveRange& r = candidates[i].second;
+    // Sizes are summed in 64 bits, as buffers that each fit in 32 bits
+    // may not fit together.
+    Expr bytes = cast(Int(64), r.size) * r.type.bytes();
+    const int* size = as_const_int(r.size);
+    int64_t const_bytes = size ? (int64_t)*size * r.type.bytes() : -1;
+    size_t j = 0;
+    while (j < slots.size() && slots[j].end >= r.first) {
+      j++;
+    }
+    if (j == slots.size()) {
+      Slot slot = {r.last, bytes, vector<string>(), const_bytes};
+      slots.push_back(slot);
+    } else {
+      slots[j].end = r.last;
+      slots[j].bytes = Max::make(slots[j].bytes, bytes);
+      slots[j].const_bytes = const_bytes < 0 || slots[j].const_bytes < 0
+                                 ? -1
+                                 : std::max(slots[j].const_bytes, const_bytes);
+    }
+    slots[j].buffers.push_back(name);
+    slot_of[name] = j;
+  }
+
+  if (slots.size() == candidates.size()) {
+    // Nothing to share.
+    return s;
+  }
+
+  // If the sizes are known, don't share if the arena would be too
+  // big. Otherwise check its size when it's allocated.
+  int64_t const_total = 0;
+  for (size_t j = 0; j < slots.size() && const_total >= 0; j++) {
+    const_total = slots[j].const_bytes < 0
+                      ? -1
+                      : const_total + (slots[j].const_bytes + 63) / 64 * 64;
+  }
+  if (const_total > max_arena_bytes) {
+    debug(2) << "Not sharing allocations, as the arena would take "
+             << const_total << " bytes\n";
+    return s;
+  }
+
+  string arena = unique_name("shared_allocation");
+  vector<string> offset_names(slots.size());
+  map<string, Expr> offsets;
+  for (size_t j = 0; j < slots.size(); j++) {
+    std::ostringstream n;
+    n << arena << ".offset." << j;
+    offset_names[j] = n.str();
+  }
+  for (size_t i = 0; i < candidates.size(); i++) {
+    const string& name = candidates[i].first;
+    Expr offset = Variable::make(Int(64), offset_names[slot_of[name]]);
+    offsets[name] =
+        cast(Int(32), offset / candidates[i].second.type.bytes());
+  }
+
+  RewriteSharedAllocations rewrite(arena, offsets);
+  Stmt body = rewrite.mutate(s);
+
+  // The arena, followed by the lets giving the offset of each slot,
+  // outermost first. The offsets are 64-bit, and the arena is only
+  // allocated once its size is known to fit in 32 bits.
+  Expr total = Variable::make(Int(64), arena + ".size");
+  body = Allocate::make(arena, UInt(8), cast(Int(32), total),
+                        Block::make(body, Free::make(arena)));
+  if (const_total < 0) {
+    body = Block::make(
+        AssertStmt::make(total <= make_const(Int(64), max_arena_bytes),
+                         "The buffers sharing " + arena +
+                             " need more than 2^31 bytes"),
+        body);
+  }
+  vector<std::pair<string, Expr> > lets;
+  Expr offset = make_zero(Int(64));
+  for (size_t j = 0; j < slots.size(); j++) {
+    lets.push_back(std::make_pair(offset_names[j], offset));
+    // Round each slot up to a multiple of 64 bytes, so that every
+    // slot is as aligned as the arena itself.
+    Expr size = ((slots[j].bytes + 63) / 64) * 64;
+    offset = Variable::make(Int(64), offset_names[j]) + size;
+  }
+  lets.push_back(std::make_pair(arena + ".size", offset));
+  for (size_t j = lets.size(); j > 0; j--) {
+    body = LetStmt::make(lets[j - 1].first, lets[j - 1].second, body);
+  }
+
+  debug(2) << "Shared " << candidates.size() << " allocations in "
+           << slots.size() << " slots:\n"
+           << body << "\n";
+  return body;
+}
+
+}  // namespace internal
+}  // namespace jmlang
\ No newline at end of file
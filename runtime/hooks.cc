@@ -0,0 +1,105 @@
+#include "runtime_internal.h"
+
+// Each entry point calls through a hook, which starts out pointing at
+// the default implementation. The jmlang_set_* functions replace the
+// hooks, and null arguments restore the defaults. The jit makes the
+// hooks private to each module, so that each pipeline has its own
+// handlers.
+
+extern "C" {
+
+/// The options for this pipeline's parallel loops.
+JMLANG_WEAK jmlang_par_for_options jmlang_module_par_for_options = {
+    0, 0, 0, 0};
+
+}  // extern "C"
+
+namespace {
+
+/// Run a loop on the shared thread pool, with this pipeline's
+/// do_task and options.
+int pool_do_par_for(jmlang_task_t f, int min, int size, uint8_t* closure) {
+  return jmlang_pool_do_par_for(f, min, size, closure, jmlang_do_task,
+                                &jmlang_module_par_for_options);
+}
+
+}  // namespace
+
+extern "C" {
+
+JMLANG_WEAK void* (*jmlang_malloc_hook)(size_t) = jmlang_default_malloc;
+JMLANG_WEAK void (*jmlang_free_hook)(void*) = jmlang_default_free;
+JMLANG_WEAK void (*jmlang_error_hook)(const char*) = jmlang_default_error;
+JMLANG_WEAK int (*jmlang_do_task_hook)(jmlang_task_t, int, uint8_t*) =
+    jmlang_default_do_task;
+JMLANG_WEAK int (*jmlang_do_par_for_hook)(jmlang_task_t, int, int,
+                                          uint8_t*) = pool_do_par_for;
+JMLANG_WEAK void (*jmlang_trace_hook)(const char*, int, int, int, int, int,
+                                      const void*, int, const int*) =
+    jmlang_default_trace;
+
+JMLANG_WEAK void* jmlang_malloc(size_t size) {
+  return jmlang_malloc_hook(size);
+}
+
+JMLANG_WEAK void jmlang_free(void* ptr) { jmlang_free_hook(ptr); }
+
+JMLANG_WEAK void jmlang_error(const char* msg) { jmlang_error_hook(msg); }
+
+JMLANG_WEAK int jmlang_do_task(jmlang_task_t f, int idx, uint8_t* closure) {
+  return jmlang_do_task_hook(f, idx, closure);
+}
+
+JMLANG_WEAK int jmlang_do_par_for(jmlang_task_t f, int min, int size,
+                                  uint8_t* closure) {
+  return jmlang_do_par_for_hook(f, min, size, closure);
+}
+
+JMLANG_WEAK void jmlang_trace(const char* func, int event, int type_code,
+                              int bits, int width, int value_index,
+                              const void* value, int num_coords,
+                              const int* coords) {
+  jmlang_trace_hook(func, event, type_code, bits, width, value_index, value,
+                    num_coords, coords);
+}
+
+JMLANG_WEAK void jmlang_set_error_handler(void (*handler)(const char*)) {
+  jmlang_error_hook = handler ? handler : jmlang_default_error;
+}
+
+JMLANG_WEAK void jmlang_set_custom_allocator(void* (*m)(size_t),
+                                             void (*f)(void*)) {
+  jmlang_malloc_hook = m ? m : jmlang_default_malloc;
+  jmlang_free_hook = f ? f : jmlang_default_free;
+}
+
+JMLANG_WEAK void jmlang_set_custom_do_task(
+    int (*do_task)(jmlang_task_t, int, uint8_t*)) {
+  jmlang_do_task_hook = do_task ? do_task : jmlang_default_do_task;
+}
+
+JMLANG_WEAK void jmlang_set_custom_do_par_for(
+    int (*do_par_for)(jmlang_task_t, int, int, uint8_t*)) {
+  jmlang_do_par_for_hook = do_par_for ? do_par_for : pool_do_par_for;
+}
+
+/// Limit the threads working on this pipeline's parallel loops at
+/// once, or zero for no limit, and set their priority on the thread
+/// pool shared with other pipelines.
+JMLANG_WEAK void jmlang_set_par_for_options(int max_threads, int priority) {
+  jmlang_module_par_for_options.max_threads =
+      max_threads < 0 ? 0 : max_threads;
+  jmlang_module_par_for_options.priority = priority;
+}
+
+JMLANG_WEAK void jmlang_set_numa_aware(int numa_aware) {
+  jmlang_module_par_for_options.numa = numa_aware ? 1 : -1;
+}
+
+JMLANG_WEAK void jmlang_set_custom_trace(
+    void (*trace)(const char*, int, int, int, int, int, const void*, int,
+                  const int*)) {
+  jmlang_trace_hook = trace ? trace : jmlang_default_trace;
+}
+
+}  // extern "C"
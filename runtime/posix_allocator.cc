@@ -0,0 +1,238 @@
+#include "runtime_internal.h"
+
+// The default allocator keeps freed blocks in a cache per thread, and
+// hands them out again, so that a pipeline realized over and over
+// reuses its buffers instead of going back to malloc, which maps and
+// unmaps big blocks, for each one. Sizes are rounded up to size
+// classes, four per power of two, and a block is only reused for its
+// own class. Blocks are aligned to cache lines, or to pages from 64k
+// up. Each block has a header, in front of it, saying which class it
+// is and where its memory starts.
+//
+// A block goes back to the cache of the thread that frees it. Each
+// thread caches up to JMLANG_ALLOCATOR_CACHE_MB megabytes (128 by
+// default; 0 turns the cache off), and blocks beyond that, or bigger
+// than the largest class, go back to the C library. A thread's cache
+// is emptied when it exits, and jmlang_trim_allocator empties them
+// all.
+
+namespace {
+
+/// The smallest block, and the number of size classes. The largest
+/// class is a gigabyte.
+const size_t min_block = 64;
+const int num_classes = 97;
+
+const size_t cache_line = 64;
+const size_t page = 4096;
+
+struct Header {
+  /// The start of the memory the block was allocated in.
+  void* base;
+  /// The block's size class, or num_classes for blocks that aren't
+  /// cached.
+  int size_class;
+};
+
+/// The memory of a cached block holds the next one in its class.
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+struct alignas(64) Cache {
+  /// Guards the lists. It's only ever contended by
+  /// jmlang_trim_allocator.
+  int lock;
+  size_t bytes;
+  FreeBlock* blocks[num_classes];
+  /// The next thread's cache.
+  Cache* next;
+};
+
+struct Allocator {
+  /// Guards starting the allocator, and the list of caches.
+  pthread_mutex_t mutex;
+  int initialized;
+  pthread_key_t current_cache;
+  Cache* caches;
+  /// The most bytes a thread caches.
+  size_t cache_limit;
+};
+
+Allocator allocator;
+
+void lock(int* l) {
+  while (__atomic_exchange_n(l, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(l, __ATOMIC_RELAXED)) {
+    }
+  }
+}
+
+void unlock(int* l) { __atomic_store_n(l, 0, __ATOMIC_RELEASE); }
+
+size_t class_size(int c) { return (size_t)(4 + c % 4) << (4 + c / 4); }
+
+/// The smallest class that fits size bytes: 64, 80, 96, 112, 128,
+/// 160 and so on. Sizes bigger than the largest class get
+/// num_classes.
+int size_class(size_t size) {
+  if (size <= min_block) {
+    return 0;
+  }
+  if (size > class_size(num_classes - 1)) {
+    return num_classes;
+  }
+  // 2^k < size <= 2^(k + 1), which is split into four classes.
+  int k = 63 - __builtin_clzll(size - 1);
+  size_t step = (size_t)1 << (k - 2);
+  int j = (int)((size - ((size_t)1 << k) + step - 1) / step);
+  return (k - 6) * 4 + j;
+}
+
+size_t alignment(size_t size) { return size >= 65536 ? page : cache_line; }
+
+Header* header(void* ptr) { return (Header*)ptr - 1; }
+
+/// Get a block from the C library. The header goes at the end of
+/// the padding that aligns the block.
+void* allocate(int c, size_t size) {
+  if (c < num_classes) {
+    size = class_size(c);
+  }
+  size_t align = alignment(size);
+  size_t total = (align + size + align - 1) & ~(align - 1);
+  uint8_t* base = (uint8_t*)aligned_alloc(align, total);
+  if (!base) {
+    return nullptr;
+  }
+  void* ptr = base + align;
+  header(ptr)->base = base;
+  header(ptr)->size_class = c;
+  return ptr;
+}
+
+/// Give a cache's blocks back to the C library. Called with the
+/// cache locked, or by its own thread as it exits.
+void empty(Cache* cache) {
+  for (int c = 0; c < num_classes; c++) {
+    while (FreeBlock* b = cache->blocks[c]) {
+      cache->blocks[c] = b->next;
+      free(header(b)->base);
+    }
+  }
+  cache->bytes = 0;
+}
+
+/// Called as a thread with a cache exits.
+void destroy_cache(void* arg) {
+  Cache* cache = (Cache*)arg;
+  pthread_mutex_lock(&allocator.mutex);
+  Cache** p = &allocator.caches;
+  while (*p != cache) {
+    p = &(*p)->next;
+  }
+  *p = cache->next;
+  pthread_mutex_unlock(&allocator.mutex);
+  empty(cache);
+  free(cache);
+}
+
+void start_allocator() {
+  pthread_mutex_lock(&allocator.mutex);
+  if (!allocator.initialized) {
+    const char* env = getenv("JMLANG_ALLOCATOR_CACHE_MB");
+    int mb = env ? atoi(env) : 128;
+    allocator.cache_limit = (size_t)(mb < 0 ? 0 : mb) << 20;
+    pthread_key_create(&allocator.current_cache, destroy_cache);
+    __atomic_store_n(&allocator.initialized, 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&allocator.mutex);
+}
+
+/// The calling thread's cache, made on first use. Null if there's no
+/// cache.
+Cache* current_cache() {
+  if (!__atomic_load_n(&allocator.initialized, __ATOMIC_ACQUIRE)) {
+    start_allocator();
+  }
+  if (allocator.cache_limit == 0) {
+    return nullptr;
+  }
+  Cache* cache = (Cache*)pthread_getspecific(allocator.current_cache);
+  if (cache) {
+    return cache;
+  }
+  cache = (Cache*)aligned_alloc(alignof(Cache), sizeof(Cache));
+  if (!cache) {
+    return nullptr;
+  }
+  cache->lock = 0;
+  cache->bytes = 0;
+  for (int c = 0; c < num_classes; c++) {
+    cache->blocks[c] = nullptr;
+  }
+  pthread_mutex_lock(&allocator.mutex);
+  cache->next = allocator.caches;
+  allocator.caches = cache;
+  pthread_mutex_unlock(&allocator.mutex);
+  pthread_setspecific(allocator.current_cache, cache);
+  return cache;
+}
+
+}  // namespace
+
+extern "C" {
+
+JMLANG_WEAK void* jmlang_default_malloc(size_t size) {
+  int c = size_class(size);
+  Cache* cache = c < num_classes ? current_cache() : nullptr;
+  if (cache) {
+    lock(&cache->lock);
+    FreeBlock* b = cache->blocks[c];
+    if (b) {
+      cache->blocks[c] = b->next;
+      cache->bytes -= class_size(c);
+    }
+    unlock(&cache->lock);
+    if (b) {
+      return b;
+    }
+  }
+  return allocate(c, size);
+}
+
+JMLANG_WEAK void jmlang_default_free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  int c = header(ptr)->size_class;
+  Cache* cache = c < num_classes ? current_cache() : nullptr;
+  if (cache) {
+    size_t size = class_size(c);
+    lock(&cache->lock);
+    bool keep = cache->bytes + size <= allocator.cache_limit;
+    if (keep) {
+      FreeBlock* b = (FreeBlock*)ptr;
+      b->next = cache->blocks[c];
+      cache->blocks[c] = b;
+      cache->bytes += size;
+    }
+    unlock(&cache->lock);
+    if (keep) {
+      return;
+    }
+  }
+  free(header(ptr)->base);
+}
+
+JMLANG_WEAK void jmlang_trim_allocator() {
+  pthread_mutex_lock(&allocator.mutex);
+  for (Cache* cache = allocator.caches; cache; cache = cache->next) {
+    lock(&cache->lock);
+    empty(cache);
+    unlock(&cache->lock);
+  }
+  pthread_mutex_unlock(&allocator.mutex);
+}
+
+}  // extern "C"
@@ -0,0 +1,11 @@
+#include "runtime_internal.h"
+
+extern "C" {
+
+JMLANG_WEAK void jmlang_default_error(const char* msg) {
+  write(2, "Error: ", 7);
+  write(2, msg, strlen(msg));
+  write(2, "\n", 1);
+}
+
+}  // extern "C"
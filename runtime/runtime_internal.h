@@ -0,0 +1,130 @@
+#ifndef JMLANG_RUNTIME_RUNTIME_INTERNAL_H
+#define JMLANG_RUNTIME_RUNTIME_INTERNAL_H
+
+// The runtime is compiled to llvm bitcode without a C or C++ library
+// at hand, so it declares the few things it needs from libc itself.
+// Everything it defines is weak, so that pipelines compiled ahead of
+// time and linked into one program share one runtime, and so that a
+// program can replace any of it by defining it.
+
+#define JMLANG_WEAK __attribute__((weak))
+
+typedef __SIZE_TYPE__ size_t;
+typedef __INTPTR_TYPE__ intptr_t;
+typedef __UINT8_TYPE__ uint8_t;
+typedef __INT32_TYPE__ int32_t;
+typedef __INT64_TYPE__ int64_t;
+typedef __UINT64_TYPE__ uint64_t;
+
+extern "C" {
+
+void* aligned_alloc(size_t alignment, size_t size);
+void free(void* ptr);
+size_t strlen(const char* s);
+long write(int fd, const void* buf, size_t count);
+char* getenv(const char* name);
+int atoi(const char* s);
+long sysconf(int name);
+#define _SC_NPROCESSORS_ONLN 84
+int open(const char* path, int flags, ...);
+#define O_RDONLY 0
+long read(int fd, void* buf, size_t count);
+int close(int fd);
+
+// Cpu sets are bitmasks, passed with their size in bytes. The thread
+// is the calling one if pid is zero.
+int sched_getaffinity(int pid, size_t size, void* mask);
+int sched_setaffinity(int pid, size_t size, const void* mask);
+int sched_getcpu();
+
+// The pthread types are opaque, and no bigger than these on the
+// platforms we run on. Zeroed mutexes and condition variables are
+// initialized.
+typedef unsigned long pthread_t;
+typedef unsigned int pthread_key_t;
+struct pthread_mutex_t {
+  uint64_t _private[8];
+};
+struct pthread_cond_t {
+  uint64_t _private[8];
+};
+int pthread_create(pthread_t* thread, const void* attr,
+                   void* (*start)(void*), void* arg);
+int pthread_join(pthread_t thread, void** result);
+int pthread_mutex_lock(pthread_mutex_t* mutex);
+int pthread_mutex_unlock(pthread_mutex_t* mutex);
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex);
+int pthread_cond_broadcast(pthread_cond_t* cond);
+int pthread_key_create(pthread_key_t* key, void (*destructor)(void*));
+int pthread_key_delete(pthread_key_t key);
+void* pthread_getspecific(pthread_key_t key);
+int pthread_setspecific(pthread_key_t key, const void* value);
+
+/// The body of a parallel loop, called with the index of one
+/// iteration and the closure holding the loop's free variables.
+typedef int (*jmlang_task_t)(int, uint8_t*);
+
+typedef int (*jmlang_do_task_t)(jmlang_task_t, int, uint8_t*);
+
+/// The entry points generated code calls (see hooks.cc).
+void* jmlang_malloc(size_t size);
+void jmlang_free(void* ptr);
+void jmlang_error(const char* msg);
+int jmlang_do_task(jmlang_task_t f, int idx, uint8_t* closure);
+int jmlang_do_par_for(jmlang_task_t f, int min, int size, uint8_t* closure);
+void jmlang_trace(const char* func, int event, int type_code, int bits,
+                  int width, int value_index, const void* value,
+                  int num_coords, const int* coords);
+
+/// How the parallel loops of a pipeline use the thread pool. Each
+/// pipeline has one (see jmlang_set_par_for_options).
+struct jmlang_par_for_options {
+  /// The most threads working on the pipeline's loops at once, or
+  /// zero for no limit.
+  int max_threads;
+  /// Idle threads take work from the loops with the highest priority
+  /// first.
+  int priority;
+  /// Whether to hand each numa node its own contiguous share of each
+  /// loop: 1 to, -1 not to, or 0 to do what JMLANG_NUMA says.
+  int numa;
+  /// The number of ranges of the pipeline's loops being run. Used by
+  /// the thread pool.
+  int active;
+};
+
+/// The default implementations the entry points start out calling.
+/// The thread pool is shared by every pipeline in the process, so it
+/// is handed the pipeline's do_task and options, rather than calling
+/// the entry points itself.
+void* jmlang_default_malloc(size_t size);
+void jmlang_default_free(void* ptr);
+void jmlang_default_error(const char* msg);
+int jmlang_default_do_task(jmlang_task_t f, int idx, uint8_t* closure);
+int jmlang_pool_do_par_for(jmlang_task_t f, int min, int size,
+                           uint8_t* closure, jmlang_do_task_t do_task,
+                           jmlang_par_for_options* options);
+void jmlang_default_trace(const char* func, int event, int type_code,
+                          int bits, int width, int value_index,
+                          const void* value, int num_coords,
+                          const int* coords);
+
+/// The thread pool starts on the first parallel loop. Users that
+/// come and go, like jit compiled pipelines, hold references to it,
+/// and its threads stop when the last reference is released.
+/// jmlang_shutdown_thread_pool stops them straight away; they start
+/// again on the next loop.
+void jmlang_thread_pool_retain();
+void jmlang_thread_pool_release();
+void jmlang_shutdown_thread_pool();
+
+/// Give the blocks the default allocator has cached back to the C
+/// library.
+void jmlang_trim_allocator();
+
+/// Close anything tracing has open.
+void jmlang_shutdown_trace();
+
+}  // extern "C"
+
+#endif  // JMLANG_RUNTIME_RUNTIME_INTERNAL_H
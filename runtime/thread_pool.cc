@@ -0,0 +1,701 @@
+#include "runtime_internal.h"
+
+// The default parallel for runs loops on a pool of worker threads,
+// with work stealing. Each thread running a loop owns a deque of
+// ranges of iterations. Whenever its deque runs dry, it splits the
+// range it's working on in half, keeps the lower half, and pushes the
+// upper half for idle threads to steal. So loops whose iterations
+// cost different amounts still balance, without chunking them ahead
+// of time. A thread waiting for a loop to finish works on that loop's
+// iterations rather than blocking, and this includes a worker running
+// a nested loop. So nested loops run on the threads that are already
+// there. Idle threads spin for a while before going to sleep.
+//
+// There's one pool for the whole process. The jit links every
+// pipeline against one copy of this file. Pipelines compiled ahead of
+// time share its weak definitions, too. Each pipeline passes its
+// options with each loop. Steals count against the pipeline's thread
+// limit, and idle threads steal from the highest priority loop first.
+//
+// On machines with several numa nodes, a pipeline can ask for its
+// loops to be numa-aware. Workers are then pinned to cores, spread
+// over the nodes, and each loop is cut into one contiguous share per
+// node, in proportion to the node's workers. A share goes in the
+// node's inbox, which only that node's threads take from (and the
+// thread waiting for the loop, as a last resort). As the same
+// iterations land on the same node every time, a buffer's pages are
+// first touched, and so placed, on the node that later loops over the
+// same rows run on. Setting JMLANG_NUMA=1 pins the workers and makes
+// every loop numa-aware by default.
+
+namespace {
+
+/// The most threads the pool will use, and the number of deques kept
+/// for threads outside the pool that call jmlang_do_par_for.
+const int max_threads = 256;
+const int max_guests = 16;
+
+/// The most numa nodes and cpus the pool knows about.
+const int max_nodes = 16;
+const int max_cpus = 1024;
+
+/// The number of ranges a deque can hold. Splitting only when the
+/// deque is empty keeps it to a few per level of loop nesting.
+const unsigned deque_capacity = 64;
+
+/// How many times an idle thread looks for work before sleeping.
+const int spin_count = 4096;
+
+/// A parallel loop being run.
+struct Job {
+  jmlang_task_t f;
+  uint8_t* closure;
+  jmlang_do_task_t do_task;
+  jmlang_par_for_options* options;
+  /// The number of iterations not yet finished.
+  int remaining;
+  /// The first nonzero result of an iteration. Once it's set, the
+  /// rest of the iterations are skipped.
+  int result;
+};
+
+/// The iterations [begin, end) of a job.
+struct Range {
+  Job* job;
+  int begin, end;
+};
+
+/// A deque of ranges. Its owner pushes and pops at the bottom, and
+/// other threads steal from the top, so the owner works on the
+/// smallest, most recently split ranges, and thieves take the
+/// biggest. It's guarded by a spinlock, as that's held for only a few
+/// instructions.
+struct alignas(64) Deque {
+  int lock;
+  /// Whether a thread outside the pool has this deque.
+  int in_use;
+  /// The numa node of the deque's thread, or -1 for guests. Inboxes
+  /// have no thread, and hold the shares of loops handed to a node.
+  int node;
+  int inbox;
+  unsigned top, bottom;
+  Range ranges[deque_capacity];
+};
+
+struct ThreadPool {
+  /// Guards starting and stopping the pool.
+  pthread_mutex_t init_mutex;
+  int initialized;
+  /// The number of references held with jmlang_thread_pool_retain.
+  int refs;
+
+  /// The number of worker threads. A thread that calls
+  /// jmlang_do_par_for works on its loop too.
+  int workers;
+  pthread_t threads[max_threads];
+
+  /// The workers' deques, then the guests', then the nodes' inboxes.
+  Deque* deques;
+  int num_deques;
+
+  /// The numa nodes with cpus the process may run on, numbered from
+  /// zero, and the node of each cpu, or -1 for cpus it can't use.
+  int num_nodes;
+  signed char cpu_node[max_cpus];
+  /// The workers on each node, and the cpu each is pinned to, or -1
+  /// if the cpus aren't known.
+  int node_workers[max_nodes];
+  short worker_cpu[max_threads];
+  /// Whether workers pin themselves to their cpus. Set by the first
+  /// numa-aware loop, or by JMLANG_NUMA.
+  int pin;
+  /// Whether loops are numa-aware unless their pipeline says
+  /// otherwise.
+  int numa_default;
+
+  /// The deque of the current thread, if it has one.
+  pthread_key_t current_deque;
+
+  /// Sleeping threads wait on wake. The epoch counts the ranges
+  /// pushed, so that a thread about to sleep can tell whether work
+  /// turned up since it last looked.
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  int sleepers;
+  unsigned epoch;
+  int shutdown;
+};
+
+ThreadPool pool;
+
+void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+void lock(int* l) {
+  while (__atomic_exchange_n(l, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(l, __ATOMIC_RELAXED)) {
+      pause();
+    }
+  }
+}
+
+void unlock(int* l) { __atomic_store_n(l, 0, __ATOMIC_RELEASE); }
+
+bool is_empty(Deque* d) {
+  return __atomic_load_n(&d->top, __ATOMIC_RELAXED) ==
+         __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+}
+
+/// Push a range on the bottom of a deque. Fails if it's full.
+bool push(Deque* d, Range r) {
+  lock(&d->lock);
+  bool ok = d->bottom - d->top < deque_capacity;
+  if (ok) {
+    d->ranges[d->bottom % deque_capacity] = r;
+    __atomic_store_n(&d->bottom, d->bottom + 1, __ATOMIC_RELAXED);
+  }
+  unlock(&d->lock);
+  return ok;
+}
+
+/// Count one more range of a pipeline's loops as running. Thieves
+/// respect the pipeline's thread limit, but a thread always takes
+/// its own ranges, as it's already counted for the loop that made
+/// them.
+bool start_range(jmlang_par_for_options* options, bool steal) {
+  int active = __atomic_load_n(&options->active, __ATOMIC_RELAXED);
+  do {
+    if (steal && options->max_threads > 0 && active >= options->max_threads) {
+      return false;
+    }
+  } while (!__atomic_compare_exchange_n(&options->active, &active,
+                                        active + 1, true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED));
+  return true;
+}
+
+/// The priority of the loop at the top of a deque, and whether there
+/// is one.
+bool top_priority(Deque* d, int* priority) {
+  if (is_empty(d)) {
+    return false;
+  }
+  lock(&d->lock);
+  bool ok = d->top != d->bottom;
+  if (ok) {
+    *priority = d->ranges[d->top % deque_capacity].job->options->priority;
+  }
+  unlock(&d->lock);
+  return ok;
+}
+
+/// Take the range at the bottom of a deque, or at the top if steal
+/// is true, if it belongs to the job, or to any job if job is null.
+/// Inboxes have no owner to work through them in order, so a job's
+/// share is taken from wherever it is in one. Otherwise nested loops
+/// waiting on shares queued behind each other's would deadlock.
+bool take(Deque* d, Job* job, bool steal, Range* r) {
+  if (is_empty(d)) {
+    return false;
+  }
+  lock(&d->lock);
+  bool ok = d->top != d->bottom;
+  if (ok) {
+    unsigned i = steal ? d->top : d->bottom - 1;
+    if (d->inbox && job) {
+      while (i != d->bottom - 1 &&
+             d->ranges[i % deque_capacity].job != job) {
+        i++;
+      }
+      Range found = d->ranges[i % deque_capacity];
+      d->ranges[i % deque_capacity] = d->ranges[d->top % deque_capacity];
+      d->ranges[d->top % deque_capacity] = found;
+      i = d->top;
+    }
+    *r = d->ranges[i % deque_capacity];
+    ok = (!job || r->job == job) && start_range(r->job->options, steal);
+    if (ok && steal) {
+      __atomic_store_n(&d->top, d->top + 1, __ATOMIC_RELAXED);
+    } else if (ok) {
+      __atomic_store_n(&d->bottom, d->bottom - 1, __ATOMIC_RELAXED);
+    }
+  }
+  unlock(&d->lock);
+  return ok;
+}
+
+Deque* inbox(int node) {
+  return &pool.deques[pool.workers + max_guests + node];
+}
+
+/// The numa node a thread is on: its worker's node, or for a guest,
+/// the node of the cpu it's running on.
+int node_of(Deque* self) {
+  if (self->node >= 0) {
+    return self->node;
+  }
+  int cpu = sched_getcpu();
+  return cpu >= 0 && cpu < max_cpus ? pool.cpu_node[cpu] : -1;
+}
+
+/// Find a range to work on: from the bottom of the thread's own
+/// deque, then from its node's inbox, or else stolen from another
+/// deque. Threads looking for a range of a particular job try the
+/// deques in turn, starting at a random one, and other nodes' inboxes
+/// last. Idle threads steal from the highest priority loop, again
+/// starting at a random deque to break ties, but preferring their own
+/// node's, and never take another node's share of a loop.
+bool find_work(Deque* self, Job* job, unsigned* seed, Range* r) {
+  if (take(self, job, false, r)) {
+    return true;
+  }
+  int node = pool.num_nodes > 1 ? node_of(self) : -1;
+  if (node >= 0 && take(inbox(node), job, true, r)) {
+    return true;
+  }
+  *seed = *seed * 1103515245 + 12345;
+  int start = (int)((*seed >> 16) % (unsigned)pool.num_deques);
+  if (!job) {
+    Deque* best = nullptr;
+    int best_priority = 0;
+    for (int i = 0; i < pool.num_deques; i++) {
+      Deque* d = &pool.deques[(start + i) % pool.num_deques];
+      int priority;
+      if (d != self && !d->inbox && top_priority(d, &priority) &&
+          (!best || priority > best_priority ||
+           (priority == best_priority && d->node == node &&
+            best->node != node))) {
+        best = d;
+        best_priority = priority;
+      }
+    }
+    if (best && take(best, nullptr, true, r)) {
+      return true;
+    }
+  }
+  for (int i = 0; i < pool.num_deques; i++) {
+    Deque* d = &pool.deques[(start + i) % pool.num_deques];
+    if (d != self && !d->inbox && take(d, job, true, r)) {
+      return true;
+    }
+  }
+  if (job) {
+    for (int n = 0; n < pool.num_nodes; n++) {
+      if (n != node && take(inbox(n), job, true, r)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/// Wake the sleeping threads, if there are any. Whatever changed to
+/// make it worth waking them must be written before calling this.
+void wake_sleepers() {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pool.sleepers, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&pool.mutex);
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.mutex);
+  }
+}
+
+/// Sleep until woken, unless work has been pushed since the epoch,
+/// the job (if any) has finished, or the pool is shutting down.
+void sleep(Job* job, unsigned epoch) {
+  pthread_mutex_lock(&pool.mutex);
+  __atomic_add_fetch(&pool.sleepers, 1, __ATOMIC_SEQ_CST);
+  bool done = job && __atomic_load_n(&job->remaining, __ATOMIC_SEQ_CST) == 0;
+  if (!done && !__atomic_load_n(&pool.shutdown, __ATOMIC_SEQ_CST) &&
+      __atomic_load_n(&pool.epoch, __ATOMIC_SEQ_CST) == epoch) {
+    pthread_cond_wait(&pool.wake, &pool.mutex);
+  }
+  __atomic_sub_fetch(&pool.sleepers, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&pool.mutex);
+}
+
+/// Run the iterations of a range, splitting off its upper half
+/// whenever the thread's deque is empty, so that there's always
+/// something for idle threads to steal.
+void run(Deque* self, Range r) {
+  Job* job = r.job;
+  int done = 0;
+  while (r.begin < r.end) {
+    if (r.end - r.begin > 1 && is_empty(self)) {
+      int mid = r.begin + (r.end - r.begin) / 2;
+      Range upper = {job, mid, r.end};
+      if (push(self, upper)) {
+        r.end = mid;
+        __atomic_add_fetch(&pool.epoch, 1, __ATOMIC_SEQ_CST);
+        wake_sleepers();
+        continue;
+      }
+    }
+    if (!__atomic_load_n(&job->result, __ATOMIC_RELAXED)) {
+      int result = job->do_task(job->f, r.begin, job->closure);
+      int ok = 0;
+      if (result) {
+        __atomic_compare_exchange_n(&job->result, &ok, result, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+      }
+    }
+    r.begin++;
+    done++;
+  }
+  // The job may be freed as soon as its last iteration is counted.
+  __atomic_sub_fetch(&job->options->active, 1, __ATOMIC_RELAXED);
+  if (__atomic_sub_fetch(&job->remaining, done, __ATOMIC_SEQ_CST) == 0) {
+    wake_sleepers();
+  }
+}
+
+/// Pin the calling thread to a cpu.
+void pin(int cpu) {
+  uint64_t mask[max_cpus / 64] = {0};
+  mask[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+  sched_setaffinity(0, sizeof(mask), mask);
+}
+
+void* worker(void* arg) {
+  Deque* self = (Deque*)arg;
+  pthread_setspecific(pool.current_deque, self);
+  int index = (int)(self - pool.deques);
+  unsigned seed = (unsigned)index + 1;
+  bool pinned = false;
+  int spins = 0;
+  while (!__atomic_load_n(&pool.shutdown, __ATOMIC_ACQUIRE)) {
+    if (!pinned && __atomic_load_n(&pool.pin, __ATOMIC_RELAXED)) {
+      if (pool.worker_cpu[index] >= 0) {
+        pin(pool.worker_cpu[index]);
+      }
+      pinned = true;
+    }
+    unsigned epoch = __atomic_load_n(&pool.epoch, __ATOMIC_SEQ_CST);
+    Range r;
+    if (find_work(self, nullptr, &seed, &r)) {
+      run(self, r);
+      spins = 0;
+    } else if (++spins < spin_count) {
+      pause();
+    } else {
+      sleep(nullptr, epoch);
+      spins = 0;
+    }
+  }
+  return nullptr;
+}
+
+/// The number of threads to use, including the ones calling
+/// jmlang_do_par_for: JMLANG_NUM_THREADS if set, or else one per
+/// cpu.
+int thread_count() {
+  const char* env = getenv("JMLANG_NUM_THREADS");
+  int n = env ? atoi(env) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  return n < 1 ? 1 : n > max_threads ? max_threads : n;
+}
+
+/// Read a small file into buf as a string. Returns false if it
+/// can't be read.
+bool read_file(const char* path, char* buf, int size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  long n = read(fd, buf, size - 1);
+  close(fd);
+  buf[n < 0 ? 0 : n] = 0;
+  return n > 0;
+}
+
+/// Mark the cpus in a list like "0-11,24-35" that the process may
+/// use as being on a node. Returns how many there were.
+int add_cpus(const char* list, const uint64_t* allowed, int node) {
+  int count = 0;
+  const char* p = list;
+  while (*p >= '0' && *p <= '9') {
+    int first = 0, last;
+    while (*p >= '0' && *p <= '9') {
+      first = first * 10 + (*p++ - '0');
+    }
+    last = first;
+    if (*p == '-') {
+      p++;
+      last = 0;
+      while (*p >= '0' && *p <= '9') {
+        last = last * 10 + (*p++ - '0');
+      }
+    }
+    for (int c = first; c <= last && c < max_cpus; c++) {
+      if (allowed[c / 64] & ((uint64_t)1 << (c % 64))) {
+        pool.cpu_node[c] = (signed char)node;
+        count++;
+      }
+    }
+    if (*p == ',') {
+      p++;
+    }
+  }
+  return count;
+}
+
+/// Find which cpus the process may run on, and their numa nodes, from
+/// sysfs. If the nodes can't be read, all the cpus are on one node.
+void find_topology() {
+  uint64_t allowed[max_cpus / 64];
+  if (sched_getaffinity(0, sizeof(allowed), allowed) != 0) {
+    for (int i = 0; i < max_cpus / 64; i++) {
+      allowed[i] = ~(uint64_t)0;
+    }
+  }
+  for (int c = 0; c < max_cpus; c++) {
+    pool.cpu_node[c] = -1;
+  }
+  pool.num_nodes = 0;
+  char list[4096];
+  for (int n = 0; n < 64 && pool.num_nodes < max_nodes; n++) {
+    char path[64] = "/sys/devices/system/node/node";
+    int len = (int)strlen(path);
+    if (n >= 10) {
+      path[len++] = (char)('0' + n / 10);
+    }
+    path[len++] = (char)('0' + n % 10);
+    const char* file = "/cpulist";
+    for (int i = 0; file[i]; i++) {
+      path[len++] = file[i];
+    }
+    path[len] = 0;
+    if (read_file(path, list, sizeof(list)) &&
+        add_cpus(list, allowed, pool.num_nodes) > 0) {
+      pool.num_nodes++;
+    }
+  }
+  if (pool.num_nodes == 0) {
+    pool.num_nodes = 1;
+    for (int c = 0; c < max_cpus; c++) {
+      if (allowed[c / 64] & ((uint64_t)1 << (c % 64))) {
+        pool.cpu_node[c] = 0;
+      }
+    }
+  }
+}
+
+/// Spread the workers over the nodes in turn, and over the cpus of
+/// each node, so that even a few threads use every node's memory
+/// bandwidth.
+void place_workers() {
+  for (int n = 0; n < pool.num_nodes; n++) {
+    pool.node_workers[n] = 0;
+  }
+  for (int i = 0; i < pool.workers; i++) {
+    int node = i % pool.num_nodes;
+    int k = pool.node_workers[node]++;
+    int cpus = 0;
+    for (int c = 0; c < max_cpus; c++) {
+      cpus += pool.cpu_node[c] == node;
+    }
+    pool.worker_cpu[i] = -1;
+    for (int c = 0, j = 0; cpus > 0 && c < max_cpus; c++) {
+      if (pool.cpu_node[c] == node && j++ == k % cpus) {
+        pool.worker_cpu[i] = (short)c;
+        break;
+      }
+    }
+  }
+}
+
+void start_pool() {
+  pthread_mutex_lock(&pool.init_mutex);
+  if (!pool.initialized) {
+    const char* numa = getenv("JMLANG_NUMA");
+    pool.numa_default = pool.pin = numa && atoi(numa) > 0;
+    find_topology();
+    pool.workers = thread_count() - 1;
+    place_workers();
+    pool.num_deques = pool.workers + max_guests + pool.num_nodes;
+    pool.deques =
+        (Deque*)aligned_alloc(alignof(Deque), sizeof(Deque) * pool.num_deques);
+    if (!pool.deques) {
+      pool.workers = 0;
+      pool.num_deques = 0;
+    }
+    for (int i = 0; i < pool.num_deques; i++) {
+      Deque* d = &pool.deques[i];
+      d->lock = d->in_use = 0;
+      d->top = d->bottom = 0;
+      d->inbox = i >= pool.workers + max_guests;
+      d->node = d->inbox ? i - pool.workers - max_guests
+                : i < pool.workers ? i % pool.num_nodes
+                                   : -1;
+    }
+    pthread_key_create(&pool.current_deque, nullptr);
+    for (int i = 0; i < pool.workers; i++) {
+      pthread_create(&pool.threads[i], nullptr, worker, &pool.deques[i]);
+    }
+    __atomic_store_n(&pool.initialized, 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&pool.init_mutex);
+}
+
+/// Stop the workers, if they're running. Called with the init mutex
+/// held.
+void stop_pool() {
+  if (!pool.initialized) {
+    return;
+  }
+  __atomic_store_n(&pool.shutdown, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_lock(&pool.mutex);
+  pthread_cond_broadcast(&pool.wake);
+  pthread_mutex_unlock(&pool.mutex);
+  for (int i = 0; i < pool.workers; i++) {
+    pthread_join(pool.threads[i], nullptr);
+  }
+  pthread_key_delete(pool.current_deque);
+  free(pool.deques);
+  pool.deques = nullptr;
+  pool.shutdown = 0;
+  __atomic_store_n(&pool.initialized, 0, __ATOMIC_RELEASE);
+}
+
+/// Take one of the deques for threads outside the pool, or return
+/// null if they're all in use.
+Deque* acquire_guest_deque() {
+  for (int i = pool.workers; i < pool.workers + max_guests; i++) {
+    int in_use = 0;
+    if (__atomic_compare_exchange_n(&pool.deques[i].in_use, &in_use, 1,
+                                    false, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED)) {
+      return &pool.deques[i];
+    }
+  }
+  return nullptr;
+}
+
+/// Hand each numa node a contiguous share of a loop, in proportion
+/// to its workers. A share that doesn't fit in its node's inbox is
+/// run here.
+void share_by_node(Deque* self, Job* job, int min, int size) {
+  int shared = 0;
+  int64_t begin = min;
+  for (int n = 0; n < pool.num_nodes; n++) {
+    shared += pool.node_workers[n];
+    int64_t end = min + (int64_t)size * shared / pool.workers;
+    Range r = {job, (int)begin, (int)end};
+    if (begin < end && !push(inbox(n), r)) {
+      start_range(job->options, false);
+      run(self, r);
+    }
+    begin = end;
+  }
+  __atomic_add_fetch(&pool.epoch, 1, __ATOMIC_SEQ_CST);
+  wake_sleepers();
+}
+
+int run_serially(jmlang_task_t f, int min, int size, uint8_t* closure,
+                 jmlang_do_task_t do_task) {
+  for (int i = min; i < min + size; i++) {
+    int result = do_task(f, i, closure);
+    if (result) {
+      return result;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+extern "C" {
+
+JMLANG_WEAK int jmlang_default_do_task(jmlang_task_t f, int idx,
+                                       uint8_t* closure) {
+  return f(idx, closure);
+}
+
+/// Iterations are handed to the pipeline's do_task, so that a custom
+/// do_task applies to them. If one fails, the ones not yet started
+/// are skipped, and the first error is returned.
+JMLANG_WEAK int jmlang_pool_do_par_for(jmlang_task_t f, int min, int size,
+                                       uint8_t* closure,
+                                       jmlang_do_task_t do_task,
+                                       jmlang_par_for_options* options) {
+  if (size <= 0) {
+    return 0;
+  }
+  if (!__atomic_load_n(&pool.initialized, __ATOMIC_ACQUIRE)) {
+    start_pool();
+  }
+  if (pool.workers == 0 || size == 1 || options->max_threads == 1) {
+    return run_serially(f, min, size, closure, do_task);
+  }
+
+  Deque* self = (Deque*)pthread_getspecific(pool.current_deque);
+  Deque* guest = nullptr;
+  if (!self) {
+    guest = self = acquire_guest_deque();
+    if (!self) {
+      return run_serially(f, min, size, closure, do_task);
+    }
+    pthread_setspecific(pool.current_deque, self);
+  }
+
+  Job job = {f, closure, do_task, options, size, 0};
+  bool numa = pool.num_nodes > 1 &&
+              (options->numa > 0 || (options->numa == 0 && pool.numa_default));
+  if (numa) {
+    __atomic_store_n(&pool.pin, 1, __ATOMIC_RELAXED);
+    share_by_node(self, &job, min, size);
+  } else {
+    Range all = {&job, min, min + size};
+    start_range(options, false);
+    run(self, all);
+  }
+
+  // Help with the rest of this loop, but not with others, so that
+  // this returns as soon as the loop is done.
+  unsigned seed = (unsigned)(intptr_t)&job;
+  int spins = 0;
+  while (__atomic_load_n(&job.remaining, __ATOMIC_ACQUIRE) > 0) {
+    unsigned epoch = __atomic_load_n(&pool.epoch, __ATOMIC_SEQ_CST);
+    Range r;
+    if (find_work(self, &job, &seed, &r)) {
+      run(self, r);
+      spins = 0;
+    } else if (++spins < spin_count) {
+      pause();
+    } else {
+      sleep(&job, epoch);
+      spins = 0;
+    }
+  }
+
+  if (guest) {
+    pthread_setspecific(pool.current_deque, nullptr);
+    __atomic_store_n(&guest->in_use, 0, __ATOMIC_RELEASE);
+  }
+  return __atomic_load_n(&job.result, __ATOMIC_RELAXED);
+}
+
+JMLANG_WEAK void jmlang_thread_pool_retain() {
+  pthread_mutex_lock(&pool.init_mutex);
+  pool.refs++;
+  pthread_mutex_unlock(&pool.init_mutex);
+}
+
+JMLANG_WEAK void jmlang_thread_pool_release() {
+  pthread_mutex_lock(&pool.init_mutex);
+  if (--pool.refs == 0) {
+    stop_pool();
+  }
+  pthread_mutex_unlock(&pool.init_mutex);
+}
+
+/// Must not be called while a parallel loop is running.
+JMLANG_WEAK void jmlang_shutdown_thread_pool() {
+  pthread_mutex_lock(&pool.init_mutex);
+  stop_pool();
+  pthread_mutex_unlock(&pool.init_mutex);
+}
+
+}  // extern "C"
@@ -0,0 +1,10 @@
+#include "runtime_internal.h"
+
+extern "C" {
+
+JMLANG_WEAK void jmlang_default_trace(const char*, int, int, int, int, int,
+                                      const void*, int, const int*) {}
+
+JMLANG_WEAK void jmlang_shutdown_trace() {}
+
+}  // extern "C"
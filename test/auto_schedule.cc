@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "jmlang/IR/IROperator.h"
+#include "jmlang/Optimizer/AutoSchedule.h"
+
+using namespace jmlang;
+using namespace jmlang::internal;
+
+// Checks that apply_schedule replaces the schedule of a function's
+// update step along with its pure schedule, so that applying one set
+// of choices after another leaves nothing of the first.
+
+namespace {
+
+/// f(x, y) = 0, then f(x, y) += r for r in [0, 10), which can run in
+/// parallel over y.
+Function make_reduction() {
+  IntrusivePtr<FunctionContents> contents(new FunctionContents);
+  contents.ptr->name = "f";
+  contents.ptr->args.push_back("x");
+  contents.ptr->args.push_back("y");
+  contents.ptr->values.push_back(0);
+  contents.ptr->output_types.push_back(Int(32));
+  Expr x = Variable::make(Int(32), "x"), y = Variable::make(Int(32), "y");
+  Expr r = Variable::make(Int(32), "r");
+  contents.ptr->reduction_args.push_back(x);
+  contents.ptr->reduction_args.push_back(y);
+  contents.ptr->reduction_values.push_back(r);
+  ReductionVariable rv = {"r", 0, 10};
+  contents.ptr->reduction_domain =
+      ReductionDomain(std::vector<ReductionVariable>(1, rv));
+  return Function(contents);
+}
+
+/// Check the loops of f's update step, innermost first, and whether
+/// the outermost is parallel.
+bool check_update(Function f, bool parallel) {
+  const char* expected[] = {"r", "x", "y"};
+  const std::vector<Schedule::Dim>& dims = f.reduction_schedule().dims;
+  bool ok = dims.size() == 3 && f.reduction_schedule().splits.empty();
+  for (size_t i = 0; ok && i < dims.size(); i++) {
+    bool parallel_dim = parallel && i == dims.size() - 1;
+    ok = dims[i].var == expected[i] &&
+         dims[i].for_type == (parallel_dim ? For::Parallel : For::Serial);
+  }
+  if (!ok) {
+    printf("The update of f has loops");
+    for (size_t i = 0; i < dims.size(); i++) {
+      printf(" %s%s", dims[i].var.c_str(),
+             dims[i].for_type == For::Parallel ? " (parallel)" : "");
+    }
+    printf(" instead of r x y%s\n", parallel ? " (parallel)" : "");
+  }
+  return ok;
+}
+
+}  // namespace
+
+int main() {
+  Function f = make_reduction();
+  StageChoice choice;
+  choice.func = f;
+  choice.compute_level = StageChoice::Root;
+  ScheduleChoices choices;
+
+  // Parallel twice, so that the second starts from what the first did,
+  // then serial.
+  choice.parallel = true;
+  choices["f"] = choice;
+  apply_schedule(choices);
+  if (!check_update(f, true)) {
+    return 1;
+  }
+  apply_schedule(choices);
+  if (!check_update(f, true)) {
+    return 1;
+  }
+  choices["f"].parallel = false;
+  apply_schedule(choices);
+  if (!check_update(f, false) ||
+      f.schedule().dims.back().for_type != For::Serial) {
+    return 1;
+  }
+  printf("Success!\n");
+  return 0;
+}
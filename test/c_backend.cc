@@ -0,0 +1,135 @@
+#include <dlfcn.h>
+#include <stdlib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "jmlang/Base/buffer_t.h"
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/CodeGen/CodeGen_C.h"
+#include "jmlang/IR/IROperator.h"
+
+using namespace jmlang;
+using namespace jmlang::internal;
+
+// Checks that the C the C backend writes for a vectorized pipeline
+// builds with the system's C compiler and computes the same as the
+// jit: signed division and remainder, which both round down, by
+// vectors, by a scalar argument and by constants, then a select and a
+// shuffle of the results.
+
+namespace {
+
+const int width = 8;
+const int size = 1024;
+
+typedef int (*CFunction)(buffer_t*, buffer_t*, int32_t, buffer_t*);
+
+buffer_t make_buffer(void* host, int size, int elem_size) {
+  buffer_t b = {0};
+  b.host = (uint8_t*)host;
+  b.extent[0] = size;
+  b.stride[0] = 1;
+  b.elem_size = elem_size;
+  return b;
+}
+
+/// out[x] = a[x] / b[x] where a[x] < b[x], a[x] % b[x] elsewhere,
+/// plus a[x] / d - a[x] % -3 + a[x] / 7, with the lanes of each
+/// vector reversed.
+Stmt pipeline() {
+  Expr x = Variable::make(Int(32), "x");
+  Expr index = Ramp::make(x * width, 1, width);
+  Type t = Int(32, width);
+  Expr a = Load::make(t, "a", index, Buffer(), Parameter());
+  Expr b = Load::make(t, "b", index, Buffer(), Parameter());
+  Expr d = Variable::make(Int(32), "d");
+  Expr value = select(a < b, a / b, a % b) + a / d - a % -3 + a / 7;
+  std::vector<Expr> lanes(1, value);
+  for (int i = width - 1; i >= 0; i--) {
+    lanes.push_back(i);
+  }
+  value = Call::make(t, Call::shuffle_vector, lanes, Call::Intrinsic);
+  return For::make("x", 0, size / width, For::Serial,
+                   Store::make("out", value, index));
+}
+
+/// Write the pipeline out as C, build it as a shared library in a
+/// fresh directory and load it, or return null.
+CFunction build_c(Stmt s, const std::vector<Argument>& args) {
+  char dir[] = "/tmp/jmlang_c_backend_XXXXXX";
+  if (!mkdtemp(dir)) {
+    printf("Couldn't make a directory to build in\n");
+    return nullptr;
+  }
+  std::string source = std::string(dir) + "/c_backend.c";
+  std::string library = std::string(dir) + "/c_backend.so";
+  compile_to_c(source, s, "c_backend", args);
+  std::string command = "cc -O2 -ffp-contract=off -shared -fPIC -o " +
+                        library + " " + source;
+  if (system(command.c_str()) != 0) {
+    printf("%s failed\n", command.c_str());
+    return nullptr;
+  }
+  void* handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    printf("%s\n", dlerror());
+    return nullptr;
+  }
+  return (CFunction)dlsym(handle, "c_backend");
+}
+
+}  // namespace
+
+int main() {
+  Stmt s = pipeline();
+  std::vector<Argument> args;
+  args.push_back(Argument("a", true, Int(32)));
+  args.push_back(Argument("b", true, Int(32)));
+  args.push_back(Argument("d", false, Int(32)));
+  args.push_back(Argument("out", true, Int(32)));
+
+  CFunction c_pipeline = build_c(s, args);
+  if (!c_pipeline) {
+    return 1;
+  }
+  CodeGen cg;
+  cg.compile(s, "c_backend", args);
+  JITModule m = cg.compile_to_function_pointers();
+
+  // Numerators and divisors of both signs, with no zero divisors.
+  std::vector<int32_t> a(size), b(size), jit_out(size), c_out(size);
+  uint32_t seed = 12345;
+  for (int i = 0; i < size; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    a[i] = (int32_t)(seed >> 8) - (1 << 23);
+    b[i] = (int32_t)(seed % 2001) - 1000;
+    if (b[i] == 0) {
+      b[i] = 1;
+    }
+  }
+  int32_t divisors[] = {5, -5, 1, -1, 64, 1000003};
+  for (int32_t d : divisors) {
+    buffer_t a_buf = make_buffer(&a[0], size, 4);
+    buffer_t b_buf = make_buffer(&b[0], size, 4);
+    buffer_t jit_buf = make_buffer(&jit_out[0], size, 4);
+    buffer_t c_buf = make_buffer(&c_out[0], size, 4);
+    const void* arg_values[] = {&a_buf, &b_buf, &d, &jit_buf};
+    m.wrapped_function(arg_values);
+    if (c_pipeline(&a_buf, &b_buf, d, &c_buf) != 0) {
+      printf("The C pipeline failed\n");
+      return 1;
+    }
+    for (int i = 0; i < size; i++) {
+      if (c_out[i] != jit_out[i]) {
+        printf("With d = %d, out[%d] is %d in C and %d in the jit\n", d, i,
+               c_out[i], jit_out[i]);
+        return 1;
+      }
+    }
+  }
+  printf("Success!\n");
+  return 0;
+}
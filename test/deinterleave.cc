@@ -0,0 +1,182 @@
+#include <cstdio>
+#include <vector>
+
+#include "jmlang/Base/buffer_t.h"
+#include "jmlang/IR/IROperator.h"
+#include "jmlang/IR/IRVisitor.h"
+#include "jmlang/JIT/Interpreter.h"
+#include "jmlang/Optimizer/Deinterleave.h"
+
+using namespace jmlang;
+using namespace jmlang::internal;
+
+// Checks that rewrite_interleavings turns groups of loads with a
+// stride of 2, 3 or 4, and runs of stores to every channel, into
+// dense loads and stores, and that the statements it makes compute
+// the same as the ones it was given.
+
+namespace {
+
+const int width = 8;
+const int iterations = 4;
+const int size = width * 4 * iterations;
+
+/// Count the loads and stores with a stride of more than one.
+class CountStrided : public IRVisitor {
+ public:
+  int loads, stores;
+
+  CountStrided() : loads(0), stores(0) {}
+
+ private:
+  using IRVisitor::visit;
+
+  bool strided(Expr index) {
+    const Ramp* ramp = index.as<Ramp>();
+    const int* stride = ramp ? as_const_int(ramp->stride) : nullptr;
+    return stride && *stride > 1;
+  }
+
+  void visit(const Load* op) {
+    loads += strided(op->index);
+    IRVisitor::visit(op);
+  }
+
+  void visit(const Store* op) {
+    stores += strided(op->index);
+    IRVisitor::visit(op);
+  }
+};
+
+Expr x = Variable::make(Int(32), "x");
+
+/// The lanes of one channel of interleaved pixels, or of dense data
+/// if stride is 1.
+Expr channel(int stride, int c) {
+  return Ramp::make(x * (width * stride) + c, stride, width);
+}
+
+Expr load(const std::string& name, Expr index) {
+  return Load::make(Int(32, width), name, index, Buffer(), Parameter());
+}
+
+Stmt loop(Stmt body) {
+  return For::make("x", 0, iterations, For::Serial, body);
+}
+
+/// out = the sum of the channels of in, weighted, with the channels
+/// loaded in reverse.
+Stmt sum_channels(int stride) {
+  Expr sum;
+  for (int c = stride - 1; c >= 0; c--) {
+    Expr value = load("in", channel(stride, c)) * (c + 1);
+    sum = sum.defined() ? sum + value : value;
+  }
+  return loop(Store::make("out", sum, channel(1, 0)));
+}
+
+/// Write each channel of out from in, in the given order of
+/// channels.
+Stmt split_channels(int stride, const int* order) {
+  Stmt s;
+  for (int i = stride - 1; i >= 0; i--) {
+    int c = order[i];
+    Stmt store = Store::make("out", load("in", channel(1, 0)) * (c + 1) + c,
+                             channel(stride, c));
+    s = s.defined() ? Block::make(store, s) : store;
+  }
+  return loop(s);
+}
+
+/// Turn rgb into bgr.
+Stmt swap_channels() {
+  Stmt s;
+  for (int c = 2; c >= 0; c--) {
+    Stmt store = Store::make("out", load("in", channel(3, 2 - c)),
+                             channel(3, c));
+    s = s.defined() ? Block::make(store, s) : store;
+  }
+  return loop(s);
+}
+
+/// Turn rgb into bgr in place, one channel after another, so that
+/// the stores can't be combined.
+Stmt swap_in_place() {
+  Stmt s;
+  for (int c = 2; c >= 0; c--) {
+    Stmt store = Store::make("out", load("out", channel(3, 2 - c)) + 1,
+                             channel(3, c));
+    s = s.defined() ? Block::make(store, s) : store;
+  }
+  return loop(s);
+}
+
+buffer_t make_buffer(int32_t* host) {
+  buffer_t b = {0};
+  b.host = (uint8_t*)host;
+  b.extent[0] = size;
+  b.stride[0] = 1;
+  b.elem_size = sizeof(int32_t);
+  return b;
+}
+
+std::vector<int32_t> run(Stmt s) {
+  std::vector<Argument> args;
+  args.push_back(Argument("in", true, Int(32)));
+  args.push_back(Argument("out", true, Int(32)));
+  std::vector<int32_t> in(size), out(size);
+  for (int i = 0; i < size; i++) {
+    in[i] = i * 7 + 3;
+    out[i] = i * 5 + 1;
+  }
+  buffer_t in_buf = make_buffer(&in[0]);
+  buffer_t out_buf = make_buffer(&out[0]);
+  const void* arg_values[] = {&in_buf, &out_buf};
+  Interpreter(s, args).run(arg_values);
+  return out;
+}
+
+/// Rewrite a statement, check how many strided loads and stores are
+/// left, and that it still computes the same.
+bool check(const char* name, Stmt s, int loads, int stores) {
+  Stmt rewritten = rewrite_interleavings(s);
+  CountStrided count;
+  rewritten.accept(&count);
+  if (count.loads != loads || count.stores != stores) {
+    printf("%s: %d strided loads and %d strided stores left, instead of "
+           "%d and %d\n",
+           name, count.loads, count.stores, loads, stores);
+    return false;
+  }
+  std::vector<int32_t> expected = run(s), actual = run(rewritten);
+  for (int i = 0; i < size; i++) {
+    if (actual[i] != expected[i]) {
+      printf("%s: out[%d] = %d instead of %d\n", name, i, actual[i],
+             expected[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  const int in_order[] = {0, 1, 2, 3};
+  const int out_of_order[] = {2, 0, 3, 1};
+  for (int stride = 2; stride <= 4; stride++) {
+    if (!check("sum_channels", sum_channels(stride), 0, 0) ||
+        !check("split_channels", split_channels(stride, in_order), 0, 0)) {
+      return 1;
+    }
+  }
+  const int rgb_order[] = {1, 2, 0};
+  if (!check("split_channels", split_channels(3, rgb_order), 0, 0) ||
+      !check("split_channels", split_channels(4, out_of_order), 0, 0) ||
+      !check("swap_channels", swap_channels(), 0, 0) ||
+      !check("swap_in_place", swap_in_place(), 0, 3)) {
+    return 1;
+  }
+  printf("Success!\n");
+  return 0;
+}
@@ -0,0 +1,183 @@
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+#include "jmlang/Base/buffer_t.h"
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/IR/IROperator.h"
+
+using namespace jmlang;
+using namespace jmlang::internal;
+
+// Checks that integer division and modulo, which codegen does with
+// multiplies and shifts when the divisor is a constant or a Param,
+// round down as div_imp and mod_imp do, for scalars and vectors of
+// every integer type up to 32 bits.
+
+namespace {
+
+template <typename T>
+int64_t min_value() {
+  return std::numeric_limits<T>::min();
+}
+
+template <typename T>
+int64_t max_value() {
+  return std::numeric_limits<T>::max();
+}
+
+/// The results of dividing each of a set of values by one divisor.
+template <typename T>
+struct Results {
+  std::vector<T> div, mod;
+};
+
+buffer_t make_buffer(void* host, int size, int elem_size) {
+  buffer_t b = {0};
+  b.host = (uint8_t*)host;
+  b.extent[0] = size;
+  b.stride[0] = 1;
+  b.elem_size = elem_size;
+  return b;
+}
+
+/// Compute div[x] = a[x] / d and mod[x] = a[x] % d, width lanes at a
+/// time, where d is a constant, or a Param if param is set.
+template <typename T>
+Results<T> run(const std::vector<T>& a, int64_t divisor, bool param,
+               int width) {
+  Type t = type_of<T>();
+  Expr x = Variable::make(Int(32), "x");
+  Expr index = width == 1 ? x : Ramp::make(x * width, 1, width);
+  Expr value =
+      Load::make(t.vector_of(width), "a", index, Buffer(), Parameter());
+  Expr d = param ? Variable::make(t, "d", Parameter(t, false, "d"))
+                 : make_const(t, (int)divisor);
+  if (width > 1) {
+    d = Broadcast::make(d, width);
+  }
+  Stmt body = Block::make(Store::make("div", value / d, index),
+                          Store::make("mod", value % d, index));
+  Stmt s = For::make("x", 0, (int)a.size() / width, For::Serial, body);
+
+  std::vector<Argument> args;
+  args.push_back(Argument("a", true, t));
+  args.push_back(Argument("div", true, t));
+  args.push_back(Argument("mod", true, t));
+  if (param) {
+    args.push_back(Argument("d", false, t));
+  }
+  CodeGen cg;
+  cg.compile(s, "div_mod", args);
+  JITModule m = cg.compile_to_function_pointers();
+
+  int n = (int)a.size();
+  std::vector<T> a_copy = a;
+  Results<T> results;
+  results.div.resize(n);
+  results.mod.resize(n);
+  buffer_t a_buf = make_buffer(&a_copy[0], n, sizeof(T));
+  buffer_t div_buf = make_buffer(&results.div[0], n, sizeof(T));
+  buffer_t mod_buf = make_buffer(&results.mod[0], n, sizeof(T));
+  T d_value = (T)divisor;
+  const void* arg_values[] = {&a_buf, &div_buf, &mod_buf, &d_value};
+  m.wrapped_function(arg_values);
+  return results;
+}
+
+/// Some values of a type: all of them for 8 and 16 bits, or the
+/// extremes and a spread in between for 32 bits.
+template <typename T>
+std::vector<T> values() {
+  Type t = type_of<T>();
+  std::vector<T> v;
+  if (t.bits < 32) {
+    for (int64_t i = min_value<T>(); i <= max_value<T>(); i++) {
+      v.push_back((T)i);
+    }
+  } else {
+    int64_t extremes[] = {min_value<T>(), min_value<T>() + 1, -7, -1, 0, 1, 7,
+                          max_value<T>() - 1, max_value<T>()};
+    for (int64_t e : extremes) {
+      v.push_back((T)e);
+    }
+    uint32_t r = 12345;
+    for (int i = 0; i < 20000; i++) {
+      r = r * 1664525u + 1013904223u;
+      v.push_back((T)(i % 2 ? r : r >> (i % 31)));
+    }
+  }
+  while (v.size() % 8) {
+    v.push_back(0);
+  }
+  return v;
+}
+
+template <typename T>
+bool check(int64_t divisor) {
+  Type t = type_of<T>();
+  std::vector<T> a = values<T>();
+  if (divisor == -1) {
+    // The smallest value over -1 overflows.
+    for (size_t i = 0; i < a.size(); i++) {
+      if ((int64_t)a[i] == min_value<T>()) {
+        a[i] = 0;
+      }
+    }
+  }
+
+  for (int param = 0; param < 2; param++) {
+    for (int width = 1; width <= 8; width += 7) {
+      Results<T> r = run<T>(a, divisor, param, width);
+      for (size_t i = 0; i < a.size(); i++) {
+        int64_t n = a[i];
+        int64_t q = n / divisor;
+        if (n % divisor != 0 && (n < 0) != (divisor < 0)) {
+          q--;
+        }
+        T div = (T)q, mod = (T)(n - q * divisor);
+        if (r.div[i] != div || r.mod[i] != mod) {
+          printf("%s%d: %lld / %s %lld, %d lanes = %lld, %% = %lld "
+                 "instead of %lld, %lld\n",
+                 t.is_int() ? "int" : "uint", t.bits, (long long)n,
+                 param ? "param" : "constant", (long long)divisor, width,
+                 (long long)r.div[i], (long long)r.mod[i], (long long)div,
+                 (long long)mod);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+template <typename T>
+bool check_all() {
+  Type t = type_of<T>();
+  std::vector<int64_t> divisors = {1, 2, 3, 7, 10, 100, max_value<T>() - 1,
+                                   max_value<T>()};
+  if (t.is_int()) {
+    int64_t negative[] = {-1, -2, -3, -7, min_value<T>() + 1, min_value<T>()};
+    divisors.insert(divisors.end(), negative, negative + 6);
+  } else {
+    divisors.push_back((int64_t)1 << (t.bits - 1));
+  }
+  for (int64_t d : divisors) {
+    if (!check<T>(d)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  if (!check_all<int8_t>() || !check_all<int16_t>() ||
+      !check_all<int32_t>() || !check_all<uint8_t>() ||
+      !check_all<uint16_t>() || !check_all<uint32_t>()) {
+    return 1;
+  }
+  printf("Success!\n");
+  return 0;
+}
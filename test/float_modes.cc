@@ -0,0 +1,131 @@
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/IR/IROperator.h"
+
+using namespace jmlang;
+using namespace jmlang::internal;
+
+// Checks that each function's floating-point operations get the fast
+// math flags of its own mode, or of the target's if it has none, and
+// not those of the function it is computed in.
+
+namespace {
+
+const char* mode_name(FloatMode mode) {
+  switch (mode) {
+    case FloatStrict:
+      return "strict";
+    case FloatContract:
+      return "contract";
+    case FloatFast:
+      return "fast";
+    default:
+      return "default";
+  }
+}
+
+/// The mode the flags of an instruction give it.
+FloatMode mode_of(const llvm::Instruction& inst) {
+  llvm::FastMathFlags flags = inst.getFastMathFlags();
+  if (flags.isFast()) {
+    return FloatFast;
+  } else if (flags.allowContract()) {
+    return FloatContract;
+  }
+  return flags.any() ? FloatDefault : FloatStrict;
+}
+
+/// For each x, f = a[x] * 3 is computed, and then g[x] = f + 5, so
+/// that f's operation is a multiply and g's an add.
+Stmt pipeline() {
+  Expr x = Variable::make(Int(32), "g.s0.x");
+  Expr a = Load::make(Float(32), "a", x, Buffer(), Parameter());
+  Expr f = Load::make(Float(32), "f", 0, Buffer(), Parameter());
+  Stmt s = Pipeline::make("f", Store::make("f", a * 3.0f, 0), Stmt(),
+                          Store::make("g", f + 5.0f, x));
+  s = Allocate::make("f", Float(32), 1, s);
+  return For::make("g.s0.x", 0, 64, For::Serial, s);
+}
+
+/// Compile the pipeline for a target in the given mode, with the
+/// given modes for f and g, and check the modes of f's multiplies
+/// and g's adds.
+bool check(FloatMode target_mode,
+           const std::map<std::string, FloatMode>& modes, FloatMode f_mode,
+           FloatMode g_mode) {
+  Target target = get_host_target();
+  target.features &= ~((uint64_t)1 << Target::FastMath);
+  target.features &= ~((uint64_t)1 << Target::FPContract);
+  if (target_mode == FloatFast) {
+    target.features |= (uint64_t)1 << Target::FastMath;
+  } else if (target_mode == FloatContract) {
+    target.features |= (uint64_t)1 << Target::FPContract;
+  }
+
+  std::vector<Argument> args;
+  args.push_back(Argument("a", true, Float(32)));
+  args.push_back(Argument("g", true, Float(32)));
+  CodeGen cg(target);
+  cg.set_float_modes(modes);
+  cg.compile(pipeline(), "float_modes", args);
+  std::unique_ptr<llvm::Module> module(cg.release_module());
+  std::unique_ptr<llvm::LLVMContext> context(&module->getContext());
+
+  int multiplies = 0, adds = 0;
+  bool ok = true;
+  for (llvm::Function& function : *module) {
+    for (llvm::Instruction& inst : llvm::instructions(function)) {
+      bool multiply = inst.getOpcode() == llvm::Instruction::FMul;
+      if (!multiply && inst.getOpcode() != llvm::Instruction::FAdd) {
+        continue;
+      }
+      (multiply ? multiplies : adds)++;
+      FloatMode expected = multiply ? f_mode : g_mode;
+      if (mode_of(inst) != expected) {
+        printf("With a %s target, %s's %s is %s instead of %s\n",
+               mode_name(target_mode), multiply ? "f" : "g",
+               multiply ? "multiply" : "add", mode_name(mode_of(inst)),
+               mode_name(expected));
+        ok = false;
+      }
+    }
+  }
+  module.reset();
+  if (!multiplies || !adds) {
+    printf("With a %s target, found %d multiplies and %d adds\n",
+           mode_name(target_mode), multiplies, adds);
+    return false;
+  }
+  return ok;
+}
+
+}  // namespace
+
+int main() {
+  std::map<std::string, FloatMode> g_fast, g_contract, g_strict, f_default;
+  g_fast["g"] = FloatFast;
+  g_contract["g"] = FloatContract;
+  g_strict["g"] = FloatStrict;
+  f_default["f"] = FloatDefault;
+  f_default["g"] = FloatFast;
+
+  if (!check(FloatStrict, g_fast, FloatStrict, FloatFast) ||
+      !check(FloatStrict, g_contract, FloatStrict, FloatContract) ||
+      !check(FloatFast, g_strict, FloatFast, FloatStrict) ||
+      !check(FloatContract, f_default, FloatContract, FloatFast) ||
+      !check(FloatContract, std::map<std::string, FloatMode>(),
+             FloatContract, FloatContract)) {
+    return 1;
+  }
+  printf("Success!\n");
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include <malloc.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Checks the default allocator: where the size classes start and
+// end, the alignment and header of blocks, which freed blocks are
+// reused, and that trimming, or turning the cache off with
+// JMLANG_ALLOCATOR_CACHE_MB=0, gives blocks back to the C library.
+
+extern "C" {
+void* jmlang_default_malloc(size_t size);
+void jmlang_default_free(void* ptr);
+void jmlang_trim_allocator();
+}
+
+namespace {
+
+/// The number of blocks the allocator has asked the C library for.
+int allocations = 0;
+
+/// As in posix_allocator.cc, in front of each block.
+struct Header {
+  void* base;
+  int size_class;
+};
+
+const int uncached = 97;
+const size_t gigabyte = (size_t)1 << 30;
+
+Header* header(void* ptr) { return (Header*)ptr - 1; }
+
+/// Allocate a block, and check its alignment and header.
+void* allocate(size_t size, int size_class, bool* ok) {
+  void* ptr = jmlang_default_malloc(size);
+  size_t align = size >= 65536 ? 4096 : 64;
+  if (!ptr || (uintptr_t)ptr % align ||
+      (uint8_t*)ptr - (uint8_t*)header(ptr)->base != (ptrdiff_t)align ||
+      header(ptr)->size_class != size_class) {
+    printf("Bad block of %zu bytes\n", size);
+    *ok = false;
+  }
+  return ptr;
+}
+
+/// Free a block of a size, and allocate one of another, checking
+/// whether the first was reused.
+bool check_reuse(size_t first, size_t second, bool reused) {
+  bool ok = true;
+  jmlang_trim_allocator();
+  void* p = jmlang_default_malloc(first);
+  jmlang_default_free(p);
+  int before = allocations;
+  void* q = jmlang_default_malloc(second);
+  if ((allocations == before) != reused || (reused && p != q)) {
+    printf("A block of %zu bytes %s reused for one of %zu\n", first,
+           reused ? "wasn't" : "was", second);
+    ok = false;
+  }
+  jmlang_default_free(q);
+  return ok;
+}
+
+}  // namespace
+
+/// The allocator's blocks come from here, so that the test can count
+/// them.
+extern "C" void* aligned_alloc(size_t alignment, size_t size) {
+  allocations++;
+  return memalign(alignment, size);
+}
+
+int main() {
+  // Big enough for a gigabyte block, unless the cache is off.
+  setenv("JMLANG_ALLOCATOR_CACHE_MB", "2048", 0);
+  bool cached = atoi(getenv("JMLANG_ALLOCATOR_CACHE_MB")) > 0;
+
+  bool ok = true;
+  struct {
+    size_t size;
+    int size_class;
+  } classes[] = {{0, 0},        {1, 0},         {64, 0},
+                 {65, 1},       {128, 4},       {129, 5},
+                 {65536, 40},   {65537, 41},    {gigabyte, 96},
+                 {gigabyte + 1, uncached}};
+  for (auto c : classes) {
+    void* p = allocate(c.size, c.size_class, &ok);
+    if (c.size <= 65537) {
+      memset(p, 1, c.size);
+    }
+    jmlang_default_free(p);
+  }
+  jmlang_default_free(nullptr);
+  jmlang_trim_allocator();
+
+  // Blocks are reused for sizes in the same class only, and not at all
+  // above a gigabyte.
+  ok = check_reuse(64, 1, cached) && ok;
+  ok = check_reuse(64, 65, false) && ok;
+  ok = check_reuse(129, 160, cached) && ok;
+  ok = check_reuse(128, 129, false) && ok;
+  ok = check_reuse(gigabyte, gigabyte - 4096, cached) && ok;
+  ok = check_reuse(gigabyte + 1, gigabyte + 1, false) && ok;
+
+  // Trimming empties the cache.
+  jmlang_default_free(jmlang_default_malloc(1000));
+  jmlang_trim_allocator();
+  int before = allocations;
+  jmlang_default_free(jmlang_default_malloc(1000));
+  if (allocations == before) {
+    printf("A block was reused after trimming\n");
+    ok = false;
+  }
+
+  // Blocks moving between threads, and threads exiting with blocks in
+  // their caches.
+  std::vector<std::thread> threads;
+  std::vector<void*> handed_over[4];
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([t, &handed_over]() {
+      std::vector<void*> live;
+      for (int i = 0; i < 5000; i++) {
+        size_t size = (size_t)((i * 2654435761u + t) % 300000);
+        void* p = jmlang_default_malloc(size);
+        memset(p, t, size < 256 ? size : 256);
+        live.push_back(p);
+        if (live.size() > 8) {
+          jmlang_default_free(live.front());
+          live.erase(live.begin());
+        }
+      }
+      handed_over[t] = live;
+    });
+  }
+  for (int t = 0; t < 4; t++) {
+    threads[t].join();
+    for (void* p : handed_over[t]) {
+      jmlang_default_free(p);
+    }
+  }
+  jmlang_trim_allocator();
+
+  if (!ok) {
+    return 1;
+  }
+  printf("Success!\n");
+  return 0;
+}
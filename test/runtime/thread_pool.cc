@@ -0,0 +1,147 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Checks the thread pool: that nested loops of uneven iterations run
+// each iteration exactly once, that errors are returned, that the
+// pool starts again after being shut down, that several threads can
+// start loops at once, and that loops keep to their thread limit.
+
+extern "C" {
+int jmlang_do_par_for(int (*f)(int, uint8_t*), int min, int size,
+                      uint8_t* closure);
+void jmlang_set_par_for_options(int max_threads, int priority);
+void jmlang_shutdown_thread_pool();
+}
+
+namespace {
+
+const int outer_size = 300;
+const int inner_size = 100;
+
+struct Counts {
+  std::atomic<int> outer[outer_size];
+  std::atomic<long> inner_sum;
+
+  Counts() : inner_sum(0) {
+    for (int i = 0; i < outer_size; i++) {
+      outer[i] = 0;
+    }
+  }
+};
+
+/// Work that takes longer for some iterations than others.
+void spin(int n) {
+  volatile double x = 0;
+  for (int k = 0; k < n; k++) {
+    x += k;
+  }
+}
+
+int inner(int i, uint8_t* closure) {
+  ((Counts*)closure)->inner_sum += i;
+  spin((i % 7) * 200);
+  return 0;
+}
+
+int outer(int i, uint8_t* closure) {
+  ((Counts*)closure)->outer[i]++;
+  if (i % 13 == 0) {
+    spin(100000);
+  }
+  return jmlang_do_par_for(inner, 0, inner_size, closure);
+}
+
+bool check_nested(const char* name) {
+  Counts counts;
+  int result = jmlang_do_par_for(outer, 0, outer_size, (uint8_t*)&counts);
+  if (result != 0) {
+    printf("%s: returned %d\n", name, result);
+    return false;
+  }
+  for (int i = 0; i < outer_size; i++) {
+    if (counts.outer[i] != 1) {
+      printf("%s: iteration %d ran %d times\n", name, i,
+             counts.outer[i].load());
+      return false;
+    }
+  }
+  long expected = (long)outer_size * inner_size * (inner_size - 1) / 2;
+  if (counts.inner_sum != expected) {
+    printf("%s: inner loops summed to %ld instead of %ld\n", name,
+           counts.inner_sum.load(), expected);
+    return false;
+  }
+  return true;
+}
+
+int failing(int i, uint8_t*) { return i == 77 ? -5 : 0; }
+
+int failing_outer(int i, uint8_t*) {
+  return i == 3 ? jmlang_do_par_for(failing, 0, 200, nullptr) : 0;
+}
+
+std::atomic<int> running(0), peak(0);
+
+int limited(int, uint8_t*) {
+  int r = ++running;
+  int p = peak;
+  while (r > p && !peak.compare_exchange_weak(p, r)) {
+  }
+  spin(20000);
+  --running;
+  return 0;
+}
+
+}  // namespace
+
+int main() {
+  for (int rep = 0; rep < 5; rep++) {
+    if (!check_nested("nested")) {
+      return 1;
+    }
+  }
+
+  if (jmlang_do_par_for(failing, 0, 200, nullptr) != -5 ||
+      jmlang_do_par_for(failing_outer, 0, 10, nullptr) != -5) {
+    printf("Errors weren't returned\n");
+    return 1;
+  }
+
+  jmlang_shutdown_thread_pool();
+  if (!check_nested("after shutdown")) {
+    return 1;
+  }
+
+  std::atomic<bool> ok(true);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&ok]() {
+      for (int k = 0; k < 3; k++) {
+        ok = check_nested("concurrent") && ok;
+      }
+    });
+  }
+  for (size_t t = 0; t < threads.size(); t++) {
+    threads[t].join();
+  }
+  if (!ok) {
+    return 1;
+  }
+
+  jmlang_set_par_for_options(2, 0);
+  for (int rep = 0; rep < 5; rep++) {
+    jmlang_do_par_for(limited, 0, 2000, nullptr);
+  }
+  jmlang_set_par_for_options(0, 0);
+  if (peak > 2) {
+    printf("%d threads ran a loop limited to 2\n", peak.load());
+    return 1;
+  }
+
+  jmlang_shutdown_thread_pool();
+  printf("Success!\n");
+  return 0;
+}
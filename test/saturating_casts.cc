@@ -0,0 +1,145 @@
+#include <cstdio>
+#include <vector>
+
+#include "jmlang/Base/buffer_t.h"
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/IR/IROperator.h"
+
+using namespace jmlang;
+using namespace jmlang::internal;
+
+// Checks that narrowing casts of clamped adds and subtracts, which
+// codegen turns into saturating vector instructions, give the same
+// results as the scalar arithmetic they stand for, for signed and
+// unsigned results.
+
+namespace {
+
+const int width = 16;
+
+buffer_t make_buffer(void* host, int size, int elem_size) {
+  buffer_t b = {0};
+  b.host = (uint8_t*)host;
+  b.extent[0] = size;
+  b.stride[0] = 1;
+  b.elem_size = elem_size;
+  return b;
+}
+
+/// out[i] = f(a[i], b[i]), computed width lanes at a time.
+template <typename T>
+std::vector<T> run(Expr (*f)(Expr, Expr), const std::vector<T>& a,
+                   const std::vector<T>& b) {
+  Type t = type_of<T>();
+  Expr x = Variable::make(Int(32), "x");
+  Expr index = Ramp::make(x * width, 1, width);
+  Expr la = Load::make(t.vector_of(width), "a", index, Buffer(), Parameter());
+  Expr lb = Load::make(t.vector_of(width), "b", index, Buffer(), Parameter());
+  Stmt s = For::make("x", 0, (int)a.size() / width, For::Serial,
+                     Store::make("out", f(la, lb), index));
+  std::vector<Argument> args;
+  args.push_back(Argument("a", true, t));
+  args.push_back(Argument("b", true, t));
+  args.push_back(Argument("out", true, t));
+  CodeGen cg;
+  cg.compile(s, "saturate", args);
+  JITModule m = cg.compile_to_function_pointers();
+
+  std::vector<T> a_copy = a, b_copy = b, out(a.size());
+  int n = (int)a.size();
+  buffer_t ab = make_buffer(&a_copy[0], n, sizeof(T));
+  buffer_t bb = make_buffer(&b_copy[0], n, sizeof(T));
+  buffer_t ob = make_buffer(&out[0], n, sizeof(T));
+  const void* arg_values[] = {&ab, &bb, &ob};
+  m.wrapped_function(arg_values);
+  return out;
+}
+
+template <typename T>
+Expr widen(Expr e) {
+  return cast(Int(sizeof(T) * 16, e.type().width), e);
+}
+
+template <typename T>
+Expr clamped_add(Expr a, Expr b) {
+  Type t = type_of<T>();
+  return cast(t.vector_of(width), clamp(widen<T>(a) + widen<T>(b),
+                                        (int)t.imin(), (int)t.imax()));
+}
+
+template <typename T>
+Expr clamped_sub(Expr a, Expr b) {
+  Type t = type_of<T>();
+  return cast(t.vector_of(width), clamp(widen<T>(a) - widen<T>(b),
+                                        (int)t.imin(), (int)t.imax()));
+}
+
+/// Clamped on one side only, which only saturates if the result is
+/// unsigned.
+template <typename T>
+Expr add_below_max(Expr a, Expr b) {
+  Type t = type_of<T>();
+  return cast(t.vector_of(width), min(widen<T>(a) + widen<T>(b),
+                                      (int)t.imax()));
+}
+
+template <typename T>
+Expr sub_above_min(Expr a, Expr b) {
+  Type t = type_of<T>();
+  return cast(t.vector_of(width), max(widen<T>(a) - widen<T>(b),
+                                      (int)t.imin()));
+}
+
+template <typename T>
+bool check(const char* name, Expr (*f)(Expr, Expr), int op, int clamp_lo,
+           int clamp_hi) {
+  Type t = type_of<T>();
+  std::vector<T> a, b;
+  // Every pair of 8-bit values, or a spread of 16-bit ones.
+  int step = t.bits == 8 ? 1 : 257;
+  for (int i = (int)t.imin(); i <= (int)t.imax(); i += step) {
+    for (int j = (int)t.imin(); j <= (int)t.imax(); j += step) {
+      a.push_back((T)i);
+      b.push_back((T)j);
+    }
+  }
+  while (a.size() % width) {
+    a.push_back(0);
+    b.push_back(0);
+  }
+  std::vector<T> out = run<T>(f, a, b);
+  for (size_t i = 0; i < a.size(); i++) {
+    int wide = op > 0 ? (int)a[i] + (int)b[i] : (int)a[i] - (int)b[i];
+    if (clamp_hi && wide > (int)t.imax()) {
+      wide = (int)t.imax();
+    }
+    if (clamp_lo && wide < (int)t.imin()) {
+      wide = (int)t.imin();
+    }
+    if (out[i] != (T)wide) {
+      printf("%s(%d, %d) = %d instead of %d\n", name, (int)a[i], (int)b[i],
+             (int)out[i], (int)(T)wide);
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T>
+bool check_all() {
+  return check<T>("clamped_add", clamped_add<T>, 1, 1, 1) &&
+         check<T>("clamped_sub", clamped_sub<T>, -1, 1, 1) &&
+         check<T>("add_below_max", add_below_max<T>, 1, 0, 1) &&
+         check<T>("sub_above_min", sub_above_min<T>, -1, 1, 0);
+}
+
+}  // namespace
+
+int main() {
+  if (!check_all<uint8_t>() || !check_all<int8_t>() ||
+      !check_all<uint16_t>() || !check_all<int16_t>()) {
+    return 1;
+  }
+  printf("Success!\n");
+  return 0;
+}
@@ -0,0 +1,172 @@
+#include <cstdio>
+#include <vector>
+
+#include "jmlang/Base/buffer_t.h"
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/IR/IROperator.h"
+#include "jmlang/IR/IRVisitor.h"
+#include "jmlang/Optimizer/ShareAllocations.h"
+
+using namespace jmlang;
+using namespace jmlang::internal;
+
+// Checks that share_allocations puts buffers with disjoint lifetimes
+// in the same slot and keeps overlapping ones apart, by running
+// statements before and after the pass, and that it doesn't make an
+// arena too big to index with 32-bit ints.
+
+namespace {
+
+/// The names of the Allocates in a statement.
+class FindAllocates : public IRVisitor {
+ public:
+  std::vector<std::string> names;
+
+ private:
+  using IRVisitor::visit;
+
+  void visit(const Allocate* op) {
+    names.push_back(op->name);
+    IRVisitor::visit(op);
+  }
+};
+
+std::vector<std::string> allocates(Stmt s) {
+  FindAllocates f;
+  s.accept(&f);
+  return f.names;
+}
+
+Expr x = Variable::make(Int(32), "x");
+
+/// name[x] = in[x] * k
+Stmt produce(const std::string& name, Expr size, int k) {
+  Expr in = Load::make(Float(32), "in", x, Buffer(), Parameter());
+  return For::make("x", 0, size, For::Serial,
+                   Store::make(name, in * (float)k, x));
+}
+
+/// out[x] += name[x]
+Stmt consume(const std::string& name, Expr size) {
+  Expr out = Load::make(Float(32), "out", x, Buffer(), Parameter());
+  Expr value = Load::make(Float(32), name, x, Buffer(), Parameter());
+  return For::make("x", 0, size, For::Serial,
+                   Store::make("out", out + value, x));
+}
+
+Stmt allocate(const std::string& name, Expr size, Stmt body) {
+  return Allocate::make(name, Float(32), size,
+                        Block::make(body, Free::make(name)));
+}
+
+/// a and b are used one after the other. c is live around both.
+Stmt make_pipeline(Expr size, bool with_c) {
+  Stmt a = Block::make(produce("a", size, 2), consume("a", size));
+  Stmt b = Block::make(produce("b", size, 3), consume("b", size));
+  Stmt s = Block::make(allocate("a", size, a), allocate("b", size, b));
+  if (with_c) {
+    s = allocate("c", size,
+                 Block::make(produce("c", size, 5),
+                             Block::make(s, consume("c", size))));
+  }
+  return s;
+}
+
+buffer_t make_buffer(void* host, int size) {
+  buffer_t b = {0};
+  b.host = (uint8_t*)host;
+  b.extent[0] = size;
+  b.stride[0] = 1;
+  b.elem_size = sizeof(float);
+  return b;
+}
+
+/// Run a statement over in and n, returning its error code and its
+/// output in out.
+int run(Stmt s, int n, std::vector<float>* out) {
+  std::vector<Argument> args;
+  args.push_back(Argument("in", true, Float(32)));
+  args.push_back(Argument("out", true, Float(32)));
+  args.push_back(Argument("n", false, Int(32)));
+  CodeGen cg;
+  cg.compile(s, "share", args);
+  JITModule m = cg.compile_to_function_pointers();
+  m.set_error_handler([](const char*) {});
+
+  int size = (int)out->size();
+  std::vector<float> in(size);
+  for (int i = 0; i < size; i++) {
+    in[i] = (float)i;
+  }
+  out->assign(size, 0.0f);
+  buffer_t in_buf = make_buffer(&in[0], size);
+  buffer_t out_buf = make_buffer(&(*out)[0], size);
+  const void* arg_values[] = {&in_buf, &out_buf, &n};
+  return m.wrapped_function(arg_values);
+}
+
+bool check_shared(const char* name, bool with_c, size_t expected_allocates) {
+  Expr n = Variable::make(Int(32), "n");
+  Stmt s = make_pipeline(n, with_c);
+  Stmt shared = share_allocations(s);
+  std::vector<std::string> names = allocates(shared);
+  if (names.size() != expected_allocates) {
+    printf("%s: %d allocations instead of %d\n", name, (int)names.size(),
+           (int)expected_allocates);
+    return false;
+  }
+
+  const int size = 1000;
+  std::vector<float> expected(size), out(size);
+  if (run(s, size, &expected) != 0 || run(shared, size, &out) != 0) {
+    printf("%s: failed to run\n", name);
+    return false;
+  }
+  for (int i = 0; i < size; i++) {
+    if (out[i] != expected[i]) {
+      printf("%s: out[%d] = %f instead of %f\n", name, i, out[i], expected[i]);
+      return false;
+    }
+  }
+
+  // Too big for the arena, which must fail before anything touches
+  // it. The buffers are 2GB each.
+  out.resize(1);
+  if (run(shared, 1 << 29, &out) == 0) {
+    printf("%s: didn't catch the arena overflowing\n", name);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  // a and b share a slot, so the arena is the only allocation.
+  if (!check_shared("disjoint", false, 1)) {
+    return 1;
+  }
+  // a and b share a slot, and c gets its own.
+  if (!check_shared("overlapping", true, 1)) {
+    return 1;
+  }
+
+  // Two buffers that are live at the same time, with known sizes that
+  // add up to more than 2^31 bytes, are left alone.
+  Stmt s = make_pipeline(3 << 27, true);
+  std::vector<std::string> names = allocates(share_allocations(s));
+  if (names.size() != 3) {
+    printf("Shared allocations that overflow the arena\n");
+    return 1;
+  }
+  // But if they're used one after the other, they fit in one slot.
+  s = make_pipeline(3 << 27, false);
+  names = allocates(share_allocations(s));
+  if (names.size() != 1 || names[0] == "a" || names[0] == "b") {
+    printf("Didn't share disjoint allocations of known size\n");
+    return 1;
+  }
+
+  printf("Success!\n");
+  return 0;
+}
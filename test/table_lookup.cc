@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <vector>
+
+#include "jmlang/Base/buffer_t.h"
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/IR/IROperator.h"
+
+using namespace jmlang;
+using namespace jmlang::internal;
+
+// Checks loads whose lanes all fall in a small window, which codegen
+// does with a dense load and a permute rather than a gather: lookups
+// into tables of up to 256 entries of each width of element, starting
+// on and off the boundaries of the permute's pieces, and upsampling
+// loads of x / 2, whose window is loaded with a mask. Vectors of
+// several widths are checked on each set of permutes the target may
+// have, and against reading the table element by element.
+
+namespace {
+
+const int size = 1024;
+
+buffer_t make_buffer(void* host, int size, int elem_size) {
+  buffer_t b = {0};
+  b.host = (uint8_t*)host;
+  b.extent[0] = size;
+  b.stride[0] = 1;
+  b.elem_size = elem_size;
+  return b;
+}
+
+/// The kind of load, and where its window starts.
+struct Lookup {
+  /// The number of entries looked up in the table, or zero to load
+  /// table[x / 2] instead.
+  int entries;
+  int first;
+};
+
+/// out[x] = table[first + min(in[x], entries - 1)], or
+/// table[first + x / 2], width lanes at a time.
+template <typename T>
+bool check(const Target& target, Lookup lookup, int width) {
+  Type t = type_of<T>();
+  Expr x = Variable::make(Int(32), "x");
+  Expr index = Ramp::make(x * width, 1, width);
+  Expr entry;
+  if (lookup.entries) {
+    Expr in = Load::make(UInt(8, width), "in", index, Buffer(), Parameter());
+    entry = cast(Int(32, width), in);
+    if (lookup.entries < 256) {
+      entry = min(entry, lookup.entries - 1);
+    }
+  } else {
+    entry = index / 2;
+  }
+  if (lookup.first) {
+    entry = entry + lookup.first;
+  }
+  Expr value =
+      Load::make(t.vector_of(width), "table", entry, Buffer(), Parameter());
+  Stmt s = For::make("x", 0, size / width, For::Serial,
+                     Store::make("out", value, index));
+
+  std::vector<Argument> args;
+  args.push_back(Argument("in", true, UInt(8)));
+  args.push_back(Argument("table", true, t));
+  args.push_back(Argument("out", true, t));
+  CodeGen cg(target);
+  cg.compile(s, "table_lookup", args);
+  JITModule m = cg.compile_to_function_pointers();
+
+  // Big enough for either kind of load.
+  const int table_size = size / 2 + lookup.first;
+  std::vector<uint8_t> input(size);
+  std::vector<T> table(table_size), out(size);
+  for (int i = 0; i < size; i++) {
+    input[i] = (uint8_t)(i * 37 + i / 256);
+  }
+  for (int i = 0; i < table_size; i++) {
+    table[i] = (T)((uint64_t)(i + 1) * 0x9e3779b97f4a7c15ull);
+  }
+  buffer_t in_buf = make_buffer(&input[0], size, 1);
+  buffer_t table_buf = make_buffer(&table[0], table_size, sizeof(T));
+  buffer_t out_buf = make_buffer(&out[0], size, sizeof(T));
+  const void* arg_values[] = {&in_buf, &table_buf, &out_buf};
+  m.wrapped_function(arg_values);
+
+  for (int i = 0; i < size; i++) {
+    int e = i / 2;
+    if (lookup.entries) {
+      e = input[i] < lookup.entries ? input[i] : lookup.entries - 1;
+    }
+    e += lookup.first;
+    if (out[i] != table[e]) {
+      const char* kind = t.is_float() ? "float" : t.is_int() ? "int" : "uint";
+      printf("%s: ", target.to_string().c_str());
+      if (lookup.entries) {
+        printf("table of %d %s%d", lookup.entries, kind, t.bits);
+      } else {
+        printf("x / 2 of %s%d", kind, t.bits);
+      }
+      printf(" from %d, %d lanes: out[%d] is wrong\n", lookup.first, width, i);
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T>
+bool check_all(const Target& target) {
+  // Tables starting at zero, then part way into a piece, then
+  // upsampling.
+  Lookup lookups[] = {{10, 0},  {16, 0}, {48, 0}, {100, 0}, {200, 0},
+                      {256, 0}, {16, 5}, {48, 3}, {100, 9}, {256, 1},
+                      {256, 37}, {0, 0}, {0, 1},  {0, 6}};
+  int widths[] = {8, 16, 32, 64};
+  for (const Lookup& l : lookups) {
+    for (int w : widths) {
+      if (!check<T>(target, l, w)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  // The host, then without its widest vectors.
+  std::vector<Target> targets(1, get_host_target());
+  Target::Feature features[] = {Target::AVX512, Target::AVX2};
+  for (Target::Feature f : features) {
+    if (targets.back().has_feature(f)) {
+      Target t = targets.back();
+      t.features &= ~((uint64_t)1 << f);
+      targets.push_back(t);
+    }
+  }
+
+  for (const Target& t : targets) {
+    if (!check_all<uint8_t>(t) || !check_all<uint16_t>(t) ||
+        !check_all<int32_t>(t) || !check_all<float>(t) ||
+        !check_all<int64_t>(t)) {
+      return 1;
+    }
+  }
+  printf("Success!\n");
+  return 0;
+}
@@ -0,0 +1,304 @@
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "jmlang/Base/buffer_t.h"
+#include "jmlang/CodeGen/CodeGen.h"
+#include "jmlang/IR/IROperator.h"
+
+using namespace jmlang;
+using namespace jmlang::internal;
+
+// Checks the Float(32) transcendentals against double-precision libm,
+// over dense samples of the range each one documents, to within the
+// error it documents, and at zeros, denormals, infinities and nans.
+
+namespace {
+
+const int width = 8;
+
+typedef Expr (*Math)(Expr, Expr);
+typedef double (*Reference)(double, double);
+
+buffer_t make_buffer(void* host, int size) {
+  buffer_t b = {0};
+  b.host = (uint8_t*)host;
+  b.extent[0] = size;
+  b.stride[0] = 1;
+  b.elem_size = sizeof(float);
+  return b;
+}
+
+/// out[x] = f(a[x], b[x]), width lanes at a time.
+std::vector<float> run(Math f, std::vector<float> a, std::vector<float> b) {
+  Expr x = Variable::make(Int(32), "x");
+  Expr index = Ramp::make(x * width, 1, width);
+  Type t = Float(32, width);
+  Expr value = f(Load::make(t, "a", index, Buffer(), Parameter()),
+                 Load::make(t, "b", index, Buffer(), Parameter()));
+  int size = (int)a.size();
+  Stmt s = For::make("x", 0, size / width, For::Serial,
+                     Store::make("out", value, index));
+
+  std::vector<Argument> args;
+  args.push_back(Argument("a", true, Float(32)));
+  args.push_back(Argument("b", true, Float(32)));
+  args.push_back(Argument("out", true, Float(32)));
+  CodeGen cg;
+  cg.compile(s, "transcendental", args);
+  JITModule m = cg.compile_to_function_pointers();
+
+  std::vector<float> out(size);
+  buffer_t a_buf = make_buffer(&a[0], size);
+  buffer_t b_buf = make_buffer(&b[0], size);
+  buffer_t out_buf = make_buffer(&out[0], size);
+  const void* arg_values[] = {&a_buf, &b_buf, &out_buf};
+  m.wrapped_function(arg_values);
+  return out;
+}
+
+/// The spacing of floats at v, or at the largest float beyond it.
+double ulp(double v) {
+  v = std::fabs(v);
+  if (v < FLT_MIN) {
+    return std::ldexp(1.0, -149);
+  }
+  int e;
+  std::frexp(std::fmin(v, FLT_MAX), &e);
+  return std::ldexp(1.0, e - 24);
+}
+
+/// v, with infinity standing in for 2^128.
+double finite(double v) {
+  return std::isinf(v) ? std::copysign(std::ldexp(1.0, 128), v) : v;
+}
+
+/// Arguments to check a function at, and the error allowed: in ulp,
+/// or absolutely if absolute is set.
+struct Samples {
+  std::vector<float> a, b;
+  double max_error;
+  bool absolute;
+
+  Samples(double e, bool abs = false) : max_error(e), absolute(abs) {}
+
+  void add(float x, float y = 0) {
+    a.push_back(x);
+    b.push_back(y);
+  }
+
+  /// n values of x evenly spaced from lo to hi.
+  void add_range(float lo, float hi, int n) {
+    for (int i = 0; i < n; i++) {
+      add(lo + (hi - lo) * (float)i / (float)(n - 1));
+    }
+  }
+
+  /// Every step'th float from lo to hi, which must both be positive.
+  void add_every(float lo, float hi, uint32_t step) {
+    uint32_t lo_bits, hi_bits;
+    memcpy(&lo_bits, &lo, 4);
+    memcpy(&hi_bits, &hi, 4);
+    for (uint32_t bits = lo_bits; bits <= hi_bits; bits += step) {
+      float x;
+      memcpy(&x, &bits, 4);
+      add(x);
+    }
+  }
+};
+
+const float inf = INFINITY;
+
+/// Zeros, the smallest and largest denormals and normals, infinities
+/// and nan, of both signs. The largest normal is left out for
+/// functions only accurate near zero.
+std::vector<float> special_values(bool near_zero = false) {
+  float positive[] = {0.0f, 1.4e-45f, 1.1754942e-38f, FLT_MIN, inf, NAN,
+                      FLT_MAX};
+  std::vector<float> values;
+  for (int i = 0; i < (near_zero ? 6 : 7); i++) {
+    values.push_back(positive[i]);
+    values.push_back(-positive[i]);
+  }
+  return values;
+}
+
+bool check(const char* name, Math f, Reference reference,
+           Samples samples) {
+  while (samples.a.size() % width) {
+    samples.add(0);
+  }
+  std::vector<float> out = run(f, samples.a, samples.b);
+
+  double worst = 0;
+  size_t worst_i = 0;
+  for (size_t i = 0; i < out.size(); i++) {
+    double expected = reference(samples.a[i], samples.b[i]);
+    float rounded = (float)expected;
+    bool special = std::isnan(expected) || std::isinf(rounded) ||
+                   rounded == 0.0f;
+    if (std::isnan(expected) != std::isnan(out[i]) ||
+        (special && !std::isnan(expected) &&
+         std::signbit(rounded) != std::signbit(out[i]))) {
+      printf("%s(%g, %g) = %g instead of %g\n", name, samples.a[i],
+             samples.b[i], out[i], rounded);
+      return false;
+    }
+    if (std::isnan(expected)) {
+      continue;
+    }
+    double error =
+        out[i] == rounded ? 0 : std::fabs(finite(out[i]) - expected);
+    if (!samples.absolute) {
+      error /= ulp(expected);
+    }
+    if (error > worst) {
+      worst = error;
+      worst_i = i;
+    }
+  }
+  if (worst > samples.max_error) {
+    printf("%s(%.9g, %.9g) = %.9g instead of %.9g, an error of %g%s\n", name,
+           samples.a[worst_i], samples.b[worst_i], out[worst_i],
+           reference(samples.a[worst_i], samples.b[worst_i]), worst,
+           samples.absolute ? "" : " ulp");
+    return false;
+  }
+  return true;
+}
+
+/// Check that f(x) is within [-1, 1] for x from lo to hi and from -hi
+/// to -lo.
+bool check_bounded(const char* name, Math f, float lo, float hi) {
+  Samples samples(0);
+  samples.add_every(lo, hi, 997);
+  size_t n = samples.a.size();
+  for (size_t i = 0; i < n; i++) {
+    samples.add(-samples.a[i]);
+  }
+  while (samples.a.size() % width) {
+    samples.add(0);
+  }
+  std::vector<float> out = run(f, samples.a, samples.b);
+  for (size_t i = 0; i < out.size(); i++) {
+    if (!(std::fabs(out[i]) <= 1)) {
+      printf("%s(%.9g) = %g\n", name, samples.a[i], out[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+double ref_exp(double x, double) { return std::exp(x); }
+double ref_log(double x, double) { return std::log(x); }
+double ref_sin(double x, double) { return std::sin(x); }
+double ref_cos(double x, double) { return std::cos(x); }
+double ref_pow(double x, double y) { return std::pow(x, y); }
+
+}  // namespace
+
+int main() {
+  const float pi = 3.14159265f;
+  const int n = 1 << 20;
+  bool ok = true;
+
+  Samples exp_samples(1);
+  exp_samples.add_range(-104, 89, n);
+  for (float v : special_values()) {
+    exp_samples.add(v);
+  }
+  ok = check("exp", [](Expr x, Expr) { return exp(x); }, ref_exp,
+             exp_samples) && ok;
+
+  Samples log_samples(1.5);
+  log_samples.add_every(1.4e-45f, FLT_MAX, 509);
+  for (float v : special_values()) {
+    log_samples.add(v);
+  }
+  ok = check("log", [](Expr x, Expr) { return log(x); }, ref_log,
+             log_samples) && ok;
+
+  Samples trig_samples(1.5), wide_trig_samples(1e-7, true);
+  trig_samples.add_range(-pi, pi, n);
+  for (float v : special_values(true)) {
+    trig_samples.add(v);
+  }
+  wide_trig_samples.add_range(-8192, 8192, n);
+  Math sin_f = [](Expr x, Expr) { return sin(x); };
+  Math cos_f = [](Expr x, Expr) { return cos(x); };
+  ok = check("sin", sin_f, ref_sin, trig_samples) && ok;
+  ok = check("cos", cos_f, ref_cos, trig_samples) && ok;
+  ok = check("sin", sin_f, ref_sin, wide_trig_samples) && ok;
+  ok = check("cos", cos_f, ref_cos, wide_trig_samples) && ok;
+  ok = check_bounded("sin", sin_f, 8192, FLT_MAX) && ok;
+  ok = check_bounded("cos", cos_f, 8192, FLT_MAX) && ok;
+
+  uint32_t seed = 12345;
+  auto random = [&seed](float lo, float hi) {
+    seed = seed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(seed >> 8) / (float)(1 << 24);
+  };
+  Samples pow_samples(1);
+  for (int i = 0; i < n; i++) {
+    pow_samples.add(std::exp2(random(-20, 20)), random(-8, 8));
+  }
+  // Negative x, to integer powers, which may be odd, and to other
+  // powers, which are nan.
+  for (int i = 0; i < n / 4; i++) {
+    pow_samples.add(-std::exp2(random(-8, 8)), std::floor(random(-30, 30)));
+    pow_samples.add(-std::exp2(random(-8, 8)), random(-30, 30));
+  }
+  float more_xs[] = {1.0f, 2.0f, 0.5f};
+  float ys[] = {0.0f, 0.5f, 1.0f, 2.0f, 2.5f, 3.0f, 1e10f, inf, NAN};
+  std::vector<float> xs = special_values();
+  for (float x : more_xs) {
+    xs.push_back(x);
+    xs.push_back(-x);
+  }
+  for (float x : xs) {
+    for (float y : ys) {
+      pow_samples.add(x, y);
+      pow_samples.add(x, -y);
+    }
+  }
+  ok = check("pow", [](Expr x, Expr y) { return pow(x, y); }, ref_pow,
+             pow_samples) && ok;
+
+  Samples fast_exp_samples(81);
+  fast_exp_samples.add_range(-87, 88, n);
+  ok = check("fast_exp", [](Expr x, Expr) { return fast_exp(x); }, ref_exp,
+             fast_exp_samples) && ok;
+
+  Samples fast_log_samples(1e-5, true);
+  fast_log_samples.add_every(FLT_MIN, FLT_MAX, 509);
+  ok = check("fast_log", [](Expr x, Expr) { return fast_log(x); }, ref_log,
+             fast_log_samples) && ok;
+
+  Samples fast_trig_samples(26), wide_fast_trig_samples(1e-5, true);
+  fast_trig_samples.add_range(-pi, pi, n);
+  wide_fast_trig_samples.add_range(-100, 100, n);
+  Math fast_sin_f = [](Expr x, Expr) { return fast_sin(x); };
+  Math fast_cos_f = [](Expr x, Expr) { return fast_cos(x); };
+  ok = check("fast_sin", fast_sin_f, ref_sin, fast_trig_samples) && ok;
+  ok = check("fast_cos", fast_cos_f, ref_cos, fast_trig_samples) && ok;
+  ok = check("fast_sin", fast_sin_f, ref_sin, wide_fast_trig_samples) && ok;
+  ok = check("fast_cos", fast_cos_f, ref_cos, wide_fast_trig_samples) && ok;
+  ok = check_bounded("fast_sin", fast_sin_f, 100, FLT_MAX) && ok;
+  ok = check_bounded("fast_cos", fast_cos_f, 100, FLT_MAX) && ok;
+
+  Samples fast_pow_samples(32);
+  for (int i = 0; i < n; i++) {
+    fast_pow_samples.add(std::exp2(random(-8, 8)), random(-1, 1));
+  }
+  ok = check("fast_pow", [](Expr x, Expr y) { return fast_pow(x, y); },
+             ref_pow, fast_pow_samples) && ok;
+
+  if (!ok) {
+    return 1;
+  }
+  printf("Success!\n");
+  return 0;
+}